@@ -0,0 +1,53 @@
+#!/bin/bash
+# Copia di un albero di file piccoli (più qualche file grande) in loopback: un processo client per file
+# contro la copia ricorsiva con -w/-r su 1 e su 4 connessioni persistenti con pipelining.
+#
+# Uso: bench/batch.sh [numero_file_piccoli] [modello]
+
+source "$(dirname "$0")/common.sh"
+
+FILES="${1:-2000}"
+MODEL="${2:-epoll}"
+
+build
+
+TREE="$WORK_DIR/tree"
+rm -rf "$WORK_DIR/root" "$TREE" "$WORK_DIR/down"
+mkdir -p "$WORK_DIR/root"
+for i in $(seq 1 "$FILES"); do
+    dir="$TREE/d$((i % 20))"
+    mkdir -p "$dir"
+    head -c $((RANDOM % 8192)) /dev/urandom > "$dir/f$i"
+done
+for i in 1 2 3; do
+    head -c 16777216 /dev/urandom > "$TREE/big$i"
+done
+total=$(find "$TREE" -type f | wc -l)
+
+start_server "$WORK_DIR/root" -m "$MODEL"
+
+printf "%-4s %-16s %-10s %-10s\n" "op" "modalità" "secondi" "file/s"
+report()
+{
+    local op="$1" mode="$2" start="$3"
+    local elapsed
+    elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+    printf "%-4s %-16s %-10.3f %-10.0f\n" "$op" "$mode" "$elapsed" "$(awk -v n="$total" -v s="$elapsed" 'BEGIN { print n / s }')"
+}
+
+start=$(now)
+(cd "$WORK_DIR" && find tree -type f | while read -r f; do client w -f "$f" -o "proc/$f"; done)
+report w processi "$start"
+
+for c in 1 4; do
+    start=$(now)
+    client w -f "$TREE" -o "batch$c" -c "$c"
+    report w "-c $c" "$start"
+done
+
+for c in 1 4; do
+    rm -rf "$WORK_DIR/down"
+    start=$(now)
+    client r -f "batch4/" -o "$WORK_DIR/down" -c "$c"
+    report r "-c $c" "$start"
+done
@@ -0,0 +1,80 @@
+// BENCHMARK: CHECKSUM CRC32C
+//
+// Misura il throughput del CRC32C usato per i trailer dei trasferimenti e per riprendere i caricamenti:
+// l'implementazione portabile (slicing-by-8) e quella scelta all'avvio per la CPU (SSE4.2 su x86-64),
+// su blocchi di varie dimensioni. Controlla anche che le due implementazioni diano lo stesso risultato.
+//
+// Uso: checksum [MiB_per_misura]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../myFTchecksum.h"
+
+typedef uint32_t (*checksum_fn)(uint32_t crc, const void *data, size_t len);
+
+
+
+/**
+ * Restituisce il tempo monotono corrente in secondi.
+ */
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+/**
+ * Calcola il checksum di total byte a blocchi di block byte e restituisce i GB/s ottenuti.
+ */
+static double measure(checksum_fn fn, const unsigned char *data, size_t block, size_t total, uint32_t *result)
+{
+    uint32_t crc = 0;
+    double start = now_seconds();
+
+    for (size_t done = 0; done < total; done += block) {
+        crc = fn(crc, data + done % total, block);
+    }
+    double elapsed = now_seconds() - start;
+    *result = crc;
+    return elapsed > 0 ? total / elapsed / 1e9 : 0;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    size_t total = (size_t)(argc > 1 ? atoi(argv[1]) : 256) << 20;
+    size_t blocks[] = { 64, 4096, 65536, 1 << 20 };
+
+    if (total == 0) {
+        fprintf(stderr, "Uso: %s [MiB_per_misura]\n", argv[0]);
+        return 1;
+    }
+
+    // un buffer grande quanto la misura, in cache per i blocchi piccoli come nei trasferimenti reali
+    unsigned char *data = malloc(total + (1 << 20));
+    if (data == NULL) {
+        fprintf(stderr, "Errore di allocazione\n");
+        return 1;
+    }
+    srand(1);
+    for (size_t i = 0; i < total + (1 << 20); i++) {
+        data[i] = (unsigned char)rand();
+    }
+
+    printf("%-10s %-14s %-14s %-8s\n", "blocco", "slicing-by-8", crc32c_implementation(), "uguali");
+    for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+        uint32_t scalar_crc, fast_crc;
+        double scalar = measure(crc32c_scalar, data, blocks[i], total, &scalar_crc);
+        double fast = measure(crc32c, data, blocks[i], total, &fast_crc);
+        printf("%-10zu %-14.2f %-14.2f %-8s\n", blocks[i], scalar, fast, scalar_crc == fast_crc ? "si" : "NO");
+    }
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#!/bin/bash
+# Throughput in GB/s del CRC32C dei trailer con l'implementazione portabile e con quella scelta per la
+# CPU (SSE4.2 su x86-64), con blocchi da 64 byte a 1 MiB.
+#
+# Uso: bench/checksum.sh [MiB_per_misura]
+
+source "$(dirname "$0")/common.sh"
+
+mkdir -p "$WORK_DIR"
+gcc -O2 "$BENCH_DIR/checksum.c" "$REPO_DIR/myFTchecksum.c" -o "$WORK_DIR/checksum" || exit 1
+"$WORK_DIR/checksum" "${1:-256}"
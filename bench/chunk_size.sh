@@ -0,0 +1,61 @@
+#!/bin/bash
+# Download e upload di un file grande su loopback con il percorso bufferizzato (-t buffered) al variare
+# della dimensione dei blocchi (-b, la stessa per server e client), da 4 KiB a 16 MiB. Per ogni
+# dimensione riporta il throughput migliore su più ripetizioni e una barra proporzionale, così la curva
+# throughput/dimensione si legge direttamente nel terminale.
+#
+# Uso: bench/chunk_size.sh [dimensione_file_MB] [ripetizioni] [lista_KiB]
+
+source "$(dirname "$0")/common.sh"
+
+FILE_MB="${1:-1024}"
+RUNS="${2:-3}"
+SIZES="${3:-4 16 64 256 1024 4096 16384}"
+
+build
+rm -rf "$WORK_DIR/root" "$WORK_DIR/local"
+mkdir -p "$WORK_DIR/root" "$WORK_DIR/local"
+head -c $((FILE_MB * 1048576)) /dev/urandom > "$WORK_DIR/local/large.bin"
+cp "$WORK_DIR/local/large.bin" "$WORK_DIR/root/large.bin"
+
+# esegue un trasferimento e stampa i secondi impiegati: timed <w|r> <opzioni client...>
+timed()
+{
+    local start end
+    start=$(now)
+    client "$@"
+    end=$(now)
+    awk -v a="$start" -v b="$end" 'BEGIN { print b - a }'
+}
+
+# barra di n caratteri, uno ogni 100 MB/s
+bar()
+{
+    awk -v r="$1" 'BEGIN { n = int(r / 100); for (i = 0; i < n; i++) printf "#"; }'
+}
+
+printf "%-10s %-10s %-10s %s\n" "direzione" "blocco KiB" "MB/s" ""
+for direction in download upload
+do
+    for kb in $SIZES
+    do
+        start_server "$WORK_DIR/root" -t buffered -b "$kb"
+
+        best=0
+        for run in $(seq 1 "$RUNS"); do
+            if [ "$direction" = download ]; then
+                elapsed=$(timed r -t buffered -b "$kb" -f large.bin -o "$WORK_DIR/local/downloaded.bin")
+            else
+                elapsed=$(timed w -t buffered -b "$kb" -f "$WORK_DIR/local/large.bin" -o uploaded.bin)
+            fi
+            rate=$(mbps $((FILE_MB * 1048576)) "$elapsed")
+            best=$(awk -v a="$best" -v b="$rate" 'BEGIN { print (b > a) ? b : a }')
+        done
+        printf "%-10s %-10s %-10s %s\n" "$direction" "$kb" "$best" "$(bar "$best")"
+
+        stop_server
+    done
+done
+
+cmp -s "$WORK_DIR/local/large.bin" "$WORK_DIR/local/downloaded.bin" || echo "Errore: il file scaricato è diverso dall'originale" >&2
+cmp -s "$WORK_DIR/local/large.bin" "$WORK_DIR/root/uploaded.bin" || echo "Errore: il file caricato è diverso dall'originale" >&2
@@ -0,0 +1,70 @@
+#!/bin/bash
+# Funzioni comuni agli script di benchmark: compilazione, avvio/arresto del server, misure di tempo.
+#
+# Nota: myFTserver e myFTclient leggono le opzioni a partire da argv[2], per questo ogni invocazione
+# passa "-" come primo argomento.
+
+BENCH_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_DIR="$(dirname "$BENCH_DIR")"
+WORK_DIR="${WORK_DIR:-/tmp/myft-bench}"
+ADDRESS="${ADDRESS:-127.0.0.1}"
+PORT="${PORT:-$((20000 + RANDOM % 20000))}"
+
+SERVER="$WORK_DIR/myFTserver"
+CLIENT="$WORK_DIR/myFTclient"
+SERVER_PID=""
+
+# compila server, client e generatore di carico con il Makefile del repository e li copia nella directory di
+# lavoro; MAKE_FLAGS passa le opzioni del Makefile (es. MAKE_FLAGS="ZSTD=1 LZ4=1 URING=1). Con -B make
+# ricompila tutto: i file oggetto non dipendono dalle opzioni e resterebbero quelli della compilazione precedente
+build()
+{
+    mkdir -p "$WORK_DIR"
+    make -s -B -C "$REPO_DIR" $MAKE_FLAGS myFTserver myFTclient myFTbench || exit 1
+    cp "$REPO_DIR/myFTserver" "$REPO_DIR/myFTclient" "$REPO_DIR/myFTbench" "$WORK_DIR" || exit 1
+}
+
+# avvia il server sulla root indicata con eventuali opzioni aggiuntive: start_server <root> [opzioni...]
+# (stdout bufferizzato per riga, così il log può essere letto mentre il server è in esecuzione)
+start_server()
+{
+    local root="$1"; shift
+    stdbuf -oL "$SERVER" - -a "$ADDRESS" -p "$PORT" -d "$root" "$@" > "$WORK_DIR/server.log" 2>&1 &
+    SERVER_PID=$!
+    sleep 0.3
+    if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+        echo "Errore: il server non è partito (vedi $WORK_DIR/server.log)" >&2
+        exit 1
+    fi
+}
+
+stop_server()
+{
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null
+        wait "$SERVER_PID" 2>/dev/null
+        SERVER_PID=""
+        PORT=$((PORT + 1))      # la porta precedente può restare in TIME_WAIT
+    fi
+}
+
+# esegue il client con le opzioni date: client <w|r|l> [opzioni...]
+client()
+{
+    local opz="$1"; shift
+    "$CLIENT" - "-$opz" -a "$ADDRESS" -p "$PORT" "$@" > /dev/null 2>&1
+}
+
+# timestamp in secondi con precisione al nanosecondo
+now()
+{
+    date +%s.%N
+}
+
+# throughput in MB/s: mbps <byte> <secondi>
+mbps()
+{
+    awk -v b="$1" -v s="$2" 'BEGIN { printf "%.1f", b / s / 1048576 }'
+}
+
+trap stop_server EXIT
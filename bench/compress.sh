@@ -0,0 +1,60 @@
+#!/bin/bash
+# Throughput di scritture e letture di un singolo file attraverso un collegamento con banda limitata
+# (proxy bench/throttle.c), senza compressione e con -z: un file di testo (i sorgenti ripetuti), un CSV
+# generato e un file casuale, che la modalità automatica deve riconoscere e inviare non compresso.
+# Riporta anche i byte passati sul filo.
+#
+# Uso: bench/compress.sh [dimensione_MiB] [Mbit/s] [codec...]
+# (lz4 e zstd richiedono MAKE_FLAGS="LZ4=1 ZSTD=1")
+
+source "$(dirname "$0")/common.sh"
+
+SIZE_MB="${1:-32}"
+RATE="${2:-100}"
+CODECS="${3:-none ftlz auto}"
+
+build
+gcc -O2 -pthread "$BENCH_DIR/throttle.c" -o "$WORK_DIR/throttle" || exit 1
+
+bytes=$((SIZE_MB * 1048576))
+rm -rf "$WORK_DIR/root"
+mkdir -p "$WORK_DIR/root"
+while [ "$(stat -c %s "$WORK_DIR/text.dat" 2>/dev/null || echo 0)" -lt "$bytes" ]
+do
+    cat "$REPO_DIR"/*.c "$REPO_DIR"/*.h "$REPO_DIR/README.md" >> "$WORK_DIR/text.dat"
+done
+truncate -s "$bytes" "$WORK_DIR/text.dat"
+awk -v n="$bytes" 'BEGIN { srand(1); print "id,data,cliente,importo,stato"; while (len < n) { line = sprintf("%d,2024-%02d-%02d,cliente_%d,%.2f,%s", ++i, i % 12 + 1, i % 28 + 1, int(rand() * 5000), rand() * 1000, (rand() < 0.9) ? "pagato" : "in attesa"); print line; len += length(line) + 1 } }' > "$WORK_DIR/table.csv"
+truncate -s "$bytes" "$WORK_DIR/table.csv"
+head -c "$bytes" /dev/urandom > "$WORK_DIR/random.bin"
+
+start_server "$WORK_DIR/root" -z auto
+PROXY_PORT=$((PORT + 1000))
+"$WORK_DIR/throttle" "$PROXY_PORT" "$ADDRESS" "$PORT" "$RATE" &
+PROXY_PID=$!
+trap 'kill $PROXY_PID 2>/dev/null; stop_server' EXIT
+sleep 0.2
+
+printf "%-8s %-6s %-12s %-12s %-10s %-10s\n" "codec" "op" "file" "byte filo" "secondi" "MB/s"
+for codec in $CODECS
+do
+    for file in text.dat table.csv random.bin
+    do
+        for op in w r
+        do
+            start=$(now)
+            if [ "$op" = w ]; then
+                out=$("$CLIENT" - -w -a "$ADDRESS" -p "$PROXY_PORT" -f "$WORK_DIR/$file" -o "$file" -z "$codec" 2>&1)
+                result="$WORK_DIR/root/$file"
+            else
+                out=$("$CLIENT" - -r -a "$ADDRESS" -p "$PROXY_PORT" -f "$file" -o "$WORK_DIR/copy.dat" -z "$codec" 2>&1)
+                result="$WORK_DIR/copy.dat"
+            fi
+            elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+            # con -z il client riporta i byte compressi; senza sul filo passa tutto il file
+            wire=$(printf "%s\n" "$out" | sed -n 's/.* in \([0-9]*\) byte compressi.*/\1/p' | head -n 1)
+            printf "%-8s %-6s %-12s %-12s %-10.3f %-10s\n" "$codec" "$op" "$file" "${wire:-$bytes}" "$elapsed" "$(mbps "$bytes" "$elapsed")"
+            cmp -s "$WORK_DIR/$file" "$result" || echo "Errore: il file trasferito non coincide ($codec $op $file)" >&2
+        done
+    done
+done
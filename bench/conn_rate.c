@@ -0,0 +1,182 @@
+// BENCHMARK: CONNESSIONI AL SECONDO
+//
+// Apre in parallelo molte connessioni brevi verso il server, ciascuna con una lettura ('r') di un file
+// piccolo, e riporta connessioni al secondo, throughput, latenze (p50, p99) di ogni richiesta completa,
+// errori e connessioni rifiutate dal server perché sovraccarico (byte di stato 'B').
+//
+// Uso: conn_rate <indirizzo> <porta> <file_remoto> <thread> <richieste_per_thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// parametri comuni a tutti i thread
+typedef struct
+{
+    struct sockaddr_in address;
+    const char *path;
+    int requests;
+} bench_config_t;
+
+// risultati di un thread
+typedef struct
+{
+    const bench_config_t *config;
+    double *latencies;      // latenza di ogni richiesta completata (secondi)
+    int completed;          // richieste completate
+    int errors;             // richieste fallite
+    int busy;               // richieste rifiutate dal server con 'B'
+    unsigned long long bytes;   // byte di file ricevuti
+    pthread_t tid;
+} bench_worker_t;
+
+
+
+/**
+ * Restituisce il tempo monotono corrente in secondi.
+ */
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+/**
+ * Esegue una richiesta di lettura completa: connessione, opzione, percorso, conferma, dati fino alla chiusura.
+ *
+ * @param bytes Incrementato con i byte di file ricevuti.
+ * @return 0 in caso di successo, 1 se il server ha rifiutato la connessione, -1 in caso di errore.
+ */
+static int read_request(const bench_config_t *config, unsigned long long *bytes)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (const struct sockaddr *)&config->address, sizeof(config->address)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    // opzione 'r' seguita dal percorso con i 5 byte nulli iniziali e il terminatore (come send_filepath)
+    char request[1 + 5 + 1024 + 1] = {0};
+    size_t path_len = strlen(config->path);
+    request[0] = 'r';
+    memcpy(request + 6, config->path, path_len);
+
+    char buffer[65536];
+    ssize_t n = 0;
+    int result = -1;
+
+    if (send(sock, request, 7 + path_len, 0) == (ssize_t)(7 + path_len) && recv(sock, buffer, 1, 0) == 1)
+    {
+        if (buffer[0] == 'T') {
+            while ((n = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
+                *bytes += n;
+            }
+            result = (n == 0) ? 0 : -1;
+        } else if (buffer[0] == 'B') {
+            result = 1;
+        }
+    }
+
+    close(sock);
+    return result;
+}
+
+
+
+static void *worker_run(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+
+    for (int i = 0; i < worker->config->requests; i++)
+    {
+        double start = now_seconds();
+        int result = read_request(worker->config, &worker->bytes);
+        if (result == 0) {
+            worker->latencies[worker->completed++] = now_seconds() - start;
+        } else if (result == 1) {
+            worker->busy++;
+        } else {
+            worker->errors++;
+        }
+    }
+    return NULL;
+}
+
+
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    if (argc != 6) {
+        fprintf(stderr, "Uso: %s <indirizzo> <porta> <file_remoto> <thread> <richieste_per_thread>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.address.sin_family = AF_INET;
+    config.address.sin_port = htons(atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &config.address.sin_addr) <= 0) {
+        fprintf(stderr, "Indirizzo non valido: %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    config.path = argv[3];
+    config.requests = atoi(argv[5]);
+    int threads = atoi(argv[4]);
+
+    bench_worker_t *workers = (bench_worker_t *)calloc(threads, sizeof(bench_worker_t));
+    double start = now_seconds();
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].config = &config;
+        workers[i].latencies = (double *)malloc(config.requests * sizeof(double));
+        pthread_create(&workers[i].tid, NULL, worker_run, &workers[i]);
+    }
+
+    // raccoglie tutte le latenze per calcolare i percentili
+    int completed = 0;
+    int errors = 0;
+    int busy = 0;
+    unsigned long long bytes = 0;
+    double *all = (double *)malloc((size_t)threads * config.requests * sizeof(double));
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].tid, NULL);
+        memcpy(all + completed, workers[i].latencies, workers[i].completed * sizeof(double));
+        completed += workers[i].completed;
+        errors += workers[i].errors;
+        busy += workers[i].busy;
+        bytes += workers[i].bytes;
+        free(workers[i].latencies);
+    }
+    double elapsed = now_seconds() - start;
+
+    qsort(all, completed, sizeof(double), compare_double);
+    double p50 = completed ? all[completed / 2] : 0;
+    double p99 = completed ? all[(int)(completed * 0.99)] : 0;
+
+    printf("%.0f %.1f %.3f %.3f %d %d\n", completed / elapsed, bytes / elapsed / 1e6, p50 * 1000, p99 * 1000, errors, busy);
+
+    free(all);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Raffiche di connessioni brevi (una lettura di un file da 4 KiB per connessione) contro il server con un
+# thread per connessione (-m thread) e con il server a eventi (-m epoll). Riporta connessioni al secondo
+# e latenze p50/p99 al variare dei client concorrenti.
+#
+# Uso: bench/conn_rate.sh [richieste_per_client] [lista_client]
+
+source "$(dirname "$0")/common.sh"
+
+REQUESTS="${1:-500}"
+CLIENT_COUNTS="${2:-1 8 64 256}"
+
+build
+gcc -O2 -pthread "$BENCH_DIR/conn_rate.c" -o "$WORK_DIR/conn_rate" || exit 1
+
+rm -rf "$WORK_DIR/root"
+mkdir -p "$WORK_DIR/root"
+head -c 4096 /dev/urandom > "$WORK_DIR/root/small.bin"
+
+printf "%-8s %-8s %-12s %-10s %-10s %-8s\n" "modello" "client" "conn/s" "p50 ms" "p99 ms" "errori"
+for model in thread epoll
+do
+    start_server "$WORK_DIR/root" -m "$model"
+    for n in $CLIENT_COUNTS; do
+        read rate mbps p50 p99 errors busy < <("$WORK_DIR/conn_rate" "$ADDRESS" "$PORT" small.bin "$n" "$REQUESTS")
+        printf "%-8s %-8s %-12s %-10s %-10s %-8s\n" "$model" "$n" "$rate" "$p50" "$p99" "$errors"
+    done
+    stop_server
+done
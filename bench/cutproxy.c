@@ -0,0 +1,208 @@
+// BENCHMARK: COLLEGAMENTO CHE SI INTERROMPE
+//
+// Proxy TCP che inoltra ogni connessione ricevuta verso il server e la interrompe dopo un numero casuale di
+// byte, tra 1 e byte_massimi, contati nelle due direzioni insieme: simula un collegamento che cade a metà
+// di un trasferimento, per provare la ripresa dei trasferimenti interrotti (-R). Raggiunto il limite il
+// proxy chiude di colpo entrambe le socket (RST), senza inoltrare i byte che restano. Con il seme la
+// sequenza dei punti di interruzione è riproducibile.
+//
+// Uso: cutproxy <porta_locale> <indirizzo> <porta> <byte_massimi> [seme]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define CUT_BUFFER (64 << 10)           // byte inoltrati al massimo a ogni passo
+
+// una connessione inoltrata, condivisa dalle due direzioni
+typedef struct
+{
+    int client;
+    int server;
+    long long budget;               // byte che restano da inoltrare prima dell'interruzione
+    int cut;                        // 1 se la connessione è già stata interrotta
+    pthread_mutex_t mutex;          // protegge budget e cut
+} cut_connection_t;
+
+// una direzione di una connessione inoltrata
+typedef struct
+{
+    cut_connection_t *conn;
+    int from;
+    int to;
+} cut_pipe_t;
+
+static struct sockaddr_in target;
+static long long max_bytes;
+static pthread_mutex_t random_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/**
+ * Interrompe la connessione: con SO_LINGER a zero la chiusura delle socket invia un RST invece di un FIN,
+ * come un collegamento caduto, e shutdown in lettura (che non invia nulla) risveglia il thread dell'altra
+ * direzione bloccato in recv.
+ */
+static void cut(cut_connection_t *conn)
+{
+    struct linger hard = { 1, 0 };
+
+    pthread_mutex_lock(&conn->mutex);
+    if (!conn->cut) {
+        conn->cut = 1;
+        setsockopt(conn->client, SOL_SOCKET, SO_LINGER, &hard, sizeof(hard));
+        setsockopt(conn->server, SOL_SOCKET, SO_LINGER, &hard, sizeof(hard));
+        shutdown(conn->client, SHUT_RD);
+        shutdown(conn->server, SHUT_RD);
+    }
+    pthread_mutex_unlock(&conn->mutex);
+}
+
+
+
+/**
+ * Inoltra i byte di una direzione finché l'altra parte non chiude o finché la connessione non esaurisce
+ * i byte concessi: l'ultimo blocco è troncato al limite e poi la connessione viene interrotta.
+ */
+static void* forward(void *arg)
+{
+    cut_pipe_t *pipe_info = arg;
+    cut_connection_t *conn = pipe_info->conn;
+    char buffer[CUT_BUFFER];
+
+    for (;;) {
+        ssize_t n = recv(pipe_info->from, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            break;
+        }
+
+        pthread_mutex_lock(&conn->mutex);
+        if (conn->cut) {
+            n = 0;
+        } else if (n > conn->budget) {
+            n = (ssize_t)conn->budget;
+        }
+        conn->budget -= n;
+        int exhausted = conn->budget <= 0;
+        pthread_mutex_unlock(&conn->mutex);
+
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = send(pipe_info->to, buffer + off, n - off, MSG_NOSIGNAL);
+            if (w < 0) {
+                break;
+            }
+            off += w;
+        }
+        if (exhausted || off < n) {
+            cut(conn);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&conn->mutex);
+    int was_cut = conn->cut;
+    pthread_mutex_unlock(&conn->mutex);
+    if (was_cut) {
+        return NULL;                // risvegliato da cut: le socket si chiudono con un RST
+    }
+
+    // chiusura normale: si propaga all'altra parte, l'altra direzione termina da sé
+    shutdown(pipe_info->to, SHUT_WR);
+    shutdown(pipe_info->from, SHUT_RD);
+    return NULL;
+}
+
+
+
+/**
+ * Gestisce una connessione: la collega al server, sceglie dopo quanti byte interromperla e inoltra le
+ * due direzioni.
+ */
+static void* handle_connection(void *arg)
+{
+    cut_connection_t conn = { .client = (int)(long)arg, .cut = 0 };
+
+    conn.server = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn.server < 0 || connect(conn.server, (struct sockaddr*)&target, sizeof(target)) < 0) {
+        fprintf(stderr, "Errore di connessione al server: %s\n", strerror(errno));
+        if (conn.server >= 0) {
+            close(conn.server);
+        }
+        close(conn.client);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&random_mutex);
+    conn.budget = 1 + (long long)(drand48() * max_bytes);
+    pthread_mutex_unlock(&random_mutex);
+    pthread_mutex_init(&conn.mutex, NULL);
+
+    cut_pipe_t up = { &conn, conn.client, conn.server };
+    cut_pipe_t down = { &conn, conn.server, conn.client };
+    pthread_t tid;
+    pthread_create(&tid, NULL, forward, &up);
+    forward(&down);
+    pthread_join(tid, NULL);
+
+    pthread_mutex_destroy(&conn.mutex);
+    close(conn.server);
+    close(conn.client);
+    return NULL;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    if (argc != 5 && argc != 6) {
+        fprintf(stderr, "Uso: %s <porta_locale> <indirizzo> <porta> <byte_massimi> [seme]\n", argv[0]);
+        return 1;
+    }
+
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_port = htons(atoi(argv[3]));
+    if (inet_pton(AF_INET, argv[2], &target.sin_addr) != 1) {
+        fprintf(stderr, "Errore: indirizzo non valido\n");
+        return 1;
+    }
+    max_bytes = atoll(argv[4]);
+    if (max_bytes <= 0) {
+        fprintf(stderr, "Errore: numero di byte non valido\n");
+        return 1;
+    }
+    srand48(argc == 6 ? atol(argv[5]) : (long)time(NULL));
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(atoi(argv[1]));
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+        fprintf(stderr, "Errore di bind: %s\n", strerror(errno));
+        return 1;
+    }
+
+    for (;;) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, handle_connection, (void*)(long)client) != 0) {
+            close(client);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+}
@@ -0,0 +1,62 @@
+#!/bin/bash
+# Caricamenti ripetuti con e senza deduplicazione (-D): un file grande caricato la prima volta, di nuovo con
+# altri nomi e in una versione con pochi byte inseriti a metà. Per ogni caricamento riporta i byte inviati
+# dal client e il tempo.
+#
+# Uso: bench/dedup.sh [dimensione_MiB] [copie] [modello]
+
+source "$(dirname "$0")/common.sh"
+
+SIZE_MB="${1:-256}"
+COPIES="${2:-3}"
+MODEL="${3:-epoll}"
+
+build
+
+bytes=$((SIZE_MB * 1048576))
+head -c "$bytes" /dev/urandom > "$WORK_DIR/big.bin"
+# versione modificata: 100 byte inseriti a metà del file
+head -c $((bytes / 2)) "$WORK_DIR/big.bin" > "$WORK_DIR/edit.bin"
+head -c 100 /dev/urandom >> "$WORK_DIR/edit.bin"
+tail -c +$((bytes / 2 + 1)) "$WORK_DIR/big.bin" >> "$WORK_DIR/edit.bin"
+
+# carica un file e stampa una riga del risultato: upload <descrizione> <file> <remoto> [opzioni...]
+upload()
+{
+    local what="$1" file="$2" remote="$3"; shift 3
+    local size sent start elapsed
+    size=$(stat -c %s "$file")
+    start=$(now)
+    out=$("$CLIENT" - -w -a "$ADDRESS" -p "$PORT" -f "$file" -o "$remote" "$@" 2>&1)
+    elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+    # con -D il client riporta i byte inviati; senza si invia sempre tutto il file
+    sent=$(printf "%s\n" "$out" | sed -n 's/.*inviati \([0-9]*\) byte.*/\1/p')
+    if printf "%s\n" "$out" | grep -q "già presente"; then
+        sent=0
+    fi
+    printf "%-10s %-14s %-14s %-10.3f %-10s\n" "$MODE" "$what" "${sent:-$size}" "$elapsed" "$(mbps "$size" "$elapsed")"
+}
+
+printf "%-10s %-14s %-14s %-10s %-10s\n" "modo" "caricamento" "byte inviati" "secondi" "MB/s"
+for MODE in normale dedup
+do
+    rm -rf "$WORK_DIR/root"
+    mkdir -p "$WORK_DIR/root"
+    if [ "$MODE" = dedup ]; then
+        start_server "$WORK_DIR/root" -m "$MODEL" -D
+        opts="-D"
+    else
+        start_server "$WORK_DIR/root" -m "$MODEL"
+        opts=""
+    fi
+
+    upload "primo" "$WORK_DIR/big.bin" big.bin $opts
+    for i in $(seq 1 "$COPIES")
+    do
+        upload "copia $i" "$WORK_DIR/big.bin" "copy$i.bin" $opts
+    done
+    upload "modificato" "$WORK_DIR/edit.bin" edit.bin $opts
+
+    cmp -s "$WORK_DIR/edit.bin" "$WORK_DIR/root/edit.bin" || echo "Errore: il file modificato sul server non coincide" >&2
+    stop_server
+done
@@ -0,0 +1,73 @@
+#!/bin/bash
+# Aggiornamento di un file grande già presente sul server, con e senza delta (-u): 100 modifiche sparse di
+# pochi byte, 100 byte inseriti a metà e 1 MiB aggiunto in coda. Per ogni aggiornamento riporta i byte
+# inviati dal client e il tempo; lo stesso per la lettura, con la copia locale da aggiornare.
+#
+# Uso: bench/delta.sh [dimensione_MiB] [modello]
+
+source "$(dirname "$0")/common.sh"
+
+SIZE_MB="${1:-256}"
+MODEL="${2:-epoll}"
+
+build
+
+bytes=$((SIZE_MB * 1048576))
+head -c "$bytes" /dev/urandom > "$WORK_DIR/base.bin"
+
+# versioni modificate della base
+cp "$WORK_DIR/base.bin" "$WORK_DIR/sparse.bin"
+for i in $(seq 1 100)
+do
+    head -c 8 /dev/urandom | dd of="$WORK_DIR/sparse.bin" bs=1 seek=$(((RANDOM * 32768 + RANDOM) % (bytes - 8))) conv=notrunc status=none
+done
+head -c $((bytes / 2)) "$WORK_DIR/base.bin" > "$WORK_DIR/insert.bin"
+head -c 100 /dev/urandom >> "$WORK_DIR/insert.bin"
+tail -c +$((bytes / 2 + 1)) "$WORK_DIR/base.bin" >> "$WORK_DIR/insert.bin"
+cp "$WORK_DIR/base.bin" "$WORK_DIR/append.bin"
+head -c 1048576 /dev/urandom >> "$WORK_DIR/append.bin"
+
+# esegue un aggiornamento e stampa una riga del risultato: update <operazione> <versione> [opzioni...]
+update()
+{
+    local op="$1" version="$2"; shift 2
+    local size sent start elapsed out
+    size=$(stat -c %s "$WORK_DIR/$version.bin")
+    if [ "$op" = w ]; then
+        cp "$WORK_DIR/base.bin" "$WORK_DIR/root/file.bin"
+        start=$(now)
+        out=$("$CLIENT" - -w -a "$ADDRESS" -p "$PORT" -f "$WORK_DIR/$version.bin" -o file.bin "$@" 2>&1)
+    else
+        cp "$WORK_DIR/$version.bin" "$WORK_DIR/root/file.bin"
+        cp "$WORK_DIR/base.bin" "$WORK_DIR/local.bin"
+        start=$(now)
+        out=$("$CLIENT" - -r -a "$ADDRESS" -p "$PORT" -f file.bin -o "$WORK_DIR/local.bin" "$@" 2>&1)
+    fi
+    elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+    # con -u il client riporta la dimensione del delta; senza si trasferisce sempre tutto il file
+    sent=$(printf "%s\n" "$out" | sed -n 's/.*delta di \([0-9]*\) byte.*/\1/p' | head -n 1)
+    printf "%-8s %-10s %-10s %-14s %-10.3f %-10s\n" "$MODE" "$op" "$version" "${sent:-$size}" "$elapsed" "$(mbps "$size" "$elapsed")"
+
+    local result="$WORK_DIR/root/file.bin"
+    [ "$op" = r ] && result="$WORK_DIR/local.bin"
+    cmp -s "$WORK_DIR/$version.bin" "$result" || echo "Errore: il file aggiornato non coincide ($op $version)" >&2
+}
+
+rm -rf "$WORK_DIR/root"
+mkdir -p "$WORK_DIR/root"
+start_server "$WORK_DIR/root" -m "$MODEL"
+
+printf "%-8s %-10s %-10s %-14s %-10s %-10s\n" "modo" "operazione" "versione" "byte inviati" "secondi" "MB/s"
+for MODE in intero delta
+do
+    opts=""
+    [ "$MODE" = delta ] && opts="-u"
+    for op in w r
+    do
+        for version in sparse insert append
+        do
+            update "$op" "$version" $opts
+        done
+    done
+done
+stop_server
@@ -0,0 +1,55 @@
+#!/bin/bash
+# Letture al secondo di file piccoli letti di continuo, con la cache del contenuto dei file disattivata e
+# attiva con le due politiche di eliminazione. Una sessione in pipelining legge più volte gli stessi file.
+# Oltre alle letture al secondo (che includono il lavoro del client) misura il tempo di CPU del server per
+# lettura, dalla somma di /proc/<pid>/task/*/schedstat, e la percentuale di letture servite dalla cache.
+#
+# Uso: bench/filecache.sh [numero_file] [dimensione_KiB] [ripetizioni] [modello] [cache_MiB]
+
+source "$(dirname "$0")/common.sh"
+
+FILES="${1:-200}"
+SIZE_KB="${2:-16}"
+ROUNDS="${3:-10}"
+MODEL="${4:-epoll}"
+CACHE_MB="${5:-64}"
+
+build
+
+rm -rf "$WORK_DIR/hotroot" "$WORK_DIR/down"
+mkdir -p "$WORK_DIR/hotroot" "$WORK_DIR/down"
+for i in $(seq 1 "$FILES"); do
+    head -c $((SIZE_KB * 1024)) /dev/urandom > "$WORK_DIR/hotroot/f$i.bin"
+done
+for r in $(seq 1 "$ROUNDS"); do
+    for i in $(seq 1 "$FILES"); do
+        echo "r f$i.bin $WORK_DIR/down/f$i.bin"
+    done
+done > "$WORK_DIR/hot_ops.txt"
+
+# nanosecondi di CPU usati finora da tutti i thread del server
+server_cpu()
+{
+    cat /proc/"$SERVER_PID"/task/*/schedstat | awk '{ t += $1 } END { printf "%.0f", t }'
+}
+
+printf "%-16s %-10s %-14s %-10s\n" "cache" "letture/s" "CPU µs/lett." "successi"
+for cache in "disattivata" "lru" "clock"
+do
+    if [ "$cache" = disattivata ]; then
+        start_server "$WORK_DIR/hotroot" -m "$MODEL"
+    else
+        start_server "$WORK_DIR/hotroot" -m "$MODEL" -F "$CACHE_MB" -E "$cache"
+    fi
+    cpu=$(server_cpu)
+    start=$(now)
+    client s -f "$WORK_DIR/hot_ops.txt" -W 64
+    elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+    cpu=$(awk -v a="$cpu" -v b="$(server_cpu)" -v n=$((FILES * ROUNDS)) 'BEGIN { printf "%.1f", (b - a) / n / 1000 }')
+
+    # ultimo contatore dei successi e dei mancati nel log del server
+    rate=$(grep "dalla cache dei file" "$WORK_DIR/server.log" | tail -1 | sed 's/.*(\([0-9]*\) successi, \([0-9]*\) mancati).*/\1 \2/' |
+           awk '{ if ($1 + $2 > 0) printf "%.1f%%", 100 * $1 / ($1 + $2); else print "-" }')
+    printf "%-16s %-10s %-14s %-10s\n" "$cache" "$(awk -v n=$((FILES * ROUNDS)) -v s="$elapsed" 'BEGIN { printf "%.0f", n / s }')" "$cpu" "${rate:--}"
+    stop_server
+done
@@ -0,0 +1,43 @@
+#!/bin/bash
+# Latenza della lista di una directory con molte voci (default un milione di file vuoti): lista ordinata
+# in un'unica risposta, non ordinata (-U) e non ordinata a pagine (-U -N). Come riferimento misura anche
+# "ls -la" eseguito localmente sulla stessa directory, il comando che il server avviava con popen a ogni lista.
+#
+# Uso: bench/list.sh [numero_file] [modello] [voci_per_pagina] [ripetizioni]
+
+source "$(dirname "$0")/common.sh"
+
+FILES="${1:-1000000}"
+MODEL="${2:-epoll}"
+PAGE="${3:-10000}"
+RUNS="${4:-3}"
+
+build
+
+# la directory viene ricreata solo se il numero di voci è cambiato
+if [ "$(cat "$WORK_DIR/list.count" 2>/dev/null)" != "$FILES" ]; then
+    rm -rf "$WORK_DIR/listroot"
+    mkdir -p "$WORK_DIR/listroot/big"
+    (cd "$WORK_DIR/listroot/big" && seq -f "f%.0f" 1 "$FILES" | xargs touch)
+    echo "$FILES" > "$WORK_DIR/list.count"
+fi
+
+start_server "$WORK_DIR/listroot" -m "$MODEL"
+
+# tempo medio di un comando su RUNS ripetizioni: average <comando...>
+average()
+{
+    local total=0
+    for r in $(seq 1 "$RUNS"); do
+        local start=$(now)
+        "$@" > /dev/null 2>&1
+        total=$(awk -v t="$total" -v a="$start" -v b="$(now)" 'BEGIN { print t + b - a }')
+    done
+    awk -v t="$total" -v n="$RUNS" 'BEGIN { printf "%.3f", t / n }'
+}
+
+printf "%-28s %-10s\n" "lista" "secondi"
+printf "%-28s %-10s\n" "ls -la (locale)" "$(average ls -la "$WORK_DIR/listroot/big")"
+printf "%-28s %-10s\n" "-l ordinata" "$(average client l -f big)"
+printf "%-28s %-10s\n" "-l -U" "$(average client l -f big -U)"
+printf "%-28s %-10s\n" "-l -U -N $PAGE" "$(average client l -f big -U -N "$PAGE")"
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Carico misto contro un server locale con myFTbench: per ogni distribuzione delle dimensioni dei file
+# (small: file da 4 KiB, mixed: 4 KiB, 1 MiB e file grandi, large: solo file grandi) esegue letture,
+# scritture e liste da più client concorrenti e salva i risultati JSON in $WORK_DIR/results, un file per
+# distribuzione con data e ora nel nome, da confrontare con quelli delle esecuzioni precedenti.
+# Con BIN_DIR usa i programmi già compilati (make bench), altrimenti li compila nella directory di lavoro.
+#
+# Uso: bench/load.sh [client] [secondi] [distribuzioni] [dimensione_file_grandi] [opzioni del server]
+
+source "$(dirname "$0")/common.sh"
+
+CLIENTS="${1:-16}"
+SECONDS_PER_RUN="${2:-10}"
+DISTRIBUTIONS="${3:-small mixed}"
+LARGE_SIZE="${4:-1g}"
+SERVER_OPTIONS="${5:-}"
+
+if [ -n "$BIN_DIR" ]; then
+    SERVER="$BIN_DIR/myFTserver"
+    BENCH="$BIN_DIR/myFTbench"
+    mkdir -p "$WORK_DIR"
+else
+    build
+    BENCH="$WORK_DIR/myFTbench"
+fi
+
+RESULTS_DIR="$WORK_DIR/results"
+mkdir -p "$WORK_DIR/root" "$RESULTS_DIR"
+start_server "$WORK_DIR/root" $SERVER_OPTIONS
+
+stamp=$(date +%Y%m%d-%H%M%S)
+for distribution in $DISTRIBUTIONS
+do
+    "$BENCH" -a "$ADDRESS" -p "$PORT" -c "$CLIENTS" -T "$SECONDS_PER_RUN" -s "$distribution" -L "$LARGE_SIZE" \
+        -j "$RESULTS_DIR/$distribution-$stamp.json" || echo "Errore: myFTbench non è terminato correttamente ($distribution)" >&2
+    echo
+done
+echo "Risultati in $RESULTS_DIR"
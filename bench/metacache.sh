@@ -0,0 +1,64 @@
+#!/bin/bash
+# Liste al secondo con la cache dei metadati del server attiva (default) e disattivata (-C 0): una
+# sessione con le richieste in pipelining ripete la lista di una directory di medie dimensioni e la lista
+# di singoli file (solo lo stat). Con la cache a caldo le richieste non toccano il disco; l'ultima riga
+# misura le liste dopo una modifica della directory a ogni ripetizione, il caso peggiore della cache.
+#
+# Uso: bench/metacache.sh [file_nella_directory] [richieste] [modello]
+
+source "$(dirname "$0")/common.sh"
+
+FILES="${1:-2000}"
+REQUESTS="${2:-500}"
+MODEL="${3:-epoll}"
+
+build
+
+rm -rf "$WORK_DIR/cacheroot"
+mkdir -p "$WORK_DIR/cacheroot/dir"
+(cd "$WORK_DIR/cacheroot/dir" && seq -f "f%.0f" 1 "$FILES" | xargs touch)
+
+# file delle operazioni della sessione: ops_file <directory|file>
+ops_file()
+{
+    for i in $(seq 1 "$REQUESTS"); do
+        if [ "$1" = directory ]; then
+            echo "l dir"
+        else
+            echo "l dir/f$(( (i % FILES) + 1 ))"
+        fi
+    done
+}
+
+# liste al secondo della sessione: rate <file_operazioni>
+rate()
+{
+    local start=$(now)
+    client s -f "$1" -W 64
+    awk -v n="$REQUESTS" -v a="$start" -v b="$(now)" 'BEGIN { printf "%.0f", n / (b - a) }'
+}
+
+ops_file directory > "$WORK_DIR/list_dir.txt"
+ops_file file > "$WORK_DIR/list_file.txt"
+
+printf "%-10s %-24s %-10s\n" "cache" "lista" "liste/s"
+for cache in "-C 0" "default"
+do
+    if [ "$cache" = default ]; then
+        start_server "$WORK_DIR/cacheroot" -m "$MODEL"
+    else
+        start_server "$WORK_DIR/cacheroot" -m "$MODEL" $cache
+    fi
+    client s -f "$WORK_DIR/list_dir.txt" -W 64      # riempie la cache
+    printf "%-10s %-24s %-10s\n" "$cache" "directory ($FILES voci)" "$(rate "$WORK_DIR/list_dir.txt")"
+    printf "%-10s %-24s %-10s\n" "$cache" "singolo file" "$(rate "$WORK_DIR/list_file.txt")"
+
+    # una modifica prima di ogni lista: ogni richiesta trova la cache invalidata
+    start=$(now)
+    for i in $(seq 1 50); do
+        touch "$WORK_DIR/cacheroot/dir/f1"
+        client l -f dir
+    done
+    printf "%-10s %-24s %-10s\n" "$cache" "dopo ogni modifica" "$(awk -v a="$start" -v b="$(now)" 'BEGIN { printf "%.0f", 50 / (b - a) }')"
+    stop_server
+done
@@ -0,0 +1,52 @@
+#!/bin/bash
+# Throughput aggregato di letture concorrenti al variare del numero di client.
+# Con il vecchio mutex globale i client venivano serviti uno alla volta; con i lock per percorso
+# letture di file diversi (o dello stesso file) procedono in parallelo.
+#
+# Uso: bench/multi_client.sh [dimensione_file_MB] [lista_client]
+
+source "$(dirname "$0")/common.sh"
+
+FILE_MB="${1:-16}"
+CLIENT_COUNTS="${2:-1 2 4 8 16}"
+
+build
+rm -rf "$WORK_DIR/root" "$WORK_DIR/out"
+mkdir -p "$WORK_DIR/root" "$WORK_DIR/out"
+
+max_clients=$(echo $CLIENT_COUNTS | tr ' ' '\n' | sort -n | tail -1)
+for i in $(seq 1 "$max_clients"); do
+    head -c $((FILE_MB * 1048576)) /dev/urandom > "$WORK_DIR/root/file_$i.bin"
+done
+
+start_server "$WORK_DIR/root"
+
+printf "%-8s %-10s %-10s\n" "client" "secondi" "MB/s"
+for n in $CLIENT_COUNTS
+do
+    start=$(now)
+    for i in $(seq 1 "$n"); do
+        client r -f "file_$i.bin" -o "$WORK_DIR/out/file_$i.bin" &
+    done
+    wait $(jobs -p | grep -v "^$SERVER_PID$")
+    end=$(now)
+
+    elapsed=$(awk -v a="$start" -v b="$end" 'BEGIN { print b - a }')
+    printf "%-8s %-10.3f %-10s\n" "$n" "$elapsed" "$(mbps $((n * FILE_MB * 1048576)) "$elapsed")"
+done
+
+# un upload lento (alimentato da una FIFO) non deve bloccare le letture di altri file
+mkfifo "$WORK_DIR/slow.fifo"
+client w -f "$WORK_DIR/slow.fifo" -o slow_upload.bin &
+slow_pid=$!
+(for i in $(seq 1 20); do head -c 65536 /dev/zero; sleep 0.1; done) > "$WORK_DIR/slow.fifo" &
+feeder_pid=$!
+sleep 0.2
+
+start=$(now)
+client r -f file_1.bin -o "$WORK_DIR/out/during_upload.bin"
+end=$(now)
+printf "\nlettura durante un upload lento di ~2s: %.3f s\n" "$(awk -v a="$start" -v b="$end" 'BEGIN { print b - a }')"
+
+wait "$feeder_pid" "$slow_pid"
+rm -f "$WORK_DIR/slow.fifo"
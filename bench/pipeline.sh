@@ -0,0 +1,59 @@
+#!/bin/bash
+# Download e upload di un file attraverso un collegamento con banda limitata (bench/throttle.c) verso un
+# server il cui disco è rallentato (bench/slowdisk.c, con pause periodiche come quelle di un disco
+# meccanico o di rete), con -t buffered, dove letture/scritture del file e invii/ricezioni si alternano,
+# e con -t pipeline, dove un thread legge o scrive il file mentre l'altro usa la socket. Riporta tempo e
+# throughput di ogni caso; il limite ideale è la banda del collegamento.
+#
+# Uso: bench/pipeline.sh [dimensione_MiB] [Mbit/s] [disco_MB/s] [pausa_ms] [chiamate_tra_le_pause] [opzioni -b]
+
+source "$(dirname "$0")/common.sh"
+
+SIZE_MB="${1:-100}"
+RATE="${2:-400}"
+DISK_MBPS="${3:-100}"
+STALL_MS="${4:-40}"
+STALL_EVERY="${5:-16}"
+CHUNK_OPTIONS="${6:-}"
+
+build
+gcc -O2 -pthread "$BENCH_DIR/throttle.c" -o "$WORK_DIR/throttle" || exit 1
+gcc -O2 -shared -fPIC "$BENCH_DIR/slowdisk.c" -o "$WORK_DIR/slowdisk.so" -ldl || exit 1
+
+rm -rf "$WORK_DIR/root"
+mkdir -p "$WORK_DIR/root"
+head -c $((SIZE_MB * 1048576)) /dev/urandom > "$WORK_DIR/local.bin"
+cp "$WORK_DIR/local.bin" "$WORK_DIR/root/remote.bin"
+
+PROXY_PID=""
+trap 'kill $PROXY_PID 2>/dev/null; stop_server' EXIT
+
+printf "%-10s %-10s %-10s %-10s\n" "modalità" "direzione" "secondi" "MB/s"
+for mode in buffered pipeline
+do
+    SLOWDISK_MBPS="$DISK_MBPS" SLOWDISK_LATENCY_US=100 SLOWDISK_STALL_MS="$STALL_MS" SLOWDISK_STALL_EVERY="$STALL_EVERY" \
+        LD_PRELOAD="$WORK_DIR/slowdisk.so" start_server "$WORK_DIR/root" -t "$mode" $CHUNK_OPTIONS
+    PROXY_PORT=$((PORT + 1000))
+    "$WORK_DIR/throttle" "$PROXY_PORT" "$ADDRESS" "$PORT" "$RATE" 64 &
+    PROXY_PID=$!
+    sleep 0.2
+
+    for direction in download upload
+    do
+        start=$(now)
+        if [ "$direction" = download ]; then
+            "$CLIENT" - -r -a "$ADDRESS" -p "$PROXY_PORT" -t buffered $CHUNK_OPTIONS -f remote.bin -o "$WORK_DIR/copy.bin" > /dev/null 2>&1
+            result="$WORK_DIR/copy.bin"
+        else
+            "$CLIENT" - -w -a "$ADDRESS" -p "$PROXY_PORT" -t buffered $CHUNK_OPTIONS -f "$WORK_DIR/local.bin" -o uploaded.bin > /dev/null 2>&1
+            result="$WORK_DIR/root/uploaded.bin"
+        fi
+        elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+        printf "%-10s %-10s %-10.2f %-10s\n" "$mode" "$direction" "$elapsed" "$(mbps $((SIZE_MB * 1048576)) "$elapsed")"
+        cmp -s "$WORK_DIR/local.bin" "$result" || echo "Errore: il file trasferito non coincide ($mode $direction)" >&2
+    done
+
+    kill "$PROXY_PID" 2>/dev/null
+    wait "$PROXY_PID" 2>/dev/null
+    stop_server
+done
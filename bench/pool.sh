@@ -0,0 +1,34 @@
+#!/bin/bash
+# Letture concorrenti di un file da 256 KiB contro il server con un thread per connessione (-m thread) e
+# con il pool di worker di dimensione fissa (-m pool). Riporta connessioni al secondo, throughput,
+# latenze p50/p99, errori e connessioni rifiutate con 'B' al variare dei client concorrenti.
+#
+# Uso: bench/pool.sh [richieste_per_client] [lista_client] [opzioni del pool, es. "-w 8 -q 64"]
+
+source "$(dirname "$0")/common.sh"
+
+REQUESTS="${1:-50}"
+CLIENT_COUNTS="${2:-1 8 64 512}"
+POOL_OPTIONS="${3:-}"
+
+build
+gcc -O2 -pthread "$BENCH_DIR/conn_rate.c" -o "$WORK_DIR/conn_rate" || exit 1
+
+rm -rf "$WORK_DIR/root"
+mkdir -p "$WORK_DIR/root"
+head -c 262144 /dev/urandom > "$WORK_DIR/root/medium.bin"
+
+printf "%-8s %-8s %-10s %-10s %-10s %-10s %-8s %-8s\n" "modello" "client" "conn/s" "MB/s" "p50 ms" "p99 ms" "errori" "rifiuti"
+for model in thread pool
+do
+    if [ "$model" = pool ]; then
+        start_server "$WORK_DIR/root" -m pool $POOL_OPTIONS
+    else
+        start_server "$WORK_DIR/root" -m thread
+    fi
+    for n in $CLIENT_COUNTS; do
+        read rate mbps p50 p99 errors busy < <("$WORK_DIR/conn_rate" "$ADDRESS" "$PORT" medium.bin "$n" "$REQUESTS")
+        printf "%-8s %-8s %-10s %-10s %-10s %-10s %-8s %-8s\n" "$model" "$n" "$rate" "$mbps" "$p50" "$p99" "$errors" "$busy"
+    done
+    stop_server
+done
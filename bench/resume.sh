@@ -0,0 +1,91 @@
+#!/bin/bash
+# Ripresa dei trasferimenti interrotti (-R) attraverso un collegamento che cade in punti casuali
+# (bench/cutproxy.c): ogni connessione viene interrotta dopo un numero casuale di byte, fino a un terzo del
+# file, quindi un trasferimento riesce solo riprendendo da dove si era fermato. Per ogni modello del server
+# ripete più volte un upload e un download con -R, rilanciando il client finché il trasferimento non riesce,
+# e confronta con cmp ogni file ottenuto con l'originale. Riporta per ogni prova i tentativi e i secondi
+# impiegati; termina con stato 1 se un file non coincide o se un trasferimento non riesce entro il numero
+# massimo di tentativi.
+#
+# Uso: bench/resume.sh [dimensione_MiB] [prove] [modelli] [seme]
+
+source "$(dirname "$0")/common.sh"
+
+SIZE_MB="${1:-20}"
+ROUNDS="${2:-3}"
+MODELS="${3:-thread pool epoll}"
+SEED="${4:-$RANDOM}"
+MAX_TRIES=100
+
+build
+gcc -O2 -pthread "$BENCH_DIR/cutproxy.c" -o "$WORK_DIR/cutproxy" || exit 1
+
+rm -rf "$WORK_DIR/root" "$WORK_DIR/local"
+mkdir -p "$WORK_DIR/root" "$WORK_DIR/local"
+# dimensione non multipla del blocco da 1 MiB, così anche l'ultimo blocco parziale viene ripreso
+head -c $((SIZE_MB * 1048576 + 12345)) /dev/urandom > "$WORK_DIR/local/source.bin"
+
+PROXY_PID=""
+trap 'kill $PROXY_PID 2>/dev/null; stop_server' EXIT
+
+# rilancia il client con -R finché il trasferimento non riesce: transfer <w|r> <destinazione>
+# stampa i tentativi e i secondi, oppure "-" come tentativi se non riesce entro MAX_TRIES
+transfer()
+{
+    local op="$1" dest="$2" tries=0 done=0 start=$(now)
+    while [ $done -eq 0 ] && [ $tries -lt $MAX_TRIES ]
+    do
+        tries=$((tries + 1))
+        if [ "$op" = w ]; then
+            timeout 60 "$CLIENT" - -w -a "$ADDRESS" -p "$PROXY_PORT" -R -f "$WORK_DIR/local/source.bin" -o "$dest" > /dev/null 2>&1 && done=1
+        else
+            timeout 60 "$CLIENT" - -r -a "$ADDRESS" -p "$PROXY_PORT" -R -f uploaded.bin -o "$dest" > /dev/null 2>&1 && done=1
+        fi
+    done
+    [ $done -eq 1 ] || tries="-"
+    echo "$tries $(awk -v a="$start" -v b="$(now)" 'BEGIN { printf "%.2f", b - a }')"
+}
+
+failures=0
+echo "file da $SIZE_MB MiB, interruzioni casuali fino a un terzo del file, seme $SEED"
+printf "%-8s %-10s %-6s %-10s %-8s %-10s\n" "modello" "direzione" "prova" "tentativi" "secondi" "esito"
+for model in $MODELS
+do
+    start_server "$WORK_DIR/root" -m "$model" -Q
+    PROXY_PORT=$((PORT + 1000))
+    "$WORK_DIR/cutproxy" "$PROXY_PORT" "$ADDRESS" "$PORT" $((SIZE_MB * 1048576 / 3)) "$SEED" &
+    PROXY_PID=$!
+    sleep 0.2
+
+    for round in $(seq 1 "$ROUNDS")
+    do
+        rm -f "$WORK_DIR/root/uploaded.bin"* "$WORK_DIR/local/copy.bin"*
+        for direction in upload download
+        do
+            if [ "$direction" = upload ]; then
+                result=$(transfer w uploaded.bin)
+                copy="$WORK_DIR/root/uploaded.bin"
+            else
+                result=$(transfer r "$WORK_DIR/local/copy.bin")
+                copy="$WORK_DIR/local/copy.bin"
+            fi
+
+            if [ "${result%% *}" = "-" ]; then
+                outcome="non riuscito"
+            elif cmp -s "$WORK_DIR/local/source.bin" "$copy"; then
+                outcome="identico"
+            else
+                outcome="DIVERSO"
+            fi
+            [ "$outcome" = identico ] || failures=$((failures + 1))
+            printf "%-8s %-10s %-6s %-10s %-8s %-10s\n" "$model" "$direction" "$round" ${result} "$outcome"
+        done
+    done
+
+    kill $PROXY_PID 2>/dev/null
+    wait $PROXY_PID 2>/dev/null
+    PROXY_PID=""
+    stop_server
+done
+
+[ $failures -eq 0 ]
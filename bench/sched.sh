@@ -0,0 +1,87 @@
+#!/bin/bash
+# Latenza delle operazioni brevi (liste e letture di file da 4 KiB) mentre download grandi occupano il server
+# con -m pool: senza scheduler (-P 0) e con lo scheduler, con i posti riservati di default (un quarto) e con -R.
+# I download grandi sono rallentati con -c, come su collegamenti lenti, così restano in corso per tutta la misura:
+# senza scheduler occupano tutti i worker e un'operazione breve attende in coda che uno di loro finisca.
+# Per ogni configurazione riporta latenza p50, p99 e massima delle operazioni brevi (misurate dal client, avvio
+# del processo compreso), il p99 dell'attesa nella coda del pool e in quelle di liste e trasferimenti piccoli
+# riportato dalle metriche del server e i download grandi in coda al momento della lettura delle metriche.
+#
+# Uso: bench/sched.sh [worker] [download_grandi] [operazioni_brevi] [velocità_per_connessione]
+
+source "$(dirname "$0")/common.sh"
+
+WORKERS="${1:-4}"
+LARGE="${2:-8}"
+OPS="${3:-20}"
+RATE="${4:-20m}"
+
+build
+rm -rf "$WORK_DIR/root" "$WORK_DIR/out"
+mkdir -p "$WORK_DIR/root/small" "$WORK_DIR/out"
+head -c $((64 << 20)) /dev/urandom > "$WORK_DIR/root/large.bin"
+for i in $(seq 1 16); do
+    head -c 4096 /dev/urandom > "$WORK_DIR/root/small/file_$i.bin"
+done
+
+# percentile di una colonna di numeri: percentile <file> <p>
+percentile()
+{
+    sort -n "$1" | awk -v p="$2" '{ v[NR] = $1 } END { i = int(NR * p / 100 + 0.999); if (i < 1) i = 1; printf "%.1f", v[i] }'
+}
+
+# p99 in ms dell'attesa nella coda del pool nel documento delle metriche: pool_wait <file>
+pool_wait()
+{
+    grep '^  "queue_wait_us"' "$1" | sed 's/.*"p99": \([0-9]*\).*/\1/' | awk '{ printf "%.1f", $1 / 1000 }'
+}
+
+# p99 in ms dell'attesa in coda di una classe nel documento delle metriche: class_wait <file> <classe>
+class_wait()
+{
+    grep "\"$2\": {\"running\"" "$1" | sed 's/.*"p99": \([0-9]*\).*/\1/' | awk '{ printf "%.1f", $1 / 1000 }'
+}
+
+# richieste in coda di una classe nel documento delle metriche: class_queued <file> <classe>
+class_queued()
+{
+    grep "\"$2\": {\"running\"" "$1" | sed 's/.*"queued": \([0-9]*\).*/\1/'
+}
+
+# misura le operazioni brevi con LARGE download grandi in corso: run <descrizione> [opzioni del server...]
+run()
+{
+    local label="$1"; shift
+    start_server "$WORK_DIR/root" -m pool -w "$WORKERS" -c "$RATE" -Q "$@"
+    rm -f "$WORK_DIR/latency"
+
+    # ogni download grande ricomincia appena finisce, finché il server resta attivo
+    for i in $(seq 1 "$LARGE"); do
+        (while client r -f large.bin -o "$WORK_DIR/out/large_$i.bin"; do :; done) &
+    done
+    sleep 1
+
+    for i in $(seq 1 "$OPS"); do
+        local s=$(now)
+        if [ $((i % 2)) -eq 0 ]; then
+            client l -f small
+        else
+            client r -f "small/file_$((i % 16 + 1)).bin" -o "$WORK_DIR/out/small.bin"
+        fi
+        awk -v a="$s" -v b="$(now)" 'BEGIN { print (b - a) * 1000 }' >> "$WORK_DIR/latency"
+    done
+
+    "$CLIENT" - -x -a "$ADDRESS" -p "$PORT" > "$WORK_DIR/stats.json" 2>/dev/null
+    stop_server
+    wait $(jobs -p) 2>/dev/null
+
+    printf "%-16s %-8s %-8s %-9s %-10s %-10s %-10s %-10s\n" "$label" "$(percentile "$WORK_DIR/latency" 50)" "$(percentile "$WORK_DIR/latency" 99)" \
+           "$(percentile "$WORK_DIR/latency" 100)" "$(pool_wait "$WORK_DIR/stats.json")" "$(class_wait "$WORK_DIR/stats.json" list)" "$(class_wait "$WORK_DIR/stats.json" small)" \
+           "$(class_queued "$WORK_DIR/stats.json" large)"
+}
+
+echo "$WORKERS worker, $LARGE download da 64 MiB a $RATE/s ciascuno, $OPS operazioni brevi (ms)"
+printf "%-16s %-8s %-8s %-9s %-10s %-10s %-10s %-10s\n" "scheduler" "p50" "p99" "max" "coda pool" "coda list" "coda small" "large in coda"
+run "nessuno" -P 0
+run "default"
+run "-R $((WORKERS / 2))" -R $((WORKERS / 2))
@@ -0,0 +1,67 @@
+#!/bin/bash
+# Operazioni al secondo su file piccoli (4 KiB) in loopback: un processo client e una connessione per
+# operazione, una sessione persistente senza pipelining (-W 1) e una sessione con le richieste in
+# pipelining (-W 64). Misura letture e scritture per ciascun modello di server.
+#
+# Uso: bench/session.sh [numero_file] [lista_modelli]
+
+source "$(dirname "$0")/common.sh"
+
+FILES="${1:-500}"
+MODELS="${2:-pool epoll}"
+
+build
+
+rm -rf "$WORK_DIR/root" "$WORK_DIR/local"
+mkdir -p "$WORK_DIR/root/small" "$WORK_DIR/local"
+for i in $(seq 1 "$FILES"); do
+    head -c 4096 /dev/urandom > "$WORK_DIR/local/f$i.bin"
+done
+cp "$WORK_DIR"/local/f*.bin "$WORK_DIR/root/small/"
+
+# file delle operazioni di una sessione: ops_file <w|r>
+ops_file()
+{
+    for i in $(seq 1 "$FILES"); do
+        if [ "$1" = w ]; then
+            echo "w $WORK_DIR/local/f$i.bin up/f$i.bin"
+        else
+            echo "r small/f$i.bin $WORK_DIR/down/f$i.bin"
+        fi
+    done
+}
+
+# esegue le operazioni con un processo per operazione: one_shot <w|r>
+one_shot()
+{
+    for i in $(seq 1 "$FILES"); do
+        if [ "$1" = w ]; then
+            client w -f "$WORK_DIR/local/f$i.bin" -o "up/f$i.bin"
+        else
+            client r -f "small/f$i.bin" -o "$WORK_DIR/down/f$i.bin"
+        fi
+    done
+}
+
+printf "%-8s %-4s %-12s %-10s\n" "modello" "op" "modalità" "op/s"
+for model in $MODELS
+do
+    start_server "$WORK_DIR/root" -m "$model"
+    for op in r w
+    do
+        ops_file "$op" > "$WORK_DIR/ops.txt"
+        for mode in processi "-W 1" "-W 64"
+        do
+            rm -rf "$WORK_DIR/down" "$WORK_DIR/root/up"
+            start=$(now)
+            if [ "$mode" = processi ]; then
+                one_shot "$op"
+            else
+                client s -f "$WORK_DIR/ops.txt" $mode
+            fi
+            elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+            printf "%-8s %-4s %-12s %-10s\n" "$model" "$op" "$mode" "$(awk -v n="$FILES" -v s="$elapsed" 'BEGIN { printf "%.0f", n / s }')"
+        done
+    done
+    stop_server
+done
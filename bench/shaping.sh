@@ -0,0 +1,62 @@
+#!/bin/bash
+# Divisione della banda tra client concorrenti con il limite di banda globale del server (-L).
+# N client (default 50) scaricano insieme un file ciascuno della stessa dimensione. Per ogni modello, senza limite,
+# con il limite e con il limite e un burst piccolo (-B 64k) riporta il throughput aggregato rispetto al limite, il
+# throughput minimo, medio e massimo dei singoli client e l'indice di equità di Jain (1 = banda divisa in parti
+# perfettamente uguali, 1/N = un solo client
+# servito). Il modello pool serve al massimo un client per worker alla volta, quindi si confrontano thread ed epoll.
+# Tutti i client arrivano da 127.0.0.1: i pesi per indirizzo (-W) e il limite per indirizzo (-I) non si vedono qui.
+#
+# Uso: bench/shaping.sh [client] [dimensione_file_MiB] [limite_globale] [modelli]
+
+source "$(dirname "$0")/common.sh"
+
+CLIENTS="${1:-50}"
+FILE_MB="${2:-4}"
+LIMIT="${3:-50m}"
+MODELS="${4:-thread epoll}"
+
+build
+rm -rf "$WORK_DIR/root" "$WORK_DIR/out"
+mkdir -p "$WORK_DIR/root" "$WORK_DIR/out"
+for i in $(seq 1 "$CLIENTS"); do
+    head -c $((FILE_MB * 1048576)) /dev/urandom > "$WORK_DIR/root/file_$i.bin"
+done
+
+# scarica i file con CLIENTS client in parallelo e stampa una riga di risultati: run <modello> <descrizione> [opzioni...]
+run()
+{
+    local model="$1" label="$2"; shift 2
+    start_server "$WORK_DIR/root" -m "$model" -Q "$@"
+    rm -f "$WORK_DIR/out/"* "$WORK_DIR/times"
+
+    local start=$(now)
+    for i in $(seq 1 "$CLIENTS"); do
+        (
+            s=$(now)
+            client r -f "file_$i.bin" -o "$WORK_DIR/out/file_$i.bin"
+            echo "$s $(now)" >> "$WORK_DIR/times"
+        ) &
+    done
+    wait $(jobs -p | grep -v "^$SERVER_PID$")
+    local elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+    stop_server
+
+    for i in $(seq 1 "$CLIENTS"); do
+        cmp -s "$WORK_DIR/root/file_$i.bin" "$WORK_DIR/out/file_$i.bin" || echo "Errore: file_$i.bin non coincide ($model $label)" >&2
+    done
+
+    # throughput di ogni client dal suo avvio alla sua fine; Jain = (somma x)^2 / (n * somma x^2)
+    awk -v bytes=$((FILE_MB * 1048576)) -v n="$CLIENTS" -v total="$elapsed" -v model="$model" -v label="$label" '
+        { x = bytes / ($2 - $1) / 1048576; sum += x; sq += x * x; if (min == "" || x < min) min = x; if (x > max) max = x }
+        END { printf "%-8s %-14s %-10.1f %-8.2f %-8.2f %-8.2f %-8.3f\n", model, label, n * bytes / total / 1048576, min, sum / NR, max, sum * sum / (NR * sq) }
+    ' "$WORK_DIR/times"
+}
+
+printf "%-8s %-14s %-10s %-8s %-8s %-8s %-8s\n" "modello" "limite" "MB/s" "min" "medio" "max" "Jain"
+for model in $MODELS
+do
+    run "$model" "nessuno"
+    run "$model" "-L $LIMIT" -L "$LIMIT"
+    run "$model" "-L $LIMIT -B 64k" -L "$LIMIT" -B 64k
+done
@@ -0,0 +1,119 @@
+// BENCHMARK: DISCO LENTO
+//
+// Libreria da caricare con LD_PRELOAD che rallenta le letture e le scritture sui file regolari del
+// programma, per simulare un disco lento senza privilegi (dm-delay e FUSE richiedono root). Ogni read,
+// write, pread e pwrite su un file regolare attende una latenza fissa più il tempo che i suoi byte
+// richiederebbero alla banda indicata e, una chiamata ogni SLOWDISK_STALL_EVERY, anche una pausa di
+// SLOWDISK_STALL_MS (ricerca su un disco meccanico, credito esaurito di un disco di rete); le altre
+// chiamate (socket, pipe) non sono toccate. sendfile e splice non passano da queste funzioni e restano
+// veloci.
+//
+// Uso: gcc -O2 -shared -fPIC slowdisk.c -o slowdisk.so -ldl -lpthread
+//      SLOWDISK_MBPS=<MB/s> SLOWDISK_LATENCY_US=<µs> [SLOWDISK_STALL_MS=<ms> SLOWDISK_STALL_EVERY=<n>]
+//      LD_PRELOAD=./slowdisk.so <programma>
+
+#define _GNU_SOURCE         // per RTLD_NEXT
+
+#include <stdlib.h>
+#include <stdatomic.h>      // contatore delle chiamate condiviso tra i thread
+#include <time.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static ssize_t (*real_pread)(int, void *, size_t, off_t);
+static ssize_t (*real_pwrite)(int, const void *, size_t, off_t);
+static double rate_bytes = 50.0 * 1048576;     // byte al secondo (SLOWDISK_MBPS)
+static double latency = 0.0001;                 // secondi per chiamata (SLOWDISK_LATENCY_US)
+static double stall = 0;                        // secondi di una pausa (SLOWDISK_STALL_MS)
+static unsigned long stall_every = 0;           // chiamate tra due pause (SLOWDISK_STALL_EVERY, 0 = mai)
+static atomic_ulong calls = 0;                  // chiamate rallentate finora
+
+
+
+__attribute__((constructor))
+static void slowdisk_init(void)
+{
+    const char *mbps = getenv("SLOWDISK_MBPS");
+    const char *us = getenv("SLOWDISK_LATENCY_US");
+    const char *stall_ms = getenv("SLOWDISK_STALL_MS");
+    const char *every = getenv("SLOWDISK_STALL_EVERY");
+
+    real_read = dlsym(RTLD_NEXT, "read");
+    real_write = dlsym(RTLD_NEXT, "write");
+    real_pread = dlsym(RTLD_NEXT, "pread");
+    real_pwrite = dlsym(RTLD_NEXT, "pwrite");
+    if (mbps != NULL && atof(mbps) > 0) {
+        rate_bytes = atof(mbps) * 1048576;
+    }
+    if (us != NULL) {
+        latency = atof(us) / 1e6;
+    }
+    if (stall_ms != NULL && every != NULL) {
+        stall = atof(stall_ms) / 1e3;
+        stall_every = strtoul(every, NULL, 10);
+    }
+}
+
+
+
+/**
+ * Attende il tempo che il disco simulato impiegherebbe per trasferire len byte, se fd è un file regolare.
+ */
+static void disk_delay(int fd, size_t len)
+{
+    struct stat st;
+    int saved_errno = errno;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        double wait = latency + len / rate_bytes;
+        if (stall_every > 0 && ++calls % stall_every == 0) {
+            wait += stall;
+        }
+        struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+        }
+    }
+    errno = saved_errno;
+}
+
+
+
+ssize_t read(int fd, void *buffer, size_t len)
+{
+    ssize_t n = real_read(fd, buffer, len);
+    if (n > 0) {
+        disk_delay(fd, n);
+    }
+    return n;
+}
+
+
+
+ssize_t write(int fd, const void *buffer, size_t len)
+{
+    disk_delay(fd, len);
+    return real_write(fd, buffer, len);
+}
+
+
+
+ssize_t pread(int fd, void *buffer, size_t len, off_t offset)
+{
+    ssize_t n = real_pread(fd, buffer, len, offset);
+    if (n > 0) {
+        disk_delay(fd, n);
+    }
+    return n;
+}
+
+
+
+ssize_t pwrite(int fd, const void *buffer, size_t len, off_t offset)
+{
+    disk_delay(fd, len);
+    return real_pwrite(fd, buffer, len, offset);
+}
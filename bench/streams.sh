@@ -0,0 +1,39 @@
+#!/bin/bash
+# Throughput di un singolo file grande in loopback in funzione del numero di flussi paralleli (-S):
+# il file viene diviso in parti contigue, ciascuna su una propria connessione.
+#
+# Uso: bench/streams.sh [dimensione_MiB] [modello] [lista_flussi]
+
+source "$(dirname "$0")/common.sh"
+
+SIZE_MB="${1:-512}"
+MODEL="${2:-epoll}"
+STREAMS="${3:-1 2 4 8 16}"
+
+build
+
+rm -rf "$WORK_DIR/root" "$WORK_DIR/down"
+mkdir -p "$WORK_DIR/root"
+head -c $((SIZE_MB * 1048576)) /dev/urandom > "$WORK_DIR/big.bin"
+bytes=$((SIZE_MB * 1048576))
+
+start_server "$WORK_DIR/root" -m "$MODEL"
+
+printf "%-4s %-8s %-10s %-10s\n" "op" "flussi" "secondi" "MB/s"
+for op in w r
+do
+    for s in $STREAMS
+    do
+        rm -f "$WORK_DIR/down.bin"
+        start=$(now)
+        if [ "$op" = w ]; then
+            client w -f "$WORK_DIR/big.bin" -o big.bin -S "$s"
+        else
+            client r -f big.bin -o "$WORK_DIR/down.bin" -S "$s"
+        fi
+        elapsed=$(awk -v a="$start" -v b="$(now)" 'BEGIN { print b - a }')
+        printf "%-4s %-8s %-10.3f %-10s\n" "$op" "$s" "$elapsed" "$(mbps "$bytes" "$elapsed")"
+    done
+done
+
+cmp -s "$WORK_DIR/big.bin" "$WORK_DIR/down.bin" || echo "Errore: il file letto non coincide con l'originale" >&2
@@ -0,0 +1,187 @@
+// BENCHMARK: COLLEGAMENTO CON BANDA LIMITATA
+//
+// Proxy TCP che inoltra ogni connessione ricevuta verso il server limitando la banda di ciascuna direzione,
+// per simulare un collegamento lento senza privilegi (tc/netem richiedono root). Ogni direzione di ogni
+// connessione ha un proprio thread che legge al massimo 16 KiB alla volta e attende quanto serve per non
+// superare la banda indicata. Con buffer_KiB i buffer delle socket del proxy sono fissati a quella
+// dimensione, come un collegamento che tiene in volo pochi dati: il mittente si blocca appena smette di
+// inviare per più del tempo che il collegamento impiega a svuotarli.
+//
+// Uso: throttle <porta_locale> <indirizzo> <porta> <Mbit/s> [buffer_KiB]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define THROTTLE_BUFFER (16 << 10)      // byte inoltrati al massimo a ogni passo
+
+// una direzione di una connessione inoltrata
+typedef struct
+{
+    int from;
+    int to;
+    double rate;            // byte al secondo
+} throttle_pipe_t;
+
+static struct sockaddr_in target;
+static double rate_bytes;
+static int socket_buffer = 0;       // byte dei buffer delle socket (0 = scelti dal kernel)
+
+
+
+/**
+ * Restituisce il tempo monotono corrente in secondi.
+ */
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+/**
+ * Fissa i buffer di invio e ricezione della socket, se richiesto.
+ */
+static void limit_buffers(int sock)
+{
+    if (socket_buffer > 0) {
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &socket_buffer, sizeof(socket_buffer));
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &socket_buffer, sizeof(socket_buffer));
+    }
+}
+
+
+
+/**
+ * Inoltra i byte di una direzione finché l'altra parte non chiude, rispettando la banda: i byte già
+ * inoltrati non possono superare il tempo trascorso per la banda.
+ */
+static void* forward(void *arg)
+{
+    throttle_pipe_t *pipe_info = arg;
+    char buffer[THROTTLE_BUFFER];
+    double start = now_seconds();
+    double sent = 0;
+
+    for (;;) {
+        ssize_t n = recv(pipe_info->from, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            break;
+        }
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = send(pipe_info->to, buffer + off, n - off, MSG_NOSIGNAL);
+            if (w < 0) {
+                goto done;
+            }
+            off += w;
+        }
+        sent += n;
+
+        double ahead = sent / pipe_info->rate - (now_seconds() - start);
+        if (ahead > 0) {
+            struct timespec ts = { (time_t)ahead, (long)((ahead - (time_t)ahead) * 1e9) };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+done:
+    // la chiusura si propaga all'altra parte; l'altra direzione termina da sé
+    shutdown(pipe_info->to, SHUT_WR);
+    shutdown(pipe_info->from, SHUT_RD);
+    return NULL;
+}
+
+
+
+/**
+ * Gestisce una connessione: la collega al server e inoltra le due direzioni.
+ */
+static void* handle_connection(void *arg)
+{
+    int client = (int)(long)arg;
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server >= 0) {
+        limit_buffers(server);
+    }
+    if (server < 0 || connect(server, (struct sockaddr*)&target, sizeof(target)) < 0) {
+        fprintf(stderr, "Errore di connessione al server: %s\n", strerror(errno));
+        if (server >= 0) {
+            close(server);
+        }
+        close(client);
+        return NULL;
+    }
+
+    throttle_pipe_t up = { client, server, rate_bytes };
+    throttle_pipe_t down = { server, client, rate_bytes };
+    pthread_t tid;
+    pthread_create(&tid, NULL, forward, &up);
+    forward(&down);
+    pthread_join(tid, NULL);
+
+    close(server);
+    close(client);
+    return NULL;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    if (argc != 5 && argc != 6) {
+        fprintf(stderr, "Uso: %s <porta_locale> <indirizzo> <porta> <Mbit/s> [buffer_KiB]\n", argv[0]);
+        return 1;
+    }
+
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_port = htons(atoi(argv[3]));
+    if (inet_pton(AF_INET, argv[2], &target.sin_addr) != 1) {
+        fprintf(stderr, "Errore: indirizzo non valido\n");
+        return 1;
+    }
+    rate_bytes = atof(argv[4]) * 1e6 / 8;
+    if (rate_bytes <= 0) {
+        fprintf(stderr, "Errore: banda non valida\n");
+        return 1;
+    }
+    if (argc == 6) {
+        socket_buffer = atoi(argv[5]) << 10;
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    limit_buffers(listener);        // ereditati dalle connessioni accettate
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(atoi(argv[1]));
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+        fprintf(stderr, "Errore di bind: %s\n", strerror(errno));
+        return 1;
+    }
+
+    for (;;) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, handle_connection, (void*)(long)client) != 0) {
+            close(client);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+}
@@ -0,0 +1,56 @@
+#!/bin/bash
+# Letture concorrenti di un file contro il server con -t buffered, -t zerocopy, -t uring e -t uring con
+# SQPOLL (-K), con 1, 64 e 1024 trasferimenti in parallelo. Per ogni caso riporta il throughput e i
+# secondi di CPU del server (utente + sistema, da /proc) per GB inviato. La modalità uring richiede
+# MAKE_FLAGS="URING=1"; senza, le sue righe vengono saltate.
+#
+# Uso: bench/uring.sh [dimensione_file_KB] [richieste_per_client] [lista_client]
+
+source "$(dirname "$0")/common.sh"
+
+FILE_KB="${1:-1024}"
+REQUESTS="${2:-10}"
+CLIENT_COUNTS="${3:-1 64 1024}"
+
+build
+gcc -O2 -pthread "$BENCH_DIR/conn_rate.c" -o "$WORK_DIR/conn_rate" || exit 1
+
+rm -rf "$WORK_DIR/root"
+mkdir -p "$WORK_DIR/root"
+head -c $((FILE_KB * 1024)) /dev/urandom > "$WORK_DIR/root/file.bin"
+
+# tick di CPU (utente + sistema) consumati finora dal server
+server_ticks()
+{
+    awk '{ print $14 + $15 }' "/proc/$SERVER_PID/stat"
+}
+
+# un'opzione -b non valida fa terminare il server subito dopo aver letto -t
+uring=1
+if "$SERVER" - -t uring -b 1 2>&1 | grep -q "trasferimento"; then
+    echo "Modalità uring non disponibile: compilare con MAKE_FLAGS=\"URING=1\""
+    uring=0
+fi
+
+printf "%-14s %-8s %-10s %-10s %-10s %-8s\n" "modalità" "client" "MB/s" "CPU s/GB" "p99 ms" "errori"
+for mode in buffered zerocopy uring uring-sqpoll
+do
+    case "$mode" in
+        uring*) [ "$uring" = 1 ] || continue ;;
+    esac
+    if [ "$mode" = uring-sqpoll ]; then
+        start_server "$WORK_DIR/root" -m pool -q 4096 -t uring -K 100
+    else
+        start_server "$WORK_DIR/root" -m pool -q 4096 -t "$mode"
+    fi
+
+    for n in $CLIENT_COUNTS; do
+        before=$(server_ticks)
+        read rate mbps p50 p99 errors busy < <("$WORK_DIR/conn_rate" "$ADDRESS" "$PORT" file.bin "$n" "$REQUESTS")
+        after=$(server_ticks)
+        cpu=$(awk -v t=$((after - before)) -v hz="$(getconf CLK_TCK)" -v n="$n" -v r="$REQUESTS" -v kb="$FILE_KB" \
+              'BEGIN { gb = n * r * kb * 1024 / 1e9; printf "%.3f", (gb > 0) ? t / hz / gb : 0 }')
+        printf "%-14s %-8s %-10s %-10s %-10s %-8s\n" "$mode" "$n" "$mbps" "$cpu" "$p99" "$((errors + busy))"
+    done
+    stop_server
+done
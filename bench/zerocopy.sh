@@ -0,0 +1,59 @@
+#!/bin/bash
+# Download e upload di un file grande su loopback con il percorso bufferizzato (read/send, recv/write)
+# e con quello zero-copy (sendfile, splice socket -> pipe -> file). La stessa modalità (-t) è usata da
+# server e client. Per ogni caso riporta il throughput e le chiamate di sistema per GB eseguite dal
+# server nel percorso dati (lette dal log del server).
+#
+# Uso: bench/zerocopy.sh [dimensione_file_MB] [ripetizioni]
+
+source "$(dirname "$0")/common.sh"
+
+FILE_MB="${1:-1024}"
+RUNS="${2:-3}"
+
+build
+rm -rf "$WORK_DIR/root" "$WORK_DIR/local"
+mkdir -p "$WORK_DIR/root" "$WORK_DIR/local"
+head -c $((FILE_MB * 1048576)) /dev/urandom > "$WORK_DIR/local/large.bin"
+cp "$WORK_DIR/local/large.bin" "$WORK_DIR/root/large.bin"
+
+# esegue un trasferimento e stampa i secondi impiegati: timed <w|r> <opzioni client...>
+timed()
+{
+    local start end
+    start=$(now)
+    client "$@"
+    end=$(now)
+    awk -v a="$start" -v b="$end" 'BEGIN { print b - a }'
+}
+
+printf "%-10s %-10s %-10s %-16s\n" "direzione" "modalità" "MB/s" "syscall/GB"
+for direction in download upload
+do
+    for mode in buffered zerocopy
+    do
+        start_server "$WORK_DIR/root" -t "$mode"
+
+        best=0
+        for run in $(seq 1 "$RUNS"); do
+            if [ "$direction" = download ]; then
+                elapsed=$(timed r -t "$mode" -f large.bin -o "$WORK_DIR/local/downloaded.bin")
+            else
+                elapsed=$(timed w -t "$mode" -f "$WORK_DIR/local/large.bin" -o uploaded.bin)
+                sleep 0.2   # il server può finire di scrivere dopo che il client ha chiuso la connessione
+            fi
+            rate=$(mbps $((FILE_MB * 1048576)) "$elapsed")
+            best=$(awk -v a="$best" -v b="$rate" 'BEGIN { print (b > a) ? b : a }')
+        done
+
+        # ultima riga "Inviati/Ricevuti <byte> byte con <syscall> chiamate di sistema" del log del server
+        [ "$direction" = download ] && pattern="Inviati" || pattern="Ricevuti"
+        syscalls_per_gb=$(grep "$pattern" "$WORK_DIR/server.log" | tail -1 | awk '{ printf "%.0f", $6 / ($3 / 1073741824) }')
+        printf "%-10s %-10s %-10s %-16s\n" "$direction" "$mode" "$best" "$syscalls_per_gb"
+
+        stop_server
+    done
+done
+
+cmp -s "$WORK_DIR/local/large.bin" "$WORK_DIR/local/downloaded.bin" || echo "Errore: il file scaricato è diverso dall'originale" >&2
+cmp -s "$WORK_DIR/local/large.bin" "$WORK_DIR/root/uploaded.bin" || echo "Errore: il file caricato è diverso dall'originale" >&2
@@ -0,0 +1,445 @@
+// COPIA DI PIÙ FILE (DIRECTORY, MANIFEST, SESSIONI)
+
+#include "myFTbatch.h"
+
+
+
+/**
+ * Aggiunge un'operazione all'elenco, ingrandendolo se necessario.
+ *
+ * @param batch - L'elenco delle operazioni.
+ * @param opz - L'operazione ('w', 'r', 'l').
+ * @param local_path - Il file locale (NULL per le liste).
+ * @param remote_path - Il percorso sul server.
+ * @param size - La dimensione del file, 0 se non nota.
+ * @return 0 in caso di successo, -1 se la memoria non è sufficiente.
+ */
+int batch_add(batch_t *batch, char opz, const char *local_path, const char *remote_path, unsigned long long size)
+{
+    if (batch->count == batch->capacity) {
+        int capacity = batch->capacity ? batch->capacity * 2 : SESSION_INITIAL_CAPACITY;
+        session_op_t *bigger = (session_op_t *)realloc(batch->ops, capacity * sizeof(session_op_t));
+        if (bigger == NULL) {
+            fprintf(stderr, "Errore nel allocazione della memoria: %s\n", strerror(errno));
+            return -1;
+        }
+        batch->ops = bigger;
+        batch->capacity = capacity;
+    }
+
+    session_op_t *op = &batch->ops[batch->count];
+    op->opz = opz;
+    op->local_path = local_path ? strdup(local_path) : NULL;
+    op->remote_path = strdup(remote_path);
+    op->size = size;
+    op->skipped = 0;
+    if ((local_path && op->local_path == NULL) || op->remote_path == NULL) {
+        free(op->local_path);
+        free(op->remote_path);
+        fprintf(stderr, "Errore nel allocazione della memoria: %s\n", strerror(errno));
+        return -1;
+    }
+    batch->count++;
+    return 0;
+}
+
+
+
+/**
+ * Unisce una directory e un nome con un solo separatore.
+ *
+ * @param dir - La directory (vuota per la directory corrente o la root del server).
+ * @param name - Il nome da aggiungere.
+ * @return Il percorso allocato dinamicamente (da liberare con free), NULL se la memoria non è sufficiente.
+ */
+char* join_path(const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    while (dir_len > 1 && dir[dir_len - 1] == '/') {
+        dir_len--;
+    }
+    if (dir_len == 0) {
+        return strdup(name);
+    }
+
+    char *path = (char *)malloc(dir_len + strlen(name) + 2);
+    if (path != NULL) {
+        sprintf(path, "%.*s/%s", (int)dir_len, dir, name);
+    }
+    return path;
+}
+
+
+
+/**
+ * Aggiunge all'elenco la scrittura di tutti i file regolari di una directory locale e delle sue
+ * sottodirectory, mantenendo la stessa struttura sotto la directory remota.
+ *
+ * @param batch - L'elenco delle operazioni.
+ * @param local_dir - La directory locale da copiare.
+ * @param remote_dir - La directory remota di destinazione.
+ * @return 0 in caso di successo, -1 se la directory non è leggibile o la memoria non è sufficiente.
+ */
+int batch_add_local_tree(batch_t *batch, const char *local_dir, const char *remote_dir)
+{
+    DIR *dir = opendir(local_dir);
+    if (dir == NULL) {
+        fprintf(stderr, "Errore durante l' apertura della directory '%s': %s\n", local_dir, strerror(errno));
+        return -1;
+    }
+
+    struct dirent *entry;
+    struct stat statbuf;
+    int result = 0;
+
+    while (result == 0 && (entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char *local_path = join_path(local_dir, entry->d_name);
+        char *remote_path = join_path(remote_dir, entry->d_name);
+        if (local_path == NULL || remote_path == NULL) {
+            result = -1;
+        }
+        // i collegamenti simbolici vengono ignorati, così la visita non esce dalla directory
+        else if (lstat(local_path, &statbuf) < 0) {
+            fprintf(stderr, "Errore nel controllo del path '%s': %s\n", local_path, strerror(errno));
+        } else if (S_ISDIR(statbuf.st_mode)) {
+            result = batch_add_local_tree(batch, local_path, remote_path);
+        } else if (S_ISREG(statbuf.st_mode)) {
+            result = batch_add(batch, 'w', local_path, remote_path, statbuf.st_size);
+        }
+        free(local_path);
+        free(remote_path);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+
+
+/**
+ * Aggiunge all'elenco la lettura di tutti i file regolari sotto una directory remota, mantenendo la
+ * stessa struttura sotto la directory locale. La lista dei file (con le dimensioni) è richiesta al
+ * server con FT_FLAG_RECURSIVE su una connessione dedicata.
+ *
+ * @param batch - L'elenco delle operazioni.
+ * @param server_address - L'indirizzo del server.
+ * @param port - La porta del server.
+ * @param remote_dir - La directory remota da copiare.
+ * @param local_dir - La directory locale di destinazione.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int batch_add_remote_tree(batch_t *batch, const char *server_address, int port, const char *remote_dir, const char *local_dir)
+{
+    ft_header_t response;
+    int result = -1;
+
+    int client_sock = connect_server(server_address, port);
+    if (client_sock < 0) {
+        return -1;
+    }
+
+    if (ft_send_request(client_sock, 'l', FT_FLAG_RECURSIVE, remote_dir, 0) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        close(client_sock);
+        return -1;
+    }
+    if (recv_response(client_sock, &response) < 0) {
+        close(client_sock);
+        return -1;
+    }
+
+    char *listing = (char *)malloc(response.payload_len + 1);
+    if (listing == NULL) {
+        fprintf(stderr, "Errore nel allocazione della memoria: %s\n", strerror(errno));
+    } else if (recv_all(client_sock, listing, response.payload_len) < 0) {
+        fprintf(stderr, "Errore nella ricezione dei dati dal server: %s\n", strerror(errno));
+    } else {
+        listing[response.payload_len] = '\0';
+        result = 0;
+    }
+    close(client_sock);
+
+    // ogni record è "<dimensione> <percorso relativo>" terminato da '\0'
+    for (size_t off = 0; result == 0 && off < response.payload_len; off += strlen(listing + off) + 1)
+    {
+        char *name = NULL;
+        unsigned long long size = strtoull(listing + off, &name, 10);
+        if (*name != ' ') {
+            fprintf(stderr, "Errore, lista ricevuta dal server non valida\n");
+            result = -1;
+            break;
+        }
+        name++;
+
+        char *local_path = join_path(local_dir, name);
+        char *remote_path = join_path(remote_dir, name);
+        result = (local_path && remote_path) ? batch_add(batch, 'r', local_path, remote_path, size) : -1;
+        free(local_path);
+        free(remote_path);
+    }
+
+    free(listing);
+    return result;
+}
+
+
+
+/**
+ * Legge un manifest: una coppia "sorgente [destinazione]" per riga, dove la sorgente è il file locale per
+ * le scritture e il file remoto per le letture; se manca la destinazione coincide con la sorgente. Le righe
+ * vuote e quelle che iniziano con '#' vengono ignorate.
+ *
+ * @param batch - L'elenco delle operazioni.
+ * @param opz - L'operazione da eseguire su tutte le coppie ('w' o 'r').
+ * @param manifest_path - Il percorso del manifest ("-" per lo standard input).
+ * @return 0 in caso di successo, -1 se il manifest non è leggibile o la memoria non è sufficiente.
+ */
+int batch_load_manifest(batch_t *batch, char opz, const char *manifest_path)
+{
+    FILE *fp = strcmp(manifest_path, "-") == 0 ? stdin : fopen(manifest_path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Errore durante l' apertura del manifest: %s\n", strerror(errno));
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_size = 0;
+    int result = 0;
+    struct stat statbuf;
+
+    while (result == 0 && getline(&line, &line_size, fp) >= 0)
+    {
+        char source[BUFFER_SIZE], destination[BUFFER_SIZE];
+
+        int fields = sscanf(line, " %1023s %1023s", source, destination);
+        if (fields <= 0 || source[0] == '#') {
+            continue;
+        }
+        if (fields == 1) {
+            strcpy(destination, source);
+        }
+
+        // per le scritture la dimensione serve a inviare prima i file più grandi
+        if (opz == 'w') {
+            result = batch_add(batch, 'w', source, destination, stat(source, &statbuf) == 0 ? (unsigned long long)statbuf.st_size : 0);
+        } else {
+            result = batch_add(batch, 'r', destination, source, 0);
+        }
+    }
+
+    free(line);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    return result;
+}
+
+
+
+/**
+ * Legge il file delle operazioni di una sessione. Ogni riga contiene un'operazione:
+ * "w <locale> [remoto]", "r <remoto> [locale]" oppure "l [remoto]"; le righe vuote e quelle che
+ * iniziano con '#' vengono ignorate. Se manca, il secondo percorso è uguale al primo.
+ *
+ * @param batch - L'elenco in cui memorizzare le operazioni.
+ * @param ops_path - Il percorso del file delle operazioni ("-" per lo standard input).
+ * @return 0 in caso di successo, -1 se il file non è leggibile o contiene una riga non valida.
+ */
+int batch_load_ops(batch_t *batch, const char *ops_path)
+{
+    FILE *fp = strcmp(ops_path, "-") == 0 ? stdin : fopen(ops_path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Errore durante l' apertura del file delle operazioni: %s\n", strerror(errno));
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_size = 0;
+    int line_number = 0;
+    int result = 0;
+
+    while (result == 0 && getline(&line, &line_size, fp) >= 0)
+    {
+        char opz[2], first[BUFFER_SIZE], second[BUFFER_SIZE];
+        line_number++;
+
+        int fields = sscanf(line, " %1s %1023s %1023s", opz, first, second);
+        if (fields <= 0 || opz[0] == '#') {
+            continue;
+        }
+        if ((opz[0] != 'w' && opz[0] != 'r' && opz[0] != 'l') || (opz[0] != 'l' && fields < 2)) {
+            fprintf(stderr, "Errore, riga %d del file delle operazioni non valida: %s", line_number, line);
+            result = -1;
+            break;
+        }
+
+        const char *remote = (opz[0] == 'w') ? (fields == 3 ? second : first) : (fields >= 2 ? first : "");
+        const char *local = (opz[0] == 'w') ? first : (fields == 3 ? second : first);
+        result = batch_add(batch, opz[0], opz[0] == 'l' ? NULL : local, remote, 0);
+    }
+
+    free(line);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    return result;
+}
+
+
+
+/**
+ * Confronta due operazioni per dimensione decrescente (qsort).
+ */
+static int compare_size_desc(const void *a, const void *b)
+{
+    const session_op_t *x = (const session_op_t *)a;
+    const session_op_t *y = (const session_op_t *)b;
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+
+
+/**
+ * Thread che esegue la sessione di una connessione della copia.
+ *
+ * @param arg - La sessione (session_t*).
+ * @return NULL alla fine della sessione.
+ */
+static void *batch_worker(void *arg)
+{
+    session_t *session = (session_t *)arg;
+    run_session(session);
+    close(session->sock);
+    return NULL;
+}
+
+
+
+/**
+ * Esegue le operazioni dell'elenco su un piccolo insieme di connessioni persistenti, ciascuna con le
+ * richieste in pipelining. Con reorder i file vengono ordinati dal più grande e assegnati ogni volta
+ * alla connessione meno carica (in byte più un costo fisso per file), così i file grandi partono
+ * subito e quelli piccoli si accodano insieme sulle connessioni libere. Al termine stampa file, byte,
+ * tempo e file al secondo.
+ *
+ * @param batch - L'elenco delle operazioni.
+ * @param server_address - L'indirizzo del server.
+ * @param port - La porta del server.
+ * @param connections - Il numero di connessioni.
+ * @param window - Le richieste in volo al massimo su ogni connessione.
+ * @param reorder - 1 per ordinare e distribuire i file, 0 per eseguire le operazioni nell'ordine dato.
+ * @return Il numero di operazioni fallite.
+ */
+int run_batch(batch_t *batch, const char *server_address, int port, int connections, int window, int reorder)
+{
+    struct timespec start, end;
+    int failed = 0;
+    unsigned long long bytes = 0;
+
+    if (connections > batch->count) {
+        connections = batch->count > 0 ? batch->count : 1;
+    }
+    if (reorder) {
+        qsort(batch->ops, batch->count, sizeof(session_op_t), compare_size_desc);
+    }
+
+    session_t *sessions = (session_t *)calloc(connections, sizeof(session_t));
+    unsigned long long *load = (unsigned long long *)calloc(connections, sizeof(unsigned long long));
+    session_op_t *assigned = (session_op_t *)malloc((batch->count + 1) * sizeof(session_op_t));
+    int *owner = (int *)malloc((batch->count + 1) * sizeof(int));
+    pthread_t *threads = (pthread_t *)calloc(connections, sizeof(pthread_t));
+    int *started = (int *)calloc(connections, sizeof(int));
+    if (sessions == NULL || load == NULL || assigned == NULL || owner == NULL || threads == NULL || started == NULL) {
+        fprintf(stderr, "Errore nel allocazione della memoria: %s\n", strerror(errno));
+        failed = batch->count;
+        goto cleanup;
+    }
+
+    // ogni file va alla connessione meno carica in quel momento
+    for (int i = 0; i < batch->count; i++) {
+        int best = 0;
+        for (int c = 1; c < connections; c++) {
+            if (load[c] < load[best]) {
+                best = c;
+            }
+        }
+        owner[i] = best;
+        load[best] += batch->ops[i].size + BATCH_FILE_COST;
+        sessions[best].count++;
+    }
+    // le operazioni di ogni connessione sono contigue in assigned e restano in ordine di dimensione
+    for (int c = 0, first = 0; c < connections; c++) {
+        sessions[c].ops = assigned + first;
+        sessions[c].window = window;
+        first += sessions[c].count;
+        sessions[c].count = 0;
+    }
+    for (int i = 0; i < batch->count; i++) {
+        session_t *session = &sessions[owner[i]];
+        session->ops[session->count++] = batch->ops[i];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int c = 0; c < connections; c++)
+    {
+        sessions[c].sock = (sessions[c].count > 0) ? connect_server(server_address, port) : -1;
+        if (sessions[c].sock < 0) {
+            sessions[c].failed = sessions[c].count;
+            continue;
+        }
+        started[c] = (pthread_create(&threads[c], NULL, batch_worker, &sessions[c]) == 0);
+        if (!started[c]) {
+            fprintf(stderr, "Errore durante la creazione del thread della connessione %d\n", c);
+            sessions[c].failed = sessions[c].count;
+            close(sessions[c].sock);
+        }
+    }
+
+    for (int c = 0; c < connections; c++) {
+        if (started[c]) {
+            pthread_join(threads[c], NULL);
+        }
+        failed += sessions[c].failed;
+        bytes += sessions[c].bytes;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    int files = batch->count - failed;
+
+    printf("CLIENT: %d file trasferiti (%llu byte) in %.3f s su %d connessioni: %.1f file/s, %.1f MB/s, %d operazioni fallite\n",
+           files, bytes, elapsed, connections, elapsed > 0 ? files / elapsed : 0.0, elapsed > 0 ? bytes / elapsed / 1048576 : 0.0, failed);
+
+cleanup:
+    free(sessions);
+    free(load);
+    free(assigned);
+    free(owner);
+    free(threads);
+    free(started);
+    return failed;
+}
+
+
+
+/**
+ * Libera l'elenco delle operazioni e i percorsi che contiene.
+ *
+ * @param batch - L'elenco delle operazioni.
+ */
+void batch_free(batch_t *batch)
+{
+    for (int i = 0; i < batch->count; i++) {
+        free(batch->ops[i].local_path);
+        free(batch->ops[i].remote_path);
+    }
+    free(batch->ops);
+    batch->ops = NULL;
+    batch->count = batch->capacity = 0;
+}
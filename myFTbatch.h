@@ -0,0 +1,29 @@
+#ifndef MY_FT_BATCH_H
+#define MY_FT_BATCH_H
+
+#include <dirent.h>             // per opendir/readdir nella visita delle directory locali
+#include <time.h>               // per clock_gettime
+#include "myFTclient.h"
+
+#define BATCH_DEFAULT_CONNECTIONS 4     // connessioni persistenti usate da una copia (opzione -c)
+#define BATCH_FILE_COST 65536           // costo fisso di un file, in byte equivalenti, nel bilanciamento tra le connessioni
+
+
+// Elenco delle operazioni di una copia (directory, manifest o file delle operazioni)
+typedef struct
+{
+    session_op_t *ops;          // operazioni da eseguire
+    int count;                  // numero di operazioni
+    int capacity;               // dimensione allocata dell'elenco
+} batch_t;
+
+int batch_add(batch_t *batch, char opz, const char *local_path, const char *remote_path, unsigned long long size);
+char* join_path(const char *dir, const char *name);
+int batch_add_local_tree(batch_t *batch, const char *local_dir, const char *remote_dir);
+int batch_add_remote_tree(batch_t *batch, const char *server_address, int port, const char *remote_dir, const char *local_dir);
+int batch_load_manifest(batch_t *batch, char opz, const char *manifest_path);
+int batch_load_ops(batch_t *batch, const char *ops_path);
+int run_batch(batch_t *batch, const char *server_address, int port, int connections, int window, int reorder);
+void batch_free(batch_t *batch);
+
+#endif // MY_FT_BATCH_H
@@ -0,0 +1,765 @@
+// GENERATORE DI CARICO
+//
+// Simula M client concorrenti che eseguono letture, scritture e liste contro un server myFTserver con il
+// protocollo a intestazione binaria, su file le cui dimensioni seguono una distribuzione scelta (molti file
+// da 4 KiB, pochi file da 1 GiB oppure un misto). Riporta throughput, operazioni al secondo e latenze
+// (p50, p99, p999) per tipo di operazione, calcolate da istogrammi HDR, e con -j salva tutto in JSON
+// (istogrammi compresi) per confrontare i risultati nel tempo.
+
+#include "myFTbench.h"
+
+#define BENCH_BLOCK_SIZE (256 * 1024)   // byte inviati e ricevuti a ogni passo
+
+static char *write_data = NULL;         // contenuto dei file scritti (ripetuto fino alla dimensione richiesta)
+static const char *op_names[BENCH_OPS] = { "read", "write", "list" };
+static FILE *report = NULL;             // messaggi e tabella dei risultati (standard error se il JSON va sullo standard output)
+
+
+
+/**
+ * Converte una dimensione con suffisso facoltativo k, m o g (potenze di 1024), es. "4k" o "1g".
+ *
+ * @param str La stringa da convertire.
+ * @return La dimensione in byte, 0 se la stringa non è valida.
+ */
+unsigned long long parse_size(const char *str)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+
+    if (errno != 0 || end == str) {
+        return 0;
+    }
+    switch (*end) {
+        case 'g': case 'G': value <<= 10;   // fall through
+        case 'm': case 'M': value <<= 10;   // fall through
+        case 'k': case 'K': value <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    return *end == '\0' ? value : 0;
+}
+
+
+
+/**
+ * Interpreta i pesi di letture, scritture e liste nella forma "lettura:scrittura:lista", es. "70:20:10".
+ *
+ * @param str La stringa da interpretare.
+ * @param mix Array dove memorizzare i tre pesi.
+ * @return 1 se i pesi sono validi (non negativi, almeno uno positivo), 0 altrimenti.
+ */
+int parse_mix(const char *str, int mix[BENCH_OPS])
+{
+    char tail;
+    if (sscanf(str, "%d:%d:%d%c", &mix[BENCH_READ], &mix[BENCH_WRITE], &mix[BENCH_LIST], &tail) != 3) {
+        return 0;
+    }
+    return mix[BENCH_READ] >= 0 && mix[BENCH_WRITE] >= 0 && mix[BENCH_LIST] >= 0 &&
+           mix[BENCH_READ] + mix[BENCH_WRITE] + mix[BENCH_LIST] > 0;
+}
+
+
+
+/**
+ * Sceglie una distribuzione delle dimensioni dei file per nome:
+ *   small  file da 4 KiB
+ *   large  file grandi (opzione -L, default 1 GiB)
+ *   mixed  90% delle operazioni su file da 4 KiB, 9% da 1 MiB, 1% sui file grandi
+ *
+ * @param name Il nome della distribuzione.
+ * @param large_size La dimensione dei file grandi.
+ * @param distribution La distribuzione da riempire.
+ * @return 1 se il nome è valido, 0 altrimenti.
+ */
+int select_distribution(const char *name, unsigned long long large_size, bench_distribution_t *distribution)
+{
+    static const bench_distribution_t distributions[] = {
+        { "small", 1, { { "small", 4096, 1024, 1 } } },
+        { "large", 1, { { "large", 0, 2, 1 } } },
+        { "mixed", 3, { { "small", 4096, 1024, 90 }, { "medium", 1 << 20, 64, 9 }, { "large", 0, 2, 1 } } },
+    };
+
+    for (size_t i = 0; i < sizeof(distributions) / sizeof(distributions[0]); i++) {
+        if (strcmp(name, distributions[i].name) == 0) {
+            *distribution = distributions[i];
+            for (int c = 0; c < distribution->count; c++) {
+                if (distribution->classes[c].size == 0) {
+                    distribution->classes[c].size = large_size;
+                }
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * Restituisce il tempo monotono corrente in secondi.
+ */
+double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+/**
+ * Generatore pseudo-casuale xorshift64* (uno per client, così i thread non condividono stato).
+ */
+static unsigned long long next_random(unsigned long long *state)
+{
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+
+
+/**
+ * Sceglie un elemento in base ai pesi: restituisce l'indice i con probabilità weights[i] / total.
+ */
+static int pick_weighted(unsigned long long *rng, const int *weights, int count, int total)
+{
+    int r = (int)(next_random(rng) % (unsigned long long)total);
+    for (int i = 0; i < count; i++) {
+        if (r < weights[i]) {
+            return i;
+        }
+        r -= weights[i];
+    }
+    return count - 1;
+}
+
+
+
+/**
+ * Apre una connessione al server (con TCP_NODELAY: le richieste brevi non attendono l'algoritmo di Nagle).
+ *
+ * @return La socket connessa, -1 in caso di errore.
+ */
+int bench_connect(const bench_config_t *config)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (const struct sockaddr *)&config->address, sizeof(config->address)) < 0) {
+        close(sock);
+        return -1;
+    }
+    int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return sock;
+}
+
+
+
+/**
+ * Riceve l'intestazione di una risposta e la classifica.
+ *
+ * @return 0 se l'esito è quello atteso, 1 se il server è sovraccarico, 2 per un altro esito, -1 in caso di errore.
+ */
+static int recv_status(int sock, ft_header_t *response, ft_status_t expected)
+{
+    if (ft_recv_header(sock, response) < 0) {
+        return -1;
+    }
+    if (response->status == FT_STATUS_BUSY) {
+        return 1;
+    }
+    return response->status == expected ? 0 : 2;
+}
+
+
+
+/**
+ * Scrive sul server un file di size byte con il contenuto di prova, seguito dal suo checksum se il server lo accetta.
+ *
+ * @param sock La socket connessa al server.
+ * @param path Il percorso remoto.
+ * @param size I byte del file.
+ * @param flags Flag aggiuntivi della richiesta (es. FT_FLAG_KEEP_ALIVE).
+ * @return 0 se il server ha salvato il file, 1 se era sovraccarico, 2 se ha risposto con un errore, -1 se la connessione è fallita.
+ */
+int bench_write(int sock, const char *path, unsigned long long size, uint16_t flags)
+{
+    ft_header_t response;
+    uint32_t crc = 0;
+    int result;
+
+    if (ft_send_request(sock, 'w', flags | FT_FLAG_TRAILER, path, size) < 0) {
+        return -1;
+    }
+    if ((result = recv_status(sock, &response, FT_STATUS_CONTINUE)) != 0) {
+        return result;
+    }
+
+    for (unsigned long long sent = 0; sent < size; ) {
+        size_t len = (size - sent < BENCH_BLOCK_SIZE) ? (size_t)(size - sent) : BENCH_BLOCK_SIZE;
+        if (send_all(sock, write_data, len, 0) < 0) {
+            return -1;
+        }
+        crc = crc32c(crc, write_data, len);
+        sent += len;
+    }
+    if ((response.flags & FT_FLAG_TRAILER) && ft_send_trailer(sock, crc) < 0) {
+        return -1;
+    }
+    return recv_status(sock, &response, FT_STATUS_OK);
+}
+
+
+
+/**
+ * Legge un file dal server scartandone i dati, dopo averne verificato il checksum se il server lo invia.
+ *
+ * @param sock La socket connessa al server.
+ * @param path Il percorso remoto.
+ * @param flags Flag aggiuntivi della richiesta.
+ * @param buffer Buffer di BENCH_BLOCK_SIZE byte per i dati ricevuti.
+ * @param bytes Incrementato con i byte del file ricevuti.
+ * @return 0 se il file è arrivato intero, 1 se il server era sovraccarico, 2 per un errore dal server o un
+ *         checksum diverso, -1 se la connessione è fallita.
+ */
+int bench_read(int sock, const char *path, uint16_t flags, char *buffer, unsigned long long *bytes)
+{
+    ft_header_t response;
+    uint32_t crc = 0;
+    uint32_t expected = 0;
+    int result;
+
+    if (ft_send_request(sock, 'r', flags | FT_FLAG_TRAILER, path, 0) < 0) {
+        return -1;
+    }
+    if ((result = recv_status(sock, &response, FT_STATUS_OK)) != 0) {
+        return result;
+    }
+    if (response.payload_len == FT_LENGTH_UNKNOWN) {
+        return -1;
+    }
+
+    for (uint64_t received = 0; received < response.payload_len; ) {
+        size_t len = (response.payload_len - received < BENCH_BLOCK_SIZE) ? (size_t)(response.payload_len - received) : BENCH_BLOCK_SIZE;
+        if (recv_all(sock, buffer, len) < 0) {
+            return -1;
+        }
+        crc = crc32c(crc, buffer, len);
+        received += len;
+    }
+    if (response.flags & FT_FLAG_TRAILER) {
+        if (ft_recv_trailer(sock, &expected) < 0) {
+            return -1;
+        }
+        if (crc != expected) {
+            return 2;
+        }
+    }
+    *bytes += response.payload_len;
+    return 0;
+}
+
+
+
+/**
+ * Chiede la lista ordinata di una directory in record binari e la riceve (scartandola) come farebbe un client.
+ *
+ * @param buffer Buffer di BENCH_BLOCK_SIZE byte per i dati ricevuti.
+ * @return 0 se la lista è arrivata intera, 1 se il server era sovraccarico, 2 per un errore dal server, -1 se la connessione è fallita.
+ */
+int bench_list(int sock, const char *path, uint16_t flags, char *buffer, unsigned long long *bytes)
+{
+    ft_header_t response;
+    int result;
+
+    if (ft_send_request(sock, 'l', flags | FT_FLAG_RECORDS | FT_FLAG_SORTED, path, 0) < 0) {
+        return -1;
+    }
+    if ((result = recv_status(sock, &response, FT_STATUS_OK)) != 0) {
+        return result;
+    }
+    if (response.payload_len == FT_LENGTH_UNKNOWN) {
+        return -1;
+    }
+    for (uint64_t received = 0; received < response.payload_len; ) {
+        size_t len = (response.payload_len - received < BENCH_BLOCK_SIZE) ? (size_t)(response.payload_len - received) : BENCH_BLOCK_SIZE;
+        if (recv_all(sock, buffer, len) < 0) {
+            return -1;
+        }
+        received += len;
+    }
+    *bytes += response.payload_len;
+    return 0;
+}
+
+
+
+/**
+ * Chiede al server la dimensione di un file ('i').
+ *
+ * @return 0 se il file esiste (size impostato), 1 se non esiste, -1 in caso di errore.
+ */
+static int bench_info(int sock, const char *path, unsigned long long *size)
+{
+    unsigned char info[FT_INFO_SIZE];
+    ft_header_t response;
+
+    if (ft_send_request(sock, 'i', FT_FLAG_KEEP_ALIVE, path, 0) < 0 || ft_recv_header(sock, &response) < 0) {
+        return -1;
+    }
+    if (response.status == FT_STATUS_NOT_FOUND) {
+        return 1;
+    }
+    if (response.status != FT_STATUS_OK || response.payload_len < FT_INFO_SIZE ||
+        recv_all(sock, info, sizeof(info)) < 0 || recv_discard(sock, (long long)(response.payload_len - FT_INFO_SIZE)) < 0) {
+        return -1;
+    }
+    *size = ft_get_u64(info);
+    return 0;
+}
+
+
+
+/**
+ * Crea sul server i file di prova letti durante la misura, saltando quelli già presenti con la dimensione
+ * giusta (così le misure successive non li riscrivono).
+ *
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int prepare_files(const bench_config_t *config)
+{
+    char path[BENCH_PATH_MAX];
+    int sock = bench_connect(config);
+
+    if (sock < 0) {
+        fprintf(stderr, "Errore nella connessione al server %s:%d: %s\n", config->address_text, config->port, strerror(errno));
+        return -1;
+    }
+
+    for (int c = 0; c < config->distribution.count; c++)
+    {
+        const bench_class_t *cls = &config->distribution.classes[c];
+        int written = 0;
+
+        for (int i = 0; i < cls->files; i++)
+        {
+            unsigned long long size = 0;
+            snprintf(path, sizeof(path), "%s/%s/f%d", config->dir, cls->name, i);
+
+            int found = bench_info(sock, path, &size);
+            if (found < 0) {
+                fprintf(stderr, "Errore nella verifica del file di prova '%s'\n", path);
+                close(sock);
+                return -1;
+            }
+            if (found == 0 && size == cls->size) {
+                continue;
+            }
+            if (bench_write(sock, path, cls->size, FT_FLAG_KEEP_ALIVE) != 0) {
+                fprintf(stderr, "Errore nella creazione del file di prova '%s'\n", path);
+                close(sock);
+                return -1;
+            }
+            written++;
+        }
+        if (written > 0) {
+            fprintf(report, "BENCH: Creati %d file da %llu byte in '%s/%s'\n", written, cls->size, config->dir, cls->name);
+        }
+    }
+
+    close(sock);
+    return 0;
+}
+
+
+
+/**
+ * Ciclo di un client: sceglie operazione e classe di dimensione secondo i pesi e la esegue, finché non scade
+ * il tempo o non ha completato le operazioni richieste. Senza -k ogni operazione apre una nuova connessione
+ * (come un'invocazione di myFTclient) e la latenza comprende la connessione.
+ */
+void *bench_worker_run(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    const bench_config_t *config = worker->config;
+    const bench_distribution_t *distribution = &config->distribution;
+    int weights[BENCH_MAX_CLASSES];
+    int weight_total = 0;
+    char path[BENCH_PATH_MAX];
+    uint16_t flags = config->keep_alive ? FT_FLAG_KEEP_ALIVE : 0;
+
+    for (int c = 0; c < distribution->count; c++) {
+        weights[c] = distribution->classes[c].weight;
+        weight_total += weights[c];
+    }
+
+    for (long done = 0; config->ops_per_client > 0 ? done < config->ops_per_client : now_seconds() < config->deadline; done++)
+    {
+        int op = pick_weighted(&worker->rng, config->mix, BENCH_OPS, config->mix_total);
+        const bench_class_t *cls = &distribution->classes[pick_weighted(&worker->rng, weights, distribution->count, weight_total)];
+        bench_result_t *result = &worker->results[op];
+        unsigned long long bytes = 0;
+        int outcome = -1;
+
+        // le letture usano i file preparati, le scritture un file per client in ogni classe
+        switch (op) {
+            case BENCH_READ:
+                snprintf(path, sizeof(path), "%s/%s/f%d", config->dir, cls->name, (int)(next_random(&worker->rng) % cls->files));
+                break;
+            case BENCH_WRITE:
+                snprintf(path, sizeof(path), "%s/%s/w%d", config->dir, cls->name, worker->id);
+                break;
+            default:
+                snprintf(path, sizeof(path), "%s/%s", config->dir, cls->name);
+                break;
+        }
+
+        double start = now_seconds();
+        if (worker->sock < 0) {
+            worker->sock = bench_connect(config);
+        }
+        if (worker->sock >= 0) {
+            switch (op) {
+                case BENCH_READ:
+                    outcome = bench_read(worker->sock, path, flags, worker->buffer, &bytes);
+                    break;
+                case BENCH_WRITE:
+                    outcome = bench_write(worker->sock, path, cls->size, flags);
+                    bytes = cls->size;
+                    break;
+                default:
+                    outcome = bench_list(worker->sock, path, flags, worker->buffer, &bytes);
+                    break;
+            }
+        }
+        double elapsed = now_seconds() - start;
+
+        if (outcome == 0) {
+            result->ops++;
+            result->bytes += bytes;
+            histogram_record(&result->latency, (uint64_t)(elapsed * 1e6));
+        } else if (outcome == 1) {
+            result->busy++;
+        } else {
+            result->errors++;
+        }
+
+        // dopo un errore la connessione persistente potrebbe non essere più allineata alle risposte
+        if (worker->sock >= 0 && (!config->keep_alive || outcome != 0)) {
+            close(worker->sock);
+            worker->sock = -1;
+        }
+    }
+
+    if (worker->sock >= 0) {
+        close(worker->sock);
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Stampa una tabella con i risultati di ogni tipo di operazione e del totale.
+ */
+void print_results(const bench_config_t *config, const bench_result_t *results, double elapsed)
+{
+    fprintf(report, "BENCH: %d client, distribuzione %s, %.2f secondi\n", config->clients, config->distribution.name, elapsed);
+    fprintf(report, "%-8s %10s %10s %10s %8s %8s %10s %10s %10s %10s\n", "op", "completate", "op/s", "MB/s", "errori", "occupato", "p50 ms", "p99 ms", "p999 ms", "max ms");
+    for (int op = 0; op <= BENCH_OPS; op++)
+    {
+        const bench_result_t *r = &results[op];
+        fprintf(report, "%-8s %10llu %10.1f %10.1f %8llu %8llu %10.3f %10.3f %10.3f %10.3f\n",
+               op < BENCH_OPS ? op_names[op] : "totale", r->ops, r->ops / elapsed, r->bytes / elapsed / 1048576, r->errors, r->busy,
+               histogram_percentile(&r->latency, 50) / 1e3, histogram_percentile(&r->latency, 99) / 1e3,
+               histogram_percentile(&r->latency, 99.9) / 1e3, r->latency.max / 1e3);
+    }
+}
+
+
+
+/**
+ * Scrive in JSON i risultati di un tipo di operazione: contatori, latenze e i bucket non vuoti
+ * dell'istogramma come coppie [valore massimo del bucket in µs, campioni].
+ */
+static void write_json_result(FILE *out, const char *name, const bench_result_t *r, double elapsed, int last)
+{
+    const histogram_t *h = &r->latency;
+    int first = 1;
+
+    fprintf(out, "    \"%s\": {\n", name);
+    fprintf(out, "      \"ops\": %llu, \"errors\": %llu, \"busy\": %llu, \"bytes\": %llu,\n", r->ops, r->errors, r->busy, r->bytes);
+    fprintf(out, "      \"ops_per_sec\": %.3f, \"mb_per_sec\": %.3f,\n", r->ops / elapsed, r->bytes / elapsed / 1048576);
+    fprintf(out, "      \"latency_us\": { \"min\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu,\n",
+            (unsigned long long)(h->count ? h->min : 0), histogram_mean(h),
+            (unsigned long long)histogram_percentile(h, 50), (unsigned long long)histogram_percentile(h, 90),
+            (unsigned long long)histogram_percentile(h, 99), (unsigned long long)histogram_percentile(h, 99.9),
+            (unsigned long long)h->max);
+    fprintf(out, "        \"histogram\": [");
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if (h->counts[i] > 0) {
+            fprintf(out, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long)histogram_bucket_value(i), (unsigned long long)h->counts[i]);
+            first = 0;
+        }
+    }
+    fprintf(out, "] }\n    }%s\n", last ? "" : ",");
+}
+
+
+
+/**
+ * Salva configurazione e risultati in JSON.
+ *
+ * @param path Il file in cui scrivere ("-" per lo standard output).
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int write_json(const char *path, const bench_config_t *config, const bench_result_t *results, double elapsed)
+{
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Errore nell'apertura del file dei risultati '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char timestamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm));
+
+    fprintf(out, "{\n  \"timestamp\": \"%s\",\n", timestamp);
+    fprintf(out, "  \"config\": {\n");
+    fprintf(out, "    \"address\": \"%s\", \"port\": %d, \"clients\": %d, \"seconds\": %d, \"ops_per_client\": %ld,\n",
+            config->address_text, config->port, config->clients, config->seconds, config->ops_per_client);
+    fprintf(out, "    \"mix\": { \"read\": %d, \"write\": %d, \"list\": %d }, \"keep_alive\": %s, \"seed\": %llu,\n",
+            config->mix[BENCH_READ], config->mix[BENCH_WRITE], config->mix[BENCH_LIST], config->keep_alive ? "true" : "false", config->seed);
+    fprintf(out, "    \"distribution\": { \"name\": \"%s\", \"classes\": [", config->distribution.name);
+    for (int c = 0; c < config->distribution.count; c++) {
+        const bench_class_t *cls = &config->distribution.classes[c];
+        fprintf(out, "%s{ \"name\": \"%s\", \"size\": %llu, \"files\": %d, \"weight\": %d }", c ? ", " : "", cls->name, cls->size, cls->files, cls->weight);
+    }
+    fprintf(out, "] }\n  },\n");
+    fprintf(out, "  \"elapsed_sec\": %.3f,\n", elapsed);
+    fprintf(out, "  \"results\": {\n");
+    for (int op = 0; op <= BENCH_OPS; op++) {
+        write_json_result(out, op < BENCH_OPS ? op_names[op] : "total", &results[op], elapsed, op == BENCH_OPS);
+    }
+    fprintf(out, "  }\n}\n");
+
+    if (out == stdout) {
+        return fflush(out) == 0 ? 0 : -1;
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Errore nella scrittura del file dei risultati '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+
+static void add_result(bench_result_t *dst, const bench_result_t *src)
+{
+    dst->ops += src->ops;
+    dst->errors += src->errors;
+    dst->busy += src->busy;
+    dst->bytes += src->bytes;
+    histogram_merge(&dst->latency, &src->latency);
+}
+
+
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Uso: %s -p porta [-a indirizzo] [-c client] [-T secondi | -n operazioni_per_client] [-x lettura:scrittura:lista]\n"
+                    "          [-s small|large|mixed] [-L dimensione_file_grandi] [-d directory_remota] [-k] [-r seme] [-j risultati.json]\n", program);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    bench_config_t config;
+    const char *distribution_name = "small";
+    const char *json_path = NULL;
+
+    memset(&config, 0, sizeof(config));
+    config.address_text = "127.0.0.1";
+    config.clients = BENCH_DEFAULT_CLIENTS;
+    config.seconds = BENCH_DEFAULT_SECONDS;
+    config.mix[BENCH_READ] = 70;
+    config.mix[BENCH_WRITE] = 20;
+    config.mix[BENCH_LIST] = 10;
+    config.large_size = BENCH_DEFAULT_LARGE;
+    config.dir = BENCH_DEFAULT_DIR;
+    config.seed = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            config.address_text = argv[++i];
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+            if (config.port <= 0 || config.port > 65535) {
+                fprintf(stderr, "Porta '%s' non valida. Il valore dovrebbe essere tra 1 e 65535\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            config.clients = atoi(argv[++i]);
+            if (config.clients <= 0) {
+                fprintf(stderr, "Numero di client '%s' non valido\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            config.seconds = atoi(argv[++i]);
+            if (config.seconds <= 0) {
+                fprintf(stderr, "Durata '%s' non valida\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            config.ops_per_client = atol(argv[++i]);
+            if (config.ops_per_client <= 0) {
+                fprintf(stderr, "Numero di operazioni '%s' non valido\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            if (!parse_mix(argv[++i], config.mix)) {
+                fprintf(stderr, "Pesi delle operazioni '%s' non validi. Usa lettura:scrittura:lista, es. 70:20:10\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            distribution_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+            config.large_size = parse_size(argv[++i]);
+            if (config.large_size == 0) {
+                fprintf(stderr, "Dimensione '%s' non valida. Usa byte o un suffisso k, m, g (es. 64m)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            config.dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-k") == 0) {
+            config.keep_alive = 1;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        }
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    report = (json_path != NULL && strcmp(json_path, "-") == 0) ? stderr : stdout;
+    if (config.port == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!select_distribution(distribution_name, config.large_size, &config.distribution)) {
+        fprintf(stderr, "Distribuzione '%s' non valida. Usa small, large o mixed\n", distribution_name);
+        return EXIT_FAILURE;
+    }
+    config.mix_total = config.mix[BENCH_READ] + config.mix[BENCH_WRITE] + config.mix[BENCH_LIST];
+    config.address.sin_family = AF_INET;
+    config.address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.address_text, &config.address.sin_addr) <= 0) {
+        fprintf(stderr, "Errore, l' indirizzo non è valido o non è supportato: %s\n", config.address_text);
+        return EXIT_FAILURE;
+    }
+
+    // contenuto pseudo-casuale dei file scritti, incomprimibile come quello di un file reale già compresso
+    write_data = (char *)malloc(BENCH_BLOCK_SIZE);
+    bench_worker_t *workers = (bench_worker_t *)calloc(config.clients, sizeof(bench_worker_t));
+    if (write_data == NULL || workers == NULL) {
+        fprintf(stderr, "Errore nell'allocazione della memoria: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    unsigned long long rng = config.seed | 1;
+    for (size_t i = 0; i + sizeof(unsigned long long) <= BENCH_BLOCK_SIZE; i += sizeof(unsigned long long)) {
+        unsigned long long value = next_random(&rng);
+        memcpy(write_data + i, &value, sizeof(value));
+    }
+
+    if (prepare_files(&config) < 0) {
+        return EXIT_FAILURE;
+    }
+
+    int started = 0;
+    double start = now_seconds();
+    config.deadline = start + config.seconds;
+
+    for (int i = 0; i < config.clients; i++)
+    {
+        bench_worker_t *worker = &workers[i];
+        worker->config = &config;
+        worker->id = i;
+        worker->rng = (config.seed + 1) * 0x9E3779B97F4A7C15ULL + i * 0xBF58476D1CE4E5B9ULL;
+        if (worker->rng == 0) {
+            worker->rng = 1;
+        }
+        worker->sock = -1;
+        worker->buffer = (char *)malloc(BENCH_BLOCK_SIZE);
+        for (int op = 0; op < BENCH_OPS; op++) {
+            histogram_init(&worker->results[op].latency);
+        }
+        if (worker->buffer == NULL || pthread_create(&worker->tid, NULL, bench_worker_run, worker) != 0) {
+            fprintf(stderr, "Errore nella creazione del client %d: %s\n", i, strerror(errno));
+            free(worker->buffer);
+            break;
+        }
+        started++;
+    }
+
+    // risultati di ogni tipo di operazione e, nell'ultima posizione, il totale
+    bench_result_t *results = (bench_result_t *)calloc(BENCH_OPS + 1, sizeof(bench_result_t));
+    if (results == NULL) {
+        fprintf(stderr, "Errore nell'allocazione della memoria: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (int op = 0; op <= BENCH_OPS; op++) {
+        histogram_init(&results[op].latency);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].tid, NULL);
+        for (int op = 0; op < BENCH_OPS; op++)
+        {
+            const bench_result_t *r = &workers[i].results[op];
+            add_result(&results[op], r);
+            add_result(&results[BENCH_OPS], r);
+        }
+        free(workers[i].buffer);
+    }
+    double elapsed = now_seconds() - start;
+
+    print_results(&config, results, elapsed);
+    int status = (started == config.clients) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (json_path != NULL && write_json(json_path, &config, results, elapsed) < 0) {
+        status = EXIT_FAILURE;
+    }
+
+    free(results);
+    free(workers);
+    free(write_data);
+    return status;
+}
@@ -0,0 +1,113 @@
+#ifndef MY_FT_BENCH_H
+#define MY_FT_BENCH_H
+
+
+#include <stdio.h>              // per printf e per il file dei risultati JSON
+#include <stdlib.h>             // per malloc, strtoull e altre utilità
+#include <unistd.h>             // per close()
+#include <string.h>             // per strcmp, strlen, memset
+#include <errno.h>              // per interpretare i codici di errore
+#include <time.h>               // per clock_gettime e la data dei risultati
+#include <pthread.h>            // un thread per ogni client simulato
+#include <sys/socket.h>         // per socket, connect, recv
+#include <arpa/inet.h>          // per inet_pton
+#include <netinet/in.h>         // per IPPROTO_TCP
+#include <netinet/tcp.h>        // per TCP_NODELAY
+#include "myFTprotocol.h"       // intestazione binaria delle richieste e delle risposte
+#include "myFTtransfer.h"       // send_all, recv_all e buffer dei dati
+#include "myFTchecksum.h"       // CRC32C dei dati inviati e ricevuti
+#include "myFThistogram.h"      // istogrammi delle latenze
+
+#define BENCH_DEFAULT_CLIENTS 16            // client concorrenti (opzione -c)
+#define BENCH_DEFAULT_SECONDS 10            // durata della misura (opzione -T)
+#define BENCH_DEFAULT_DIR "myftbench"       // directory remota dei file di prova (opzione -d)
+#define BENCH_DEFAULT_LARGE (1ULL << 30)    // dimensione dei file grandi (opzione -L)
+#define BENCH_MAX_CLASSES 3                 // classi di dimensione al massimo in una distribuzione
+#define BENCH_PATH_MAX 512                  // lunghezza massima di un percorso remoto generato
+
+// Operazioni generate dai client
+typedef enum
+{
+    BENCH_READ = 0,
+    BENCH_WRITE = 1,
+    BENCH_LIST = 2,
+    BENCH_OPS = 3
+} bench_op_t;
+
+
+// Classe di dimensione dei file: i file di prova della classe e il peso con cui viene scelta
+typedef struct
+{
+    const char *name;           // nome della sottodirectory remota (es. "small")
+    unsigned long long size;    // byte di ogni file (0 = dimensione dei file grandi, opzione -L)
+    int files;                  // file preparati per le letture
+    int weight;                 // peso relativo nella scelta di letture, scritture e liste
+} bench_class_t;
+
+
+// Distribuzione delle dimensioni dei file (opzione -s)
+typedef struct
+{
+    const char *name;
+    int count;
+    bench_class_t classes[BENCH_MAX_CLASSES];
+} bench_distribution_t;
+
+
+// Parametri comuni a tutti i client
+typedef struct
+{
+    struct sockaddr_in address;
+    const char *address_text;
+    int port;
+    int clients;                            // client concorrenti
+    int seconds;                            // durata della misura, se ops_per_client è 0
+    long ops_per_client;                    // operazioni di ogni client (0 = per la durata indicata)
+    int mix[BENCH_OPS];                     // pesi di letture, scritture e liste (opzione -x)
+    int mix_total;
+    bench_distribution_t distribution;      // classi con le dimensioni già risolte
+    unsigned long long large_size;          // dimensione dei file grandi
+    const char *dir;                        // directory remota dei file di prova
+    int keep_alive;                         // 1: una connessione persistente per client (opzione -k)
+    unsigned long long seed;                // seme dei generatori pseudo-casuali (opzione -r)
+    double deadline;                        // istante in cui i client smettono di iniziare operazioni
+} bench_config_t;
+
+
+// Risultati di un tipo di operazione
+typedef struct
+{
+    unsigned long long ops;     // operazioni completate
+    unsigned long long errors;  // operazioni fallite (esito di errore, connessione interrotta, checksum diverso)
+    unsigned long long busy;    // operazioni rifiutate dal server sovraccarico
+    unsigned long long bytes;   // byte di file (o di lista) trasferiti dalle operazioni completate
+    histogram_t latency;        // latenza delle operazioni completate, in microsecondi
+} bench_result_t;
+
+
+// Un client simulato
+typedef struct
+{
+    const bench_config_t *config;
+    int id;
+    unsigned long long rng;                 // stato del generatore pseudo-casuale
+    int sock;                               // connessione persistente (-1 se assente)
+    char *buffer;                           // blocco dei dati ricevuti
+    bench_result_t results[BENCH_OPS];
+    pthread_t tid;
+} bench_worker_t;
+
+unsigned long long parse_size(const char *str);
+int parse_mix(const char *str, int mix[BENCH_OPS]);
+int select_distribution(const char *name, unsigned long long large_size, bench_distribution_t *distribution);
+double now_seconds(void);
+int bench_connect(const bench_config_t *config);
+int bench_write(int sock, const char *path, unsigned long long size, uint16_t flags);
+int bench_read(int sock, const char *path, uint16_t flags, char *buffer, unsigned long long *bytes);
+int bench_list(int sock, const char *path, uint16_t flags, char *buffer, unsigned long long *bytes);
+int prepare_files(const bench_config_t *config);
+void *bench_worker_run(void *arg);
+void print_results(const bench_config_t *config, const bench_result_t *results, double elapsed);
+int write_json(const char *path, const bench_config_t *config, const bench_result_t *results, double elapsed);
+
+#endif // MY_FT_BENCH_H
@@ -0,0 +1,601 @@
+// CACHE DEI METADATI
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>         // per PATH_MAX
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include "myFTcache.h"
+#include "myFTlock.h"
+
+// eventi che cambiano la lista di una directory o lo stat di una sua voce
+#define METACACHE_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | \
+                          IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+
+// Stato della cache: un solo mutex protegge tabella, lista LRU e directory osservate. Le letture dal disco
+// avvengono fuori dal mutex; il contatore di generazione del bucket, incrementato a ogni invalidazione,
+// impedisce di inserire il risultato di una lettura superata da una modifica avvenuta nel frattempo.
+static struct
+{
+    int enabled;                                        // 0 se la cache è disattivata
+    pthread_mutex_t mutex;
+    metacache_entry_t *buckets[METACACHE_BUCKETS];
+    unsigned long long generation[METACACHE_BUCKETS];  // invalidazioni avvenute nel bucket
+    metacache_entry_t *lru_head;                        // entry usata più di recente
+    metacache_entry_t *lru_tail;                        // entry da eliminare per prima
+    size_t bytes;                                       // memoria occupata dalle entry
+    size_t budget;                                      // memoria massima
+    metacache_watch_t **watches;                        // directory osservate, indicizzate per watch descriptor
+    int watches_capacity;
+    int inotify_fd;
+    unsigned long long hits;                            // richieste servite dalla cache
+    unsigned long long misses;                          // richieste lette dal disco
+} cache = { .mutex = PTHREAD_MUTEX_INITIALIZER, .inotify_fd = -1 };
+
+
+
+/**
+ * Calcola il bucket (hash FNV-1a) di un percorso.
+ *
+ * @param key Il percorso normalizzato.
+ * @return L'indice del bucket.
+ */
+static unsigned int metacache_bucket(const char *key)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash % METACACHE_BUCKETS;
+}
+
+
+
+/**
+ * Inizia a osservare una directory, oppure prende un riferimento in più se è già osservata.
+ * Va chiamata con il mutex della cache acquisito.
+ *
+ * @param dirpath Il percorso normalizzato della directory.
+ * @return La directory osservata, NULL se non si può osservare (percorso inesistente, non una directory,
+ *         limite di inotify raggiunto o stessa directory già osservata con un altro percorso).
+ */
+static metacache_watch_t* watch_get(const char *dirpath)
+{
+    int wd = inotify_add_watch(cache.inotify_fd, dirpath, IN_ONLYDIR | METACACHE_EVENTS);
+    if (wd < 0) {
+        return NULL;
+    }
+
+    // inotify restituisce lo stesso watch descriptor per la stessa directory
+    if (wd < cache.watches_capacity && cache.watches[wd] != NULL) {
+        metacache_watch_t *watch = cache.watches[wd];
+        if (strcmp(watch->path, dirpath) != 0) {
+            return NULL;    // raggiunta con un altro percorso (collegamento simbolico): gli eventi userebbero l'altro
+        }
+        watch->refs++;
+        return watch;
+    }
+
+    if (wd >= cache.watches_capacity) {
+        int capacity = cache.watches_capacity > 0 ? cache.watches_capacity : 64;
+        while (capacity <= wd) {
+            capacity *= 2;
+        }
+        metacache_watch_t **bigger = (metacache_watch_t **)realloc(cache.watches, capacity * sizeof(*bigger));
+        if (bigger == NULL) {
+            inotify_rm_watch(cache.inotify_fd, wd);
+            return NULL;
+        }
+        memset(bigger + cache.watches_capacity, 0, (capacity - cache.watches_capacity) * sizeof(*bigger));
+        cache.watches = bigger;
+        cache.watches_capacity = capacity;
+    }
+
+    metacache_watch_t *watch = (metacache_watch_t *)malloc(sizeof(metacache_watch_t));
+    char *path = strdup(dirpath);
+    if (watch == NULL || path == NULL) {
+        free(watch);
+        free(path);
+        inotify_rm_watch(cache.inotify_fd, wd);
+        return NULL;
+    }
+    watch->wd = wd;
+    watch->path = path;
+    watch->refs = 1;
+    cache.watches[wd] = watch;
+    return watch;
+}
+
+
+
+/**
+ * Smette di osservare una directory: il watch descriptor viene rimosso subito, la struttura quando nessuna
+ * entry la usa più. Va chiamata con il mutex della cache acquisito.
+ *
+ * @param watch La directory osservata.
+ */
+static void watch_detach(metacache_watch_t *watch)
+{
+    if (watch->wd >= 0) {
+        inotify_rm_watch(cache.inotify_fd, watch->wd);
+        cache.watches[watch->wd] = NULL;
+        watch->wd = -1;
+    }
+}
+
+
+
+/**
+ * Rilascia un riferimento a una directory osservata e smette di osservarla se era l'ultimo.
+ * Va chiamata con il mutex della cache acquisito.
+ *
+ * @param watch La directory osservata (NULL è ignorato).
+ */
+static void watch_put(metacache_watch_t *watch)
+{
+    if (watch != NULL && --watch->refs == 0) {
+        watch_detach(watch);
+        free(watch->path);
+        free(watch);
+    }
+}
+
+
+
+/**
+ * Toglie un'entry da tabella e lista LRU e ne libera la memoria. Va chiamata con il mutex acquisito.
+ *
+ * @param entry L'entry.
+ */
+static void entry_remove(metacache_entry_t *entry)
+{
+    metacache_entry_t **link = &cache.buckets[entry->bucket];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache.lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache.lru_tail = entry->lru_prev;
+    }
+
+    cache.bytes -= entry->bytes;
+    watch_put(entry->watch);
+    list_free(&entry->list);
+    free(entry->key);
+    free(entry);
+}
+
+
+
+/**
+ * Cerca un'entry e, se c'è, la sposta in testa alla lista LRU. Va chiamata con il mutex acquisito.
+ *
+ * @param key Il percorso normalizzato.
+ * @param kind Il tipo di entry.
+ * @return L'entry oppure NULL se non è in cache.
+ */
+static metacache_entry_t* entry_lookup(const char *key, metacache_kind_t kind)
+{
+    metacache_entry_t *entry = cache.buckets[metacache_bucket(key)];
+    while (entry != NULL && (entry->kind != kind || strcmp(entry->key, key) != 0)) {
+        entry = entry->next;
+    }
+
+    if (entry != NULL && entry != cache.lru_head) {
+        entry->lru_prev->lru_next = entry->lru_next;
+        if (entry->lru_next != NULL) {
+            entry->lru_next->lru_prev = entry->lru_prev;
+        } else {
+            cache.lru_tail = entry->lru_prev;
+        }
+        entry->lru_prev = NULL;
+        entry->lru_next = cache.lru_head;
+        cache.lru_head->lru_prev = entry;
+        cache.lru_head = entry;
+    }
+    return entry;
+}
+
+
+
+/**
+ * Inserisce un'entry in testa alla lista LRU ed elimina quelle usate meno di recente finché la memoria
+ * torna nel limite. L'entry prende un riferimento alla directory osservata. Va chiamata con il mutex acquisito.
+ *
+ * @param entry L'entry (con key, kind, bucket, dati e bytes già impostati).
+ * @param watch La directory osservata da cui dipende l'entry.
+ */
+static void entry_insert(metacache_entry_t *entry, metacache_watch_t *watch)
+{
+    entry->watch = watch;
+    watch->refs++;
+
+    entry->next = cache.buckets[entry->bucket];
+    cache.buckets[entry->bucket] = entry;
+    entry->lru_prev = NULL;
+    entry->lru_next = cache.lru_head;
+    if (cache.lru_head != NULL) {
+        cache.lru_head->lru_prev = entry;
+    } else {
+        cache.lru_tail = entry;
+    }
+    cache.lru_head = entry;
+    cache.bytes += entry->bytes;
+
+    while (cache.bytes > cache.budget && cache.lru_tail != entry) {
+        entry_remove(cache.lru_tail);
+    }
+}
+
+
+
+/**
+ * Invalida lo stat e la lista di un percorso. Va chiamata con il mutex acquisito.
+ *
+ * @param key Il percorso normalizzato.
+ */
+static void invalidate_key(const char *key)
+{
+    unsigned int bucket = metacache_bucket(key);
+    metacache_entry_t *entry = cache.buckets[bucket];
+
+    cache.generation[bucket]++;
+    while (entry != NULL) {
+        metacache_entry_t *next = entry->next;
+        if (strcmp(entry->key, key) == 0) {
+            entry_remove(entry);
+        }
+        entry = next;
+    }
+}
+
+
+
+/**
+ * Invalida un percorso e tutto ciò che contiene (NULL: l'intera cache). Serve quando una directory viene
+ * spostata o rimossa: le directory osservate sotto di essa hanno ancora il vecchio percorso e non ricevono
+ * eventi. Va chiamata con il mutex acquisito.
+ *
+ * @param prefix Il percorso normalizzato della directory, NULL per svuotare la cache.
+ */
+static void invalidate_prefix(const char *prefix)
+{
+    size_t len = (prefix != NULL) ? strlen(prefix) : 0;
+
+    // una lettura in corso sotto il percorso non deve inserire il proprio risultato
+    for (int i = 0; i < METACACHE_BUCKETS; i++) {
+        cache.generation[i]++;
+    }
+
+    metacache_entry_t *entry = cache.lru_head;
+    while (entry != NULL) {
+        metacache_entry_t *next = entry->lru_next;
+        if (prefix == NULL || (strncmp(entry->key, prefix, len) == 0 && (entry->key[len] == '\0' || entry->key[len] == '/'))) {
+            entry_remove(entry);
+        }
+        entry = next;
+    }
+}
+
+
+
+/**
+ * Thread che legge gli eventi inotify delle directory osservate e invalida le entry che riguardano:
+ * la lista (e lo stat) della directory e lo stat della voce coinvolta. Una directory spostata o rimossa
+ * invalida tutto ciò che contiene; se la coda degli eventi trabocca la cache viene svuotata.
+ *
+ * @param arg Non usato.
+ * @return NULL se la lettura degli eventi fallisce.
+ */
+static void *metacache_watcher(void *arg)
+{
+    (void)arg;
+    char *events = (char *)malloc(METACACHE_EVENT_BUFFER);
+    char child[PATH_MAX];
+
+    while (events != NULL)
+    {
+        ssize_t n = read(cache.inotify_fd, events, METACACHE_EVENT_BUFFER);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Errore durante la lettura degli eventi inotify: %s\n", strerror(errno));
+            break;
+        }
+
+        pthread_mutex_lock(&cache.mutex);
+        for (ssize_t pos = 0; pos < n; )
+        {
+            struct inotify_event *event = (struct inotify_event *)(events + pos);
+            pos += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                invalidate_prefix(NULL);
+                continue;
+            }
+            if (event->wd < 0 || event->wd >= cache.watches_capacity || cache.watches[event->wd] == NULL) {
+                continue;   // directory non più osservata
+            }
+            metacache_watch_t *watch = cache.watches[event->wd];
+            watch->refs++;      // la struttura resta valida mentre si rimuovono le entry che la usano
+
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                invalidate_prefix(watch->path);
+                if (event->mask & IN_IGNORED) {
+                    cache.watches[watch->wd] = NULL;    // il kernel ha già rimosso il watch descriptor
+                    watch->wd = -1;
+                }
+                watch_detach(watch);
+            }
+            else
+            {
+                invalidate_key(watch->path);
+                if (event->len > 0 && (size_t)snprintf(child, sizeof(child), "%s/%s", watch->path, event->name) < sizeof(child)) {
+                    if ((event->mask & IN_ISDIR) && (event->mask & (IN_MOVED_FROM | IN_DELETE))) {
+                        invalidate_prefix(child);
+                    } else {
+                        invalidate_key(child);
+                    }
+                }
+            }
+            watch_put(watch);
+        }
+        pthread_mutex_unlock(&cache.mutex);
+    }
+
+    // senza eventi la cache non sarebbe più coerente: da qui in poi ogni richiesta va al disco
+    pthread_mutex_lock(&cache.mutex);
+    cache.enabled = 0;
+    invalidate_prefix(NULL);
+    pthread_mutex_unlock(&cache.mutex);
+    free(events);
+    return NULL;
+}
+
+
+
+/**
+ * Attiva la cache dei metadati e avvia il thread che ne riceve le invalidazioni da inotify.
+ *
+ * @param budget La memoria massima in byte (0 lascia la cache disattivata).
+ * @return 0 in caso di successo (o cache disattivata), -1 se la cache non si può attivare.
+ */
+int metacache_init(size_t budget)
+{
+    pthread_t tid;
+
+    if (budget == 0) {
+        return 0;
+    }
+    cache.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (cache.inotify_fd < 0) {
+        fprintf(stderr, "Errore durante l'inizializzazione di inotify: %s\n", strerror(errno));
+        return -1;
+    }
+    cache.budget = budget;
+    cache.enabled = 1;
+
+    if (pthread_create(&tid, NULL, metacache_watcher, NULL) != 0) {
+        fprintf(stderr, "Errore durante la creazione del thread della cache dei metadati\n");
+        cache.enabled = 0;
+        close(cache.inotify_fd);
+        cache.inotify_fd = -1;
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+
+
+/**
+ * Restituisce la lista completa di una directory, ordinata per nome: dalla cache se presente, altrimenti
+ * letta dal disco e messa in cache. La directory viene osservata prima della lettura, così una modifica
+ * avvenuta durante la lettura arriva comunque come evento. Le date delle sottodirectory nella lista sono
+ * quelle della lettura finché la directory stessa non cambia.
+ *
+ * @param path Il percorso della directory (o di un file, che dà una sola voce e non viene messo in cache).
+ * @param list La lista (vuota) da riempire; va liberata con list_free.
+ * @return 1 se la lista viene dalla cache, 0 se è stata letta dal disco, -1 in caso di errore (errno impostato).
+ */
+int metacache_list(const char *path, list_t *list)
+{
+    uint64_t next;
+
+    if (!cache.enabled) {
+        return list_directory(path, 1, 0, FT_LENGTH_UNKNOWN, list, &next);
+    }
+    char *key = normalize_path(path);
+    if (key == NULL) {
+        return -1;
+    }
+    unsigned int bucket = metacache_bucket(key);
+
+    pthread_mutex_lock(&cache.mutex);
+    metacache_entry_t *entry = entry_lookup(key, METACACHE_LIST);
+    if (entry != NULL) {
+        cache.hits++;
+        int copied = list_copy(list, &entry->list);
+        pthread_mutex_unlock(&cache.mutex);
+        free(key);
+        return copied == 0 ? 1 : -1;
+    }
+    cache.misses++;
+    metacache_watch_t *watch = watch_get(key);
+    unsigned long long generation = cache.generation[bucket];
+    pthread_mutex_unlock(&cache.mutex);
+
+    int result = list_directory(path, 1, 0, FT_LENGTH_UNKNOWN, list, &next);
+    int saved_errno = errno;
+
+    entry = NULL;
+    if (result == 0 && watch != NULL) {
+        entry = (metacache_entry_t *)calloc(1, sizeof(metacache_entry_t));
+        if (entry != NULL && list_copy(&entry->list, list) < 0) {
+            free(entry);
+            entry = NULL;
+        }
+    }
+
+    pthread_mutex_lock(&cache.mutex);
+    if (entry != NULL && cache.enabled && cache.generation[bucket] == generation && entry_lookup(key, METACACHE_LIST) == NULL)
+    {
+        entry->key = key;
+        key = NULL;
+        entry->kind = METACACHE_LIST;
+        entry->bucket = bucket;
+        entry->bytes = sizeof(metacache_entry_t) + strlen(entry->key) + 1 + entry->list.len + entry->list.count * sizeof(size_t);
+        if (entry->bytes <= cache.budget) {
+            entry_insert(entry, watch);
+            entry = NULL;
+        } else {
+            key = entry->key;
+        }
+    }
+    watch_put(watch);
+    pthread_mutex_unlock(&cache.mutex);
+
+    if (entry != NULL) {
+        list_free(&entry->list);
+        free(entry);
+    }
+    free(key);
+    errno = saved_errno;
+    return result;
+}
+
+
+
+/**
+ * Come stat, ma servita dalla cache quando possibile. Anche un percorso inesistente viene messo in cache
+ * (ENOENT o ENOTDIR), finché un evento sulla directory che lo contiene non lo invalida.
+ *
+ * @param path Il percorso.
+ * @param statbuf La struttura da riempire.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int metacache_stat(const char *path, struct stat *statbuf)
+{
+    if (!cache.enabled) {
+        return stat(path, statbuf);
+    }
+    char *key = normalize_path(path);
+    if (key == NULL) {
+        return -1;
+    }
+    unsigned int bucket = metacache_bucket(key);
+
+    pthread_mutex_lock(&cache.mutex);
+    metacache_entry_t *entry = entry_lookup(key, METACACHE_STAT);
+    if (entry != NULL) {
+        cache.hits++;
+        int error = entry->error;
+        *statbuf = entry->statbuf;
+        pthread_mutex_unlock(&cache.mutex);
+        free(key);
+        errno = error;
+        return error == 0 ? 0 : -1;
+    }
+    cache.misses++;
+
+    // lo stat di una voce cambia con gli eventi della directory che la contiene
+    char *slash = strrchr(key, '/');
+    metacache_watch_t *watch = NULL;
+    if (slash != NULL && slash != key) {
+        *slash = '\0';
+        watch = watch_get(key);
+        *slash = '/';
+    }
+    unsigned long long generation = cache.generation[bucket];
+    pthread_mutex_unlock(&cache.mutex);
+
+    int result = stat(path, statbuf);
+    int error = (result < 0) ? errno : 0;
+
+    pthread_mutex_lock(&cache.mutex);
+    if (watch != NULL && (error == 0 || error == ENOENT || error == ENOTDIR) && cache.enabled &&
+        cache.generation[bucket] == generation && entry_lookup(key, METACACHE_STAT) == NULL)
+    {
+        entry = (metacache_entry_t *)calloc(1, sizeof(metacache_entry_t));
+        if (entry != NULL) {
+            entry->key = key;
+            key = NULL;
+            entry->kind = METACACHE_STAT;
+            entry->bucket = bucket;
+            entry->error = error;
+            entry->statbuf = *statbuf;
+            entry->bytes = sizeof(metacache_entry_t) + strlen(entry->key) + 1;
+            entry_insert(entry, watch);
+        }
+    }
+    watch_put(watch);
+    pthread_mutex_unlock(&cache.mutex);
+
+    free(key);
+    errno = error;
+    return result;
+}
+
+
+
+/**
+ * Invalida subito le entry toccate da una scrittura del server: il file e tutte le directory che lo
+ * contengono (lista e stat, le directory intermedie possono essere appena state create). Gli eventi inotify
+ * arriverebbero comunque, ma dopo la risposta al client.
+ *
+ * @param path Il percorso scritto.
+ */
+void metacache_invalidate(const char *path)
+{
+    if (!cache.enabled) {
+        return;
+    }
+    char *key = normalize_path(path);
+    if (key == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache.mutex);
+    char *slash;
+    do {
+        invalidate_key(key);
+        slash = strrchr(key, '/');
+        if (slash != NULL) {
+            *slash = '\0';
+        }
+    } while (slash != NULL && slash != key);
+    pthread_mutex_unlock(&cache.mutex);
+    free(key);
+}
+
+
+
+/**
+ * Legge i contatori della cache.
+ *
+ * @param hits Puntatore dove memorizzare le richieste servite dalla cache.
+ * @param misses Puntatore dove memorizzare le richieste lette dal disco.
+ */
+void metacache_stats(unsigned long long *hits, unsigned long long *misses)
+{
+    pthread_mutex_lock(&cache.mutex);
+    *hits = cache.hits;
+    *misses = cache.misses;
+    pthread_mutex_unlock(&cache.mutex);
+}
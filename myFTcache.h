@@ -0,0 +1,52 @@
+#ifndef MY_FT_CACHE_H
+#define MY_FT_CACHE_H
+
+#include <stddef.h>         // per size_t
+#include <sys/stat.h>       // per struct stat
+#include "myFTlist.h"       // liste delle directory
+
+#define METACACHE_DEFAULT_MB 64         // memoria della cache dei metadati in MiB (opzione -C del server, 0 la disattiva)
+#define METACACHE_BUCKETS 4096          // bucket della tabella hash delle entry
+#define METACACHE_EVENT_BUFFER 65536    // byte letti a ogni read degli eventi inotify
+
+
+// Tipo di un'entry: lo stat di un percorso oppure la lista ordinata di una directory
+typedef enum
+{
+    METACACHE_STAT = 0,
+    METACACHE_LIST = 1
+} metacache_kind_t;
+
+
+// Directory osservata con inotify: gli eventi sulle sue voci invalidano le entry che ne dipendono
+typedef struct
+{
+    int wd;                         // watch descriptor restituito da inotify_add_watch
+    char *path;                     // percorso della directory (chiave normalizzata)
+    int refs;                       // entry (e letture in corso) che dipendono dalla directory
+} metacache_watch_t;
+
+
+// Entry della cache. Tutti i campi sono protetti dal mutex della cache.
+typedef struct metacache_entry
+{
+    char *key;                      // percorso normalizzato
+    metacache_kind_t kind;          // stat o lista
+    unsigned int bucket;            // bucket della tabella hash
+    int error;                      // METACACHE_STAT: 0 oppure l'errno di stat (percorso inesistente)
+    struct stat statbuf;            // METACACHE_STAT: informazioni sul percorso
+    list_t list;                    // METACACHE_LIST: voci ordinate per nome
+    size_t bytes;                   // memoria occupata dall'entry
+    metacache_watch_t *watch;       // directory osservata da cui dipende l'entry
+    struct metacache_entry *next;   // entry successiva nella catena del bucket
+    struct metacache_entry *lru_prev;   // entry usata più di recente
+    struct metacache_entry *lru_next;   // entry usata meno di recente
+} metacache_entry_t;
+
+int metacache_init(size_t budget);
+int metacache_list(const char *path, list_t *list);
+int metacache_stat(const char *path, struct stat *statbuf);
+void metacache_invalidate(const char *path);
+void metacache_stats(unsigned long long *hits, unsigned long long *misses);
+
+#endif // MY_FT_CACHE_H
@@ -0,0 +1,253 @@
+// CHECKSUM
+
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "myFTchecksum.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>      // istruzione crc32 di SSE4.2 (scelta all'avvio se la CPU la supporta)
+#define CRC32C_X86 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u         // polinomio di Castagnoli in forma riflessa
+#define CRC32C_STRIPE 2048              // byte di ciascuno dei tre flussi calcolati in parallelo con SSE4.2
+
+
+// Aggiornamento del registro del CRC (senza le inversioni iniziale e finale)
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const unsigned char *p, size_t len);
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len);
+static uint32_t crc32c_table[8][256];   // tabelle per l'elaborazione di 8 byte alla volta (slicing-by-8)
+static crc32c_fn crc32c_update = crc32c_sw;
+static const char *crc32c_name = "slicing-by-8";
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+
+
+/**
+ * Aggiorna il registro del CRC con slicing-by-8: una lettura da ciascuna delle 8 tabelle ogni 8 byte
+ * invece di 8 passi dipendenti.
+ */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len >= 8) {
+        uint32_t low = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc32c_table[7][low & 0xFF] ^ crc32c_table[6][(low >> 8) & 0xFF] ^
+              crc32c_table[5][(low >> 16) & 0xFF] ^ crc32c_table[4][low >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^ crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+
+
+#ifdef CRC32C_X86
+static uint32_t crc32c_shift_table[4][256];     // effetto di CRC32C_STRIPE byte nulli su ciascun byte del registro
+
+
+
+/**
+ * Aggiorna il registro del CRC con l'istruzione crc32 di SSE4.2, 8 byte alla volta.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42_serial(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t c = crc;
+
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+
+
+/**
+ * Porta il registro del CRC avanti di CRC32C_STRIPE byte nulli: il registro è lineare, quindi basta la
+ * somma (xor) del contributo di ciascuno dei suoi 4 byte.
+ */
+static inline uint32_t crc32c_shift(uint32_t crc)
+{
+    return crc32c_shift_table[0][crc & 0xFF] ^ crc32c_shift_table[1][(crc >> 8) & 0xFF] ^
+           crc32c_shift_table[2][(crc >> 16) & 0xFF] ^ crc32c_shift_table[3][crc >> 24];
+}
+
+
+
+/**
+ * Aggiorna il registro del CRC con SSE4.2 su tre flussi indipendenti. L'istruzione crc32 ha una latenza
+ * di 3 cicli ma ne può iniziare una per ciclo: tre tratti consecutivi da CRC32C_STRIPE byte vengono
+ * calcolati in parallelo (i due successivi partendo da 0) e poi ricombinati, perché il CRC di A seguito
+ * da B è il CRC di A portato avanti di |B| byte nulli, xor il CRC di B.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len >= 3 * CRC32C_STRIPE)
+    {
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        for (size_t i = 0; i < CRC32C_STRIPE; i += 8) {
+            uint64_t v0, v1, v2;
+            memcpy(&v0, p + i, sizeof(v0));
+            memcpy(&v1, p + CRC32C_STRIPE + i, sizeof(v1));
+            memcpy(&v2, p + 2 * CRC32C_STRIPE + i, sizeof(v2));
+            c0 = _mm_crc32_u64(c0, v0);
+            c1 = _mm_crc32_u64(c1, v1);
+            c2 = _mm_crc32_u64(c2, v2);
+        }
+        crc = crc32c_shift((uint32_t)c0) ^ (uint32_t)c1;
+        crc = crc32c_shift(crc) ^ (uint32_t)c2;
+        p += 3 * CRC32C_STRIPE;
+        len -= 3 * CRC32C_STRIPE;
+    }
+    return crc32c_sse42_serial(crc, p, len);
+}
+#endif
+
+
+
+/**
+ * Costruisce le tabelle del CRC32C (la prima è la tabella classica byte per byte, le altre danno il
+ * contributo di un byte che si trova 1..7 posizioni più indietro nel blocco di 8 byte) e sceglie la
+ * versione più veloce per la CPU corrente.
+ */
+static void crc32c_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
+        }
+    }
+
+#ifdef CRC32C_X86
+    if (__builtin_cpu_supports("sse4.2")) {
+        static const unsigned char zeros[CRC32C_STRIPE];
+        for (int k = 0; k < 4; k++) {
+            for (uint32_t b = 0; b < 256; b++) {
+                crc32c_shift_table[k][b] = crc32c_sse42_serial(b << (8 * k), zeros, sizeof(zeros));
+            }
+        }
+        crc32c_update = crc32c_sse42;
+        crc32c_name = "sse4.2";
+    }
+#endif
+}
+
+
+
+/**
+ * Aggiorna un CRC32C (Castagnoli) con nuovi dati, con l'istruzione crc32 di SSE4.2 se la CPU la supporta.
+ *
+ * @param crc Il CRC dei dati precedenti (0 all'inizio).
+ * @param data I dati.
+ * @param len I byte dei dati.
+ * @return Il CRC aggiornato.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_update(~crc, (const unsigned char *)data, len);
+}
+
+
+
+/**
+ * Aggiorna un CRC32C con la sola versione a tabelle (per confrontarla con quella scelta per la CPU).
+ */
+uint32_t crc32c_scalar(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_sw(~crc, (const unsigned char *)data, len);
+}
+
+
+
+/**
+ * Restituisce il nome della versione del CRC32C scelta per la CPU corrente.
+ */
+const char* crc32c_implementation(void)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return crc32c_name;
+}
+
+
+
+/**
+ * Calcola il CRC32C di un tratto di file leggendolo con pread (la posizione del file non cambia).
+ *
+ * @param fd Il file descriptor del file.
+ * @param offset La posizione del primo byte.
+ * @param len I byte del tratto.
+ * @param crc Puntatore dove memorizzare il CRC.
+ * @return 0 in caso di successo, -1 in caso di errore o se il file finisce prima del tratto (errno = EIO).
+ */
+int file_crc32c(int fd, off_t offset, size_t len, uint32_t *crc)
+{
+    uint32_t value = 0;
+
+    if (file_crc32c_update(fd, offset, len, &value) < 0) {
+        return -1;
+    }
+    *crc = value;
+    return 0;
+}
+
+
+
+/**
+ * Aggiorna un CRC32C con un tratto di file letto con pread (usata per i dati passati con sendfile o
+ * splice, che il processo non vede: il tratto appena trasferito è ancora nel page cache).
+ *
+ * @param fd Il file descriptor del file.
+ * @param offset La posizione del primo byte.
+ * @param len I byte del tratto.
+ * @param crc Il CRC dei dati precedenti, aggiornato.
+ * @return 0 in caso di successo, -1 in caso di errore o se il file finisce prima del tratto (errno = EIO).
+ */
+int file_crc32c_update(int fd, off_t offset, size_t len, uint32_t *crc)
+{
+    unsigned char buffer[CHECKSUM_BUFFER_SIZE];
+    uint32_t value = *crc;
+
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer), offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        value = crc32c(value, buffer, n);
+        offset += n;
+        len -= n;
+    }
+    *crc = value;
+    return 0;
+}
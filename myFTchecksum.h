@@ -0,0 +1,17 @@
+#ifndef MY_FT_CHECKSUM_H
+#define MY_FT_CHECKSUM_H
+
+#include <stdint.h>         // per uint32_t
+#include <stddef.h>         // per size_t
+#include <sys/types.h>      // per off_t
+
+#define CHECKSUM_BUFFER_SIZE 65536      // byte letti dal file a ogni passo del calcolo di un checksum
+
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+uint32_t crc32c_scalar(uint32_t crc, const void *data, size_t len);
+const char* crc32c_implementation(void);
+int file_crc32c(int fd, off_t offset, size_t len, uint32_t *crc);
+int file_crc32c_update(int fd, off_t offset, size_t len, uint32_t *crc);
+
+#endif // MY_FT_CHECKSUM_H
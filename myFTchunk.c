@@ -0,0 +1,301 @@
+// SUDDIVISIONE DEI FILE IN CHUNK DEFINITI DAL CONTENUTO
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>      // per htonl e ntohl
+#include "myFTchunk.h"
+#include "myFTprotocol.h"   // per ft_put_u64 e ft_get_u64
+
+// maschere della normalizzazione: prima della dimensione media servono 2 bit a zero in più (confine meno
+// probabile), dopo 2 in meno; i bit si prendono in alto, dove l'hash dipende dagli ultimi 64 byte
+#define CHUNK_MASK_SMALL (((1ULL << 20) - 1) << 44)
+#define CHUNK_MASK_LARGE (((1ULL << 16) - 1) << 48)
+
+
+static uint64_t gear[256];                              // valore pseudocasuale di ogni byte
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+
+
+/**
+ * Genera la tabella gear con splitmix64 a partire da un seme fisso: client e server devono ottenere
+ * la stessa tabella, altrimenti i confini dei chunk non coincidono.
+ */
+static void gear_init(void)
+{
+    uint64_t seed = 0x6d7946542d636463ULL;     // "myFT-cdc"
+
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+
+
+/**
+ * Trova il confine del primo chunk dei dati.
+ *
+ * @param data I dati a partire dall'inizio del chunk.
+ * @param len I byte disponibili (il chunk non va oltre).
+ * @return La lunghezza del chunk: tra CHUNK_MIN_SIZE e CHUNK_MAX_SIZE, oppure len se è minore.
+ */
+size_t chunk_cut(const unsigned char *data, size_t len)
+{
+    uint64_t hash = 0;
+    size_t normal = CHUNK_AVG_SIZE;
+    size_t i = CHUNK_MIN_SIZE;
+
+    pthread_once(&gear_once, gear_init);
+
+    if (len <= CHUNK_MIN_SIZE) {
+        return len;
+    }
+    if (len > CHUNK_MAX_SIZE) {
+        len = CHUNK_MAX_SIZE;
+    }
+    if (normal > len) {
+        normal = len;
+    }
+
+    // i primi CHUNK_MIN_SIZE byte non vengono nemmeno esaminati
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & CHUNK_MASK_SMALL)) {
+            return i + 1;
+        }
+    }
+    for (; i < len; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & CHUNK_MASK_LARGE)) {
+            return i + 1;
+        }
+    }
+    return len;
+}
+
+
+
+/**
+ * Aggiunge un chunk al manifest, facendo crescere l'array secondo necessità.
+ *
+ * @param manifest Il manifest.
+ * @param capacity Puntatore alla capacità allocata dell'array dei chunk.
+ * @param data Il contenuto del chunk.
+ * @param len I byte del chunk.
+ * @return 0 in caso di successo, -1 se la memoria non basta.
+ */
+static int manifest_append(manifest_t *manifest, size_t *capacity, const unsigned char *data, size_t len)
+{
+    if (manifest->count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        chunk_ref_t *chunks = (chunk_ref_t *)realloc(manifest->chunks, new_capacity * sizeof(chunk_ref_t));
+        if (chunks == NULL) {
+            return -1;
+        }
+        manifest->chunks = chunks;
+        *capacity = new_capacity;
+    }
+
+    chunk_ref_t *chunk = &manifest->chunks[manifest->count++];
+    chunk->length = (uint32_t)len;
+    sha256(data, len, chunk->hash);
+    manifest->size += len;
+    return 0;
+}
+
+
+
+/**
+ * Suddivide un file in chunk e ne calcola gli hash. Il file viene letto dall'inizio con pread,
+ * senza spostare la posizione del file descriptor.
+ *
+ * @param fd Il file descriptor del file.
+ * @param manifest Il manifest da riempire (da liberare con manifest_free).
+ * @return 0 in caso di successo, -1 in caso di errore (errno indica il motivo).
+ */
+int manifest_build(int fd, manifest_t *manifest)
+{
+    size_t capacity = 0;
+    size_t start = 0, end = 0;
+    off_t offset = 0;
+    int eof = 0;
+
+    memset(manifest, 0, sizeof(*manifest));
+    unsigned char *buffer = (unsigned char *)malloc(CHUNK_READ_SIZE);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    while (1)
+    {
+        // servono almeno CHUNK_MAX_SIZE byte davanti perché il confine non dipenda da dove finisce la lettura
+        if (!eof && end - start < CHUNK_MAX_SIZE)
+        {
+            memmove(buffer, buffer + start, end - start);
+            end -= start;
+            start = 0;
+            while (!eof && end < CHUNK_READ_SIZE) {
+                ssize_t n = pread(fd, buffer + end, CHUNK_READ_SIZE - end, offset);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    goto fail;
+                }
+                eof = (n == 0);
+                end += n;
+                offset += n;
+            }
+        }
+        if (start == end) {
+            break;
+        }
+
+        size_t len = chunk_cut(buffer + start, end - start);
+        if (manifest_append(manifest, &capacity, buffer + start, len) < 0) {
+            goto fail;
+        }
+        start += len;
+    }
+
+    free(buffer);
+    return 0;
+
+fail:
+    free(buffer);
+    manifest_free(manifest);
+    return -1;
+}
+
+
+
+/**
+ * Codifica un manifest nel formato inviato sul filo.
+ *
+ * @param manifest Il manifest.
+ * @param len Puntatore dove memorizzare i byte del manifest codificato.
+ * @return Il manifest codificato (da liberare con free) oppure NULL se la memoria non basta.
+ */
+unsigned char* manifest_encode(const manifest_t *manifest, size_t *len)
+{
+    *len = MANIFEST_HEADER_SIZE + (size_t)manifest->count * MANIFEST_ENTRY_SIZE;
+    unsigned char *buffer = (unsigned char *)malloc(*len);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    ft_put_u64(buffer, manifest->size);
+    uint32_t count = htonl(manifest->count);
+    memcpy(buffer + 8, &count, 4);
+
+    unsigned char *p = buffer + MANIFEST_HEADER_SIZE;
+    for (uint32_t i = 0; i < manifest->count; i++) {
+        uint32_t length = htonl(manifest->chunks[i].length);
+        memcpy(p, &length, 4);
+        memcpy(p + 4, manifest->chunks[i].hash, SHA256_DIGEST_SIZE);
+        p += MANIFEST_ENTRY_SIZE;
+    }
+    return buffer;
+}
+
+
+
+/**
+ * Decodifica e controlla un manifest ricevuto: il numero di chunk deve corrispondere ai byte ricevuti,
+ * ogni chunk deve avere una lunghezza tra 1 e CHUNK_MAX_SIZE e la somma delle lunghezze deve essere la
+ * dimensione del file.
+ *
+ * @param buffer Il manifest codificato.
+ * @param len I byte del manifest codificato.
+ * @param manifest Il manifest da riempire (da liberare con manifest_free).
+ * @return 0 se il manifest è valido, -1 altrimenti (errno EINVAL o ENOMEM).
+ */
+int manifest_decode(const unsigned char *buffer, size_t len, manifest_t *manifest)
+{
+    uint32_t count;
+    uint64_t total = 0;
+
+    memset(manifest, 0, sizeof(*manifest));
+    if (len < MANIFEST_HEADER_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&count, buffer + 8, 4);
+    count = ntohl(count);
+    if ((len - MANIFEST_HEADER_SIZE) / MANIFEST_ENTRY_SIZE != count || (len - MANIFEST_HEADER_SIZE) % MANIFEST_ENTRY_SIZE != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    manifest->size = ft_get_u64(buffer);
+    manifest->count = count;
+    manifest->chunks = (chunk_ref_t *)malloc((count ? count : 1) * sizeof(chunk_ref_t));
+    if (manifest->chunks == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    const unsigned char *p = buffer + MANIFEST_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t length;
+        memcpy(&length, p, 4);
+        manifest->chunks[i].length = ntohl(length);
+        memcpy(manifest->chunks[i].hash, p + 4, SHA256_DIGEST_SIZE);
+        total += manifest->chunks[i].length;
+        if (manifest->chunks[i].length == 0 || manifest->chunks[i].length > CHUNK_MAX_SIZE) {
+            break;
+        }
+        p += MANIFEST_ENTRY_SIZE;
+    }
+    if (p != buffer + len || total != manifest->size) {
+        manifest_free(manifest);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Calcola l'identità del contenuto descritto da un manifest: lo SHA-256 della dimensione (8 byte
+ * big-endian) seguita dagli hash dei chunk.
+ *
+ * @param manifest Il manifest.
+ * @param id Il digest di SHA256_DIGEST_SIZE byte.
+ */
+void manifest_id(const manifest_t *manifest, unsigned char id[SHA256_DIGEST_SIZE])
+{
+    sha256_t ctx;
+    unsigned char size[8];
+
+    ft_put_u64(size, manifest->size);
+    sha256_init(&ctx);
+    sha256_update(&ctx, size, sizeof(size));
+    for (uint32_t i = 0; i < manifest->count; i++) {
+        sha256_update(&ctx, manifest->chunks[i].hash, SHA256_DIGEST_SIZE);
+    }
+    sha256_final(&ctx, id);
+}
+
+
+
+/**
+ * Libera i chunk di un manifest.
+ *
+ * @param manifest Il manifest.
+ */
+void manifest_free(manifest_t *manifest)
+{
+    free(manifest->chunks);
+    manifest->chunks = NULL;
+    manifest->count = 0;
+    manifest->size = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef MY_FT_CHUNK_H
+#define MY_FT_CHUNK_H
+
+#include <stdint.h>         // per i tipi a dimensione fissa
+#include <stddef.h>         // per size_t
+#include "myFTsha256.h"     // hash dei chunk e identità del contenuto
+
+// Suddivisione di un file in chunk definiti dal contenuto (FastCDC con hash "gear"): i confini dipendono
+// solo dai byte vicini, quindi una modifica locale cambia pochi chunk e tutti gli altri restano identici.
+// Il manifest di un file è la sua dimensione seguita da lunghezza e SHA-256 di ogni chunk, in ordine:
+//
+//   offset  dim  campo
+//   0       8    dimensione del file
+//   8       4    numero di chunk
+//   12      36   per ogni chunk: lunghezza (4 byte) e SHA-256 (32 byte)
+//
+// Tutti i campi sono in ordine di rete (big-endian). L'identità del contenuto è lo SHA-256 della dimensione
+// seguita dagli hash dei chunk: chi riceve il manifest la ricalcola senza dover leggere il file.
+
+#define CHUNK_MIN_SIZE (64 << 10)               // nessun confine prima di 64 KiB
+#define CHUNK_AVG_SIZE (256 << 10)              // dimensione media attesa
+#define CHUNK_MAX_SIZE (1 << 20)                // confine forzato a 1 MiB
+#define CHUNK_READ_SIZE (4 * CHUNK_MAX_SIZE)    // byte letti dal file a ogni passo della suddivisione
+#define MANIFEST_HEADER_SIZE 12                 // dimensione e numero di chunk
+#define MANIFEST_ENTRY_SIZE (4 + SHA256_DIGEST_SIZE)    // lunghezza e hash di un chunk
+#define MANIFEST_MAX_SIZE (16 << 20)            // manifest più grande accettato (file fino a ~100 GiB di chunk medi)
+
+
+// Un chunk del file
+typedef struct
+{
+    uint32_t length;                            // byte del chunk
+    unsigned char hash[SHA256_DIGEST_SIZE];     // SHA-256 del contenuto
+} chunk_ref_t;
+
+
+// Manifest decodificato
+typedef struct
+{
+    uint64_t size;          // dimensione del file (somma delle lunghezze dei chunk)
+    uint32_t count;         // numero di chunk
+    chunk_ref_t *chunks;    // chunk nell'ordine del file
+} manifest_t;
+
+size_t chunk_cut(const unsigned char *data, size_t len);
+int manifest_build(int fd, manifest_t *manifest);
+unsigned char* manifest_encode(const manifest_t *manifest, size_t *len);
+int manifest_decode(const unsigned char *buffer, size_t len, manifest_t *manifest);
+void manifest_id(const manifest_t *manifest, unsigned char id[SHA256_DIGEST_SIZE]);
+void manifest_free(manifest_t *manifest);
+
+#endif // MY_FT_CHUNK_H
@@ -1,6 +1,15 @@
 //CLIENT
 
 #include "myFTclient.h"
+#include "myFTbatch.h"
+#include "myFTstream.h"
+#include "myFTresume.h"
+#include "myFTdedup.h"
+#include "myFTsync.h"
+
+transfer_mode_t client_transfer_mode = TRANSFER_ZEROCOPY;   // modalità di invio/ricezione dei file (opzione -t)
+int client_legacy_protocol = 0;                             // 1 per usare il protocollo senza intestazione binaria (opzione -P legacy)
+int client_compress_codec = CODEC_NONE;                     // compressione dei dati sul filo (opzione -z, CODEC_NONE la disattiva)
 
 /**
  * Restituisce il numero di byte disponibili sul dispositivo specificato dal percorso.
@@ -27,22 +36,28 @@ unsigned long long int available_bytes(const char *path)
  *
  * @param path - Il percorso del file locale dove scrivere i dati.
  * @param client_sock - Il socket connesso al server dal quale ricevere i dati.
+ * @param length - La dimensione annunciata del file, -1 se i dati arrivano fino alla chiusura della connessione.
+ * @param keep_in_sync - 1 per scartare in caso di errore i byte annunciati e non ricevuti (sessioni), così la
+ *                       connessione resta allineata alla risposta successiva.
+ * @param trailer - 1 se i dati sono seguiti dal loro CRC32C (FT_FLAG_TRAILER), da confrontare con quello calcolato.
+ * @return 0 se il file è stato ricevuto interamente, -1 in caso di errore.
  */
-void write_file_in_dir(const char *path, int client_sock) 
+int write_file_in_dir(const char *path, int client_sock, long long length, int keep_in_sync, int trailer) 
 {
-    ssize_t bytes_received;         // definisce una variabile per memorizzare il numero di byte ricevuti
-    char buffer[BUFFER_SIZE];       // definisce un buffer di dimensione BUFFER_SIZE per la lettura dei dati dal socket
+    transfer_stats_t stats;         // byte ricevuti e chiamate di sistema eseguite
+    uint32_t crc;                   // CRC32C dei dati ricevuti
+    memset(&stats, 0, sizeof(stats));
     
-    // O_WRONLY: apertura in modalità scrittura
+    // O_RDWR: apertura in scrittura, e in lettura per il checksum dei byte ricevuti con splice
     // O_CREAT: crea il file se non esiste
     // O_TRUNC: tronca il file a 0 byte se esiste già
     // 0644: permessi del file (lettura e scrittura per il proprietario, solo lettura per gli altri)
-    int file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int file_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
     
     // controlla se il file è stato aperto correttamente
     if (file_fd < 0) {
         fprintf(stderr, "Errore apertura file: %s\n", strerror(errno));    // stampa un messaggio di errore se l'apertura del file fallisce
-        return;                                                            // termina la funzione in caso di errore
+        goto discard;                                                      // termina la funzione in caso di errore
     }
 
     // controllo se ho abbastanza memoria per salvare il file
@@ -53,35 +68,95 @@ void write_file_in_dir(const char *path, int client_sock)
     if (bytes_on_device == 0) {
         fprintf(stderr, "Errore nel controllo dello spazio di memoria disponibile sul dispositivo: \n");
         close(file_fd);
-        return;
+        goto discard;
     }
 
-    // ciclo per ricevere dati dal socket e scriverli nel file
-    while ((bytes_received = recv(client_sock, buffer, sizeof(buffer), 0)) > 0) 
-    {
-        bytes_on_device -= bytes_received;
-
-        // ERRORE: memoria piena
-        if (bytes_on_device < 0){
+    // riceve i dati dal socket e li scrive nel file (splice in modalità zerocopy, recv/write altrimenti)
+    if (recv_file(client_sock, file_fd, length, bytes_on_device, client_transfer_mode, &stats, trailer ? &crc : NULL) < 0) {
+        if (errno == ENOSPC) {
             fprintf(stderr, "Memoria piena: \n");
-            close(file_fd);
-            return;
+        } else {
+            fprintf(stderr, "Errore durante la ricezione dei dati: %s\n", strerror(errno));
         }
+        close(file_fd);
+        goto discard;
+    }
+    close(file_fd);
 
-        // scrivo i dati che ricevo dal socket nel file identificato dal file descriptor
-        if (write(file_fd, buffer, bytes_received) < 0) {
-            fprintf(stderr, "Errore scrittura dati: %s\n", strerror(errno));
-            close(file_fd);
-            return;
-        }
+    return trailer ? check_trailer(client_sock, crc) : 0;
+
+discard:
+    if (keep_in_sync && length >= 0 && stats.bytes < (unsigned long long)length) {
+        recv_discard(client_sock, length - (long long)stats.bytes + (trailer ? FT_TRAILER_SIZE : 0));
     }
+    return -1;
+}
 
-    // controlla se si è verificato un errore durante la ricezione dei dati
-    if (bytes_received < 0) {
-        fprintf(stderr, "Errore durante la ricezione dei dati: %s\n", strerror(errno));
+
+
+/**
+ * Riceve il CRC32C che il server invia dopo i dati (FT_FLAG_TRAILER) e lo confronta con quello calcolato.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param crc - Il CRC32C dei dati ricevuti.
+ * @return 0 se coincidono, -1 se il file è danneggiato o in caso di errore.
+ */
+int check_trailer(int client_sock, uint32_t crc)
+{
+    uint32_t expected;
+
+    if (ft_recv_trailer(client_sock, &expected) < 0) {
+        fprintf(stderr, "Errore nella ricezione del checksum dei dati: %s\n", strerror(errno));
+        return -1;
+    }
+    if (expected != crc) {
+        fprintf(stderr, "Errore: il file ricevuto è danneggiato (checksum %08x invece di %08x)\n", crc, expected);
+        return -1;
+    }
+    printf("CLIENT: Checksum dei dati verificato (%08x)\n", crc);
+    return 0;
+}
+
+
+
+/**
+ * Riceve dal server i dati di un file in frame compressi e li scrive nel file locale: un thread decomprime
+ * e scrive mentre questo riceve i frame successivi.
+ *
+ * @param path - Il percorso del file locale dove scrivere i dati.
+ * @param client_sock - Il socket connesso al server dal quale ricevere i dati.
+ * @param length - La dimensione annunciata del file.
+ * @param trailer - 1 se i dati sono seguiti dal CRC32C dei byte del file (FT_FLAG_TRAILER).
+ * @return 0 se il file è stato ricevuto interamente, -1 in caso di errore.
+ */
+int write_compressed_file(const char *path, int client_sock, long long length, int trailer)
+{
+    compress_stats_t stats;         // byte del file, byte ricevuti e codec
+
+    int file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_fd < 0) {
+        fprintf(stderr, "Errore apertura file: %s\n", strerror(errno));
+        return -1;
+    }
+    unsigned long long int bytes_on_device = available_bytes(path);
+    if (bytes_on_device == 0) {
+        fprintf(stderr, "Errore nel controllo dello spazio di memoria disponibile sul dispositivo: \n");
+        close(file_fd);
+        return -1;
+    }
+
+    if (recv_compressed(client_sock, file_fd, length, bytes_on_device, &stats) < 0) {
+        if (errno == ENOSPC) {
+            fprintf(stderr, "Memoria piena: \n");
+        } else {
+            fprintf(stderr, "Errore durante la ricezione dei dati: %s\n", strerror(errno));
+        }
+        close(file_fd);
+        return -1;
     }
-    
     close(file_fd);
+    printf("CLIENT: Ricevuti %llu byte in %llu byte compressi (%s)\n", stats.bytes, stats.wire_bytes, compress_codec_name(stats.codec));
+    return trailer ? check_trailer(client_sock, stats.crc) : 0;
 }
 
 
@@ -124,9 +199,9 @@ void divide_dirpath_from_filename(const char *input, char **first_part, char **s
 
 
 /**
- * Crea una directory se non esiste.
+ * Crea la directory che conterrà un file, comprese le directory intermedie, se non esiste.
  *
- * @param dir - Il percorso della directory da creare.
+ * @param dir - Il percorso del file di cui creare la directory.
  * @return 1 se la directory esiste o è stata creata con successo, altrimenti 0.
  */
 int create_dir(const char *dir) 
@@ -145,9 +220,18 @@ int create_dir(const char *dir)
         //controlla se l'errore è 'ENOENT', che significa che il file o directory non esiste
         if (errno == ENOENT) 
         {
-            // la directory non esiste, quindi creiamola
+            // la directory non esiste, quindi creiamola insieme a quelle intermedie mancanti
+            // (EEXIST: un'altra connessione della stessa copia l'ha appena creata)
+            for (char *slash = strchr(first_part + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+                *slash = '\0';
+                int created = (mkdir(first_part, 0777) == 0 || errno == EEXIST);
+                *slash = '/';
+                if (!created) {
+                    break;
+                }
+            }
             // tenta di creare la directory con permessi 0777 (lettura, scrittura, esecuzione per tutti)
-            if (mkdir(first_part, 0777) == -1) { 
+            if (mkdir(first_part, 0777) == -1 && errno != EEXIST) { 
                 fprintf(stderr, "Errore nella creazione della directory: %s\n", strerror(errno));
             } else {
                 successful =  1;
@@ -205,29 +289,48 @@ void send_filepath(int client_sock, const char *path)
  *
  * @param fd - Il file descriptor del file da leggere.
  * @param client_sock - Il socket connesso al server.
+ * @param length - I byte da inviare (dimensione annunciata al server), -1 per inviare fino alla fine del file.
+ * @param trailer - 1 per far seguire i dati dal loro CRC32C (FT_FLAG_TRAILER).
+ * @return 0 se il file è stato inviato interamente, -1 in caso di errore.
  */
-void send_data(int fd, int client_sock) 
+int send_data(int fd, int client_sock, long long length, int trailer) 
 {
-    char buffer[BUFFER_SIZE];    // buffer per la lettura dei dati dal file
-    ssize_t bytes_read;          // variabile per memorizzare il numero di byte letti dal file
+    transfer_stats_t stats;      // byte inviati e chiamate di sistema eseguite
+    uint32_t crc;                // CRC32C dei dati inviati
 
-    // legge il contenuto del file e lo invia al server in loop
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) 
-    {
-        // invia i dati letti al server tramite il socket del client
-        if (send(client_sock, buffer, bytes_read, 0) < 0) {
+    // invia il contenuto del file al server (sendfile in modalità zerocopy, read/send altrimenti)
+    if (send_file(fd, client_sock, length, client_transfer_mode, &stats, trailer ? &crc : NULL) < 0 ||
+        (trailer && ft_send_trailer(client_sock, crc) < 0)) {
             fprintf(stderr, "Errore durante l' invio dei dati del file al server: %s\n", strerror(errno));
-            close(fd);
-            return;
-        }
+            return -1;
     }
+    printf("CLIENT: Dati del file inviati con successo al server\n");
+    return 0;
+}
 
-    // controlla se si è verificato un errore durante la lettura del file
-    if (bytes_read < 0) {
-            fprintf(stderr, "Errore durante la lettura del file: %s\n", strerror(errno));
-    } else {
-            printf("CLIENT: Dati del file inviati con successo al server\n");
+
+
+/**
+ * Invia i dati di un file al server in frame compressi: un thread comprime mentre questo invia i frame pronti.
+ *
+ * @param fd - Il file descriptor del file da leggere.
+ * @param client_sock - Il socket connesso al server.
+ * @param length - I byte da inviare (dimensione annunciata al server).
+ * @param codecs - I codec accettati dal server.
+ * @param trailer - 1 per far seguire i dati dal CRC32C dei byte del file (FT_FLAG_TRAILER).
+ * @return 0 se il file è stato inviato interamente, -1 in caso di errore.
+ */
+int send_compressed_data(int fd, int client_sock, long long length, unsigned codecs, int trailer)
+{
+    compress_stats_t stats;      // byte del file, byte inviati, codec scelto e CRC32C
+
+    if (send_compressed(fd, client_sock, length, codecs, client_compress_codec, &stats) < 0 ||
+        (trailer && ft_send_trailer(client_sock, stats.crc) < 0)) {
+        fprintf(stderr, "Errore durante l' invio dei dati del file al server: %s\n", strerror(errno));
+        return -1;
     }
+    printf("CLIENT: Inviati %llu byte in %llu byte compressi (%s)\n", stats.bytes, stats.wire_bytes, compress_codec_name(stats.codec));
+    return 0;
 }
 
 
@@ -267,7 +370,7 @@ void write_mode(int client_sock, const char *from_path)
     }
 
     // invia i dati del file al server utilizzando il file descriptor aperto e il socket del client
-    send_data(file_fd, client_sock);   
+    send_data(file_fd, client_sock, -1, 0);   
     
     // chiude il file descriptor
     close(file_fd);
@@ -288,7 +391,7 @@ void read_mode(int client_sock, const char *destination_path)
     
     //se la directory esiste o è stata creata con successo, scrive il file nella directory
     if (is_dir) {
-        write_file_in_dir(destination_path, client_sock);
+        write_file_in_dir(destination_path, client_sock, -1, 0, 0);
     }
 }
 
@@ -332,6 +435,565 @@ void list_mode(int client_sock)
 
 
 
+/**
+ * Riceve la risposta del server a una richiesta con intestazione binaria e ne stampa l'eventuale errore.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param response - L'intestazione della risposta ricevuta.
+ * @return 0 se l'esito è FT_STATUS_OK o FT_STATUS_CONTINUE, -1 altrimenti.
+ */
+int recv_response(int client_sock, ft_header_t *response)
+{
+    if (ft_recv_header(client_sock, response) < 0) {
+        fprintf(stderr, "Errore nella ricezione della risposta del server: %s\n", strerror(errno));
+        return -1;
+    }
+    if (response->status != FT_STATUS_OK && response->status != FT_STATUS_CONTINUE) {
+        fprintf(stderr, "Errore dal server: %s\n", ft_status_message(response->status));
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Invia un file al server con l'intestazione binaria: la richiesta annuncia la dimensione del file, i dati
+ * vengono inviati solo dopo il via libera del server e al termine si riceve l'esito della scrittura.
+ * Se la dimensione non è nota (es. una pipe) i dati vanno fino alla chiusura del lato di scrittura.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param from_path - Il percorso del file locale da inviare.
+ * @param destination_path - Il percorso remoto in cui scrivere il file.
+ * @return 0 se il server ha salvato il file, -1 in caso di errore.
+ */
+int request_write(int client_sock, const char *from_path, const char *destination_path)
+{
+    struct stat statbuf;
+    ft_header_t response;
+
+    int file_fd = open(from_path, O_RDONLY);
+    if (file_fd < 0) {
+        fprintf(stderr, "Errore durante l' apertura del file: %s\n", strerror(errno));
+        return -1;
+    }
+
+    long long length = -1;
+    if (fstat(file_fd, &statbuf) == 0 && S_ISREG(statbuf.st_mode)) {
+        length = statbuf.st_size;
+    }
+
+    // con -z si propone di inviare i dati compressi: il server accetta riportando i codec nel via libera;
+    // con una dimensione nota i dati sono seguiti dal loro checksum, se il server lo riporta nel via libera
+    uint16_t flags = (client_compress_codec != CODEC_NONE && length > 0) ? FT_FLAG_COMPRESS : 0;
+    if (length >= 0) {
+        flags |= FT_FLAG_TRAILER;
+    }
+    if (ft_send_request(client_sock, 'w', flags, destination_path, length >= 0 ? (uint64_t)length : FT_LENGTH_UNKNOWN) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    printf("CLIENT: Richiesta di scrittura su '%s' inviata al server\n", destination_path);
+
+    // attende il via libera (FT_STATUS_CONTINUE) o l'errore, ad esempio spazio insufficiente
+    if (recv_response(client_sock, &response) < 0 || response.status != FT_STATUS_CONTINUE) {
+        close(file_fd);
+        return -1;
+    }
+
+    unsigned codecs = (flags & FT_FLAG_COMPRESS) ? compress_codecs(response.flags) : 0;
+    int trailer = (response.flags & FT_FLAG_TRAILER) != 0;
+    int sent = codecs ? send_compressed_data(file_fd, client_sock, length, codecs, trailer) : send_data(file_fd, client_sock, length, trailer);
+    close(file_fd);
+
+    // senza dimensione annunciata la fine dei dati è segnalata chiudendo il lato di scrittura
+    if (sent == 0 && length < 0) {
+        shutdown(client_sock, SHUT_WR);
+    }
+
+    // anche se l'invio è fallito il server potrebbe aver inviato il motivo (es. spazio esaurito)
+    if (recv_response(client_sock, &response) < 0 || sent < 0) {
+        return -1;
+    }
+    printf("CLIENT: Il server ha salvato il file\n");
+    return 0;
+}
+
+
+
+/**
+ * Riceve un file dal server con l'intestazione binaria: la risposta annuncia la dimensione del file, così
+ * lo spazio può essere controllato e preallocato prima di ricevere i dati e un file troncato viene riconosciuto.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param remote_path - Il percorso remoto del file da leggere.
+ * @param destination_path - Il percorso del file locale dove scrivere i dati ricevuti.
+ * @return 0 se il file è stato ricevuto interamente, -1 in caso di errore.
+ */
+int request_read(int client_sock, const char *remote_path, const char *destination_path)
+{
+    ft_header_t response;
+
+    // con -z il client annuncia i codec che accetta: il server decide se comprimere e se far seguire i dati dal checksum
+    uint16_t flags = (client_compress_codec != CODEC_NONE) ? compress_flags(client_compress_codec) : 0;
+    flags |= FT_FLAG_TRAILER;
+    if (ft_send_request(client_sock, 'r', flags, remote_path, 0) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        return -1;
+    }
+    printf("CLIENT: Richiesta di lettura di '%s' inviata al server\n", remote_path);
+
+    if (recv_response(client_sock, &response) < 0) {
+        return -1;
+    }
+    printf("CLIENT: Il server invia %llu byte\n", (unsigned long long)response.payload_len);
+
+    // crea la directory specificata se non esiste
+    if (!create_dir(destination_path)) {
+        return -1;
+    }
+    int trailer = (response.flags & FT_FLAG_TRAILER) != 0;
+    if ((flags & FT_FLAG_COMPRESS) && (response.flags & FT_FLAG_COMPRESS)) {
+        return write_compressed_file(destination_path, client_sock, (long long)response.payload_len, trailer);
+    }
+    return write_file_in_dir(destination_path, client_sock, (long long)response.payload_len, 0, trailer);
+}
+
+
+
+/**
+ * Chiede al server dimensione ed eventualmente checksum dei blocchi di un file ('i').
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param remote_path - Il percorso remoto del file.
+ * @param flags - I flag della richiesta (FT_FLAG_KEEP_ALIVE, FT_FLAG_PARTIAL, FT_FLAG_CHECKSUM).
+ * @param size - Puntatore dove memorizzare la dimensione del file.
+ * @param checksums - Puntatore dove memorizzare il CRC32C di ogni blocco completo (da liberare con free),
+ *                    NULL se non interessano.
+ * @param count - Puntatore dove memorizzare il numero di checksum.
+ * @return 0 in caso di successo, 1 se il file non esiste sul server, -1 in caso di errore.
+ */
+int request_info(int client_sock, const char *remote_path, uint16_t flags, unsigned long long *size, uint32_t **checksums, size_t *count)
+{
+    unsigned char info[FT_INFO_SIZE];
+    ft_header_t response;
+
+    if (ft_send_request(client_sock, 'i', flags, remote_path, 0) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        return -1;
+    }
+    if (ft_recv_header(client_sock, &response) < 0) {
+        fprintf(stderr, "Errore nella ricezione della risposta del server: %s\n", strerror(errno));
+        return -1;
+    }
+    if (response.status == FT_STATUS_NOT_FOUND) {
+        return 1;
+    }
+    if (response.status != FT_STATUS_OK) {
+        fprintf(stderr, "Errore dal server: %s\n", ft_status_message(response.status));
+        return -1;
+    }
+
+    uint64_t extra = response.payload_len - FT_INFO_SIZE;
+    if (response.payload_len < FT_INFO_SIZE || extra % 4 != 0 || recv_all(client_sock, info, sizeof(info)) < 0) {
+        fprintf(stderr, "Errore nella ricezione delle informazioni sul file '%s'\n", remote_path);
+        return -1;
+    }
+    *size = ft_get_u64(info);
+
+    if (checksums == NULL) {
+        return recv_discard(client_sock, (long long)extra) == 0 ? 0 : -1;
+    }
+
+    // un checksum per blocco completo, in ordine di rete
+    *count = extra / 4;
+    *checksums = (uint32_t *)malloc(extra > 0 ? extra : 1);
+    if (*checksums == NULL || recv_all(client_sock, *checksums, extra) < 0) {
+        fprintf(stderr, "Errore nella ricezione dei checksum del file '%s'\n", remote_path);
+        free(*checksums);
+        *checksums = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < *count; i++) {
+        (*checksums)[i] = ntohl((*checksums)[i]);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve la lista annunciata dalla risposta del server e la stampa sullo standard output.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param length - I byte della lista.
+ * @return 0 se la lista è stata ricevuta interamente, -1 in caso di errore.
+ */
+int recv_listing(int client_sock, uint64_t length)
+{
+    char buffer[BUFFER_SIZE];
+
+    uint64_t remaining = length;
+    while (remaining > 0)
+    {
+        size_t chunk = remaining < sizeof(buffer) ? (size_t)remaining : sizeof(buffer);
+        if (recv_all(client_sock, buffer, chunk) < 0) {
+            fprintf(stderr, "Errore nella ricezione dei dati dal server: %s\n", strerror(errno));
+            return -1;
+        }
+        // scrive i dati ricevuti sullo standard output
+        if (write(STDOUT_FILENO, buffer, chunk) < 0) {
+            fprintf(stderr, "Errore durante la scrittura dei dati sullo stdout: %s\n", strerror(errno));
+            return -1;
+        }
+        remaining -= chunk;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve i record di una lista binaria e li stampa come righe "ls -la" sullo standard output.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param length - I byte della lista.
+ * @param next - Puntatore dove memorizzare il cursore che precede i record di una pagina (NULL se la lista non è a pagine).
+ * @return 0 se la lista è stata ricevuta interamente, -1 in caso di errore.
+ */
+int recv_records(int client_sock, uint64_t length, uint64_t *next)
+{
+    list_entry_t entry;
+    char line[LIST_LINE_MAX];
+    size_t off = (next != NULL) ? LIST_CURSOR_SIZE : 0;
+    int decoded;
+
+    char *records = (char *)malloc(length > 0 ? length : 1);
+    if (records == NULL) {
+        fprintf(stderr, "Errore nel allocazione della memoria: %s\n", strerror(errno));
+        return -1;
+    }
+    if (recv_all(client_sock, records, length) < 0) {
+        fprintf(stderr, "Errore nella ricezione dei dati dal server: %s\n", strerror(errno));
+        free(records);
+        return -1;
+    }
+
+    decoded = (length >= off) ? 1 : -1;
+    if (next != NULL && decoded == 1) {
+        *next = ft_get_u64((const unsigned char *)records);
+    }
+    while (decoded == 1 && (decoded = list_decode(records, length, &off, &entry)) == 1) {
+        fwrite(line, 1, list_format_entry(&entry, line, sizeof(line)), stdout);
+    }
+    free(records);
+
+    if (decoded < 0) {
+        fprintf(stderr, "Errore, lista ricevuta dal server non valida\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve e stampa la lista di una directory remota con l'intestazione binaria. Il server invia un record
+ * per voce, che il client stampa come una riga di "ls -la". Con page > 0 la lista arriva a pagine di page
+ * voci, richieste una dopo l'altra sulla stessa connessione passando il cursore restituito dalla pagina
+ * precedente: il client inizia a stampare subito e nessuno dei due tiene in memoria l'intera directory
+ * (senza ordinamento, altrimenti il server deve comunque leggere tutte le voci per ogni pagina).
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param remote_path - Il percorso remoto da elencare.
+ * @param sorted - 1 per le voci ordinate per nome, 0 per l'ordine della directory.
+ * @param page - Le voci di ogni pagina (0 per l'intera lista in una risposta).
+ * @return 0 se la lista è stata ricevuta interamente, -1 in caso di errore.
+ */
+int request_list(int client_sock, const char *remote_path, int sorted, uint64_t page)
+{
+    ft_header_t response;
+    uint16_t flags = FT_FLAG_RECORDS | (sorted ? FT_FLAG_SORTED : 0) | (page > 0 ? FT_FLAG_RANGE | FT_FLAG_KEEP_ALIVE : 0);
+    uint64_t cursor = 0;
+
+    do
+    {
+        if (ft_send_range_request(client_sock, 'l', flags, remote_path, 0, cursor, page) < 0) {
+            fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+            return -1;
+        }
+
+        // un percorso inesistente è segnalato dall'esito della risposta
+        if (recv_response(client_sock, &response) < 0 || recv_records(client_sock, response.payload_len, page > 0 ? &cursor : NULL) < 0) {
+            return -1;
+        }
+    } while (page > 0 && cursor != LIST_CURSOR_END);
+
+    fflush(stdout);
+    return 0;
+}
+
+
+
+/**
+ * Chiede al server le sue metriche (opcode 's') e stampa il documento JSON ricevuto sullo standard output.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @return 0 se le metriche sono state ricevute interamente, -1 in caso di errore.
+ */
+int request_stats(int client_sock)
+{
+    ft_header_t response;
+
+    if (ft_send_request(client_sock, 's', 0, "", 0) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        return -1;
+    }
+    if (recv_response(client_sock, &response) < 0 || recv_listing(client_sock, response.payload_len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Thread che invia le richieste di una sessione senza attendere le risposte, tenendone in volo al massimo
+ * window. Le scritture usano FT_FLAG_NO_CONTINUE: i dati seguono subito la richiesta.
+ * Le richieste consecutive brevi (letture, liste e file fino a SESSION_SMALL_FILE byte) vengono accorpate
+ * negli stessi segmenti TCP con TCP_CORK, che si toglie quando la finestra è piena o le richieste sono finite.
+ *
+ * @param arg - La sessione (session_t*).
+ * @return NULL alla fine dell'invio.
+ */
+void *session_sender(void *arg)
+{
+    session_t *session = (session_t *)arg;
+    struct stat statbuf;
+    int corked = 0;
+
+    for (int i = 0; i < session->count; i++)
+    {
+        session_op_t *op = &session->ops[i];
+        int failed = 0;
+        int file_fd = -1;
+
+        // attende che si liberi un posto nella finestra
+        pthread_mutex_lock(&session->mutex);
+        while (session->sent - session->completed >= session->window && !session->aborted) {
+            pthread_cond_wait(&session->cond, &session->mutex);
+        }
+        int aborted = session->aborted;
+        pthread_mutex_unlock(&session->mutex);
+        if (aborted) {
+            break;
+        }
+
+        if (op->opz == 'w')
+        {
+            // la dimensione deve essere nota in anticipo: i file non regolari vengono saltati
+            file_fd = open(op->local_path, O_RDONLY);
+            if (file_fd < 0 || fstat(file_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+                fprintf(stderr, "Errore, '%s' non è un file regolare leggibile: operazione saltata\n", op->local_path);
+                op->skipped = 1;
+            } else {
+                op->size = statbuf.st_size;
+            }
+        }
+
+        int small = (op->opz != 'w' || op->size <= SESSION_SMALL_FILE);
+        if (!op->skipped && small != corked) {
+            setsockopt(session->sock, IPPROTO_TCP, TCP_CORK, &small, sizeof(small));
+            corked = small;
+        }
+
+        if (op->skipped) {
+            // nessuna richiesta da inviare
+        } else if (op->opz == 'w') {
+            failed = (ft_send_request(session->sock, 'w', FT_FLAG_KEEP_ALIVE | FT_FLAG_NO_CONTINUE, op->remote_path, op->size) < 0 ||
+                      send_data(file_fd, session->sock, op->size, 0) < 0);
+        } else {
+            failed = (ft_send_request(session->sock, op->opz, FT_FLAG_KEEP_ALIVE, op->remote_path, 0) < 0);
+        }
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+
+        pthread_mutex_lock(&session->mutex);
+        if (failed) {
+            fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+            session->aborted = 1;
+        } else {
+            session->sent++;
+        }
+        int flush = (session->sent - session->completed >= session->window || i == session->count - 1);
+        pthread_cond_broadcast(&session->cond);
+        pthread_mutex_unlock(&session->mutex);
+        if (failed) {
+            break;
+        }
+
+        // prima di attendere le risposte le richieste accorpate devono partire
+        if (corked && flush) {
+            corked = 0;
+            setsockopt(session->sock, IPPROTO_TCP, TCP_CORK, &corked, sizeof(corked));
+        }
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Esegue le operazioni di una sessione su un'unica connessione: un thread invia le richieste mentre
+ * il thread chiamante riceve le risposte, che il server invia nello stesso ordine.
+ *
+ * @param session - La sessione, con socket connessa e operazioni caricate.
+ * @return Il numero di operazioni fallite (anche in session->failed), -1 se non è stato possibile avviare la sessione.
+ */
+int run_session(session_t *session)
+{
+    pthread_t sender;
+    ft_header_t response;
+    int failed = 0;
+
+    pthread_mutex_init(&session->mutex, NULL);
+    pthread_cond_init(&session->cond, NULL);
+    session->sent = session->completed = session->aborted = 0;
+    session->bytes = 0;
+
+    // con più richieste brevi in volo non conviene attendere l'algoritmo di Nagle
+    int nodelay = 1;
+    setsockopt(session->sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (pthread_create(&sender, NULL, session_sender, session) != 0) {
+        fprintf(stderr, "Errore durante la creazione del thread di invio\n");
+        session->failed = session->count;
+        return -1;
+    }
+
+    for (int i = 0; i < session->count; i++)
+    {
+        session_op_t *op = &session->ops[i];
+
+        // attende che la richiesta i sia stata inviata (o saltata)
+        pthread_mutex_lock(&session->mutex);
+        while (session->sent <= i && !session->aborted) {
+            pthread_cond_wait(&session->cond, &session->mutex);
+        }
+        int available = (session->sent > i);
+        pthread_mutex_unlock(&session->mutex);
+        if (!available) {
+            failed += session->count - i;
+            break;
+        }
+
+        int ok = 0;
+        if (op->skipped) {
+            ok = 0;
+        } else if (ft_recv_header(session->sock, &response) < 0) {
+            // senza risposta la connessione non è più utilizzabile: le operazioni rimanenti falliscono
+            fprintf(stderr, "Errore nella ricezione della risposta del server: %s\n", strerror(errno));
+            pthread_mutex_lock(&session->mutex);
+            session->aborted = 1;
+            pthread_cond_broadcast(&session->cond);
+            pthread_mutex_unlock(&session->mutex);
+            failed += session->count - i;
+            break;
+        } else if (response.status != FT_STATUS_OK) {
+            fprintf(stderr, "Errore dal server per '%c %s': %s\n", op->opz, op->remote_path, ft_status_message(response.status));
+        } else if (op->opz == 'w') {
+            printf("CLIENT: Il server ha salvato '%s'\n", op->remote_path);
+            session->bytes += op->size;
+            ok = 1;
+        } else if (op->opz == 'r') {
+            // se la directory locale non è utilizzabile i dati vanno comunque tolti dalla connessione
+            if (!create_dir(op->local_path)) {
+                recv_discard(session->sock, (long long)response.payload_len);
+            } else {
+                ok = (write_file_in_dir(op->local_path, session->sock, (long long)response.payload_len, 1, 0) == 0);
+                session->bytes += ok ? response.payload_len : 0;
+            }
+        } else {
+            ok = (recv_listing(session->sock, response.payload_len) == 0);
+        }
+        failed += !ok;
+
+        pthread_mutex_lock(&session->mutex);
+        session->completed++;
+        pthread_cond_broadcast(&session->cond);
+        pthread_mutex_unlock(&session->mutex);
+    }
+
+    // la chiusura della connessione termina la sessione anche lato server
+    shutdown(session->sock, SHUT_RDWR);
+    pthread_join(sender, NULL);
+    pthread_mutex_destroy(&session->mutex);
+    pthread_cond_destroy(&session->cond);
+
+    session->failed = failed;
+    return failed;
+}
+
+
+
+/**
+ * Crea una socket e la connette al server.
+ *
+ * @param server_address - L'indirizzo IPv4 del server.
+ * @param port - La porta del server.
+ * @return Il file descriptor della socket connessa, -1 in caso di errore.
+ */
+int connect_server(const char *server_address, int port)
+{
+    // inizializza la struttura per l'indirizzo del server
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;    // famiglia di indirizzi IPv4
+
+    // creazione del socket
+    int client_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (client_sock < 0) {
+        fprintf(stderr, "Errore durante la creazione del socket: %s\n", strerror(errno));
+        return -1;
+    }
+    transfer_tune_socket(client_sock);     // prima di connect: la finestra TCP dipende dal buffer di ricezione
+
+    // imposta il numero di porta del server
+    server_addr.sin_port = htons(port);
+
+    // converte l'indirizzo IP passato come argomento in un formato utilizzabile dalla struttura sockaddr_in (binario)
+    if (inet_pton(AF_INET, server_address, &server_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Errore, l' indirizzo non è valido o non è supportato: %s\n", strerror(errno));
+        close(client_sock);
+        return -1;
+    }
+
+    // connessione al server
+    if (connect(client_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        switch (errno) {
+            case ECONNREFUSED:
+                fprintf(stderr, "Connessione rifiutata sulla porta '%d'. Nessun servizio in ascolto: %s\n", port, strerror(errno));
+                break;
+            case ETIMEDOUT:
+                fprintf(stderr, "Connessione scaduta sulla porta '%d'. Il servizio potrebbe non essere disponibile o c'è un problema di rete: %s\n", port, strerror(errno));
+                break;
+            case EHOSTUNREACH:
+                fprintf(stderr, "Indirizzo IP '%s' non raggiungibile: %s\n", server_address, strerror(errno));
+                break;
+            default:
+                fprintf(stderr, "Errore, connessione '%s' fallita: %s\n", server_address, strerror(errno));
+                break;
+        }
+        close(client_sock);
+        return -1;
+    }
+    return client_sock;
+}
+
+
+
 
 
 
@@ -348,16 +1010,22 @@ int main(int argc, char *argv[])
     int port = 0;
     char *from_path = NULL;
     char *destination_path = NULL;
-
-    // inizializza la struttura per l'indirizzo del server
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;    // famiglia di indirizzi IPv4
-
-    char opz = argv[2][1]; // write/read/list (da -w/-r/-l salvo solo la lettera in modo da passare da string a char)
+    char *manifest_path = NULL;
+    int window = SESSION_DEFAULT_WINDOW;
+    int connections = BATCH_DEFAULT_CONNECTIONS;
+    int streams = 1;
+    int resume = 0;
+    int dedup = 0;
+    int delta = 0;
+    int sorted = 1;
+    unsigned long long page = 0;
+    struct stat statbuf;
+
+    char opz = argv[2][1]; // write/read/list/sessione/metriche (da -w/-r/-l/-s/-x salvo solo la lettera in modo da passare da string a char)
     
     // validazione dell'opzione
-    if (opz != 'w' && opz != 'r' && opz != 'l') {
-        fprintf(stderr, "Opzione '%c' non valida. Usa -w per scrittura, -r per lettura, -l per lista\n", opz);
+    if (opz != 'w' && opz != 'r' && opz != 'l' && opz != 's' && opz != 'x') {
+        fprintf(stderr, "Opzione '%c' non valida. Usa -w per scrittura, -r per lettura, -l per lista, -s per una sessione, -x per le metriche del server\n", opz);
         exit(EXIT_FAILURE); 
     }
 
@@ -383,10 +1051,104 @@ int main(int argc, char *argv[])
         else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             destination_path = argv[++i];
         }
+
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            if (!parse_transfer_mode(argv[++i], &client_transfer_mode)) {
+                fprintf(stderr, "Modalità di trasferimento '%s' non valida. Usa zerocopy, buffered, pipeline o uring (con liburing)\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            char *end;
+            long chunk_kb = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || chunk_kb > (TRANSFER_CHUNK_MAX >> 10) || transfer_set_chunk_size((size_t)(chunk_kb < 0 ? 0 : chunk_kb) << 10) < 0) {
+                fprintf(stderr, "Dimensione dei blocchi '%s' non valida. Il valore dovrebbe essere tra %d e %d KiB\n", argv[i], TRANSFER_CHUNK_MIN >> 10, TRANSFER_CHUNK_MAX >> 10);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            manifest_path = argv[++i];
+        }
+
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            connections = atoi(argv[++i]);
+            if (connections < 1) {
+                fprintf(stderr, "Numero di connessioni '%s' non valido. Il valore deve essere almeno 1\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if (strcmp(argv[i], "-R") == 0) {
+            resume = 1;
+        }
+
+        else if (strcmp(argv[i], "-D") == 0) {
+            dedup = 1;
+        }
+
+        else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+            if (!compress_parse_codec(argv[++i], &client_compress_codec)) {
+                fprintf(stderr, "Codec '%s' non valido o non disponibile. Usa auto, none, ftlz, lz4 o zstd\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if (strcmp(argv[i], "-u") == 0) {
+            delta = 1;
+        }
+
+        else if (strcmp(argv[i], "-U") == 0) {
+            sorted = 0;
+        }
+
+        else if (strcmp(argv[i], "-N") == 0 && i + 1 < argc) {
+            page = strtoull(argv[++i], NULL, 10);
+            if (page < 1) {
+                fprintf(stderr, "Dimensione della pagina '%s' non valida. Il valore deve essere almeno 1\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            streams = atoi(argv[++i]);
+            if (streams < 1 || streams > STREAM_MAX) {
+                fprintf(stderr, "Numero di flussi '%s' non valido. Il valore dovrebbe essere tra 1 e %d\n", argv[i], STREAM_MAX);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc) {
+            window = atoi(argv[++i]);
+            if (window < 1) {
+                fprintf(stderr, "Finestra '%s' non valida. Il valore deve essere almeno 1\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "framed") == 0) {
+                client_legacy_protocol = 0;
+            } else if (strcmp(argv[i], "legacy") == 0) {
+                client_legacy_protocol = 1;
+            } else {
+                fprintf(stderr, "Protocollo '%s' non valido. Usa framed o legacy\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 
     // verifica che tutti i parametri necessari siano stati forniti
-    if (opz == 'w' || opz == 'r') {
+    if ((opz == 'w' || opz == 'r') && manifest_path) {
+        if (!server_address || port == 0) {
+            fprintf(stderr, "Mancano argomenti obbligatori per l' opzione '%c': \n", opz);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    else if (opz == 'w' || opz == 'r') {
         if (!server_address || port == 0 || !from_path) {
             fprintf(stderr, "Mancano argomenti obbligatori per l' opzione '%c': \n", opz);
             exit(EXIT_FAILURE);
@@ -411,43 +1173,131 @@ int main(int argc, char *argv[])
         }
     }
 
+    // le metriche del server non riguardano un percorso, e richiedono l'intestazione binaria
+    else if (opz == 'x') {
+        if (!server_address || port == 0) {
+            fprintf(stderr, "Mancano argomenti obbligatori per l' opzione '%c'\n", opz);
+            exit(EXIT_FAILURE);
+        }
+        if (client_legacy_protocol) {
+            fprintf(stderr, "Le metriche del server non sono supportate dal protocollo legacy\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
+    // una sessione esegue le operazioni elencate nel file indicato con -f, e richiede l'intestazione binaria
+    else if (opz == 's') {
+        if (!server_address || port == 0 || !from_path) {
+            fprintf(stderr, "Mancano argomenti obbligatori per l' opzione '%c'\n", opz);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // creazione del socket
-    int client_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (client_sock < 0) {
-        fprintf(stderr, "Errore durante la creazione del socket: %s\n", strerror(errno));
+    // copia di più file: un manifest, una directory locale da scrivere o una directory remota (percorso che termina con '/') da leggere
+    int batch = (manifest_path != NULL) ||
+                (opz == 'w' && stat(from_path, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) ||
+                (opz == 'r' && from_path[strlen(from_path) - 1] == '/');
+
+    // sessioni, copie di più file e flussi paralleli richiedono l'intestazione binaria
+    if ((opz == 's' || batch || streams > 1) && client_legacy_protocol) {
+        fprintf(stderr, "Le sessioni, le copie di più file e i flussi paralleli non sono supportati dal protocollo legacy\n");
         exit(EXIT_FAILURE);
     }
 
-    // imposta il numero di porta del server
-    server_addr.sin_port = htons(port);
+    // la deduplicazione riguarda la scrittura di un singolo file su una sola connessione, con l'intestazione binaria
+    if (dedup && (opz != 'w' || resume || batch || streams > 1 || client_legacy_protocol)) {
+        fprintf(stderr, "La deduplicazione (-D) è supportata solo per la scrittura di un singolo file su un flusso, senza -R\n");
+        exit(EXIT_FAILURE);
+    }
 
-    // converte l'indirizzo IP passato come argomento in un formato utilizzabile dalla struttura sockaddr_in (binario)
-    if (inet_pton(AF_INET, server_address, &server_addr.sin_addr) <= 0) {
-        fprintf(stderr, "Errore, l' indirizzo non è valido o non è supportato: %s\n", strerror(errno));
-        close(client_sock);
+    // l'aggiornamento con delta riguarda un singolo file su una sola connessione, con l'intestazione binaria
+    if (delta && ((opz != 'w' && opz != 'r') || dedup || resume || batch || streams > 1 || client_legacy_protocol)) {
+        fprintf(stderr, "L'aggiornamento con delta (-u) è supportato solo per la scrittura o la lettura di un singolo file su un flusso, senza -R e -D\n");
         exit(EXIT_FAILURE);
     }
 
+    // la compressione riguarda le scritture e le letture di un singolo file su una sola connessione, senza -R e -D
+    if (client_compress_codec != CODEC_NONE && ((opz != 'w' && opz != 'r') || dedup || resume || batch || streams > 1 || client_legacy_protocol)) {
+        fprintf(stderr, "La compressione (-z) è supportata solo per la scrittura o la lettura di un singolo file su un flusso, senza -R e -D\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // sessione: le operazioni del file, nell'ordine, sulla stessa connessione e con le richieste in pipelining.
+    // Copia di più file: i file, dal più grande, distribuiti su più connessioni persistenti
+    if (opz == 's' || batch)
+    {
+        batch_t list = { NULL, 0, 0 };
+        int loaded;
+
+        if (opz == 's') {
+            loaded = batch_load_ops(&list, from_path);
+            connections = 1;
+        } else if (manifest_path) {
+            loaded = batch_load_manifest(&list, opz, manifest_path);
+        } else if (opz == 'w') {
+            loaded = batch_add_local_tree(&list, from_path, destination_path);
+        } else {
+            loaded = batch_add_remote_tree(&list, server_address, port, from_path, destination_path);
+        }
+
+        int failed = (loaded == 0) ? run_batch(&list, server_address, port, connections, window, opz != 's') : -1;
+        batch_free(&list);
+        return failed == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    // la ripresa riguarda un singolo file su una sola connessione, con l'intestazione binaria
+    if (resume && (opz == 'l' || opz == 's' || opz == 'x' || batch || streams > 1 || client_legacy_protocol)) {
+        fprintf(stderr, "La ripresa (-R) è supportata solo per la scrittura o la lettura di un singolo file su un flusso\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // ordine e pagine riguardano la lista con l'intestazione binaria
+    if ((!sorted || page > 0) && (opz != 'l' || client_legacy_protocol)) {
+        fprintf(stderr, "Le opzioni -U e -N sono supportate solo per la lista (-l) con il protocollo framed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // un singolo file su più flussi: ogni connessione trasferisce un intervallo del file
+    if ((opz == 'w' || opz == 'r') && streams > 1) {
+        return run_streams(server_address, port, opz, opz == 'w' ? from_path : destination_path, opz == 'w' ? destination_path : from_path, streams) == 0 ? 0 : EXIT_FAILURE;
+    }
+
     // connessione al server
-    if (connect(client_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        switch (errno) {
-            case ECONNREFUSED:
-                fprintf(stderr, "Connessione rifiutata sulla porta '%d'. Nessun servizio in ascolto: %s\n", server_addr.sin_port, strerror(errno));
+    int client_sock = connect_server(server_address, port);
+    if (client_sock < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // protocollo con intestazione binaria: dimensioni ed esiti viaggiano nelle intestazioni
+    if (!client_legacy_protocol)
+    {
+        int result = -1;
+        switch (opz) {
+            case 'w':
+                if (dedup) {
+                    result = request_dedup_write(client_sock, from_path, destination_path);
+                } else if (delta) {
+                    result = request_delta_write(client_sock, from_path, destination_path);
+                } else {
+                    result = resume ? request_resume_write(client_sock, from_path, destination_path) : request_write(client_sock, from_path, destination_path);
+                }
                 break;
-            case ETIMEDOUT:
-                fprintf(stderr, "Connessione scaduta sulla porta '%d'. Il servizio potrebbe non essere disponibile o c'è un problema di rete: %s\n", port, strerror(errno));
+            case 'r':
+                if (delta) {
+                    result = request_delta_read(client_sock, from_path, destination_path);
+                } else {
+                    result = resume ? request_resume_read(client_sock, from_path, destination_path) : request_read(client_sock, from_path, destination_path);
+                }
                 break;
-            case EHOSTUNREACH:
-                fprintf(stderr, "Indirizzo IP '%s' non raggiungibile: %s\n", server_address, strerror(errno));
+            case 'l':
+                result = request_list(client_sock, from_path, sorted, page);
                 break;
-            default:
-                fprintf(stderr, "Errore, connessione '%s' fallita: %s\n", server_address, strerror(errno));
+            case 'x':
+                result = request_stats(client_sock);
                 break;
         }
         close(client_sock);
-        exit(EXIT_FAILURE);
+        return result == 0 ? 0 : EXIT_FAILURE;
     }
 
     // invia l'opzione al server
@@ -468,9 +1318,14 @@ int main(int argc, char *argv[])
     {
         // riceve la risposta dal server
         if (recv(client_sock, &server_response, 1, 0) > 0) {
-            if (server_response == 'T') {
+            if (server_response == LEGACY_ACK) {
                 break;
             }
+            if (server_response == STATUS_BUSY) {
+                fprintf(stderr, "Server occupato, riprovare più tardi\n");
+                close(client_sock);
+                exit(EXIT_FAILURE);
+            }
         } else {
             fprintf(stderr, "Errore nella ricezione della conferma del server che dichiara la sua corretta ricezione\n");
             close(client_sock);
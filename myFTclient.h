@@ -12,19 +12,75 @@
 #include <arpa/inet.h>          // per funzioni di conversione di indirizzi e gestione socket come inet_pton e inet_ntop
 #include <errno.h>              // per gestire gli errori con errno e interpretare i codici di errore
 #include <sys/statvfs.h>        // necessaria per fstatvfs
+#include <pthread.h>            // per il thread che invia le richieste di una sessione
+#include <netinet/in.h>         // per IPPROTO_TCP
+#include <netinet/tcp.h>        // per TCP_NODELAY
+#include "myFTtransfer.h"       // invio e ricezione dei file (zero-copy con sendfile/splice o bufferizzato)
+#include "myFTprotocol.h"       // intestazione binaria delle richieste e delle risposte
+#include "myFTlist.h"           // record della lista di una directory
+#include "myFTcompress.h"       // compressione dei dati sul filo
 
-#define BUFFER_SIZE 1024        // definisce la dimensione del buffer utilizzato per la lettura e scrittura dei dati
+#define BUFFER_SIZE 1024        // buffer dei percorsi e delle liste (i dati dei file usano i blocchi del pool, vedi transfer_buffer_acquire)
+#define SESSION_DEFAULT_WINDOW 64   // richieste inviate al massimo senza averne ricevuto la risposta (opzione -W)
+#define SESSION_INITIAL_CAPACITY 16 // capacità iniziale dell'elenco delle operazioni di una sessione
+#define SESSION_SMALL_FILE 65536    // richieste e file fino a questa dimensione vengono accorpati negli stessi segmenti TCP
+
+
+// Un'operazione di una sessione (una riga del file delle operazioni)
+typedef struct
+{
+    char opz;                   // operazione ('w', 'r', 'l')
+    char *local_path;           // file locale da inviare o in cui salvare (NULL per le liste)
+    char *remote_path;          // percorso sul server
+    unsigned long long size;    // dimensione del file (0 se non nota)
+    int skipped;                // 1 se la richiesta non è stata inviata (file locale non leggibile)
+} session_op_t;
+
+
+// Sessione: più operazioni sulla stessa connessione, con al massimo window richieste in attesa di risposta
+typedef struct
+{
+    int sock;                   // socket connessa al server
+    session_op_t *ops;          // operazioni nell'ordine del file
+    int count;                  // numero di operazioni
+    int window;                 // richieste in volo al massimo (1 = nessun pipelining)
+    int sent;                   // richieste inviate (o saltate) dal thread di invio
+    int completed;              // risposte ricevute
+    int aborted;                // 1 se la connessione non è più utilizzabile
+    int failed;                 // operazioni fallite
+    unsigned long long bytes;   // byte dei file trasferiti con successo
+    pthread_mutex_t mutex;      // protegge sent, completed e aborted
+    pthread_cond_t cond;        // segnala l'avanzamento di invio e ricezione
+} session_t;
+
+extern transfer_mode_t client_transfer_mode;   // modalità di invio/ricezione dei file (zerocopy o buffered)
+extern int client_legacy_protocol;              // 1 per usare il protocollo senza intestazione binaria
+extern int client_compress_codec;               // codec dei dati sul filo (opzione -z, CODEC_NONE se disattivata)
 
 unsigned long long int available_bytes(const char *path);
-void write_file_in_dir(const char *path, int client_sock);
+int write_file_in_dir(const char *path, int client_sock, long long length, int keep_in_sync, int trailer);
+int check_trailer(int client_sock, uint32_t crc);
+int write_compressed_file(const char *path, int client_sock, long long length, int trailer);
 void divide_dirpath_from_filename(const char *input, char **first_part, char **second_part);
 int create_dir(const char *dir);
 void send_filepath(int client_sock, const char *path);
-void send_data(int fd, int client_sock);
+int send_data(int fd, int client_sock, long long length, int trailer);
+int send_compressed_data(int fd, int client_sock, long long length, unsigned codecs, int trailer);
 void send_option(int client_sock, const char opz);
 void write_mode(int client_sock, const char *from_path);
 void read_mode(int client_sock, const char *destination_path);
 void list_mode(int client_sock);
+int recv_response(int client_sock, ft_header_t *response);
+int request_write(int client_sock, const char *from_path, const char *destination_path);
+int request_read(int client_sock, const char *remote_path, const char *destination_path);
+int request_info(int client_sock, const char *remote_path, uint16_t flags, unsigned long long *size, uint32_t **checksums, size_t *count);
+int recv_listing(int client_sock, uint64_t length);
+int recv_records(int client_sock, uint64_t length, uint64_t *next);
+int request_list(int client_sock, const char *remote_path, int sorted, uint64_t page);
+int request_stats(int client_sock);
+void *session_sender(void *arg);
+int run_session(session_t *session);
+int connect_server(const char *server_address, int port);
 
 
 #endif // MY_FT_CLIENT_H
\ No newline at end of file
@@ -0,0 +1,909 @@
+// COMPRESSIONE DEI DATI SUL FILO
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "myFTcompress.h"
+#include "myFTprotocol.h"       // flag che annunciano i codec accettati
+#include "myFTtransfer.h"       // send_all e recv_all
+#include "myFTchecksum.h"       // CRC32C dei byte del file
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define FTLZ_MIN_MATCH 4                        // byte minimi di una ripetizione
+#define FTLZ_HASH_BITS 14                       // voci della tabella delle ultime posizioni (2^14)
+#define FTLZ_MAX_OFFSET 65535                   // distanza massima di una ripetizione (2 byte)
+#define FTLZ_LAST_LITERALS 5                    // gli ultimi byte del blocco sono sempre dati (come in lz4)
+#define FTLZ_BOUND(n) ((n) + (n) / 255 + 16)    // dimensione massima di un blocco compresso
+
+
+// Stato di un compressore (uno per thread)
+typedef struct
+{
+    uint32_t table[1 << FTLZ_HASH_BITS];        // ultima posizione di ogni hash di 4 byte (CODEC_FTLZ)
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd;                            // contesto riusato tra i chunk
+#endif
+} compressor_t;
+
+
+// Un frame della pipeline
+typedef struct
+{
+    unsigned char *data;        // intestazione del frame e dati
+    size_t len;                 // byte validi in data
+} frame_t;
+
+
+// Coda di frame tra il thread di compressione (o di ricezione) e quello di invio (o di scrittura)
+typedef struct
+{
+    frame_t slots[COMPRESS_QUEUE];
+    int head;                   // primo frame pronto
+    int count;                  // frame pronti
+    int done;                   // 1 quando il produttore ha finito
+    int error;                  // errno del primo errore del produttore o del consumatore (0 se nessuno)
+    int aborted;                // 1 se il consumatore ha smesso di prendere frame
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    int fd;                     // file da leggere (invio) o da scrivere (ricezione)
+    long long length;           // byte del file
+    unsigned codecs;            // codec accettati da chi riceve (bit 1 << codec)
+    int codec;                  // codec richiesto, oppure CODEC_AUTO
+    compress_stats_t *stats;
+} pipeline_t;
+
+
+static const char *codec_names[CODEC_COUNT] = { "none", "ftlz", "lz4", "zstd" };
+
+
+
+/**
+ * Interpreta il nome di un codec (opzione -z): "auto" per la scelta automatica.
+ *
+ * @param str Il nome.
+ * @param codec Dove memorizzare il codec (CODEC_AUTO per "auto").
+ * @return 1 se il nome è valido e il codec disponibile, 0 altrimenti.
+ */
+int compress_parse_codec(const char *str, int *codec)
+{
+    if (strcmp(str, "auto") == 0) {
+        *codec = CODEC_AUTO;
+        return 1;
+    }
+    for (int i = 0; i < CODEC_COUNT; i++) {
+        if (strcmp(str, codec_names[i]) == 0 && codec_available(i)) {
+            *codec = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * Restituisce il nome di un codec.
+ */
+const char* compress_codec_name(int codec)
+{
+    if (codec == CODEC_AUTO) {
+        return "auto";
+    }
+    return (codec >= 0 && codec < CODEC_COUNT) ? codec_names[codec] : "?";
+}
+
+
+
+/**
+ * Indica se un codec è compilato nel programma.
+ */
+int codec_available(int codec)
+{
+    switch (codec)
+    {
+        case CODEC_NONE:
+        case CODEC_FTLZ:
+            return 1;
+#ifdef HAVE_LZ4
+        case CODEC_LZ4:
+            return 1;
+#endif
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD:
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+
+
+/**
+ * Calcola i flag con cui chi riceve i dati annuncia i codec che accetta: FT_FLAG_COMPRESS (nessuna
+ * compressione e CODEC_FTLZ) più FT_FLAG_LZ4 e FT_FLAG_ZSTD se compilati.
+ *
+ * @param codec Il codec preferito: con un codec esplicito si annuncia solo quello (oltre a quelli di base).
+ * @return I flag da aggiungere alla richiesta o alla risposta.
+ */
+uint16_t compress_flags(int codec)
+{
+    uint16_t flags = FT_FLAG_COMPRESS;
+
+    if (codec_available(CODEC_LZ4) && (codec == CODEC_AUTO || codec == CODEC_LZ4)) {
+        flags |= FT_FLAG_LZ4;
+    }
+    if (codec_available(CODEC_ZSTD) && (codec == CODEC_AUTO || codec == CODEC_ZSTD)) {
+        flags |= FT_FLAG_ZSTD;
+    }
+    return flags;
+}
+
+
+
+/**
+ * Ricava dai flag dell'altra parte i codec utilizzabili da entrambe.
+ *
+ * @param flags I flag della richiesta o della risposta.
+ * @return I codec utilizzabili (bit 1 << codec), 0 se l'altra parte non accetta dati compressi.
+ */
+unsigned compress_codecs(uint16_t flags)
+{
+    if (!(flags & FT_FLAG_COMPRESS)) {
+        return 0;
+    }
+    unsigned codecs = (1u << CODEC_NONE) | (1u << CODEC_FTLZ);
+    if ((flags & FT_FLAG_LZ4) && codec_available(CODEC_LZ4)) {
+        codecs |= 1u << CODEC_LZ4;
+    }
+    if ((flags & FT_FLAG_ZSTD) && codec_available(CODEC_ZSTD)) {
+        codecs |= 1u << CODEC_ZSTD;
+    }
+    return codecs;
+}
+
+
+
+static void put_u32(unsigned char *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+
+
+static uint32_t load32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+
+static uint64_t load64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+
+/**
+ * Scrive una lunghezza nel formato di lz4: i 4 bit del token, poi byte da 255 e il resto.
+ */
+static unsigned char* ftlz_put_length(unsigned char *op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+
+
+/**
+ * Aggiunge una sequenza al blocco compresso: dati, poi (se match_len > 0) la ripetizione.
+ *
+ * @return La nuova fine del blocco, NULL se non c'è spazio.
+ */
+static unsigned char* ftlz_sequence(unsigned char *op, unsigned char *end, const unsigned char *literals, size_t literal_len, size_t offset, size_t match_len)
+{
+    size_t worst = 1 + literal_len / 255 + 1 + literal_len + 2 + match_len / 255 + 1;
+    if ((size_t)(end - op) < worst) {
+        return NULL;
+    }
+
+    size_t extra = match_len ? match_len - FTLZ_MIN_MATCH : 0;
+    unsigned char *token = op++;
+    *token = (unsigned char)(((literal_len < 15 ? literal_len : 15) << 4) | (extra < 15 ? extra : 15));
+    if (literal_len >= 15) {
+        op = ftlz_put_length(op, literal_len - 15);
+    }
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if (match_len > 0) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        if (extra >= 15) {
+            op = ftlz_put_length(op, extra - 15);
+        }
+    }
+    return op;
+}
+
+
+
+/**
+ * Comprime un blocco con CODEC_FTLZ: LZ77 con una tabella delle ultime posizioni di ogni hash di 4 byte,
+ * nel formato dei blocchi di lz4. Le zone senza ripetizioni vengono attraversate a passi crescenti.
+ *
+ * @return I byte del blocco compresso, 0 se non entra in cap byte.
+ */
+static size_t ftlz_compress(compressor_t *cp, const unsigned char *src, size_t len, unsigned char *dst, size_t cap)
+{
+    unsigned char *op = dst;
+    unsigned char *end = dst + cap;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    memset(cp->table, 0, sizeof(cp->table));
+
+    if (len > FTLZ_MIN_MATCH + FTLZ_LAST_LITERALS + 8)
+    {
+        size_t limit = len - FTLZ_LAST_LITERALS - 8;        // ultima posizione da cui cercare una ripetizione
+        size_t match_limit = len - FTLZ_LAST_LITERALS;      // una ripetizione non arriva agli ultimi byte
+
+        while (ip < limit)
+        {
+            uint32_t sequence = load32(src + ip);
+            uint32_t h = (sequence * 2654435761u) >> (32 - FTLZ_HASH_BITS);
+            size_t ref = cp->table[h];
+            cp->table[h] = (uint32_t)ip;
+
+            if (ref >= ip || ip - ref > FTLZ_MAX_OFFSET || load32(src + ref) != sequence) {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            // la ripetizione si estende 8 byte alla volta: il primo byte diverso è il primo bit a 1 dello XOR
+            size_t match_len = FTLZ_MIN_MATCH;
+            while (ip + match_len + 8 <= match_limit) {
+                uint64_t diff = load64(src + ref + match_len) ^ load64(src + ip + match_len);
+                if (diff != 0) {
+                    match_len += __builtin_ctzll(diff) >> 3;
+                    break;
+                }
+                match_len += 8;
+            }
+            if (ip + match_len + 8 > match_limit) {
+                while (ip + match_len < match_limit && src[ref + match_len] == src[ip + match_len]) {
+                    match_len++;
+                }
+            }
+
+            op = ftlz_sequence(op, end, src + anchor, ip - anchor, ip - ref, match_len);
+            if (op == NULL) {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    // gli ultimi byte sono dati
+    op = ftlz_sequence(op, end, src + anchor, len - anchor, 0, 0);
+    return (op != NULL) ? (size_t)(op - dst) : 0;
+}
+
+
+
+/**
+ * Legge una lunghezza estesa del formato di lz4 controllando di non uscire dal blocco.
+ */
+static int ftlz_get_length(const unsigned char *src, size_t len, size_t *ip, size_t *length)
+{
+    unsigned char byte;
+    do {
+        if (*ip >= len) {
+            return -1;
+        }
+        byte = src[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+
+
+/**
+ * Decomprime un blocco CODEC_FTLZ controllando ogni lunghezza e distanza: un blocco non valido è un errore,
+ * mai una lettura o una scrittura fuori dai buffer.
+ *
+ * @return 0 se il blocco produce esattamente raw_len byte, -1 altrimenti.
+ */
+static int ftlz_decompress(const unsigned char *src, size_t len, unsigned char *dst, size_t raw_len)
+{
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < len)
+    {
+        unsigned char token = src[ip++];
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && ftlz_get_length(src, len, &ip, &literal_len) < 0) {
+            return -1;
+        }
+        if (literal_len > len - ip || literal_len > raw_len - op) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        // l'ultima sequenza ha solo dati
+        if (ip == len) {
+            break;
+        }
+        if (len - ip < 2) {
+            return -1;
+        }
+        size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && ftlz_get_length(src, len, &ip, &match_len) < 0) {
+            return -1;
+        }
+        match_len += FTLZ_MIN_MATCH;
+        if (offset == 0 || offset > op || match_len > raw_len - op) {
+            return -1;
+        }
+
+        // la ripetizione può sovrapporsi ai byte che produce (es. una sequenza di byte uguali): a 8 byte
+        // alla volta solo se la distanza è di almeno 8 byte
+        unsigned char *out = dst + op;
+        const unsigned char *ref = out - offset;
+        size_t i = 0;
+        if (offset >= match_len) {
+            memcpy(out, ref, match_len);
+            i = match_len;
+        } else if (offset >= 8) {
+            for (; i + 8 <= match_len; i += 8) {
+                memcpy(out + i, ref + i, 8);
+            }
+        }
+        for (; i < match_len; i++) {
+            out[i] = ref[i];
+        }
+        op += match_len;
+    }
+    return (op == raw_len) ? 0 : -1;
+}
+
+
+
+/**
+ * Comprime un chunk con il codec indicato.
+ *
+ * @return I byte compressi, 0 se il codec non riesce a stare in cap byte (i dati vanno inviati così come sono).
+ */
+static size_t codec_compress(compressor_t *cp, int codec, const unsigned char *src, size_t len, unsigned char *dst, size_t cap)
+{
+    switch (codec)
+    {
+        case CODEC_FTLZ:
+            return ftlz_compress(cp, src, len, dst, cap);
+#ifdef HAVE_LZ4
+        case CODEC_LZ4: {
+            int n = LZ4_compress_default((const char *)src, (char *)dst, (int)len, (int)cap);
+            return n > 0 ? (size_t)n : 0;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD: {
+            if (cp->zstd == NULL && (cp->zstd = ZSTD_createCCtx()) == NULL) {
+                return 0;
+            }
+            size_t n = ZSTD_compressCCtx(cp->zstd, dst, cap, src, len, COMPRESS_ZSTD_LEVEL);
+            return ZSTD_isError(n) ? 0 : n;
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+
+
+/**
+ * Decomprime un frame.
+ *
+ * @return 0 se il frame produce esattamente raw_len byte, -1 se non è valido.
+ */
+static int codec_decompress(int codec, const unsigned char *src, size_t len, unsigned char *dst, size_t raw_len)
+{
+    switch (codec)
+    {
+        case CODEC_NONE:
+            if (len != raw_len) {
+                return -1;
+            }
+            memcpy(dst, src, len);
+            return 0;
+        case CODEC_FTLZ:
+            return ftlz_decompress(src, len, dst, raw_len);
+#ifdef HAVE_LZ4
+        case CODEC_LZ4:
+            return LZ4_decompress_safe((const char *)src, (char *)dst, (int)len, (int)raw_len) == (int)raw_len ? 0 : -1;
+#endif
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD: {
+            size_t n = ZSTD_decompress(dst, raw_len, src, len);
+            return (!ZSTD_isError(n) && n == raw_len) ? 0 : -1;
+        }
+#endif
+        default:
+            return -1;
+    }
+}
+
+
+
+/**
+ * Inizializza la coda di una pipeline e ne alloca i frame.
+ *
+ * @return 0 in caso di successo, -1 se manca memoria.
+ */
+static int pipeline_init(pipeline_t *pl, int fd, long long length, compress_stats_t *stats)
+{
+    memset(pl, 0, sizeof(*pl));
+    pl->fd = fd;
+    pl->length = length;
+    pl->stats = stats;
+    pthread_mutex_init(&pl->mutex, NULL);
+    pthread_cond_init(&pl->cond, NULL);
+
+    for (int i = 0; i < COMPRESS_QUEUE; i++) {
+        pl->slots[i].data = (unsigned char *)malloc(COMPRESS_FRAME_HEADER + FTLZ_BOUND(COMPRESS_CHUNK));
+        if (pl->slots[i].data == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+static void pipeline_destroy(pipeline_t *pl)
+{
+    for (int i = 0; i < COMPRESS_QUEUE; i++) {
+        free(pl->slots[i].data);
+    }
+    pthread_mutex_destroy(&pl->mutex);
+    pthread_cond_destroy(&pl->cond);
+}
+
+
+
+/**
+ * Attende un frame libero in fondo alla coda.
+ *
+ * @return Il frame da riempire, NULL se il consumatore ha smesso.
+ */
+static frame_t* pipeline_reserve(pipeline_t *pl)
+{
+    pthread_mutex_lock(&pl->mutex);
+    while (pl->count == COMPRESS_QUEUE && !pl->aborted) {
+        pthread_cond_wait(&pl->cond, &pl->mutex);
+    }
+    frame_t *frame = pl->aborted ? NULL : &pl->slots[(pl->head + pl->count) % COMPRESS_QUEUE];
+    pthread_mutex_unlock(&pl->mutex);
+    return frame;
+}
+
+
+
+/**
+ * Rende disponibile al consumatore il frame riempito.
+ */
+static void pipeline_publish(pipeline_t *pl)
+{
+    pthread_mutex_lock(&pl->mutex);
+    pl->count++;
+    pthread_cond_broadcast(&pl->cond);
+    pthread_mutex_unlock(&pl->mutex);
+}
+
+
+
+/**
+ * Segnala la fine del lavoro del produttore (err = 0) oppure il suo errore.
+ */
+static void pipeline_finish(pipeline_t *pl, int err)
+{
+    pthread_mutex_lock(&pl->mutex);
+    pl->done = 1;
+    if (err != 0 && pl->error == 0) {
+        pl->error = err;
+    }
+    pthread_cond_broadcast(&pl->cond);
+    pthread_mutex_unlock(&pl->mutex);
+}
+
+
+
+/**
+ * Attende il primo frame pronto della coda.
+ *
+ * @return Il frame, NULL se il produttore ha finito (o ha avuto un errore) e la coda è vuota.
+ */
+static frame_t* pipeline_take(pipeline_t *pl)
+{
+    pthread_mutex_lock(&pl->mutex);
+    while (pl->count == 0 && !pl->done) {
+        pthread_cond_wait(&pl->cond, &pl->mutex);
+    }
+    frame_t *frame = (pl->count > 0) ? &pl->slots[pl->head] : NULL;
+    pthread_mutex_unlock(&pl->mutex);
+    return frame;
+}
+
+
+
+/**
+ * Libera il primo frame della coda, già consumato.
+ */
+static void pipeline_release(pipeline_t *pl)
+{
+    pthread_mutex_lock(&pl->mutex);
+    pl->head = (pl->head + 1) % COMPRESS_QUEUE;
+    pl->count--;
+    pthread_cond_broadcast(&pl->cond);
+    pthread_mutex_unlock(&pl->mutex);
+}
+
+
+
+/**
+ * Il consumatore smette di prendere frame (errore): il produttore non resta bloccato sulla coda piena.
+ */
+static void pipeline_abort(pipeline_t *pl, int err)
+{
+    pthread_mutex_lock(&pl->mutex);
+    pl->aborted = 1;
+    if (pl->error == 0) {
+        pl->error = err;
+    }
+    pthread_cond_broadcast(&pl->cond);
+    pthread_mutex_unlock(&pl->mutex);
+}
+
+
+
+/**
+ * Legge esattamente len byte dalla posizione corrente del file.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (EIO se il file si è accorciato).
+ */
+static int read_full(int fd, unsigned char *buffer, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, buffer + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Thread di compressione: legge il file a chunk, li comprime e li mette in coda come frame. In modalità
+ * automatica il primo chunk viene compresso con il codec più veloce disponibile: se non scende sotto
+ * COMPRESS_SAMPLE_RATIO per cento i dati non si comprimono (es. già compressi o cifrati) e il resto del file
+ * viaggia senza compressione, altrimenti si usa zstd se entrambe le parti lo hanno. Un chunk che non si
+ * riduce viene comunque inviato così com'è.
+ */
+static void* compress_thread(void *arg)
+{
+    pipeline_t *pl = (pipeline_t *)arg;
+    compressor_t *cp = (compressor_t *)calloc(1, sizeof(compressor_t));
+    unsigned char *raw = (unsigned char *)malloc(COMPRESS_CHUNK);
+    unsigned long long remaining = (unsigned long long)pl->length;
+    int err = 0;
+
+    if (cp == NULL || raw == NULL) {
+        err = ENOMEM;
+    }
+
+    int fast = (pl->codecs & (1u << CODEC_LZ4)) ? CODEC_LZ4 : CODEC_FTLZ;
+    int codec = pl->codec;
+    if (codec != CODEC_AUTO && !(pl->codecs & (1u << codec))) {
+        codec = fast;       // codec non accettato da chi riceve
+    }
+    int sampling = (codec == CODEC_AUTO);
+
+    while (err == 0 && remaining > 0)
+    {
+        size_t len = remaining < COMPRESS_CHUNK ? (size_t)remaining : COMPRESS_CHUNK;
+        if (read_full(pl->fd, raw, len) < 0) {
+            err = errno;
+            break;
+        }
+        pl->stats->crc = crc32c(pl->stats->crc, raw, len);
+        frame_t *frame = pipeline_reserve(pl);
+        if (frame == NULL) {
+            break;
+        }
+
+        unsigned char *dst = frame->data + COMPRESS_FRAME_HEADER;
+        size_t cap = FTLZ_BOUND(COMPRESS_CHUNK);
+        size_t packed = 0;
+        int used = CODEC_NONE;
+
+        if (sampling) {
+            // campione: il primo chunk con il codec veloce
+            packed = codec_compress(cp, fast, raw, len, dst, cap);
+            sampling = 0;
+            if (packed == 0 || packed * 100 > (size_t)len * COMPRESS_SAMPLE_RATIO) {
+                codec = CODEC_NONE;
+                packed = 0;
+            } else {
+                codec = (pl->codecs & (1u << CODEC_ZSTD)) ? CODEC_ZSTD : fast;
+                used = fast;
+            }
+            pl->stats->codec = codec;
+        }
+        if (packed == 0 && codec != CODEC_NONE) {
+            packed = codec_compress(cp, codec, raw, len, dst, cap);
+            used = codec;
+        }
+        if (packed == 0 || packed >= len) {
+            memcpy(dst, raw, len);
+            packed = len;
+            used = CODEC_NONE;
+        }
+
+        frame->data[0] = (unsigned char)used;
+        put_u32(frame->data + 1, (uint32_t)len);
+        put_u32(frame->data + 5, (uint32_t)packed);
+        frame->len = COMPRESS_FRAME_HEADER + packed;
+        remaining -= len;
+        pipeline_publish(pl);
+    }
+
+#ifdef HAVE_ZSTD
+    if (cp != NULL) {
+        ZSTD_freeCCtx(cp->zstd);
+    }
+#endif
+    free(cp);
+    free(raw);
+    pipeline_finish(pl, err);
+    return NULL;
+}
+
+
+
+/**
+ * Invia length byte del file dalla sua posizione corrente come frame compressi. Un thread comprime i chunk
+ * mentre il thread chiamante invia quelli già pronti.
+ *
+ * @param fd Il file da inviare, posizionato sul primo byte.
+ * @param sock La socket su cui inviare.
+ * @param length I byte da inviare (annunciati nell'intestazione).
+ * @param codecs I codec accettati da chi riceve (compress_codecs).
+ * @param codec Il codec da usare, oppure CODEC_AUTO.
+ * @param stats Statistiche del trasferimento (azzerate all'inizio).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int send_compressed(int fd, int sock, long long length, unsigned codecs, int codec, compress_stats_t *stats)
+{
+    pipeline_t pl;
+    pthread_t thread;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->codec = (codec == CODEC_AUTO) ? CODEC_NONE : codec;
+    if (length <= 0) {
+        return 0;
+    }
+    if (pipeline_init(&pl, fd, length, stats) < 0) {
+        pipeline_destroy(&pl);
+        return -1;
+    }
+    pl.codecs = codecs;
+    pl.codec = codec;
+    int err = pthread_create(&thread, NULL, compress_thread, &pl);
+    if (err != 0) {
+        pipeline_destroy(&pl);
+        errno = err;
+        return -1;
+    }
+
+    frame_t *frame;
+    while ((frame = pipeline_take(&pl)) != NULL)
+    {
+        if (send_all(sock, frame->data, frame->len, 0) < 0) {
+            pipeline_abort(&pl, errno);
+            break;
+        }
+        stats->bytes += get_u32(frame->data + 1);
+        stats->wire_bytes += frame->len;
+        stats->frames++;
+        pipeline_release(&pl);
+        transfer_paced(frame->len);
+    }
+
+    pthread_join(thread, NULL);
+    err = pl.error;
+    pipeline_destroy(&pl);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Thread di scrittura: decomprime i frame ricevuti e li scrive nel file. Dopo un errore continua a
+ * prendere i frame dalla coda senza scriverli, così chi riceve resta allineato alla richiesta successiva.
+ */
+static void* decompress_thread(void *arg)
+{
+    pipeline_t *pl = (pipeline_t *)arg;
+    unsigned char *raw = (unsigned char *)malloc(COMPRESS_CHUNK);
+    int err = (raw == NULL) ? ENOMEM : 0;
+    frame_t *frame;
+
+    while ((frame = pipeline_take(pl)) != NULL)
+    {
+        size_t len = get_u32(frame->data + 1);
+        if (err == 0 && codec_decompress(frame->data[0], frame->data + COMPRESS_FRAME_HEADER, frame->len - COMPRESS_FRAME_HEADER, raw, len) < 0) {
+            err = EBADMSG;
+        }
+        if (err == 0) {
+            pl->stats->crc = crc32c(pl->stats->crc, raw, len);
+        }
+        for (size_t done = 0; err == 0 && done < len; ) {
+            ssize_t n = write(pl->fd, raw + done, len - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                err = (n < 0) ? errno : EIO;
+            }
+            done += (n > 0) ? n : 0;
+        }
+        if (err != 0) {
+            pipeline_abort(pl, err);    // solo per registrare l'errore: la coda continua a svuotarsi
+        }
+        pipeline_release(pl);
+    }
+    free(raw);
+    return NULL;
+}
+
+
+
+/**
+ * Riceve length byte di un file come frame compressi e li scrive nel file dalla sua posizione corrente.
+ * Il thread chiamante riceve i frame mentre un altro thread li decomprime e li scrive. In caso di errore
+ * di scrittura (es. disco pieno) i frame restanti vengono ricevuti e scartati, così la connessione resta
+ * allineata; un frame non valido invece interrompe la ricezione.
+ *
+ * @param sock La socket da cui ricevere.
+ * @param fd Il file in cui scrivere.
+ * @param length I byte del file (annunciati nell'intestazione).
+ * @param max_bytes Byte disponibili sul dispositivo: superarli è un errore ENOSPC.
+ * @param stats Statistiche del trasferimento (azzerate all'inizio).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int recv_compressed(int sock, int fd, long long length, unsigned long long max_bytes, compress_stats_t *stats)
+{
+    pipeline_t pl;
+    pthread_t thread;
+    unsigned char header[COMPRESS_FRAME_HEADER];
+    int broken = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (length <= 0) {
+        return 0;
+    }
+    if (pipeline_init(&pl, fd, length, stats) < 0) {
+        pipeline_destroy(&pl);
+        return -1;
+    }
+    int err = pthread_create(&thread, NULL, decompress_thread, &pl);
+    if (err != 0) {
+        pipeline_destroy(&pl);
+        errno = err;
+        return -1;
+    }
+
+    while (stats->bytes < (unsigned long long)length)
+    {
+        if (recv_all(sock, header, sizeof(header)) < 0) {
+            broken = errno;
+            break;
+        }
+        uint32_t len = get_u32(header + 1);
+        uint32_t packed = get_u32(header + 5);
+        if (header[0] >= CODEC_COUNT || !codec_available(header[0]) || len == 0 || len > COMPRESS_CHUNK ||
+            packed > FTLZ_BOUND(COMPRESS_CHUNK) || len > (unsigned long long)length - stats->bytes) {
+            broken = EBADMSG;
+            break;
+        }
+
+        // oltre lo spazio disponibile i frame si ricevono ma non si scrivono
+        if (stats->bytes + len > max_bytes) {
+            pipeline_abort(&pl, ENOSPC);
+        }
+        frame_t *frame = pipeline_reserve(&pl);
+        if (frame == NULL) {
+            if (recv_discard(sock, packed) < 0) {
+                broken = errno;
+                break;
+            }
+        } else {
+            memcpy(frame->data, header, sizeof(header));
+            if (recv_all(sock, frame->data + COMPRESS_FRAME_HEADER, packed) < 0) {
+                broken = errno;
+                break;
+            }
+            frame->len = COMPRESS_FRAME_HEADER + packed;
+            pipeline_publish(&pl);
+        }
+        stats->bytes += len;
+        stats->wire_bytes += COMPRESS_FRAME_HEADER + packed;
+        stats->frames++;
+        if (header[0] != CODEC_NONE) {
+            stats->codec = header[0];
+        }
+    }
+
+    pipeline_finish(&pl, broken);
+    pthread_join(thread, NULL);
+    err = pl.error;
+    pipeline_destroy(&pl);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
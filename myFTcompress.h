@@ -0,0 +1,60 @@
+#ifndef MY_FT_COMPRESS_H
+#define MY_FT_COMPRESS_H
+
+#include <stdint.h>         // per i tipi a dimensione fissa
+#include <stddef.h>         // per size_t
+
+// Compressione dei dati sul filo. Con FT_FLAG_COMPRESS i payload_len byte di un file viaggiano come una
+// sequenza di frame, ognuno con al massimo COMPRESS_CHUNK byte del file:
+//
+//   offset  dim  campo
+//   0       1    codec (codec_t)
+//   1       4    byte del file contenuti nel frame
+//   5       4    byte che seguono l'intestazione del frame
+//   9       ...  dati (compressi, oppure così come sono con CODEC_NONE)
+//
+// Tutti i campi sono in ordine di rete (big-endian). Chi invia sceglie il codec di ogni frame tra quelli
+// accettati da chi riceve: CODEC_NONE e CODEC_FTLZ sempre, lz4 e zstd solo se compilati da entrambe le parti
+// (-DHAVE_LZ4 -llz4, -DHAVE_ZSTD -lzstd) e annunciati con FT_FLAG_LZ4 e FT_FLAG_ZSTD.
+// La compressione avviene in un thread a parte mentre il thread chiamante invia i frame già pronti, così
+// CPU e rete lavorano in parallelo; lo stesso in ricezione con la decompressione e la scrittura su disco.
+
+#define COMPRESS_CHUNK (256 << 10)              // byte del file al massimo in un frame
+#define COMPRESS_FRAME_HEADER 9                 // intestazione di un frame
+#define COMPRESS_QUEUE 4                        // frame pronti al massimo tra i due thread della pipeline
+#define COMPRESS_SAMPLE_RATIO 90                // modalità automatica: il primo chunk compresso deve scendere sotto questa percentuale
+#define COMPRESS_ZSTD_LEVEL 3                   // livello di zstd (il predefinito della libreria)
+
+
+// Codec di un frame
+typedef enum
+{
+    CODEC_NONE = 0,             // dati non compressi
+    CODEC_FTLZ = 1,             // LZ77 veloce incluso nel programma (formato dei blocchi di lz4)
+    CODEC_LZ4 = 2,              // liblz4 (con HAVE_LZ4)
+    CODEC_ZSTD = 3,             // libzstd (con HAVE_ZSTD)
+    CODEC_COUNT
+} codec_t;
+
+#define CODEC_AUTO (-1)         // modalità automatica: codec scelto per ogni file dal primo chunk
+
+
+// Statistiche di un trasferimento compresso
+typedef struct
+{
+    unsigned long long bytes;       // byte del file
+    unsigned long long wire_bytes;  // byte inviati o ricevuti sulla socket (intestazioni dei frame comprese)
+    unsigned long long frames;      // frame trasferiti
+    int codec;                      // codec scelto per il file (CODEC_NONE se i dati non si comprimono)
+    uint32_t crc;                   // CRC32C dei byte del file (prima della compressione)
+} compress_stats_t;
+
+int compress_parse_codec(const char *str, int *codec);
+const char* compress_codec_name(int codec);
+int codec_available(int codec);
+uint16_t compress_flags(int codec);
+unsigned compress_codecs(uint16_t flags);
+int send_compressed(int fd, int sock, long long length, unsigned codecs, int codec, compress_stats_t *stats);
+int recv_compressed(int sock, int fd, long long length, unsigned long long max_bytes, compress_stats_t *stats);
+
+#endif // MY_FT_COMPRESS_H
@@ -0,0 +1,146 @@
+// CARICAMENTO CON DEDUPLICAZIONE
+
+#include "myFTdedup.h"
+
+
+
+/**
+ * Invia al server i chunk indicati dalla bitmap, nell'ordine del file. I chunk mancanti consecutivi
+ * vengono inviati con un'unica chiamata, così un file nuovo parte in un solo trasferimento.
+ *
+ * @param file_fd - Il file descriptor del file locale.
+ * @param client_sock - Il socket connesso al server.
+ * @param manifest - Il manifest del file locale.
+ * @param missing - La bitmap dei chunk da inviare (bit 7 del primo byte = primo chunk).
+ * @return I byte inviati, -1 in caso di errore.
+ */
+long long send_missing_chunks(int file_fd, int client_sock, const manifest_t *manifest, const unsigned char *missing)
+{
+    transfer_stats_t stats;
+    unsigned long long offset = 0;
+    unsigned long long run_start = 0;
+    unsigned long long run_length = 0;
+    long long sent = 0;
+
+    for (uint32_t i = 0; i <= manifest->count; i++)
+    {
+        int wanted = (i < manifest->count) && (missing[i / 8] & (0x80 >> (i % 8)));
+        if (wanted) {
+            if (run_length == 0) {
+                run_start = offset;
+            }
+            run_length += manifest->chunks[i].length;
+        }
+
+        // fine di una sequenza di chunk mancanti (o del file): la si invia
+        if (!wanted && run_length > 0) {
+            if (lseek(file_fd, (off_t)run_start, SEEK_SET) < 0) {
+                fprintf(stderr, "Errore durante il posizionamento nel file: %s\n", strerror(errno));
+                return -1;
+            }
+            if (send_file(file_fd, client_sock, (long long)run_length, client_transfer_mode, &stats, NULL) < 0) {
+                fprintf(stderr, "Errore durante l' invio dei dati del file al server: %s\n", strerror(errno));
+                return -1;
+            }
+            sent += run_length;
+            run_length = 0;
+        }
+        if (i < manifest->count) {
+            offset += manifest->chunks[i].length;
+        }
+    }
+    return sent;
+}
+
+
+
+/**
+ * Invia un file al server con deduplicazione. Il client divide il file in chunk definiti dal contenuto e
+ * invia il manifest con i loro hash; il server risponde con i chunk che non ha già nell'archivio e il client
+ * invia solo quelli. Un file già presente sul server (anche con un altro nome) non viene trasferito affatto,
+ * uno modificato in un punto trasferisce solo i chunk attorno alla modifica.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param from_path - Il percorso del file locale da inviare.
+ * @param destination_path - Il percorso remoto in cui scrivere il file.
+ * @return 0 se il server ha salvato il file, -1 in caso di errore.
+ */
+int request_dedup_write(int client_sock, const char *from_path, const char *destination_path)
+{
+    struct stat statbuf;
+    ft_header_t response;
+    manifest_t manifest;
+    unsigned char *missing = NULL;
+    int result = -1;
+
+    memset(&response, 0, sizeof(response));
+
+    int file_fd = open(from_path, O_RDONLY);
+    if (file_fd < 0) {
+        fprintf(stderr, "Errore durante l' apertura del file: %s\n", strerror(errno));
+        return -1;
+    }
+    if (fstat(file_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+        fprintf(stderr, "Errore, la deduplicazione richiede un file regolare: '%s'\n", from_path);
+        close(file_fd);
+        return -1;
+    }
+
+    if (manifest_build(file_fd, &manifest) < 0) {
+        fprintf(stderr, "Errore durante il calcolo dei chunk del file: %s\n", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    size_t len;
+    unsigned char *encoded = manifest_encode(&manifest, &len);
+    if (encoded == NULL || len > MANIFEST_MAX_SIZE) {
+        fprintf(stderr, "Errore, manifest del file non valido o troppo grande\n");
+        goto out;
+    }
+
+    // il manifest segue subito la richiesta, senza attendere il via libera
+    if (ft_send_request(client_sock, 'd', 0, destination_path, len) < 0 || send_all(client_sock, encoded, len, 0) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        goto out;
+    }
+    printf("CLIENT: Manifest di '%s' inviato al server (%u chunk, %llu byte)\n", destination_path, manifest.count, (unsigned long long)manifest.size);
+
+    if (recv_response(client_sock, &response) < 0) {
+        if (response.status == FT_STATUS_BAD_REQUEST) {
+            fprintf(stderr, "CLIENT: Il server deve essere avviato con l'opzione -D per accettare caricamenti con deduplicazione\n");
+        }
+        goto out;
+    }
+    if (response.status == FT_STATUS_OK) {
+        printf("CLIENT: Il contenuto è già presente sul server, nessun dato inviato\n");
+        result = 0;
+        goto out;
+    }
+
+    // FT_STATUS_CONTINUE: segue la bitmap dei chunk che mancano al server
+    size_t missing_len = ((size_t)manifest.count + 7) / 8;
+    if (response.payload_len != missing_len || (missing = (unsigned char *)malloc(missing_len)) == NULL) {
+        fprintf(stderr, "Errore, risposta del server non valida\n");
+        goto out;
+    }
+    if (recv_all(client_sock, missing, missing_len) < 0) {
+        fprintf(stderr, "Errore nella ricezione della risposta del server: %s\n", strerror(errno));
+        goto out;
+    }
+
+    long long sent = send_missing_chunks(file_fd, client_sock, &manifest, missing);
+
+    // anche se l'invio è fallito il server potrebbe aver inviato il motivo (es. spazio esaurito)
+    if (recv_response(client_sock, &response) < 0 || sent < 0) {
+        goto out;
+    }
+    printf("CLIENT: Il server ha salvato il file (inviati %lld byte su %llu)\n", sent, (unsigned long long)manifest.size);
+    result = 0;
+
+out:
+    free(missing);
+    free(encoded);
+    manifest_free(&manifest);
+    close(file_fd);
+    return result;
+}
@@ -0,0 +1,11 @@
+#ifndef MY_FT_DEDUP_H
+#define MY_FT_DEDUP_H
+
+#include "myFTclient.h"
+#include "myFTchunk.h"          // manifest del file locale
+
+
+long long send_missing_chunks(int file_fd, int client_sock, const manifest_t *manifest, const unsigned char *missing);
+int request_dedup_write(int client_sock, const char *from_path, const char *destination_path);
+
+#endif // MY_FT_DEDUP_H
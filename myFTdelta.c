@@ -0,0 +1,1244 @@
+// TRASFERIMENTO DELLE SOLE DIFFERENZE (FIRME, DELTA E RICOSTRUZIONE)
+
+#define _GNU_SOURCE         // per copy_file_range e mkostemp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <arpa/inet.h>      // per htonl e ntohl
+#include "myFTdelta.h"
+#include "myFTprotocol.h"   // per ft_put_u64 e ft_get_u64
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>      // SSE2 (sempre presente su x86-64) e AVX2 (scelto all'avvio se la CPU lo supporta)
+#define DELTA_X86 1
+#endif
+
+#define DELTA_NONE UINT32_MAX               // nessun blocco
+#define DELTA_BUFFER_SIZE (256 << 10)       // buffer di lettura del delta e di copia dei dati
+
+
+// Somme del checksum debole di un blocco: a = somma dei byte, b = somma dei byte pesati per la distanza dalla fine
+typedef void (*weak_sums_fn)(const unsigned char *data, size_t len, uint32_t *a, uint32_t *b);
+
+static void weak_sums_scalar(const unsigned char *data, size_t len, uint32_t *a, uint32_t *b);
+static weak_sums_fn weak_sums = weak_sums_scalar;
+static pthread_once_t weak_once = PTHREAD_ONCE_INIT;
+
+
+
+/**
+ * Aggiunge alle somme del checksum debole i byte indicati, uno alla volta.
+ *
+ * @param data I byte da aggiungere.
+ * @param len Il numero di byte.
+ * @param a La somma dei byte (aggiornata).
+ * @param b La somma pesata (aggiornata).
+ */
+static void weak_sums_scalar(const unsigned char *data, size_t len, uint32_t *a, uint32_t *b)
+{
+    uint32_t sa = *a;
+    uint32_t sb = *b;
+
+    for (size_t i = 0; i < len; i++) {
+        sa += data[i];
+        sb += sa;
+    }
+    *a = sa;
+    *b = sb;
+}
+
+
+
+#ifdef DELTA_X86
+/**
+ * Somma i quattro interi a 32 bit di un registro SSE.
+ */
+static inline uint32_t hsum_epi32(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+
+
+/**
+ * Somme del checksum debole con SSE2, 16 byte alla volta. Per ogni gruppo b cresce di 16 volte la somma
+ * dei byte precedenti più i byte del gruppo pesati da 16 a 1; le somme sono modulo 2^32 come nella versione
+ * scalare, che elabora gli ultimi byte.
+ */
+static void weak_sums_sse2(const unsigned char *data, size_t len, uint32_t *a, uint32_t *b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+    __m128i va = zero;          // somme dei byte
+    __m128i vp = zero;          // somme di va prima di ogni gruppo
+    __m128i vb = zero;          // byte pesati all'interno dei gruppi
+    size_t groups = len / 16;
+
+    for (size_t i = 0; i < groups; i++, data += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)data);
+        vp = _mm_add_epi32(vp, va);
+        va = _mm_add_epi32(va, _mm_sad_epu8(v, zero));
+        vb = _mm_add_epi32(vb, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights_lo));
+        vb = _mm_add_epi32(vb, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights_hi));
+    }
+
+    uint32_t n = (uint32_t)(groups * 16);
+    *b += *a * n + 16 * hsum_epi32(vp) + hsum_epi32(vb);
+    *a += hsum_epi32(va);
+    weak_sums_scalar(data, len % 16, a, b);
+}
+
+
+
+/**
+ * Somme del checksum debole con AVX2, 32 byte alla volta (stesso schema della versione SSE2: i byte
+ * vengono pesati da 32 a 1 con una sola moltiplicazione per coppie).
+ */
+__attribute__((target("avx2")))
+static void weak_sums_avx2(const unsigned char *data, size_t len, uint32_t *a, uint32_t *b)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    __m256i va = zero;
+    __m256i vp = zero;
+    __m256i vb = zero;
+    size_t groups = len / 32;
+
+    for (size_t i = 0; i < groups; i++, data += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)data);
+        vp = _mm256_add_epi32(vp, va);
+        va = _mm256_add_epi32(va, _mm256_sad_epu8(v, zero));
+        vb = _mm256_add_epi32(vb, _mm256_madd_epi16(_mm256_maddubs_epi16(v, weights), ones));
+    }
+
+    uint32_t sa = hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(va), _mm256_extracti128_si256(va, 1)));
+    uint32_t sp = hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(vp), _mm256_extracti128_si256(vp, 1)));
+    uint32_t sb = hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(vb), _mm256_extracti128_si256(vb, 1)));
+    uint32_t n = (uint32_t)(groups * 32);
+    *b += *a * n + 32 * sp + sb;
+    *a += sa;
+    weak_sums_scalar(data, len % 32, a, b);
+}
+#endif
+
+
+
+/**
+ * Sceglie la versione più veloce delle somme del checksum debole per la CPU corrente.
+ */
+static void weak_init(void)
+{
+#ifdef DELTA_X86
+    weak_sums = __builtin_cpu_supports("avx2") ? weak_sums_avx2 : weak_sums_sse2;
+#endif
+}
+
+
+
+/**
+ * Calcola le somme del checksum debole di un blocco.
+ */
+static void weak_block(const unsigned char *data, size_t len, uint32_t *a, uint32_t *b)
+{
+    pthread_once(&weak_once, weak_init);
+    *a = 0;
+    *b = 0;
+    weak_sums(data, len, a, b);
+}
+
+
+
+/**
+ * Calcola il checksum debole di un blocco: le due somme ridotte a 16 bit, come in rsync.
+ *
+ * @param data I byte del blocco.
+ * @param len La lunghezza del blocco.
+ * @return Il checksum debole.
+ */
+uint32_t delta_weak(const unsigned char *data, size_t len)
+{
+    uint32_t a, b;
+
+    weak_block(data, len, &a, &b);
+    return (a & 0xffff) | (b << 16);
+}
+
+
+
+/**
+ * Sceglie la dimensione dei blocchi della firma di un file: circa la radice quadrata della dimensione
+ * (firma e dati ritrasmessi per ogni modifica crescono allo stesso modo), multipla di 64 byte, tra
+ * DELTA_MIN_BLOCK e DELTA_MAX_BLOCK, ma abbastanza grande da non superare DELTA_MAX_BLOCKS blocchi.
+ *
+ * @param size La dimensione del file.
+ * @return La dimensione dei blocchi.
+ */
+uint32_t delta_block_size(uint64_t size)
+{
+    uint64_t block = 1;
+
+    while (block * block < size) {
+        block <<= 1;
+    }
+    block = (block + 63) & ~63ULL;
+    if (block < DELTA_MIN_BLOCK) {
+        block = DELTA_MIN_BLOCK;
+    }
+    if (block > DELTA_MAX_BLOCK) {
+        block = DELTA_MAX_BLOCK;
+    }
+    if ((size + block - 1) / block > DELTA_MAX_BLOCKS) {
+        block = ((size + DELTA_MAX_BLOCKS - 1) / DELTA_MAX_BLOCKS + 63) & ~63ULL;
+    }
+    return (uint32_t)block;
+}
+
+
+
+// moltiplicazione a 128 bit ripiegata su 64 bit: ogni bit del risultato dipende da tutti quelli degli operandi
+static inline uint64_t mum(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t load_le64(const unsigned char *p)
+{
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+
+
+/**
+ * Calcola il checksum forte di un blocco: un hash a 128 bit non crittografico (due accumulatori con
+ * moltiplicazioni 64x64 -> 128 bit, 16 byte per passo). Serve solo a confermare le corrispondenze del
+ * checksum debole, quindi conta la velocità: la firma di un file grande ne calcola uno per blocco.
+ *
+ * @param data I byte del blocco.
+ * @param len La lunghezza del blocco.
+ * @param strong Dove scrivere il checksum.
+ */
+void delta_strong(const unsigned char *data, size_t len, unsigned char strong[DELTA_STRONG_SIZE])
+{
+    uint64_t h1 = 0x243f6a8885a308d3ULL ^ len;
+    uint64_t h2 = 0x13198a2e03707344ULL ^ mum(len, 0x9e3779b97f4a7c15ULL);
+    unsigned char tail[16];
+
+    while (len >= 16) {
+        uint64_t a = load_le64(data);
+        uint64_t b = load_le64(data + 8);
+        h1 = rotl64(h1, 29) * 0x9e3779b97f4a7c15ULL + mum(a ^ 0xa4093822299f31d0ULL, b ^ 0x082efa98ec4e6c89ULL);
+        h2 = rotl64(h2, 31) * 0xc2b2ae3d27d4eb4fULL + mum(b ^ 0x452821e638d01377ULL, a ^ 0xbe5466cf34e90c6cULL);
+        data += 16;
+        len -= 16;
+    }
+    if (len > 0) {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, data, len);
+        uint64_t a = load_le64(tail);
+        uint64_t b = load_le64(tail + 8);
+        h1 = rotl64(h1, 29) * 0x9e3779b97f4a7c15ULL + mum(a ^ 0xa4093822299f31d0ULL, b ^ 0x082efa98ec4e6c89ULL);
+        h2 = rotl64(h2, 31) * 0xc2b2ae3d27d4eb4fULL + mum(b ^ 0x452821e638d01377ULL, a ^ 0xbe5466cf34e90c6cULL);
+    }
+
+    uint64_t x = fmix64(h1 + h2);
+    uint64_t y = fmix64(h2 ^ rotl64(h1, 32));
+    ft_put_u64(strong, x);
+    ft_put_u64(strong + 8, y);
+}
+
+
+
+/**
+ * Data di modifica di un file in nanosecondi.
+ */
+static uint64_t mtime_ns(const struct stat *statbuf)
+{
+    return (uint64_t)statbuf->st_mtim.tv_sec * 1000000000ULL + (uint64_t)statbuf->st_mtim.tv_nsec;
+}
+
+
+
+/**
+ * Legge len byte da una posizione del file, fermandosi solo alla fine del file.
+ *
+ * @return I byte letti, -1 in caso di errore (errno impostato).
+ */
+static ssize_t pread_full(int fd, unsigned char *buffer, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = pread(fd, buffer + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return (ssize_t)done;
+}
+
+
+
+/**
+ * Calcola la firma di un file: per ogni blocco il checksum debole (con le istruzioni vettoriali della CPU)
+ * e quello forte. Il file viene letto con pread, senza spostare la sua posizione.
+ *
+ * @param fd Il file descriptor del file (regolare).
+ * @param sig La firma da riempire (da liberare con delta_signature_free).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int delta_signature_build(int fd, delta_signature_t *sig)
+{
+    struct stat statbuf;
+
+    memset(sig, 0, sizeof(*sig));
+    if (fstat(fd, &statbuf) < 0) {
+        return -1;
+    }
+    if (!S_ISREG(statbuf.st_mode)) {
+        errno = EISDIR;
+        return -1;
+    }
+    sig->size = (uint64_t)statbuf.st_size;
+    sig->mtime = mtime_ns(&statbuf);
+    sig->block_size = delta_block_size(sig->size);
+    sig->count = (uint32_t)((sig->size + sig->block_size - 1) / sig->block_size);
+    if (sig->count == 0) {
+        return 0;
+    }
+
+    // il buffer contiene un numero intero di blocchi
+    size_t buffer_len = DELTA_READ_SIZE - DELTA_READ_SIZE % sig->block_size;
+    if (buffer_len < sig->block_size) {
+        buffer_len = sig->block_size;
+    }
+    unsigned char *buffer = (unsigned char *)malloc(buffer_len);
+    sig->blocks = (delta_block_t *)malloc((size_t)sig->count * sizeof(delta_block_t));
+    if (buffer == NULL || sig->blocks == NULL) {
+        free(buffer);
+        delta_signature_free(sig);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    uint32_t index = 0;
+    uint64_t offset = 0;
+    while (index < sig->count)
+    {
+        ssize_t n = pread_full(fd, buffer, buffer_len, offset);
+        if (n <= 0) {
+            if (n == 0) {
+                errno = ESTALE;     // il file si è accorciato durante la lettura
+            }
+            free(buffer);
+            delta_signature_free(sig);
+            return -1;
+        }
+        for (size_t pos = 0; pos < (size_t)n && index < sig->count; pos += sig->block_size, index++) {
+            size_t len = ((size_t)n - pos < sig->block_size) ? (size_t)n - pos : sig->block_size;
+            sig->blocks[index].weak = delta_weak(buffer + pos, len);
+            delta_strong(buffer + pos, len, sig->blocks[index].strong);
+        }
+        offset += n;
+    }
+    free(buffer);
+    return 0;
+}
+
+
+
+/**
+ * Codifica una firma nel formato descritto in myFTdelta.h.
+ *
+ * @param sig La firma.
+ * @param len Puntatore dove memorizzare la lunghezza della firma codificata.
+ * @return La firma codificata (da liberare con free) oppure NULL se manca la memoria.
+ */
+unsigned char* delta_signature_encode(const delta_signature_t *sig, size_t *len)
+{
+    size_t size = SIGNATURE_HEADER_SIZE + (size_t)sig->count * SIGNATURE_ENTRY_SIZE;
+    unsigned char *buffer = (unsigned char *)malloc(size);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    uint32_t value = htonl(sig->block_size);
+    memcpy(buffer, &value, 4);
+    ft_put_u64(buffer + 4, sig->size);
+    ft_put_u64(buffer + 12, sig->mtime);
+    value = htonl(sig->count);
+    memcpy(buffer + 20, &value, 4);
+
+    unsigned char *p = buffer + SIGNATURE_HEADER_SIZE;
+    for (uint32_t i = 0; i < sig->count; i++, p += SIGNATURE_ENTRY_SIZE) {
+        value = htonl(sig->blocks[i].weak);
+        memcpy(p, &value, 4);
+        memcpy(p + 4, sig->blocks[i].strong, DELTA_STRONG_SIZE);
+    }
+    *len = size;
+    return buffer;
+}
+
+
+
+/**
+ * Decodifica e controlla una firma ricevuta: il numero di blocchi deve corrispondere alla dimensione
+ * della base e alla dimensione dei blocchi.
+ *
+ * @param buffer La firma codificata.
+ * @param len La lunghezza della firma.
+ * @param sig La firma da riempire (da liberare con delta_signature_free).
+ * @return 0 in caso di successo, -1 se la firma non è valida (EINVAL) o manca la memoria (ENOMEM).
+ */
+int delta_signature_decode(const unsigned char *buffer, size_t len, delta_signature_t *sig)
+{
+    uint32_t value;
+
+    memset(sig, 0, sizeof(*sig));
+    if (len < SIGNATURE_HEADER_SIZE || len > SIGNATURE_MAX_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&value, buffer, 4);
+    sig->block_size = ntohl(value);
+    sig->size = ft_get_u64(buffer + 4);
+    sig->mtime = ft_get_u64(buffer + 12);
+    memcpy(&value, buffer + 20, 4);
+    sig->count = ntohl(value);
+
+    if (sig->block_size == 0 || sig->count > DELTA_MAX_BLOCKS ||
+        (sig->size + sig->block_size - 1) / sig->block_size != sig->count ||
+        len != SIGNATURE_HEADER_SIZE + (size_t)sig->count * SIGNATURE_ENTRY_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (sig->count == 0) {
+        return 0;
+    }
+
+    sig->blocks = (delta_block_t *)malloc((size_t)sig->count * sizeof(delta_block_t));
+    if (sig->blocks == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    const unsigned char *p = buffer + SIGNATURE_HEADER_SIZE;
+    for (uint32_t i = 0; i < sig->count; i++, p += SIGNATURE_ENTRY_SIZE) {
+        memcpy(&value, p, 4);
+        sig->blocks[i].weak = ntohl(value);
+        memcpy(sig->blocks[i].strong, p + 4, DELTA_STRONG_SIZE);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Libera i blocchi di una firma.
+ */
+void delta_signature_free(delta_signature_t *sig)
+{
+    free(sig->blocks);
+    sig->blocks = NULL;
+    sig->count = 0;
+}
+
+
+
+/**
+ * Aggiunge un'istruzione al delta, unendola alla precedente se la prosegue (blocchi consecutivi
+ * della base oppure dati nuovi contigui entro DELTA_LITERAL_MAX).
+ *
+ * @return 0 in caso di successo, -1 se manca la memoria.
+ */
+static int delta_add(delta_t *delta, char type, uint64_t start, uint64_t length)
+{
+    if (delta->count > 0) {
+        delta_op_t *last = &delta->ops[delta->count - 1];
+        uint64_t limit = (type == 'L') ? DELTA_LITERAL_MAX : UINT32_MAX;
+        if (last->type == type && last->start + last->length == start && last->length + length <= limit) {
+            last->length += length;
+            return 0;
+        }
+    }
+    if (delta->count == delta->capacity) {
+        size_t capacity = delta->capacity ? delta->capacity * 2 : 64;
+        delta_op_t *ops = (delta_op_t *)realloc(delta->ops, capacity * sizeof(delta_op_t));
+        if (ops == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        delta->ops = ops;
+        delta->capacity = capacity;
+    }
+    delta->ops[delta->count].type = type;
+    delta->ops[delta->count].start = start;
+    delta->ops[delta->count].length = length;
+    delta->count++;
+    return 0;
+}
+
+
+
+/**
+ * Aggiunge al delta i dati nuovi tra due posizioni del file, in istruzioni di al più DELTA_LITERAL_MAX byte.
+ */
+static int delta_add_literal(delta_t *delta, uint64_t from, uint64_t to)
+{
+    while (from < to) {
+        uint64_t len = (to - from < DELTA_LITERAL_MAX) ? to - from : DELTA_LITERAL_MAX;
+        if (delta_add(delta, 'L', from, len) < 0) {
+            return -1;
+        }
+        delta->literal_bytes += len;
+        from += len;
+    }
+    return 0;
+}
+
+
+
+// Indice dei blocchi completi della firma per checksum debole
+typedef struct
+{
+    uint32_t *heads;        // primo blocco di ogni bucket (DELTA_NONE se vuoto)
+    uint32_t *next;         // blocco successivo nello stesso bucket
+    uint32_t mask;          // bucket - 1 (potenza di 2)
+} weak_index_t;
+
+static inline uint32_t weak_bucket(const weak_index_t *index, uint32_t weak)
+{
+    return (weak * 0x9e3779b1u) >> 7 & index->mask;
+}
+
+
+
+/**
+ * Cerca tra i blocchi della firma quello con i checksum dei byte indicati. Il blocco che segue l'ultimo
+ * trovato viene provato per primo (le parti invariate sono di solito lunghe sequenze di blocchi); il
+ * checksum forte si calcola solo se almeno un blocco ha lo stesso checksum debole.
+ *
+ * @return L'indice del blocco, DELTA_NONE se nessuno coincide.
+ */
+static uint32_t find_block(const delta_signature_t *sig, const weak_index_t *index, uint32_t full, uint32_t hint,
+                           uint32_t weak, const unsigned char *data)
+{
+    unsigned char strong[DELTA_STRONG_SIZE];
+    int have_strong = 0;
+
+    if (hint < full && sig->blocks[hint].weak == weak) {
+        delta_strong(data, sig->block_size, strong);
+        have_strong = 1;
+        if (memcmp(strong, sig->blocks[hint].strong, DELTA_STRONG_SIZE) == 0) {
+            return hint;
+        }
+    }
+    for (uint32_t i = index->heads[weak_bucket(index, weak)]; i != DELTA_NONE; i = index->next[i]) {
+        if (sig->blocks[i].weak != weak || i == hint) {
+            continue;
+        }
+        if (!have_strong) {
+            delta_strong(data, sig->block_size, strong);
+            have_strong = 1;
+        }
+        if (memcmp(strong, sig->blocks[i].strong, DELTA_STRONG_SIZE) == 0) {
+            return i;
+        }
+    }
+    return DELTA_NONE;
+}
+
+
+
+/**
+ * Calcola il delta tra la base descritta da una firma e un file. Il file viene letto una volta: la finestra
+ * di un blocco avanza di un byte alla volta aggiornando il checksum debole in tempo costante e, quando un
+ * blocco della base coincide, salta di un blocco intero (il checksum della nuova finestra si ricalcola con
+ * le istruzioni vettoriali). L'ultimo blocco della base, se più corto, può coincidere solo con la fine del file.
+ * I dati nuovi restano nel file: il delta ne registra solo la posizione.
+ *
+ * @param fd Il file descriptor del nuovo file (letto con pread).
+ * @param sig La firma della base.
+ * @param delta Il delta da riempire (da liberare con delta_free).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int delta_compute(int fd, const delta_signature_t *sig, delta_t *delta)
+{
+    struct stat statbuf;
+    weak_index_t index = { NULL, NULL, 0 };
+    unsigned char *buffer = NULL;
+    int result = -1;
+
+    memset(delta, 0, sizeof(*delta));
+    if (fstat(fd, &statbuf) < 0) {
+        return -1;
+    }
+    if (!S_ISREG(statbuf.st_mode)) {
+        errno = EISDIR;
+        return -1;
+    }
+    uint32_t bs = sig->block_size;
+    uint64_t size = (uint64_t)statbuf.st_size;
+    delta->block_size = bs;
+    delta->basis_size = sig->size;
+    delta->basis_mtime = sig->mtime;
+    delta->size = size;
+
+    // indice dei blocchi completi; inseriti dall'ultimo, così ogni bucket li elenca in ordine
+    uint32_t full = (uint32_t)(sig->size / bs);
+    uint32_t buckets = 16;
+    while (buckets < 2 * (uint64_t)full) {
+        buckets <<= 1;
+    }
+    index.mask = buckets - 1;
+    index.heads = (uint32_t *)malloc(buckets * sizeof(uint32_t));
+    index.next = (uint32_t *)malloc((full ? full : 1) * sizeof(uint32_t));
+    size_t window = (DELTA_READ_SIZE > 2 * (size_t)bs) ? DELTA_READ_SIZE : 2 * (size_t)bs;
+    buffer = (unsigned char *)malloc(window);
+    if (index.heads == NULL || index.next == NULL || buffer == NULL) {
+        errno = ENOMEM;
+        goto out;
+    }
+    memset(index.heads, 0xff, buckets * sizeof(uint32_t));
+    for (uint32_t i = full; i-- > 0; ) {
+        uint32_t bucket = weak_bucket(&index, sig->blocks[i].weak);
+        index.next[i] = index.heads[bucket];
+        index.heads[bucket] = i;
+    }
+
+    uint64_t buffer_off = 0;        // posizione nel file del primo byte del buffer
+    size_t buffer_len = 0;          // byte validi nel buffer
+    uint64_t pos = 0;               // inizio della finestra
+    uint64_t literal = 0;           // inizio dei dati nuovi non ancora registrati
+    uint32_t hint = DELTA_NONE;     // blocco che segue l'ultimo trovato
+    uint32_t a = 0, b = 0;
+    int have_sums = 0;
+
+    while (full > 0 && pos + bs <= size)
+    {
+        // la finestra e il byte che la segue (per farla scorrere) devono essere nel buffer
+        uint64_t need = (pos + bs < size) ? pos + bs + 1 : size;
+        if (buffer_off + buffer_len < need) {
+            size_t keep = (size_t)(buffer_off + buffer_len - pos);
+            memmove(buffer, buffer + (pos - buffer_off), keep);
+            buffer_off = pos;
+            buffer_len = keep;
+            ssize_t n = pread_full(fd, buffer + buffer_len, window - buffer_len, buffer_off + buffer_len);
+            if (n < 0) {
+                goto out;
+            }
+            buffer_len += n;
+            if (buffer_off + buffer_len < need) {
+                errno = ESTALE;     // il file si è accorciato durante la lettura
+                goto out;
+            }
+        }
+        const unsigned char *p = buffer + (pos - buffer_off);
+
+        if (!have_sums) {
+            weak_block(p, bs, &a, &b);
+            have_sums = 1;
+        }
+        uint32_t match = find_block(sig, &index, full, hint, (a & 0xffff) | (b << 16), p);
+        if (match != DELTA_NONE) {
+            if (delta_add_literal(delta, literal, pos) < 0 || delta_add(delta, 'C', match, 1) < 0) {
+                goto out;
+            }
+            pos += bs;
+            literal = pos;
+            hint = match + 1;
+            have_sums = 0;
+            continue;
+        }
+
+        // la finestra scorre di un byte: esce p[0], entra p[bs]
+        if (pos + bs < size) {
+            uint32_t out = p[0];
+            a += p[bs] - out;
+            b += a - bs * out;
+        }
+        pos++;
+    }
+
+    // l'ultimo blocco della base, se più corto degli altri, può coincidere con la fine del file
+    uint32_t tail = (uint32_t)(sig->size % bs);
+    if (tail > 0 && size - literal >= tail) {
+        ssize_t n = pread_full(fd, buffer, tail, size - tail);
+        if (n != (ssize_t)tail) {
+            if (n >= 0) {
+                errno = ESTALE;
+            }
+            goto out;
+        }
+        const delta_block_t *last = &sig->blocks[sig->count - 1];
+        unsigned char strong[DELTA_STRONG_SIZE];
+        if (delta_weak(buffer, tail) == last->weak) {
+            delta_strong(buffer, tail, strong);
+            if (memcmp(strong, last->strong, DELTA_STRONG_SIZE) == 0) {
+                if (delta_add_literal(delta, literal, size - tail) < 0 || delta_add(delta, 'C', sig->count - 1, 1) < 0) {
+                    goto out;
+                }
+                literal = size;
+            }
+        }
+    }
+    if (delta_add_literal(delta, literal, size) < 0) {
+        goto out;
+    }
+    result = 0;
+
+out:
+    free(index.heads);
+    free(index.next);
+    free(buffer);
+    if (result < 0) {
+        int saved_errno = errno;
+        delta_free(delta);
+        errno = saved_errno;
+    }
+    return result;
+}
+
+
+
+/**
+ * Calcola la lunghezza del delta codificato, cioè il payload da annunciare prima di inviarlo.
+ */
+uint64_t delta_encoded_size(const delta_t *delta)
+{
+    uint64_t size = DELTA_HEADER_SIZE;
+
+    for (size_t i = 0; i < delta->count; i++) {
+        size += (delta->ops[i].type == 'C') ? DELTA_COPY_SIZE : DELTA_LITERAL_SIZE + delta->ops[i].length;
+    }
+    return size;
+}
+
+
+
+/**
+ * Scrive tutti i byte del buffer in un file descriptor (file o socket).
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+static int write_all(int fd, const unsigned char *buffer, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buffer, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        buffer += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Copia un intervallo di un file in un file descriptor (file o socket) con sendfile, oppure con
+ * pread e write se sendfile non è supportato tra i due descriptor.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+static int send_range(int out_fd, int src_fd, uint64_t offset, uint64_t len, unsigned char *buffer)
+{
+    off_t off = (off_t)offset;
+
+    while (len > 0) {
+        ssize_t n = sendfile(out_fd, src_fd, &off, len < (1 << 30) ? len : (1 << 30));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            break;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            errno = ESTALE;     // il file si è accorciato
+            return -1;
+        }
+        len -= n;
+    }
+
+    while (len > 0) {
+        ssize_t n = pread_full(src_fd, buffer, len < DELTA_BUFFER_SIZE ? len : DELTA_BUFFER_SIZE, (uint64_t)off);
+        if (n <= 0) {
+            if (n == 0) {
+                errno = ESTALE;
+            }
+            return -1;
+        }
+        if (write_all(out_fd, buffer, n) < 0) {
+            return -1;
+        }
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Scrive il delta codificato in un file descriptor (la socket verso chi ha la base, oppure un file).
+ * Le istruzioni vengono accumulate in un buffer; i dati nuovi passano dal file con sendfile.
+ *
+ * @param out_fd Dove scrivere il delta.
+ * @param src_fd Il nuovo file, da cui il delta è stato calcolato.
+ * @param delta Il delta.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int delta_send(int out_fd, int src_fd, const delta_t *delta)
+{
+    unsigned char *buffer = (unsigned char *)malloc(DELTA_BUFFER_SIZE);
+    size_t used = DELTA_HEADER_SIZE;
+    uint32_t value;
+    int result = -1;
+
+    if (buffer == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    value = htonl(delta->block_size);
+    memcpy(buffer, &value, 4);
+    ft_put_u64(buffer + 4, delta->basis_size);
+    ft_put_u64(buffer + 12, delta->basis_mtime);
+    ft_put_u64(buffer + 20, delta->size);
+
+    for (size_t i = 0; i < delta->count; i++)
+    {
+        const delta_op_t *op = &delta->ops[i];
+        if (used + DELTA_COPY_SIZE > DELTA_BUFFER_SIZE) {
+            if (write_all(out_fd, buffer, used) < 0) {
+                goto out;
+            }
+            used = 0;
+        }
+        buffer[used] = op->type;
+        if (op->type == 'C') {
+            value = htonl((uint32_t)op->start);
+            memcpy(buffer + used + 1, &value, 4);
+            value = htonl((uint32_t)op->length);
+            memcpy(buffer + used + 5, &value, 4);
+            used += DELTA_COPY_SIZE;
+            continue;
+        }
+
+        // dati nuovi: prima le istruzioni accumulate, poi i byte direttamente dal file
+        value = htonl((uint32_t)op->length);
+        memcpy(buffer + used + 1, &value, 4);
+        used += DELTA_LITERAL_SIZE;
+        if (write_all(out_fd, buffer, used) < 0 || send_range(out_fd, src_fd, op->start, op->length, buffer) < 0) {
+            goto out;
+        }
+        used = 0;
+    }
+    if (used > 0 && write_all(out_fd, buffer, used) < 0) {
+        goto out;
+    }
+    result = 0;
+
+out:
+    free(buffer);
+    return result;
+}
+
+
+
+// Lettore bufferizzato di un delta di lunghezza nota (da una socket o da un file)
+typedef struct
+{
+    int fd;
+    uint64_t remaining;         // byte del delta ancora da leggere dal descriptor
+    unsigned char *buffer;
+    size_t pos;                 // primo byte non consumato del buffer
+    size_t len;                 // byte validi nel buffer
+} delta_reader_t;
+
+
+
+/**
+ * Rende disponibile nel buffer almeno un byte del delta.
+ *
+ * @return I byte disponibili, 0 alla fine del delta, -1 in caso di errore (errno impostato).
+ */
+static ssize_t reader_fill(delta_reader_t *reader)
+{
+    if (reader->pos < reader->len) {
+        return (ssize_t)(reader->len - reader->pos);
+    }
+    if (reader->remaining == 0) {
+        return 0;
+    }
+    size_t want = (reader->remaining < DELTA_BUFFER_SIZE) ? (size_t)reader->remaining : DELTA_BUFFER_SIZE;
+    ssize_t n;
+    do {
+        n = read(reader->fd, reader->buffer, want);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+    if (n == 0) {
+        errno = ECONNRESET;     // il delta si è interrotto
+        return -1;
+    }
+    reader->pos = 0;
+    reader->len = n;
+    reader->remaining -= n;
+    return n;
+}
+
+
+
+/**
+ * Legge esattamente len byte del delta.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore o se il delta finisce prima (EINVAL).
+ */
+static int reader_read(delta_reader_t *reader, unsigned char *out, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = reader_fill(reader);
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EINVAL;
+            }
+            return -1;
+        }
+        size_t take = ((size_t)n < len) ? (size_t)n : len;
+        memcpy(out, reader->buffer + reader->pos, take);
+        reader->pos += take;
+        out += take;
+        len -= take;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Copia un intervallo della base nel nuovo file con copy_file_range (che su alcuni filesystem condivide
+ * i blocchi invece di copiarli), oppure con pread e pwrite.
+ */
+static int copy_basis(int basis_fd, uint64_t offset, int out_fd, uint64_t out_offset, uint64_t len, unsigned char *buffer)
+{
+    loff_t in = (loff_t)offset;
+    loff_t out = (loff_t)out_offset;
+
+    while (len > 0) {
+        ssize_t n = copy_file_range(basis_fd, &in, out_fd, &out, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;      // non supportato tra i due file: si copia con pread e pwrite
+        }
+        len -= n;
+    }
+
+    while (len > 0) {
+        ssize_t n = pread_full(basis_fd, buffer, len < DELTA_BUFFER_SIZE ? len : DELTA_BUFFER_SIZE, (uint64_t)in);
+        if (n <= 0) {
+            if (n == 0) {
+                errno = ESTALE;
+            }
+            return -1;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = pwrite(out_fd, buffer + done, n - done, out + done);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w < 0) {
+                return -1;
+            }
+            done += w;
+        }
+        in += n;
+        out += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Ricostruisce il nuovo file applicando un delta alla base. Prima di tutto si controlla che la base sia
+ * ancora quella della firma (dimensione e data di modifica); ogni istruzione viene verificata prima di
+ * eseguirla, così un delta non valido non scrive oltre la dimensione annunciata.
+ *
+ * @param in_fd Da dove leggere il delta (socket o file, dalla posizione corrente).
+ * @param length La lunghezza del delta.
+ * @param basis_fd La base.
+ * @param out_fd Il nuovo file, vuoto.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato: EINVAL se il delta non è valido,
+ *         ESTALE se la base è cambiata dopo il calcolo della firma).
+ */
+int delta_apply(int in_fd, uint64_t length, int basis_fd, int out_fd)
+{
+    struct stat statbuf;
+    unsigned char header[DELTA_HEADER_SIZE];
+    uint32_t value;
+    int result = -1;
+
+    delta_reader_t reader = { in_fd, length, (unsigned char *)malloc(DELTA_BUFFER_SIZE), 0, 0 };
+    unsigned char *copy_buffer = (unsigned char *)malloc(DELTA_BUFFER_SIZE);
+    if (reader.buffer == NULL || copy_buffer == NULL) {
+        errno = ENOMEM;
+        goto out;
+    }
+    if (reader_read(&reader, header, DELTA_HEADER_SIZE) < 0 || fstat(basis_fd, &statbuf) < 0) {
+        goto out;
+    }
+    memcpy(&value, header, 4);
+    uint32_t bs = ntohl(value);
+    uint64_t basis_size = ft_get_u64(header + 4);
+    uint64_t basis_mtime = ft_get_u64(header + 12);
+    uint64_t size = ft_get_u64(header + 20);
+    if (bs == 0) {
+        errno = EINVAL;
+        goto out;
+    }
+    if ((uint64_t)statbuf.st_size != basis_size || mtime_ns(&statbuf) != basis_mtime) {
+        errno = ESTALE;
+        goto out;
+    }
+    uint64_t blocks = (basis_size + bs - 1) / bs;
+
+    uint64_t written = 0;
+    for (;;)
+    {
+        ssize_t available = reader_fill(&reader);
+        if (available < 0) {
+            goto out;
+        }
+        if (available == 0) {
+            break;
+        }
+
+        unsigned char op[DELTA_COPY_SIZE];
+        if (reader_read(&reader, op, 1) < 0) {
+            goto out;
+        }
+        if (op[0] == 'C')
+        {
+            if (reader_read(&reader, op + 1, 8) < 0) {
+                goto out;
+            }
+            memcpy(&value, op + 1, 4);
+            uint64_t first = ntohl(value);
+            memcpy(&value, op + 5, 4);
+            uint64_t count = ntohl(value);
+            if (count == 0 || first + count > blocks) {
+                errno = EINVAL;
+                goto out;
+            }
+            uint64_t offset = first * bs;
+            uint64_t len = (count * bs < basis_size - offset) ? count * bs : basis_size - offset;
+            if (written + len > size) {
+                errno = EINVAL;
+                goto out;
+            }
+            if (copy_basis(basis_fd, offset, out_fd, written, len, copy_buffer) < 0) {
+                goto out;
+            }
+            written += len;
+        }
+        else if (op[0] == 'L')
+        {
+            if (reader_read(&reader, op + 1, 4) < 0) {
+                goto out;
+            }
+            memcpy(&value, op + 1, 4);
+            uint64_t len = ntohl(value);
+            if (written + len > size) {
+                errno = EINVAL;
+                goto out;
+            }
+            // i dati nuovi vanno dal buffer del lettore al file, senza altre copie
+            while (len > 0) {
+                ssize_t n = reader_fill(&reader);
+                if (n <= 0) {
+                    if (n == 0) {
+                        errno = EINVAL;
+                    }
+                    goto out;
+                }
+                size_t take = ((uint64_t)n < len) ? (size_t)n : (size_t)len;
+                ssize_t w = pwrite(out_fd, reader.buffer + reader.pos, take, (off_t)written);
+                if (w < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (w < 0) {
+                    goto out;
+                }
+                reader.pos += w;
+                written += w;
+                len -= w;
+            }
+        }
+        else {
+            errno = EINVAL;
+            goto out;
+        }
+    }
+
+    if (written != size) {
+        errno = EINVAL;
+        goto out;
+    }
+    result = 0;
+
+out:
+    free(reader.buffer);
+    free(copy_buffer);
+    return result;
+}
+
+
+
+/**
+ * Aggiorna un file applicando un delta: il nuovo contenuto si costruisce in un file temporaneo accanto
+ * (con i permessi del file originale) che poi lo sostituisce atomicamente. Se qualcosa va storto il file
+ * originale resta com'era.
+ *
+ * @param path Il file da aggiornare (la base del delta).
+ * @param in_fd Da dove leggere il delta (socket o file, dalla posizione corrente).
+ * @param length La lunghezza del delta.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int delta_patch(const char *path, int in_fd, uint64_t length)
+{
+    struct stat statbuf;
+    int saved_errno;
+
+    int basis_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (basis_fd < 0) {
+        return -1;
+    }
+    if (fstat(basis_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+        close(basis_fd);
+        errno = EISDIR;
+        return -1;
+    }
+
+    size_t len = strlen(path) + sizeof(DELTA_TMP_SUFFIX);
+    char *tmp = (char *)malloc(len);
+    if (tmp == NULL) {
+        close(basis_fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    snprintf(tmp, len, "%s%s", path, DELTA_TMP_SUFFIX);
+    int out_fd = mkostemp(tmp, O_CLOEXEC);
+    if (out_fd < 0) {
+        saved_errno = errno;
+        close(basis_fd);
+        free(tmp);
+        errno = saved_errno;
+        return -1;
+    }
+
+    int result = delta_apply(in_fd, length, basis_fd, out_fd);
+    if (result == 0 && fchmod(out_fd, statbuf.st_mode & 07777) < 0) {
+        result = -1;
+    }
+    saved_errno = errno;
+    if (close(out_fd) < 0 && result == 0) {
+        result = -1;
+        saved_errno = errno;
+    }
+    if (result == 0 && rename(tmp, path) < 0) {
+        result = -1;
+        saved_errno = errno;
+    }
+    if (result < 0) {
+        unlink(tmp);
+    }
+    close(basis_fd);
+    free(tmp);
+    errno = saved_errno;
+    return result;
+}
+
+
+
+/**
+ * Crea un file temporaneo anonimo (già rimosso dalla directory) dove appoggiare un delta.
+ *
+ * @param dir La directory del file temporaneo, NULL per quella dei file temporanei del sistema.
+ * @return Il file descriptor (da chiudere), -1 in caso di errore (errno impostato).
+ */
+int delta_spool(const char *dir)
+{
+    char path[4096];
+
+    if (dir == NULL || dir[0] == '\0') {
+        dir = getenv("TMPDIR");
+        if (dir == NULL || dir[0] == '\0') {
+            dir = P_tmpdir;
+        }
+    }
+    if ((size_t)snprintf(path, sizeof(path), "%s/.myft-delta-XXXXXX", dir) >= sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+
+
+/**
+ * Libera le istruzioni di un delta.
+ */
+void delta_free(delta_t *delta)
+{
+    free(delta->ops);
+    delta->ops = NULL;
+    delta->count = delta->capacity = 0;
+}
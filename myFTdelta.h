@@ -0,0 +1,102 @@
+#ifndef MY_FT_DELTA_H
+#define MY_FT_DELTA_H
+
+#include <stdint.h>         // per i tipi a dimensione fissa
+#include <stddef.h>         // per size_t
+
+// Trasferimento delle sole differenze tra due versioni di un file (come rsync). Chi ha la versione vecchia
+// (la base) ne invia la firma: per ogni blocco un checksum debole, che si aggiorna in tempo costante
+// spostando la finestra di un byte, e uno forte. Chi ha la versione nuova la scorre byte per byte, riconosce
+// i blocchi della base ovunque si trovino e produce il delta: istruzioni di copia dei blocchi della base e
+// dati nuovi. La firma:
+//
+//   offset  dim  campo
+//   0       4    dimensione dei blocchi
+//   4       8    dimensione della base
+//   12      8    data di modifica della base (nanosecondi)
+//   20      4    numero di blocchi (l'ultimo può essere più corto)
+//   24      20   per ogni blocco: checksum debole (4 byte) e forte (DELTA_STRONG_SIZE byte)
+//
+// Il delta:
+//
+//   0       4    dimensione dei blocchi della firma
+//   4       8    dimensione della base
+//   12      8    data di modifica della base: chi applica il delta controlla che la base non sia cambiata
+//   20      8    dimensione del nuovo file
+//   28      ...  istruzioni: 'C', primo blocco (4 byte) e numero di blocchi (4 byte) da copiare dalla base,
+//                oppure 'L', lunghezza (4 byte) e i byte nuovi
+//
+// Tutti i campi sono in ordine di rete (big-endian).
+
+#define DELTA_MIN_BLOCK 2048                    // blocchi più piccoli renderebbero la firma troppo grande
+#define DELTA_MAX_BLOCK (128 << 10)             // oltre, una piccola modifica costa un blocco troppo grande
+#define DELTA_MAX_BLOCKS (1 << 21)              // blocchi al massimo di una firma (i file enormi usano blocchi più grandi)
+#define DELTA_STRONG_SIZE 16                    // byte del checksum forte di un blocco
+#define DELTA_READ_SIZE (4 << 20)               // byte letti dal file a ogni passo
+#define DELTA_LITERAL_MAX (1 << 30)             // byte nuovi al massimo in un'istruzione 'L'
+#define SIGNATURE_HEADER_SIZE 24
+#define SIGNATURE_ENTRY_SIZE (4 + DELTA_STRONG_SIZE)
+#define SIGNATURE_MAX_SIZE (SIGNATURE_HEADER_SIZE + (size_t)DELTA_MAX_BLOCKS * SIGNATURE_ENTRY_SIZE)
+#define DELTA_HEADER_SIZE 28
+#define DELTA_COPY_SIZE 9                       // istruzione 'C'
+#define DELTA_LITERAL_SIZE 5                    // istruzione 'L' (senza i byte che la seguono)
+#define DELTA_TMP_SUFFIX ".delta-XXXXXX"        // file in costruzione accanto a quello da aggiornare
+
+
+// Un blocco della firma
+typedef struct
+{
+    uint32_t weak;                              // checksum debole (scorrevole)
+    unsigned char strong[DELTA_STRONG_SIZE];    // checksum forte
+} delta_block_t;
+
+
+// Firma di un file
+typedef struct
+{
+    uint32_t block_size;        // byte di ogni blocco (tranne l'ultimo)
+    uint64_t size;              // dimensione del file
+    uint64_t mtime;             // data di modifica in nanosecondi
+    uint32_t count;             // numero di blocchi
+    delta_block_t *blocks;      // blocchi nell'ordine del file
+} delta_signature_t;
+
+
+// Un'istruzione del delta
+typedef struct
+{
+    char type;                  // 'C' copia dalla base, 'L' dati nuovi
+    uint64_t start;             // 'C': primo blocco della base; 'L': posizione dei dati nel nuovo file
+    uint64_t length;            // 'C': numero di blocchi; 'L': byte
+} delta_op_t;
+
+
+// Delta tra una base (nota attraverso la sua firma) e un file
+typedef struct
+{
+    uint32_t block_size;        // dimensione dei blocchi della firma
+    uint64_t basis_size;        // dimensione della base
+    uint64_t basis_mtime;       // data di modifica della base
+    uint64_t size;              // dimensione del nuovo file
+    delta_op_t *ops;            // istruzioni nell'ordine del nuovo file
+    size_t count;               // numero di istruzioni
+    size_t capacity;            // istruzioni allocate
+    uint64_t literal_bytes;     // byte nuovi da trasferire
+} delta_t;
+
+uint32_t delta_block_size(uint64_t size);
+uint32_t delta_weak(const unsigned char *data, size_t len);
+void delta_strong(const unsigned char *data, size_t len, unsigned char strong[DELTA_STRONG_SIZE]);
+int delta_signature_build(int fd, delta_signature_t *sig);
+unsigned char* delta_signature_encode(const delta_signature_t *sig, size_t *len);
+int delta_signature_decode(const unsigned char *buffer, size_t len, delta_signature_t *sig);
+void delta_signature_free(delta_signature_t *sig);
+int delta_compute(int fd, const delta_signature_t *sig, delta_t *delta);
+uint64_t delta_encoded_size(const delta_t *delta);
+int delta_send(int out_fd, int src_fd, const delta_t *delta);
+int delta_apply(int in_fd, uint64_t length, int basis_fd, int out_fd);
+int delta_patch(const char *path, int in_fd, uint64_t length);
+int delta_spool(const char *dir);
+void delta_free(delta_t *delta);
+
+#endif // MY_FT_DELTA_H
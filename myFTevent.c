@@ -0,0 +1,1969 @@
+// SERVER A EVENTI (EPOLL)
+
+#define _GNU_SOURCE         // necessaria per accept4, splice e SO_REUSEPORT
+
+#include <fcntl.h>
+#include <sys/epoll.h>      // per epoll_create1, epoll_ctl, epoll_wait
+#include <sys/sendfile.h>   // per sendfile()
+#include <sys/eventfd.h>    // per eventfd, con cui il thread ausiliario risveglia il ciclo
+#include "myFTevent.h"
+
+
+// esito di un passo della macchina a stati di una connessione
+typedef enum
+{
+    STEP_DONE,          // fase completata
+    STEP_WAIT,          // la socket non è pronta: si riprende al prossimo evento
+    STEP_ERROR          // errore o disconnessione: la connessione va chiusa
+} step_result_t;
+
+static void conn_advance(event_loop_t *loop, connection_t *conn);
+static step_result_t start_dedup(event_loop_t *loop, connection_t *conn);
+
+
+
+/**
+ * Restituisce il numero di thread del server a eventi da usare di default (uno per core).
+ *
+ * @return Il numero di core disponibili (almeno 1).
+ */
+int default_event_threads(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+
+
+/**
+ * Crea una socket di ascolto non bloccante con SO_REUSEPORT: ogni thread ne apre una sulla stessa
+ * porta e il kernel distribuisce le nuove connessioni tra di esse.
+ *
+ * @param address Indirizzo e porta su cui mettersi in ascolto.
+ * @return Il file descriptor della socket oppure -1 in caso di errore.
+ */
+static int open_listener(const struct sockaddr_in *address)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Errore durante la creazione della socket del server: %s\n", strerror(errno));
+        return -1;
+    }
+
+    transfer_tune_socket(fd);       // le connessioni accettate ereditano i buffer della socket di ascolto
+
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        fprintf(stderr, "Errore durante l'impostazione di SO_REUSEPORT: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (bind(fd, (const struct sockaddr *)address, sizeof(*address)) < 0) {
+        fprintf(stderr, "Errore durante il binding: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "Errore listen: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+
+/**
+ * Cambia gli eventi per cui una connessione viene notificata.
+ *
+ * @param loop Il ciclo a eventi che gestisce la connessione.
+ * @param conn La connessione.
+ * @param events Gli eventi epoll di interesse (0 per nessuno).
+ */
+static void conn_set_events(event_loop_t *loop, connection_t *conn, uint32_t events)
+{
+    if (conn->events == events) {
+        return;
+    }
+    conn->events = events;
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = conn;
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, conn->client->sockfd, &ev) < 0) {
+        LOG_ERROR("Errore durante l'aggiornamento degli eventi della connessione: %s", strerror(errno));
+    }
+}
+
+
+
+/**
+ * Rilascia le risorse della richiesta in corso: lock, file, pipe e buffer.
+ *
+ * @param conn La connessione.
+ */
+static void conn_release(connection_t *conn)
+{
+    if (conn->file_fd >= 0) {
+        close(conn->file_fd);
+    }
+    if (conn->spool != NULL) {
+        unlink(conn->spool);            // scrittura non conclusa o dati danneggiati: il file richiesto resta com'era
+        free(conn->spool);
+    }
+
+    // le cache non devono attendere l'evento inotify o il cambio della data di modifica per vedere la scrittura
+    if ((conn->opz == 'w' || conn->opz == 'd') && conn->fullpath != NULL) {
+        char *part = (conn->framed && (conn->request.flags & FT_FLAG_PARTIAL)) ? partial_path(conn->fullpath) : NULL;
+        metacache_invalidate(part ? part : conn->fullpath);
+        filecache_invalidate(part ? part : conn->fullpath);
+        free(part);
+    }
+    path_lock_release(conn->lock);
+    path_lock_cancel(conn->pending_lock);
+    shape_flow_end(&conn->client->shape);
+
+    if (conn->pipe_fds[0] >= 0) {
+        close(conn->pipe_fds[0]);
+        close(conn->pipe_fds[1]);
+    }
+
+    free(conn->fullpath);
+    store_free_plan(conn->plan);
+    if (conn->cached != NULL) {
+        filecache_release(conn->cached);    // il buffer è il contenuto del file in cache
+    } else if (conn->pooled) {
+        transfer_buffer_release(conn->buffer);
+    } else {
+        free(conn->buffer);
+    }
+}
+
+
+
+/**
+ * Registra nelle metriche la richiesta in corso, conclusa o interrotta: operazione, latenza e byte trasferiti.
+ *
+ * @param conn La connessione.
+ * @param aborted 1 se la richiesta si interrompe con la chiusura della connessione.
+ */
+static void conn_account(connection_t *conn, int aborted)
+{
+    if (conn->started_us == 0) {
+        return;                         // nessuna richiesta in corso (es. sessione inattiva)
+    }
+
+    // i dati di una lettura escono dal file, oppure dal buffer per liste, informazioni e file in cache
+    if (conn->opz == 'w' || conn->opz == 'd') {
+        metrics_bytes(conn->bytes, 0);
+    } else {
+        metrics_bytes(0, conn->file_fd >= 0 ? conn->bytes : conn->buffer_off);
+    }
+    metrics_request(conn->opz, conn->started_us);
+    if (aborted) {
+        metrics_abort();
+    }
+    conn->started_us = 0;
+}
+
+
+
+/**
+ * Chiude una connessione: rilascia il lock, chiude file e socket e rimuove il client dal registro.
+ *
+ * @param conn La connessione da chiudere.
+ */
+static void conn_close(connection_t *conn)
+{
+    conn_account(conn, 1);
+    conn_release(conn);
+    metrics_connection_closed();
+
+    close(conn->client->sockfd);        // la chiusura rimuove anche la socket dall'istanza epoll
+    remove_client(conn->client);
+
+    free(conn->client);
+    free(conn);
+}
+
+
+
+/**
+ * Prepara una connessione di una sessione (FT_FLAG_KEEP_ALIVE) a ricevere la richiesta successiva.
+ *
+ * @param conn La connessione.
+ */
+static void conn_reset(connection_t *conn)
+{
+    client_t *cli = conn->client;
+    uint32_t events = conn->events;
+    unsigned int requests = conn->requests;
+
+    conn_release(conn);
+    memset(conn, 0, sizeof(*conn));
+
+    conn->client = cli;
+    conn->events = events;              // la socket resta registrata nell'istanza epoll
+    conn->requests = requests + 1;
+    conn->state = CONN_OPTION;
+    conn->length = -1;
+    conn->file_fd = -1;
+    conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+}
+
+
+
+/**
+ * Accetta tutte le connessioni in attesa sulla socket di ascolto e le registra nell'istanza epoll.
+ *
+ * @param loop Il ciclo a eventi che accetta le connessioni.
+ */
+static void accept_connections(event_loop_t *loop)
+{
+    while (1)
+    {
+        struct sockaddr_in client_address;
+        socklen_t client_len = sizeof(client_address);
+
+        int fd = accept4(loop->listen_fd, (struct sockaddr *)&client_address, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERROR("Errore durante l' accettazione del client: %s", strerror(errno));
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        connection_t *conn = (connection_t *)calloc(1, sizeof(connection_t));
+        client_t *cli = (client_t *)malloc(sizeof(client_t));
+        if (conn == NULL || cli == NULL) {
+            LOG_ERROR("Errore durante l'allocazione della connessione: %s", strerror(errno));
+            free(conn);
+            free(cli);
+            close(fd);
+            continue;
+        }
+
+        cli->address = client_address;
+        cli->sockfd = fd;
+        cli->uid = __atomic_fetch_add(&uid_counter, 1, __ATOMIC_RELAXED);
+        shape_flow_init(&cli->shape, &client_address);
+
+        conn->client = cli;
+        conn->state = CONN_OPTION;
+        conn->length = -1;
+        conn->events = EPOLLIN;
+        conn->file_fd = -1;
+        conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+
+        if (add_client(cli) < 0) {
+            free(cli);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        metrics_connection_opened();
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOG_ERROR("Errore durante la registrazione della connessione: %s", strerror(errno));
+            conn_close(conn);
+        }
+    }
+}
+
+
+
+/**
+ * Prepara l'invio di una risposta breve e la fase in cui passare una volta inviata.
+ * Con l'intestazione binaria la risposta riporta l'esito, altrimenti è la conferma 'T'; una risposta
+ * seguita dai dati riporta FT_FLAG_TRAILER se i dati saranno seguiti dal loro CRC32C.
+ *
+ * @param conn La connessione.
+ * @param status L'esito della richiesta (ignorato dal protocollo precedente).
+ * @param payload_len I byte di dati che seguiranno la risposta.
+ * @param next La fase successiva all'invio.
+ */
+static void conn_reply(connection_t *conn, ft_status_t status, uint64_t payload_len, conn_state_t next)
+{
+    if (conn->framed) {
+        ft_header_t header;
+        ft_header_init(&header, conn->opz, status, payload_len);
+        if (conn->trailer && next != CONN_DONE) {
+            header.flags = FT_FLAG_TRAILER;
+        }
+        ft_header_encode(&header, conn->reply);
+        conn->reply_len = FT_HEADER_SIZE;
+    } else {
+        conn->reply[0] = LEGACY_ACK;
+        conn->reply_len = 1;
+    }
+    conn->reply_off = 0;
+    conn->status = status;
+    conn->after_reply = next;
+    if (conn->framed) {
+        metrics_error(status);
+    }
+    conn->state = CONN_REPLY;
+}
+
+
+
+/**
+ * Conclude una richiesta fallita: con l'intestazione binaria il client riceve l'esito prima della
+ * chiusura, con il protocollo precedente la connessione viene semplicemente chiusa.
+ * Se i dati di una scrittura sono già in arrivo (FT_FLAG_NO_CONTINUE oppure dopo FT_STATUS_CONTINUE, sempre
+ * per il manifest e i chunk di un caricamento con deduplicazione) vengono prima scartati, così il client riceve
+ * l'esito e la sessione resta allineata.
+ *
+ * @param conn La connessione.
+ * @param status L'esito dell'errore.
+ * @return STEP_DONE se c'è una risposta da inviare, STEP_ERROR altrimenti.
+ */
+static step_result_t conn_fail(connection_t *conn, ft_status_t status)
+{
+    if (!conn->framed) {
+        return STEP_ERROR;
+    }
+    // il payload che segue la richiesta (manifest, firma o dati già in arrivo) va scartato fino alla fine
+    if (conn->opz == 'd' || (conn->opz == 'r' && (conn->request.flags & FT_FLAG_DELTA)) ||
+        (conn->opz == 'w' && ((conn->request.flags & FT_FLAG_NO_CONTINUE) || conn->state == CONN_RECV_FILE))) {
+        if (conn->length < 0 && conn->request.payload_len != FT_LENGTH_UNKNOWN) {
+            conn->length = (long long)conn->request.payload_len;
+        }
+        if (conn->trailer && conn->state == CONN_RECV_FILE) {
+            conn->length += FT_TRAILER_SIZE;    // anche il checksum che segue i dati è già in arrivo
+        }
+        conn->status = status;
+        conn->state = CONN_DRAIN;
+        return STEP_DONE;
+    }
+    conn_reply(conn, status, 0, CONN_DONE);
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Riceve il primo byte: l'operazione richiesta (protocollo precedente) oppure il primo byte del magic
+ * dell'intestazione binaria.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo.
+ */
+static step_result_t step_option(connection_t *conn)
+{
+    ssize_t n = recv(conn->client->sockfd, conn->header, 1, 0);
+
+    if (n == 1) {
+        conn->started_us = metrics_now_us();
+        conn->header_len = 1;
+        conn->framed = (conn->header[0] == (unsigned char)(FT_MAGIC >> 24));
+        conn->opz = (char)conn->header[0];
+        return STEP_DONE;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return STEP_WAIT;
+    }
+    if (n < 0) {
+        LOG_ERROR("Errore durante la ricezione del operazione richiesta dal client: %s", strerror(errno));
+    } else if (conn->requests > 0) {
+        LOG_INFO("Il client %d ha chiuso la sessione", conn->client->uid);    // fine normale di una sessione
+    }
+    return STEP_ERROR;
+}
+
+
+
+/**
+ * Riceve il resto dell'intestazione binaria e la decodifica.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo.
+ */
+static step_result_t step_header(connection_t *conn)
+{
+    while (conn->header_len < FT_HEADER_SIZE)
+    {
+        ssize_t n = recv(conn->client->sockfd, conn->header + conn->header_len, FT_HEADER_SIZE - conn->header_len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return STEP_WAIT;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                LOG_ERROR("Errore durante la ricezione dell'intestazione: %s", strerror(errno));
+            }
+            return STEP_ERROR;
+        }
+        conn->header_len += n;
+    }
+
+    int valid = (ft_header_decode(conn->header, &conn->request) == 0);
+    conn->opz = conn->request.opcode;
+    if (!valid || (conn->opz != 'w' && conn->opz != 'r' && conn->opz != 'l' && conn->opz != 'i' && conn->opz != 'd' && conn->opz != 's')) {
+        // dopo un'intestazione non valida non si sa dove inizi la richiesta successiva
+        LOG_ERROR("Errore, intestazione non valida dal client %d", conn->client->uid);
+        conn_reply(conn, FT_STATUS_BAD_REQUEST, 0, CONN_DONE);
+        return STEP_DONE;
+    }
+
+    conn->keep_alive = (conn->request.flags & FT_FLAG_KEEP_ALIVE) != 0;
+    if (conn->keep_alive && conn->requests == 0) {
+        // in una sessione le risposte brevi non devono attendere l'algoritmo di Nagle
+        int nodelay = 1;
+        setsockopt(conn->client->sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Riceve il percorso inviato dal client: con il protocollo precedente 5 byte nulli, il percorso e il
+ * terminatore '\0', con l'intestazione binaria esattamente path_len byte (più l'intervallo con FT_FLAG_RANGE).
+ * A differenza di una singola recv il percorso può arrivare diviso su più segmenti TCP.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo.
+ */
+static step_result_t step_path(connection_t *conn)
+{
+    char chunk[BUFFER_SIZE];
+    size_t framed_len = conn->request.path_len + ((conn->request.flags & FT_FLAG_RANGE) ? FT_RANGE_SIZE : 0);
+
+    while (1)
+    {
+        // con l'intestazione binaria si legge solo il percorso, senza consumare i dati che lo seguono
+        size_t wanted = conn->framed ? framed_len - conn->path_len : sizeof(chunk);
+        if (conn->framed && wanted == 0) {
+            if (conn->request.flags & FT_FLAG_RANGE) {
+                ft_range_decode((unsigned char *)conn->path + conn->request.path_len, &conn->request);
+                conn->path_len = conn->request.path_len;
+            }
+            conn->path[conn->path_len] = '\0';
+            if (strlen(conn->path) != conn->path_len) {
+                LOG_ERROR("Errore, il percorso ricevuto dal client %d contiene byte nulli", conn->client->uid);
+                return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+            }
+            return STEP_DONE;
+        }
+
+        ssize_t n = recv(conn->client->sockfd, conn->framed ? conn->path + conn->path_len : chunk, wanted, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return STEP_WAIT;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                LOG_ERROR("Errore durante la ricezione del percorso: %s", strerror(errno));
+            } else {
+                LOG_INFO("Il client %d si è disconnesso", conn->client->uid);
+            }
+            return STEP_ERROR;
+        }
+        if (conn->framed) {
+            conn->path_len += n;
+            continue;
+        }
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (conn->padding_seen < LEGACY_PATH_PADDING && chunk[i] == '\0' && conn->path_len == 0) {
+                conn->padding_seen++;           // byte nullo iniziale
+            } else if (chunk[i] == '\0') {
+                conn->path[conn->path_len] = '\0';
+                return STEP_DONE;               // terminatore: percorso completo
+            } else if (conn->path_len + 1 < BUFFER_SIZE) {
+                conn->path[conn->path_len++] = chunk[i];
+            } else {
+                LOG_ERROR("Errore, percorso ricevuto dal client %d troppo lungo", conn->client->uid);
+                return STEP_ERROR;
+            }
+        }
+    }
+}
+
+
+
+/**
+ * Preleva i byte di dati appena inviati dai limiti di banda della connessione. Se un limite è superato la
+ * connessione resta sospesa fino a paused_until: conn_advance la mette nella lista di attesa del ciclo.
+ *
+ * @param conn La connessione.
+ * @param bytes I byte inviati.
+ * @return 1 se la connessione deve sospendere l'invio, 0 altrimenti.
+ */
+static int conn_pace(connection_t *conn, size_t bytes)
+{
+    uint64_t wait = shape_take(&conn->client->shape, bytes);
+
+    if (wait == 0) {
+        return 0;
+    }
+    conn->paused_until = metrics_now_us() + wait;
+    return 1;
+}
+
+
+
+/**
+ * Controlla se la connessione è ancora sospesa da un limite di banda.
+ *
+ * @param conn La connessione.
+ * @return 1 se deve ancora attendere, 0 se può inviare.
+ */
+static int conn_paused(connection_t *conn)
+{
+    if (conn->paused_until == 0) {
+        return 0;
+    }
+    if (metrics_now_us() < conn->paused_until) {
+        return 1;
+    }
+    conn->paused_until = 0;
+    return 0;
+}
+
+
+
+/**
+ * Invia la risposta breve preparata da conn_reply.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo.
+ */
+static step_result_t step_reply(connection_t *conn)
+{
+    if (conn_paused(conn)) {
+        return STEP_WAIT;
+    }
+
+    // dati già in memoria (liste, file dalla cache) partono con la risposta nella stessa sendmsg
+    int with_buffer = (conn->after_reply == CONN_SEND_BUFFER && conn->buffer_off < conn->buffer_len);
+
+    while (conn->reply_off < conn->reply_len)
+    {
+        struct iovec iov[2];
+        struct msghdr msg;
+
+        iov[0].iov_base = conn->reply + conn->reply_off;
+        iov[0].iov_len = conn->reply_len - conn->reply_off;
+        iov[1].iov_base = conn->buffer + conn->buffer_off;
+        iov[1].iov_len = conn->buffer_len - conn->buffer_off;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = with_buffer ? 2 : 1;
+
+        ssize_t n = sendmsg(conn->client->sockfd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return STEP_WAIT;
+            }
+            LOG_ERROR("Errore durante l'invio della risposta al client: %s", strerror(errno));
+            return STEP_ERROR;
+        }
+        size_t reply_part = ((size_t)n < iov[0].iov_len) ? (size_t)n : iov[0].iov_len;
+        conn->reply_off += reply_part;
+        conn->buffer_off += n - reply_part;
+        conn_pace(conn, n - reply_part);    // l'eventuale attesa riguarda il resto del buffer
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Costruisce le informazioni su un file con i CRC32C dei blocchi o con la firma (FT_FLAG_CHECKSUM,
+ * FT_FLAG_DELTA), che leggono tutto il file. Eseguita dal thread ausiliario del ciclo.
+ *
+ * @param conn La connessione.
+ */
+static void offload_info(connection_t *conn)
+{
+    // con FT_FLAG_PARTIAL le informazioni riguardano il file parziale di un caricamento da riprendere
+    char *path = (conn->request.flags & FT_FLAG_PARTIAL) ? partial_path(conn->fullpath) : strdup(conn->fullpath);
+    conn->buffer = (path != NULL) ? build_info(path, conn->request.flags, &conn->buffer_len) : NULL;
+    int saved_errno = errno;
+    free(path);
+    conn->offload_status = (conn->buffer != NULL) ? FT_STATUS_OK : ft_status_from_errno(saved_errno);
+}
+
+
+
+/**
+ * Costruisce la lista di una directory: legge e ordina tutte le voci (con una stat per voce) quando non
+ * sono nella cache dei metadati, e la lista ricorsiva (FT_FLAG_RECURSIVE) visita tutto l'albero.
+ * Eseguita dal thread ausiliario del ciclo.
+ *
+ * @param conn La connessione.
+ */
+static void offload_listing(connection_t *conn)
+{
+    if (conn->framed && (conn->request.flags & FT_FLAG_RECURSIVE)) {
+        conn->buffer = build_tree_listing(conn->fullpath, &conn->buffer_len);
+    } else {
+        conn->buffer = build_listing(conn->fullpath, conn->framed ? &conn->request : NULL, &conn->buffer_len);
+    }
+    conn->offload_status = (conn->buffer != NULL) ? FT_STATUS_OK : ft_status_from_errno(errno);
+}
+
+
+
+/**
+ * Affida al thread ausiliario del ciclo un lavoro che legge un file o un albero per intero: eseguito nel
+ * ciclo fermerebbe tutte le sue connessioni fino alla fine. La connessione resta senza eventi sulla
+ * socket finché il lavoro non si conclude, poi riprende da finish_offload.
+ *
+ * @param loop Il ciclo a eventi.
+ * @param conn La connessione.
+ * @param work Il lavoro, che lascia il risultato nella connessione e l'esito in offload_status.
+ * @return STEP_WAIT.
+ */
+static step_result_t conn_offload(event_loop_t *loop, connection_t *conn, void (*work)(connection_t *conn))
+{
+    conn->offload = work;
+    conn->offload_status = FT_STATUS_OK;
+    conn->next_offload = NULL;
+    conn->state = CONN_OFFLOAD;
+
+    pthread_mutex_lock(&loop->offload_mutex);
+    if (loop->offload_tail != NULL) {
+        loop->offload_tail->next_offload = conn;
+    } else {
+        loop->offload_head = conn;
+    }
+    loop->offload_tail = conn;
+    pthread_cond_signal(&loop->offload_cond);
+    pthread_mutex_unlock(&loop->offload_mutex);
+    return STEP_WAIT;
+}
+
+
+
+/**
+ * Conclude nel ciclo un lavoro eseguito dal thread ausiliario: prepara la risposta con il risultato, o
+ * prosegue il caricamento con deduplicazione di cui è stato calcolato il piano.
+ *
+ * @param loop Il ciclo a eventi.
+ * @param conn La connessione.
+ * @return L'esito del passo.
+ */
+static step_result_t finish_offload(event_loop_t *loop, connection_t *conn)
+{
+    if (conn->offload != NULL) {
+        return STEP_WAIT;                   // lavoro ancora in corso
+    }
+    if (conn->offload_final) {
+        conn->offload_final = 0;
+        conn_reply(conn, conn->offload_status, 0, CONN_DONE);   // i dati sono già stati ricevuti tutti
+        return STEP_DONE;
+    }
+    if (conn->offload_status != FT_STATUS_OK) {
+        return conn_fail(conn, conn->offload_status);
+    }
+
+    if (conn->opz == 'd') {
+        return start_dedup(loop, conn);
+    } else if (conn->opz == 'r') {
+        conn_reply(conn, FT_STATUS_OK, conn->length, CONN_SEND_FILE);      // il delta nel file temporaneo
+    } else if (!conn->framed) {
+        conn->state = CONN_SEND_BUFFER;     // la lista del protocollo precedente: la conferma è già partita
+    } else {
+        conn_reply(conn, FT_STATUS_OK, conn->buffer_len, CONN_SEND_BUFFER);
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Riprende le connessioni i cui lavori sono stati conclusi dal thread ausiliario (segnalate dall'eventfd),
+ * chiudendo quelle i cui client si sono disconnessi nel frattempo.
+ *
+ * @param loop Il ciclo a eventi.
+ */
+static void resume_offloaded(event_loop_t *loop)
+{
+    uint64_t count;
+    if (read(loop->offload_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("Errore durante la lettura dell'eventfd: %s", strerror(errno));
+    }
+
+    pthread_mutex_lock(&loop->offload_mutex);
+    connection_t *conn = loop->offload_done;
+    loop->offload_done = NULL;
+    pthread_mutex_unlock(&loop->offload_mutex);
+
+    while (conn != NULL)
+    {
+        connection_t *next = conn->next_offload;
+        conn->next_offload = NULL;
+        conn->offload = NULL;
+
+        if (conn->closed) {
+            conn_close(conn);
+        } else {
+            conn_advance(loop, conn);
+        }
+        conn = next;
+    }
+}
+
+
+
+/**
+ * Thread ausiliario di un ciclo a eventi: esegue in ordine i lavori affidati con conn_offload e
+ * segnala al ciclo quelli conclusi.
+ *
+ * @param arg Puntatore all'event_loop_t del ciclo.
+ * @return Non ritorna.
+ */
+static void *offload_run(void *arg)
+{
+    event_loop_t *loop = (event_loop_t *)arg;
+    uint64_t one = 1;
+
+    while (1)
+    {
+        pthread_mutex_lock(&loop->offload_mutex);
+        while (loop->offload_head == NULL) {
+            pthread_cond_wait(&loop->offload_cond, &loop->offload_mutex);
+        }
+        connection_t *conn = loop->offload_head;
+        loop->offload_head = conn->next_offload;
+        if (loop->offload_head == NULL) {
+            loop->offload_tail = NULL;
+        }
+        pthread_mutex_unlock(&loop->offload_mutex);
+
+        log_context(conn->client->uid, conn->opz);
+        conn->offload(conn);
+
+        pthread_mutex_lock(&loop->offload_mutex);
+        conn->next_offload = loop->offload_done;
+        loop->offload_done = conn;
+        pthread_mutex_unlock(&loop->offload_mutex);
+
+        if (write(loop->offload_fd, &one, sizeof(one)) < 0) {
+            LOG_ERROR("Errore durante la scrittura dell'eventfd: %s", strerror(errno));
+        }
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Prepara l'operazione richiesta una volta ottenuto il lock: apre il file o costruisce la lista e, con
+ * l'intestazione binaria, prepara la risposta con l'esito e la dimensione dei dati. Le operazioni che leggono
+ * un file o un albero per intero prima di rispondere passano al thread ausiliario del ciclo.
+ *
+ * @param loop Il ciclo a eventi.
+ * @param conn La connessione.
+ * @return STEP_DONE se l'operazione può cominciare (o c'è un esito da inviare), STEP_WAIT se è stata affidata
+ *         al thread ausiliario, STEP_ERROR altrimenti.
+ */
+static step_result_t start_operation(event_loop_t *loop, connection_t *conn)
+{
+    struct stat statbuf;
+
+    if (conn->opz == 'r') {
+        shape_flow_begin(&conn->client->shape);     // il download entra nella divisione della banda
+    }
+
+    if (conn->opz == 'r' && conn->framed && (conn->request.flags & FT_FLAG_DELTA))
+    {
+        // la firma della copia del client segue subito la richiesta: senza una dimensione nota non si resta allineati
+        conn->length = (long long)conn->request.payload_len;
+        if (conn->request.payload_len == FT_LENGTH_UNKNOWN || conn->length < 0) {
+            conn->keep_alive = 0;
+            conn_reply(conn, FT_STATUS_BAD_REQUEST, 0, CONN_DONE);
+            return STEP_DONE;
+        }
+        if ((unsigned long long)conn->length > SIGNATURE_MAX_SIZE || (conn->request.flags & FT_FLAG_RANGE)) {
+            return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+        }
+        conn->buffer = (char *)malloc(conn->length > 0 ? conn->length : 1);
+        if (conn->buffer == NULL) {
+            return conn_fail(conn, FT_STATUS_IO_ERROR);
+        }
+        conn->state = CONN_RECV_BUFFER;
+    }
+
+    else if (conn->opz == 'r')
+    {
+        // un file piccolo letto spesso parte dalla memoria: la risposta e i dati escono insieme da step_reply
+        conn->cached = filecache_acquire(conn->fullpath);
+        if (conn->cached != NULL)
+        {
+            size_t offset;
+            unsigned long long hits, misses;
+
+            conn->length = cached_read_length(conn->cached, conn->framed ? &conn->request : NULL, &offset);
+            if (conn->length < 0) {
+                return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+            }
+            conn->buffer = (conn->length > 0) ? conn->cached->data + offset : NULL;
+            conn->buffer_len = (size_t)conn->length;
+            conn->trailer = (conn->framed && (conn->request.flags & FT_FLAG_TRAILER));
+            conn->crc = conn->trailer ? crc32c(0, conn->buffer, conn->buffer_len) : 0;
+            conn->state = CONN_SEND_BUFFER;
+            filecache_stats(&hits, &misses);
+            LOG_INFO("Invio di %lld byte dalla cache dei file (%llu successi, %llu mancati)", conn->length, hits, misses);
+            if (conn->framed) {
+                conn_reply(conn, FT_STATUS_OK, conn->length, CONN_SEND_BUFFER);
+            }
+            return STEP_DONE;
+        }
+
+        conn->file_fd = open(conn->fullpath, O_RDONLY | O_CLOEXEC);
+        if (conn->file_fd < 0) {
+            LOG_ERROR("Errore apertura file: %s", strerror(errno));
+            return conn_fail(conn, ft_status_from_errno(errno));
+        }
+        conn->state = CONN_SEND_FILE;
+
+        // la dimensione annunciata è stabile: il lock condiviso esclude le scritture sullo stesso percorso
+        if (conn->framed) {
+            if (fstat(conn->file_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+                LOG_ERROR("Errore, il percorso '%s' non è un file regolare", conn->fullpath);
+                return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+            }
+            conn->length = statbuf.st_size;
+
+            // un intervallo viene limitato alla fine del file e letto dalla sua posizione
+            if (conn->request.flags & FT_FLAG_RANGE) {
+                conn->length = range_read_length(&conn->request, conn->length);
+                if (!valid_range(&conn->request) || lseek(conn->file_fd, (off_t)conn->request.range_offset, SEEK_SET) < 0) {
+                    return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+                }
+            }
+            conn->trailer = (conn->request.flags & FT_FLAG_TRAILER) != 0;
+            conn_reply(conn, FT_STATUS_OK, conn->length, CONN_SEND_FILE);
+        }
+    }
+
+    else if (conn->opz == 'w')
+    {
+        char *dirpath = NULL;
+        char *filename = NULL;
+
+        if (conn->framed && conn->request.payload_len != FT_LENGTH_UNKNOWN) {
+            conn->length = (long long)conn->request.payload_len;
+            if (conn->length < 0) {
+                // dimensioni oltre 2^63 - 1 non sono rappresentabili: i dati non si possono scartare
+                conn->keep_alive = 0;
+                conn_reply(conn, FT_STATUS_BAD_REQUEST, 0, CONN_DONE);
+                return STEP_DONE;
+            }
+        }
+        if (conn->framed && !valid_range(&conn->request)) {
+            return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+        }
+        // un delta ha una dimensione nota e sostituisce l'intero file
+        int delta = (conn->framed && (conn->request.flags & FT_FLAG_DELTA));
+        if (delta && (conn->length < 0 || (conn->request.flags & (FT_FLAG_RANGE | FT_FLAG_PARTIAL)))) {
+            return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+        }
+
+        divide_dirpath_from_filename(conn->fullpath, &dirpath, &filename);
+        int is_dir = ensure_directory_exists(dirpath);
+        int saved_errno = errno;
+        if (is_dir && store_contains(conn->fullpath)) {
+            is_dir = 0;
+            saved_errno = EACCES;       // l'archivio dei contenuti deduplicati non si scrive direttamente
+        }
+
+        // lo spazio si misura sulla directory, prima di troncare un eventuale file esistente
+        conn->max_bytes = is_dir ? available_bytes(dirpath[0] ? dirpath : "/") : 0;
+        free(dirpath);
+        free(filename);
+        if (!is_dir) {
+            return conn_fail(conn, ft_status_from_errno(saved_errno));
+        }
+        if (conn->max_bytes == 0) {
+            LOG_ERROR("Errore nel controllo della memoria disponibile sul dispositivo");
+            return conn_fail(conn, FT_STATUS_IO_ERROR);
+        }
+
+        if (conn->length >= 0 && (unsigned long long)conn->length > conn->max_bytes) {
+            LOG_WARN("Memoria piena, il file annunciato è di %lld byte", conn->length);
+            return conn_fail(conn, FT_STATUS_NO_SPACE);
+        }
+
+        // un intervallo si scrive nel file esistente, portato alla dimensione finale, senza troncarlo;
+        // un caricamento da riprendere si scrive nel file parziale, rinominato quando è completo
+        int range = (conn->framed && (conn->request.flags & FT_FLAG_RANGE));
+        char *part = (conn->framed && (conn->request.flags & FT_FLAG_PARTIAL)) ? partial_path(conn->fullpath) : NULL;
+        if (part == NULL && conn->framed && (conn->request.flags & FT_FLAG_PARTIAL)) {
+            return conn_fail(conn, ft_status_from_errno(errno));
+        }
+        // un delta si riceve in un file temporaneo accanto al file da aggiornare, che deve esistere, e così una
+        // scrittura intera seguita dal checksum, che sostituisce il file solo se il checksum coincide;
+        // un file collegato all'archivio dei contenuti deduplicati va prima separato
+        int checked = (conn->framed && !(conn->request.flags & FT_FLAG_NO_CONTINUE) && !range && !delta &&
+                       conn->length >= 0 && (conn->request.flags & FT_FLAG_TRAILER));
+        if (delta) {
+            conn->file_fd = open_delta_spool(conn->fullpath);
+        } else if (checked) {
+            conn->file_fd = open_write_spool(part ? part : conn->fullpath, &conn->spool);
+        } else if (store_unshare(part ? part : conn->fullpath, range) == 0) {
+            conn->file_fd = open(part ? part : conn->fullpath, range ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }
+        free(part);
+        if (conn->file_fd < 0 || (range && prepare_range_file(conn->file_fd, &conn->request) < 0)) {
+            LOG_ERROR("Errore apertura file: %s", strerror(errno));
+            return conn_fail(conn, ft_status_from_errno(errno));
+        }
+
+        // dimensione nota: lo spazio viene preallocato tutto in una volta (i filesystem senza fallocate sono ignorati)
+        off_t offset = range ? (off_t)conn->request.range_offset : 0;
+        if (conn->length > 0 && fallocate(conn->file_fd, 0, offset, conn->length) < 0 && errno == ENOSPC) {
+            return conn_fail(conn, FT_STATUS_NO_SPACE);
+        }
+
+        // la pipe per splice serve solo in modalità zerocopy; se non si riesce a crearla si usa il buffer
+        if (server_transfer_mode == TRANSFER_ZEROCOPY && pipe2(conn->pipe_fds, O_CLOEXEC | O_NONBLOCK) == 0) {
+            fcntl(conn->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+        } else {
+            conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+        }
+        conn->state = CONN_RECV_FILE;
+
+        // il client attende il via libera prima di inviare i dati (a meno che li stia già inviando);
+        // il checksum che segue i dati si accetta solo con una dimensione nota
+        if (conn->framed && !(conn->request.flags & FT_FLAG_NO_CONTINUE)) {
+            conn->trailer = (!delta && conn->length >= 0 && (conn->request.flags & FT_FLAG_TRAILER));
+            conn_reply(conn, FT_STATUS_CONTINUE, 0, CONN_RECV_FILE);
+        }
+    }
+
+    else if (conn->opz == 'd' && conn->framed)
+    {
+        char *dirpath = NULL;
+        char *filename = NULL;
+
+        // il manifest segue subito la richiesta: senza una dimensione nota non si può restare allineati
+        conn->length = (long long)conn->request.payload_len;
+        if (conn->request.payload_len == FT_LENGTH_UNKNOWN || conn->length < 0) {
+            conn->keep_alive = 0;
+            conn_reply(conn, FT_STATUS_BAD_REQUEST, 0, CONN_DONE);
+            return STEP_DONE;
+        }
+        if (!store_enabled()) {
+            LOG_WARN("Deduplicazione non attiva (opzione -D)");
+            return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+        }
+        if (conn->length == 0 || conn->length > MANIFEST_MAX_SIZE || (conn->request.flags & (FT_FLAG_RANGE | FT_FLAG_PARTIAL))) {
+            return conn_fail(conn, FT_STATUS_BAD_REQUEST);
+        }
+        if (store_contains(conn->fullpath)) {
+            return conn_fail(conn, FT_STATUS_DENIED);
+        }
+
+        divide_dirpath_from_filename(conn->fullpath, &dirpath, &filename);
+        int is_dir = ensure_directory_exists(dirpath);
+        int saved_errno = errno;
+        free(dirpath);
+        free(filename);
+        if (!is_dir) {
+            return conn_fail(conn, ft_status_from_errno(saved_errno));
+        }
+
+        conn->buffer = (char *)malloc(conn->length);
+        if (conn->buffer == NULL) {
+            return conn_fail(conn, FT_STATUS_IO_ERROR);
+        }
+        conn->state = CONN_RECV_BUFFER;
+    }
+
+    else if (conn->opz == 'l')
+    {
+        if (conn->framed && metacache_stat(conn->fullpath, &statbuf) < 0) {
+            return conn_fail(conn, ft_status_from_errno(errno));
+        }
+        // una directory grande (o un albero) richiede secondi: la lista si costruisce fuori dal ciclo
+        return conn_offload(loop, conn, offload_listing);
+    }
+
+    else if (conn->opz == 'i' && conn->framed && (conn->request.flags & (FT_FLAG_CHECKSUM | FT_FLAG_DELTA)))
+    {
+        return conn_offload(loop, conn, offload_info);     // checksum e firma leggono tutto il file
+    }
+
+    else if (conn->opz == 'i' && conn->framed)
+    {
+        // con FT_FLAG_PARTIAL le informazioni riguardano il file parziale di un caricamento da riprendere
+        char *path = (conn->request.flags & FT_FLAG_PARTIAL) ? partial_path(conn->fullpath) : strdup(conn->fullpath);
+        conn->buffer = (path != NULL) ? build_info(path, conn->request.flags, &conn->buffer_len) : NULL;
+        free(path);
+        if (conn->buffer == NULL) {
+            return conn_fail(conn, ft_status_from_errno(errno));
+        }
+        conn->state = CONN_SEND_BUFFER;
+        conn_reply(conn, FT_STATUS_OK, conn->buffer_len, CONN_SEND_BUFFER);
+    }
+
+    else {
+        LOG_ERROR("Operazione %c non valida", conn->opz);
+        return STEP_ERROR;
+    }
+
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Prova ad acquisire il lock sul percorso senza bloccare il thread e, se ci riesce, avvia l'operazione.
+ * Se il lock è occupato la connessione viene messa nella lista di attesa del ciclo a eventi.
+ *
+ * @param loop Il ciclo a eventi.
+ * @param conn La connessione.
+ * @return L'esito del passo (STEP_WAIT se la connessione è in attesa del lock).
+ */
+static step_result_t step_lock(event_loop_t *loop, connection_t *conn)
+{
+    // le scritture di un intervallo condividono il lock: le connessioni di una stessa copia scrivono parti diverse del file
+    // (non quelle di un file parziale, che alla fine sostituisce il percorso); un caricamento con deduplicazione è esclusivo
+    int exclusive = (conn->opz == 'd' || (conn->opz == 'w' && !(conn->framed && (conn->request.flags & (FT_FLAG_RANGE | FT_FLAG_PARTIAL)) == FT_FLAG_RANGE)));
+    // uno scrittore resta registrato sull'entry mentre attende, così i nuovi lettori non lo scavalcano
+    conn->lock = path_lock_try_acquire(conn->fullpath, exclusive, &conn->pending_lock);
+
+    if (conn->lock == NULL) {
+        if (errno != EBUSY) {
+            return STEP_ERROR;
+        }
+        // nessun evento sulla socket finché il lock non si libera (solo EPOLLHUP/EPOLLERR)
+        conn_set_events(loop, conn, 0);
+        conn->next_waiting = loop->waiting;
+        loop->waiting = conn;
+        return STEP_WAIT;
+    }
+
+    return start_operation(loop, conn);
+}
+
+
+
+/**
+ * Calcola quanti byte trasferire al prossimo passo senza superare la dimensione annunciata.
+ *
+ * @param conn La connessione.
+ * @param chunk Dimensione massima del blocco.
+ * @return Il numero di byte da trasferire.
+ */
+static size_t conn_chunk(const connection_t *conn, size_t chunk)
+{
+    if (conn->length >= 0 && (unsigned long long)conn->length - conn->bytes < chunk) {
+        return (size_t)((unsigned long long)conn->length - conn->bytes);
+    }
+    return chunk;
+}
+
+
+
+/**
+ * Restituisce la posizione nel file del prossimo byte da trasferire (l'inizio dell'intervallo più i byte
+ * già trasferiti), da cui il checksum rilegge i byte passati con sendfile o splice.
+ *
+ * @param conn La connessione.
+ * @return La posizione nel file.
+ */
+static off_t conn_file_offset(const connection_t *conn)
+{
+    off_t start = (conn->framed && (conn->request.flags & FT_FLAG_RANGE)) ? (off_t)conn->request.range_offset : 0;
+    return start + (off_t)conn->bytes;
+}
+
+
+
+/**
+ * Prepara l'invio del CRC32C che segue i dati di una lettura (FT_FLAG_TRAILER), come una risposta breve
+ * dopo la quale la richiesta è conclusa.
+ *
+ * @param conn La connessione.
+ */
+static void conn_send_trailer(connection_t *conn)
+{
+    ft_trailer_encode(conn->reply, conn->crc);
+    conn->reply_len = FT_TRAILER_SIZE;
+    conn->reply_off = 0;
+    conn->after_reply = CONN_DONE;
+    conn->state = CONN_REPLY;
+}
+
+
+
+/**
+ * Invia il file al client finché la socket accetta dati.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo (STEP_DONE a fine file o raggiunta la dimensione annunciata).
+ */
+static step_result_t step_send_file(connection_t *conn)
+{
+    int sock = conn->client->sockfd;
+
+    if (conn_paused(conn)) {
+        return STEP_WAIT;
+    }
+
+    while (conn->buffer == NULL)
+    {
+        if (conn_chunk(conn, transfer_sendfile_chunk()) == 0) {
+            return STEP_DONE;
+        }
+        ssize_t n = (server_transfer_mode == TRANSFER_ZEROCOPY) ? sendfile(sock, conn->file_fd, NULL, conn_chunk(conn, transfer_sendfile_chunk())) : -1;
+
+        if (n > 0) {
+            // i dati non passano dallo spazio utente: il checksum li rilegge dalla page cache
+            if (conn->trailer && file_crc32c_update(conn->file_fd, conn_file_offset(conn), n, &conn->crc) < 0) {
+                LOG_ERROR("Errore durante il calcolo del checksum del file: %s", strerror(errno));
+                return STEP_ERROR;
+            }
+            conn->bytes += n;
+            if (conn_pace(conn, n)) {
+                return STEP_WAIT;
+            }
+            continue;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (server_transfer_mode == TRANSFER_ZEROCOPY) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return STEP_WAIT;
+            }
+            if (errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) {
+                LOG_ERROR("Errore durante l'invio dei dati del file al client: %s", strerror(errno));
+                return STEP_ERROR;
+            }
+        }
+
+        // modalità buffered o sendfile non supportato: si prosegue con read/send in un blocco del pool del thread
+        conn->buffer = (char *)transfer_buffer_acquire();
+        if (conn->buffer == NULL) {
+            return STEP_ERROR;
+        }
+        conn->pooled = 1;
+    }
+
+    while (conn->buffer != NULL)
+    {
+        if (conn->buffer_off == conn->buffer_len)
+        {
+            if (conn_chunk(conn, transfer_chunk_size()) == 0) {
+                return STEP_DONE;
+            }
+            ssize_t bytes_read = read(conn->file_fd, conn->buffer, conn_chunk(conn, transfer_chunk_size()));
+            if (bytes_read < 0) {
+                LOG_ERROR("Errore durante la lettura del file: %s", strerror(errno));
+                return STEP_ERROR;
+            }
+            if (bytes_read == 0) {
+                break;
+            }
+            conn->buffer_len = bytes_read;
+            conn->buffer_off = 0;
+            if (conn->trailer) {
+                conn->crc = crc32c(conn->crc, conn->buffer, bytes_read);
+            }
+        }
+
+        ssize_t n = send(sock, conn->buffer + conn->buffer_off, conn->buffer_len - conn->buffer_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return STEP_WAIT;
+            }
+            LOG_ERROR("Errore durante l'invio dei dati del file al client: %s", strerror(errno));
+            return STEP_ERROR;
+        }
+        conn->buffer_off += n;
+        conn->bytes += n;
+        if (conn_pace(conn, n)) {
+            return STEP_WAIT;
+        }
+    }
+
+    // fine del file: con una dimensione annunciata il file non deve essersi accorciato nel frattempo
+    if (conn->length >= 0 && conn->bytes < (unsigned long long)conn->length) {
+        LOG_ERROR("Errore, il file '%s' si è accorciato durante l'invio", conn->fullpath);
+        return STEP_ERROR;
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Invia al client il contenuto del buffer della connessione (lista della directory).
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo (STEP_DONE quando il buffer è stato inviato tutto).
+ */
+static step_result_t step_send_buffer(connection_t *conn)
+{
+    if (conn_paused(conn)) {
+        return STEP_WAIT;
+    }
+    while (conn->buffer_off < conn->buffer_len)
+    {
+        ssize_t n = send(conn->client->sockfd, conn->buffer + conn->buffer_off, conn->buffer_len - conn->buffer_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return STEP_WAIT;
+            }
+            LOG_ERROR("Errore durante l'invio di dati al client: %s", strerror(errno));
+            return STEP_ERROR;
+        }
+        conn->buffer_off += n;
+        if (conn_pace(conn, n)) {
+            return STEP_WAIT;
+        }
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Riceve in memoria il payload annunciato (il manifest di un caricamento con deduplicazione o la firma
+ * di una lettura delle differenze).
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo (STEP_DONE quando il payload è stato ricevuto tutto).
+ */
+static step_result_t step_recv_buffer(connection_t *conn)
+{
+    while (conn->bytes < (unsigned long long)conn->length)
+    {
+        ssize_t n = recv(conn->client->sockfd, conn->buffer + conn->bytes, conn->length - conn->bytes, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return STEP_WAIT;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                LOG_ERROR("Errore durante la ricezione dei dati della richiesta: %s", strerror(errno));
+            } else {
+                LOG_INFO("Il client %d si è disconnesso", conn->client->uid);
+            }
+            return STEP_ERROR;
+        }
+        conn->bytes += n;
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Decodifica il manifest di un caricamento con deduplicazione e stabilisce quali chunk mancano
+ * all'archivio. Eseguita dal thread ausiliario del ciclo: il piano consulta l'indice per ogni chunk.
+ *
+ * @param conn La connessione, con il manifest ricevuto nel buffer.
+ */
+static void offload_dedup_plan(connection_t *conn)
+{
+    conn->offload_status = store_plan((unsigned char *)conn->buffer, (size_t)conn->length, &conn->plan);
+}
+
+
+
+/**
+ * Conclude un caricamento con deduplicazione: costruisce il contenuto dai chunk ricevuti e da quelli
+ * dell'archivio e lo collega al percorso richiesto. Eseguita dal thread ausiliario del ciclo: la
+ * costruzione legge, verifica e scrive tutto il contenuto.
+ *
+ * @param conn La connessione, con i chunk ricevuti nel file temporaneo (-1 se non ne mancava nessuno).
+ */
+static void offload_dedup_commit(connection_t *conn)
+{
+    conn->offload_status = store_commit(conn->plan, conn->file_fd, conn->fullpath);
+}
+
+
+
+/**
+ * Prosegue un caricamento con deduplicazione dopo il piano. Se non manca nessun chunk il percorso viene
+ * collegato subito, altrimenti si invia FT_STATUS_CONTINUE con la bitmap dei chunk mancanti (nel buffer
+ * del manifest, che non serve più) e ci si prepara a ricevere solo quelli.
+ *
+ * @param loop Il ciclo a eventi.
+ * @param conn La connessione, con il piano del caricamento.
+ * @return STEP_DONE se c'è una risposta da inviare, STEP_WAIT se il collegamento è stato affidato al
+ *         thread ausiliario, STEP_ERROR altrimenti.
+ */
+static step_result_t start_dedup(event_loop_t *loop, connection_t *conn)
+{
+    if (conn->plan->whole) {
+        LOG_INFO("Contenuto già presente nell'archivio, nessun dato da ricevere");
+        conn->offload_final = 1;
+        return conn_offload(loop, conn, offload_dedup_commit);
+    }
+
+    conn->file_fd = store_open_spool();
+    if (conn->file_fd < 0) {
+        return conn_fail(conn, ft_status_from_errno(errno));
+    }
+    LOG_INFO("Mancano %llu byte su %llu", conn->plan->missing_bytes, (unsigned long long)conn->plan->manifest.size);
+
+    memcpy(conn->buffer, conn->plan->missing, conn->plan->missing_len);
+    conn->buffer_len = conn->plan->missing_len;
+    conn->buffer_off = 0;
+    conn->length = (long long)conn->plan->missing_bytes;
+    conn->bytes = 0;
+    conn->max_bytes = conn->plan->missing_bytes;
+
+    if (server_transfer_mode == TRANSFER_ZEROCOPY && pipe2(conn->pipe_fds, O_CLOEXEC | O_NONBLOCK) == 0) {
+        fcntl(conn->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    } else {
+        conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+    }
+    conn_reply(conn, FT_STATUS_CONTINUE, conn->buffer_len, CONN_SEND_BUFFER);
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Calcola il delta del file rispetto alla firma ricevuta dal client e lo prepara in un file temporaneo,
+ * da cui viene inviato come un file qualsiasi (con sendfile in modalità zerocopy). Eseguita dal thread
+ * ausiliario del ciclo: il calcolo legge tutto il file.
+ *
+ * @param conn La connessione, con la firma ricevuta nel buffer.
+ */
+static void offload_delta_read(connection_t *conn)
+{
+    delta_signature_t sig;
+    delta_t delta;
+
+    int decoded = delta_signature_decode((unsigned char *)conn->buffer, (size_t)conn->length, &sig);
+    free(conn->buffer);
+    conn->buffer = NULL;
+    if (decoded < 0) {
+        conn->offload_status = (errno == EINVAL) ? FT_STATUS_BAD_REQUEST : FT_STATUS_IO_ERROR;
+        return;
+    }
+
+    int file_fd = open(conn->fullpath, O_RDONLY | O_CLOEXEC);
+    int computed = (file_fd >= 0) ? delta_compute(file_fd, &sig, &delta) : -1;
+    delta_signature_free(&sig);
+    if (computed == 0) {
+        conn->file_fd = delta_spool(NULL);
+        if (conn->file_fd < 0 || delta_send(conn->file_fd, file_fd, &delta) < 0 || lseek(conn->file_fd, 0, SEEK_SET) < 0) {
+            computed = -1;
+        }
+    }
+    int saved_errno = errno;
+    if (file_fd >= 0) {
+        close(file_fd);
+    }
+    if (computed < 0) {
+        LOG_ERROR("Errore durante il calcolo delle differenze di '%s': %s", conn->fullpath, strerror(saved_errno));
+        if (file_fd >= 0) {
+            delta_free(&delta);
+        }
+        conn->offload_status = ft_status_from_errno(saved_errno);
+        return;
+    }
+
+    conn->length = (long long)delta_encoded_size(&delta);
+    conn->bytes = 0;
+    LOG_INFO("Differenze di %s: %llu byte nuovi su %llu, delta di %lld byte", conn->fullpath,
+                (unsigned long long)delta.literal_bytes, (unsigned long long)delta.size, conn->length);
+    delta_free(&delta);
+}
+
+
+
+/**
+ * Scrive nel file tutti i byte presenti nella pipe (splice pipe -> file, con ripiego su read/write).
+ *
+ * @param conn La connessione.
+ * @param pending I byte presenti nella pipe.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+static int drain_pipe(connection_t *conn, size_t pending)
+{
+    char buffer[BUFFER_SIZE];
+
+    while (pending > 0)
+    {
+        ssize_t n = splice(conn->pipe_fds[0], NULL, conn->file_fd, NULL, pending, SPLICE_F_MOVE);
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+        {
+            // il filesystem non accetta splice: copia attraverso un buffer
+            n = read(conn->pipe_fds[0], buffer, pending < sizeof(buffer) ? pending : sizeof(buffer));
+            if (n > 0 && write(conn->file_fd, buffer, n) != n) {
+                n = -1;
+            }
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        pending -= n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve i dati del file finché la socket ne ha di disponibili e li scrive su disco.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo (STEP_DONE raggiunta la dimensione annunciata o quando il client chiude il lato di scrittura).
+ */
+static step_result_t step_recv_file(connection_t *conn)
+{
+    int sock = conn->client->sockfd;
+
+    while (conn_chunk(conn, SPLICE_PIPE_SIZE) > 0)
+    {
+        ssize_t n;
+
+        if (conn->pipe_fds[0] >= 0)
+        {
+            // socket -> pipe -> file senza passare dallo spazio utente
+            n = splice(sock, NULL, conn->pipe_fds[1], NULL, conn_chunk(conn, SPLICE_PIPE_SIZE), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                close(conn->pipe_fds[0]);
+                close(conn->pipe_fds[1]);
+                conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+                continue;
+            }
+            if (n > 0 && drain_pipe(conn, n) < 0) {
+                LOG_ERROR("Errore nella scrittura dei byte nel file: %s", strerror(errno));
+                conn->bytes += n;       // già tolti dalla socket
+                return conn_fail(conn, ft_status_from_errno(errno));
+            }
+            if (n > 0 && conn->trailer && file_crc32c_update(conn->file_fd, conn_file_offset(conn), n, &conn->crc) < 0) {
+                LOG_ERROR("Errore durante il calcolo del checksum del file: %s", strerror(errno));
+                conn->bytes += n;
+                return conn_fail(conn, FT_STATUS_IO_ERROR);
+            }
+        }
+        else
+        {
+            if (conn->buffer == NULL) {
+                if ((conn->buffer = (char *)transfer_buffer_acquire()) == NULL) {
+                    return STEP_ERROR;
+                }
+                conn->pooled = 1;
+            }
+            n = recv(sock, conn->buffer, conn_chunk(conn, transfer_chunk_size()), 0);
+            if (n > 0 && write(conn->file_fd, conn->buffer, n) != n) {
+                LOG_ERROR("Errore nella scrittura dei byte nel file: %s", strerror(errno));
+                conn->bytes += n;       // già tolti dalla socket
+                return conn_fail(conn, ft_status_from_errno(errno));
+            }
+            if (n > 0 && conn->trailer) {
+                conn->crc = crc32c(conn->crc, conn->buffer, n);
+            }
+        }
+
+        if (n == 0) {
+            // il client ha chiuso la connessione (o il lato di scrittura): fine del file
+            if (conn->length >= 0) {
+                LOG_ERROR("Errore, il client %d si è disconnesso prima di inviare tutto il file", conn->client->uid);
+                return STEP_ERROR;
+            }
+            return STEP_DONE;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return STEP_WAIT;
+            }
+            LOG_ERROR("Errore durante la ricezione dei dati: %s", strerror(errno));
+            return STEP_ERROR;
+        }
+
+        conn->bytes += n;
+        if (conn->bytes > conn->max_bytes) {
+            LOG_WARN("Memoria piena");
+            return conn_fail(conn, FT_STATUS_NO_SPACE);
+        }
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Riceve il CRC32C che segue i dati di una scrittura (FT_FLAG_TRAILER) nel buffer dell'intestazione,
+ * che non serve più.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo (STEP_DONE quando il checksum è stato ricevuto tutto).
+ */
+static step_result_t step_recv_trailer(connection_t *conn)
+{
+    while (conn->header_len < FT_TRAILER_SIZE)
+    {
+        ssize_t n = recv(conn->client->sockfd, conn->header + conn->header_len, FT_TRAILER_SIZE - conn->header_len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return STEP_WAIT;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                LOG_ERROR("Errore durante la ricezione del checksum dei dati: %s", strerror(errno));
+            } else {
+                LOG_INFO("Il client %d si è disconnesso", conn->client->uid);
+            }
+            return STEP_ERROR;
+        }
+        conn->header_len += n;
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Ricostruisce il file aggiornato dal delta ricevuto e dal file esistente. Eseguita dal thread ausiliario
+ * del ciclo: la ricostruzione legge e riscrive tutto il file.
+ *
+ * @param conn La connessione, con il delta ricevuto nel file temporaneo.
+ */
+static void offload_finish_delta(connection_t *conn)
+{
+    conn->offload_status = finish_delta(conn->fullpath, conn->file_fd, conn->length);
+}
+
+
+
+/**
+ * Prepara l'esito finale di una scrittura ricevuta interamente: con l'intestazione binaria il client lo
+ * attende, e il file temporaneo di una scrittura con checksum o un file parziale completato sostituisce il
+ * percorso richiesto prima della risposta.
+ *
+ * @param loop Il ciclo a eventi.
+ * @param conn La connessione.
+ * @return STEP_DONE, o STEP_WAIT se il completamento è stato affidato al thread ausiliario.
+ */
+static step_result_t finish_write(event_loop_t *loop, connection_t *conn)
+{
+    // checksum verificato: il file temporaneo prende il posto del file richiesto (o di quello parziale)
+    if (conn->spool != NULL) {
+        int partial = (conn->request.flags & FT_FLAG_PARTIAL) != 0;
+        char *part = partial ? partial_path(conn->fullpath) : NULL;
+        ft_status_t status = (partial && part == NULL) ? FT_STATUS_IO_ERROR : FT_STATUS_OK;
+        status = finish_write_spool(part ? part : conn->fullpath, conn->spool, status);
+        conn->spool = NULL;
+        free(part);
+        if (status != FT_STATUS_OK) {
+            conn_reply(conn, status, 0, CONN_DONE);
+            return STEP_DONE;
+        }
+    }
+
+    if (conn->opz == 'd') {
+        conn->offload_final = 1;
+        return conn_offload(loop, conn, offload_dedup_commit);
+    } else if (conn->framed && (conn->request.flags & FT_FLAG_DELTA)) {
+        conn->offload_final = 1;
+        return conn_offload(loop, conn, offload_finish_delta);
+    } else if (conn->framed && (conn->request.flags & FT_FLAG_PARTIAL) && partial_complete(&conn->request)) {
+        conn_reply(conn, finish_partial(conn->fullpath), 0, CONN_DONE);
+    } else if (conn->framed) {
+        conn_reply(conn, FT_STATUS_OK, 0, CONN_DONE);
+    } else {
+        conn->state = CONN_DONE;
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Scarta i dati di una scrittura fallita ancora in arrivo dal client, fino alla dimensione annunciata
+ * o alla chiusura del lato di scrittura.
+ *
+ * @param conn La connessione.
+ * @return L'esito del passo (STEP_DONE quando non restano dati da scartare).
+ */
+static step_result_t step_drain(connection_t *conn)
+{
+    char chunk[BUFFER_SIZE];
+
+    while (conn_chunk(conn, SPLICE_PIPE_SIZE) > 0)
+    {
+        // con MSG_TRUNC una socket TCP scarta i byte senza copiarli nel buffer
+        ssize_t n = recv(conn->client->sockfd, chunk, conn_chunk(conn, SPLICE_PIPE_SIZE), MSG_TRUNC);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return STEP_WAIT;
+        }
+        if (n == 0 && conn->length < 0) {
+            return STEP_DONE;
+        }
+        if (n <= 0) {
+            return STEP_ERROR;
+        }
+        conn->bytes += n;
+    }
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Restituisce gli eventi epoll di cui ha bisogno la fase corrente di una connessione.
+ *
+ * @param conn La connessione.
+ * @return EPOLLIN per le fasi che ricevono, EPOLLOUT per quelle che inviano.
+ */
+static uint32_t conn_wanted_events(const connection_t *conn)
+{
+    switch (conn->state)
+    {
+        case CONN_REPLY:
+        case CONN_SEND_FILE:
+        case CONN_SEND_BUFFER:
+            return EPOLLOUT;
+        case CONN_LOCK:
+        case CONN_OFFLOAD:
+            return 0;
+        default:
+            return EPOLLIN;
+    }
+}
+
+
+
+/**
+ * Prepara la risposta all'opcode 's': le metriche del server, inviate come un buffer in memoria.
+ *
+ * @param conn La connessione.
+ * @return STEP_DONE (la risposta da inviare).
+ */
+static step_result_t start_stats(connection_t *conn)
+{
+    size_t len;
+
+    conn->buffer = metrics_format(&len);
+    if (conn->buffer == NULL) {
+        return conn_fail(conn, FT_STATUS_IO_ERROR);
+    }
+    conn->buffer_len = len;
+    conn_reply(conn, FT_STATUS_OK, len, CONN_SEND_BUFFER);
+    return STEP_DONE;
+}
+
+
+
+/**
+ * Fa avanzare la macchina a stati di una connessione finché possibile. Ogni fase che non può
+ * proseguire senza bloccare lascia la connessione registrata per l'evento di cui ha bisogno.
+ *
+ * @param loop Il ciclo a eventi che gestisce la connessione.
+ * @param conn La connessione.
+ */
+static void conn_advance(event_loop_t *loop, connection_t *conn)
+{
+    step_result_t result = STEP_DONE;
+
+    while (result == STEP_DONE && conn->state != CONN_DONE)
+    {
+        // i messaggi del thread riguardano questa connessione (l'operazione è nota dopo l'intestazione)
+        log_context(conn->client->uid, conn->state > CONN_HEADER ? conn->opz : '\0');
+
+        switch (conn->state)
+        {
+            case CONN_OPTION:
+                result = step_option(conn);
+                if (result == STEP_DONE) {
+                    conn->state = conn->framed ? CONN_HEADER : CONN_PATH;
+                }
+                break;
+
+            case CONN_HEADER:
+                result = step_header(conn);
+                if (result == STEP_DONE && conn->state == CONN_HEADER) {
+                    conn->state = CONN_PATH;
+                }
+                break;
+
+            case CONN_PATH:
+                result = step_path(conn);
+                if (result == STEP_DONE && conn->state == CONN_PATH && conn->framed && conn->opz == 's') {
+                    result = start_stats(conn);     // nessun percorso né lock
+                } else if (result == STEP_DONE && conn->state == CONN_PATH) {
+                    LOG_DEBUG("Il client %d ha mandato questo percorso -> %s", conn->client->uid, conn->path);
+                    conn->fullpath = construct_full_path(loop->ft_root_directory, conn->path);
+                    if (conn->fullpath == NULL) {
+                        result = conn_fail(conn, FT_STATUS_BAD_REQUEST);
+                    } else if (conn->framed) {
+                        conn->state = CONN_LOCK;    // l'esito si conosce solo dopo aver aperto il file
+                    } else {
+                        conn_reply(conn, FT_STATUS_OK, 0, CONN_LOCK);
+                    }
+                }
+                break;
+
+            case CONN_REPLY:
+                result = step_reply(conn);
+                if (result == STEP_DONE) {
+                    conn->state = conn->after_reply;
+                }
+                break;
+
+            case CONN_LOCK:
+                result = step_lock(loop, conn);
+                break;
+
+            case CONN_OFFLOAD:
+                result = finish_offload(loop, conn);
+                break;
+
+            case CONN_SEND_FILE:
+                result = step_send_file(conn);
+                if (result == STEP_DONE) {
+                    if (conn->trailer) {
+                        conn_send_trailer(conn);
+                    } else {
+                        conn->state = CONN_DONE;
+                    }
+                }
+                break;
+
+            case CONN_SEND_BUFFER:
+                result = step_send_buffer(conn);
+                if (result == STEP_DONE && conn->opz == 'd') {
+                    // inviata la bitmap dei chunk mancanti: il buffer torna libero per la ricezione
+                    free(conn->buffer);
+                    conn->buffer = NULL;
+                    conn->buffer_len = conn->buffer_off = 0;
+                    conn->state = CONN_RECV_FILE;
+                } else if (result == STEP_DONE && conn->trailer) {
+                    conn_send_trailer(conn);
+                } else if (result == STEP_DONE) {
+                    conn->state = CONN_DONE;
+                }
+                break;
+
+            case CONN_RECV_BUFFER:
+                result = step_recv_buffer(conn);
+                if (result == STEP_DONE) {
+                    result = conn_offload(loop, conn, (conn->opz == 'd') ? offload_dedup_plan : offload_delta_read);
+                }
+                break;
+
+            case CONN_RECV_FILE:
+                result = step_recv_file(conn);
+                if (result == STEP_DONE && conn->state == CONN_RECV_FILE) {
+                    if (conn->trailer) {
+                        conn->header_len = 0;
+                        conn->state = CONN_RECV_TRAILER;
+                    } else {
+                        result = finish_write(loop, conn);
+                    }
+                }
+                break;
+
+            case CONN_RECV_TRAILER:
+                result = step_recv_trailer(conn);
+                if (result == STEP_DONE) {
+                    uint32_t expected = ft_trailer_decode(conn->header);
+                    if (expected != conn->crc) {
+                        LOG_WARN("Dati danneggiati, checksum %08x invece di %08x", conn->crc, expected);
+                        conn_reply(conn, FT_STATUS_CORRUPT, 0, CONN_DONE);
+                    } else {
+                        result = finish_write(loop, conn);
+                    }
+                }
+                break;
+
+            case CONN_DRAIN:
+                result = step_drain(conn);
+                if (result == STEP_DONE) {
+                    conn_reply(conn, conn->status, 0, CONN_DONE);
+                }
+                break;
+
+            case CONN_DONE:
+                break;
+        }
+
+        // in una sessione le richieste già ricevute (pipelining) vengono servite subito, senza attendere un evento
+        if (conn->state == CONN_DONE && result == STEP_DONE) {
+            if (conn->status == FT_STATUS_OK) {
+                LOG_INFO("Compito eseguito con successo");
+            }
+            conn_account(conn, 0);
+            if (!conn->keep_alive) {
+                conn_close(conn);
+                return;
+            }
+            conn_reset(conn);
+        }
+    }
+
+    if (result == STEP_ERROR) {
+        conn_close(conn);
+    } else if (conn->paused_until != 0) {
+        // limite di banda superato: nessun evento sulla socket fino alla ripresa, riprovata come i lock occupati
+        conn_set_events(loop, conn, 0);
+        conn->next_waiting = loop->waiting;
+        loop->waiting = conn;
+    } else if (conn->state != CONN_LOCK) {
+        conn_set_events(loop, conn, conn_wanted_events(conn));
+    }
+}
+
+
+
+/**
+ * Riprova ad acquisire i lock per le connessioni in attesa, chiudendo quelle i cui client si sono disconnessi.
+ *
+ * @param loop Il ciclo a eventi.
+ */
+static void retry_waiting(event_loop_t *loop)
+{
+    connection_t *conn = loop->waiting;
+    loop->waiting = NULL;
+
+    while (conn != NULL)
+    {
+        connection_t *next = conn->next_waiting;
+        conn->next_waiting = NULL;
+
+        if (conn->closed) {
+            conn_close(conn);
+        } else {
+            conn_advance(loop, conn);   // se il lock è ancora occupato la connessione torna in lista
+        }
+        conn = next;
+    }
+}
+
+
+
+/**
+ * Ciclo principale di un thread del server a eventi.
+ *
+ * @param arg Puntatore all'event_loop_t del thread.
+ * @return NULL in caso di errore irrecuperabile di epoll_wait.
+ */
+static void *event_loop_run(void *arg)
+{
+    event_loop_t *loop = (event_loop_t *)arg;
+    struct epoll_event events[EVENT_MAX_EVENTS];
+
+    while (1)
+    {
+        // con connessioni in attesa di un lock si riprova periodicamente, altrimenti si attende senza timeout
+        int n = epoll_wait(loop->epoll_fd, events, EVENT_MAX_EVENTS, loop->waiting ? LOCK_RETRY_MS : -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Errore in epoll_wait: %s", strerror(errno));
+            return NULL;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            connection_t *conn = (connection_t *)events[i].data.ptr;
+
+            if (conn == NULL) {
+                log_context(0, '\0');
+                accept_connections(loop);
+            } else if ((void *)conn == (void *)&loop->offload_fd) {
+                resume_offloaded(loop);
+            } else if (conn->state == CONN_LOCK || conn->state == CONN_OFFLOAD || conn->paused_until != 0) {
+                // una connessione in attesa del lock, della banda o di un lavoro riceve solo EPOLLHUP/EPOLLERR: il client se n'è andato
+                conn->closed = 1;
+                epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->client->sockfd, NULL);
+            } else {
+                conn_advance(loop, conn);
+            }
+        }
+
+        if (loop->waiting) {
+            retry_waiting(loop);
+        }
+    }
+}
+
+
+
+/**
+ * Avvia il server a eventi: crea un thread per ciascun ciclo epoll, ognuno con la propria socket di
+ * ascolto sulla stessa porta (SO_REUSEPORT), e attende la loro terminazione.
+ *
+ * @param address Indirizzo e porta su cui mettersi in ascolto.
+ * @param threads Numero di thread (cicli a eventi) da avviare.
+ * @param ft_root_directory La directory root del server.
+ * @return 0 alla terminazione dei thread, -1 se non è stato possibile avviare il server.
+ */
+int run_event_loops(const struct sockaddr_in *address, int threads, const char *ft_root_directory)
+{
+    event_loop_t *loops = (event_loop_t *)calloc(threads, sizeof(event_loop_t));
+    if (loops == NULL) {
+        fprintf(stderr, "Errore durante l'allocazione dei cicli a eventi: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        event_loop_t *loop = &loops[i];
+        loop->ft_root_directory = ft_root_directory;
+
+        loop->listen_fd = open_listener(address);
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->listen_fd < 0 || loop->epoll_fd < 0) {
+            if (loop->epoll_fd < 0) {
+                fprintf(stderr, "Errore durante la creazione dell'istanza epoll: %s\n", strerror(errno));
+            }
+            return -1;
+        }
+
+        // la socket di ascolto è riconoscibile perché registrata con data.ptr = NULL
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->listen_fd, &ev) < 0) {
+            fprintf(stderr, "Errore durante la registrazione della socket di ascolto: %s\n", strerror(errno));
+            return -1;
+        }
+
+        // l'eventfd del thread ausiliario è riconoscibile perché registrato con data.ptr = &offload_fd
+        pthread_mutex_init(&loop->offload_mutex, NULL);
+        pthread_cond_init(&loop->offload_cond, NULL);
+        loop->offload_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ev.events = EPOLLIN;
+        ev.data.ptr = &loop->offload_fd;
+        if (loop->offload_fd < 0 || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->offload_fd, &ev) < 0) {
+            fprintf(stderr, "Errore durante la creazione dell'eventfd del thread ausiliario: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    printf("SERVER: Ascolto sulla porta -> %d con %d thread epoll\n\n", ntohs(address->sin_port), threads);
+    fflush(stdout);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&loops[i].helper, NULL, offload_run, &loops[i]) != 0 ||
+            pthread_create(&loops[i].tid, NULL, event_loop_run, &loops[i]) != 0) {
+            fprintf(stderr, "Errore creazione del thread: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(loops[i].tid, NULL);
+    }
+
+    free(loops);
+    return 0;
+}
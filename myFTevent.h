@@ -0,0 +1,99 @@
+#ifndef MY_FT_EVENT_H
+#define MY_FT_EVENT_H
+
+#include <netinet/in.h>     // per struct sockaddr_in
+#include "myFTserver.h"
+
+#define EVENT_MAX_EVENTS 256            // eventi restituiti al massimo da una chiamata a epoll_wait
+#define LOCK_RETRY_MS 5                 // intervallo tra due tentativi di acquisire un lock occupato (o di riprendere un invio sospeso)
+
+
+// Fasi di una connessione gestita dal server a eventi
+typedef enum
+{
+    CONN_OPTION,        // attesa del primo byte: l'operazione richiesta o l'inizio dell'intestazione binaria
+    CONN_HEADER,        // ricezione del resto dell'intestazione binaria
+    CONN_PATH,          // ricezione del percorso (5 byte nulli, percorso, terminatore oppure path_len byte)
+    CONN_REPLY,         // invio di una risposta breve (conferma 'T' o intestazione), poi si passa a after_reply
+    CONN_LOCK,          // attesa del lock sul percorso
+    CONN_OFFLOAD,       // attesa di un lavoro lungo sul disco eseguito dal thread ausiliario del ciclo
+    CONN_SEND_FILE,     // invio del file (lettura)
+    CONN_SEND_BUFFER,   // invio di un buffer in memoria (lista)
+    CONN_RECV_BUFFER,   // ricezione del payload in memoria (manifest di un caricamento con deduplicazione)
+    CONN_RECV_FILE,     // ricezione del file (scrittura)
+    CONN_RECV_TRAILER,  // ricezione del CRC32C che segue i dati della scrittura (FT_FLAG_TRAILER)
+    CONN_DRAIN,         // scrittura fallita: si scartano i dati in arrivo, poi si invia l'esito
+    CONN_DONE           // richiesta conclusa: la connessione va chiusa (o riusata con FT_FLAG_KEEP_ALIVE)
+} conn_state_t;
+
+
+// Stato di una connessione non bloccante
+typedef struct connection
+{
+    client_t *client;               // informazioni sul client (registrate nel registro dei client)
+    conn_state_t state;             // fase corrente
+    char opz;                       // operazione richiesta ('w', 'r', 'l', 'i', 'd', 's')
+    int framed;                     // 1 se il client usa l'intestazione binaria
+    int keep_alive;                 // 1 se dopo la risposta la connessione resta aperta (FT_FLAG_KEEP_ALIVE)
+    unsigned int requests;          // richieste già concluse sulla connessione
+    uint64_t started_us;            // arrivo della richiesta in corso, per le metriche (0 se nessuna)
+    unsigned char header[FT_HEADER_SIZE];   // intestazione binaria ricevuta
+    size_t header_len;              // byte dell'intestazione ricevuti finora
+    ft_header_t request;            // intestazione decodificata
+    int padding_seen;               // byte nulli iniziali del percorso già ricevuti
+    char path[FT_PATH_MAX + FT_RANGE_SIZE + 1];     // percorso relativo ricevuto (seguito dall'intervallo con FT_FLAG_RANGE)
+    size_t path_len;                // lunghezza del percorso ricevuto finora
+    char *fullpath;                 // percorso completo nella root del server
+    path_lock_t *lock;              // lock sul percorso (NULL se non acquisito)
+    path_lock_t *pending_lock;      // entry su cui la connessione attende come scrittore (NULL se non in attesa)
+    unsigned char reply[FT_HEADER_SIZE];    // risposta breve da inviare
+    size_t reply_len;               // byte validi nella risposta
+    size_t reply_off;               // byte della risposta già inviati
+    conn_state_t after_reply;       // fase successiva all'invio della risposta
+    ft_status_t status;             // esito della richiesta
+    int file_fd;                    // file letto o scritto (-1 se non aperto)
+    char *spool;                    // file temporaneo di una scrittura intera seguita dal checksum (NULL se non usato)
+    int pipe_fds[2];                // pipe per splice socket -> file (-1 se non usata)
+    char *buffer;                   // dati da inviare o ricevuti (percorso bufferizzato e liste)
+    int pooled;                     // 1 se buffer è un blocco del pool del thread (percorso bufferizzato)
+    filecache_entry_t *cached;      // file letto dalla cache del contenuto (buffer punta nei suoi dati)
+    store_plan_t *plan;             // caricamento con deduplicazione: chunk da ricevere e da copiare dall'archivio
+    size_t buffer_len;              // byte validi nel buffer
+    size_t buffer_off;              // byte del buffer già inviati
+    long long length;               // byte del file da trasferire (-1 fino alla fine del file o alla chiusura)
+    unsigned long long bytes;       // byte del file trasferiti
+    unsigned long long max_bytes;   // byte disponibili sul dispositivo (scrittura)
+    int trailer;                    // 1 se i dati sono seguiti dal loro CRC32C (FT_FLAG_TRAILER)
+    uint32_t crc;                   // CRC32C dei byte del file trasferiti finora
+    uint32_t events;                // eventi epoll attualmente registrati
+    int closed;                     // 1 se il client si è disconnesso mentre la connessione attendeva un lock o la banda
+    uint64_t paused_until;          // ripresa dell'invio dopo un limite di banda (0 se la connessione non è sospesa)
+    struct connection *next_waiting;    // connessione successiva nella lista di attesa dei lock
+    void (*offload)(struct connection *conn);   // lavoro affidato al thread ausiliario (NULL se concluso)
+    ft_status_t offload_status;     // esito del lavoro affidato al thread ausiliario
+    int offload_final;              // 1 se il lavoro conclude la richiesta: il suo esito è la risposta finale
+    struct connection *next_offload;    // connessione successiva nella coda dei lavori o in quella dei lavori conclusi
+} connection_t;
+
+
+// Un thread del server a eventi con la propria socket di ascolto e la propria istanza epoll
+typedef struct
+{
+    int listen_fd;                  // socket di ascolto (condivisa a livello di porta con SO_REUSEPORT)
+    int epoll_fd;                   // istanza epoll del thread
+    const char *ft_root_directory;  // directory root del server
+    connection_t *waiting;          // connessioni in attesa di un lock o sospese da un limite di banda
+    pthread_t tid;                  // thread che esegue il ciclo
+    pthread_t helper;               // thread ausiliario: checksum, firme, differenze e liste ricorsive fuori dal ciclo
+    int offload_fd;                 // eventfd con cui il thread ausiliario segnala al ciclo i lavori conclusi
+    pthread_mutex_t offload_mutex;  // protegge le code dei lavori
+    pthread_cond_t offload_cond;    // segnalata quando arriva un lavoro per il thread ausiliario
+    connection_t *offload_head;     // primo lavoro da eseguire
+    connection_t *offload_tail;     // ultimo lavoro da eseguire
+    connection_t *offload_done;     // lavori conclusi, da riprendere nel ciclo
+} event_loop_t;
+
+int default_event_threads(void);
+int run_event_loops(const struct sockaddr_in *address, int threads, const char *ft_root_directory);
+
+#endif // MY_FT_EVENT_H
@@ -0,0 +1,582 @@
+// CACHE DEL CONTENUTO DEI FILE PICCOLI
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>       // per mmap e madvise dell'arena
+#include <sys/stat.h>
+#include "myFTfilecache.h"
+#include "myFTcache.h"
+#include "myFTlock.h"
+
+
+// Stato della cache: un solo mutex protegge tabella, lista di eliminazione e arena. Il contenuto di un file
+// viene letto fuori dal mutex in una parte dell'arena già riservata; i riferimenti tengono in vita un'entry
+// (e la sua memoria) finché l'ultimo invio non è concluso, anche se nel frattempo è stata eliminata.
+static struct
+{
+    int enabled;                                        // 0 se la cache è disattivata
+    pthread_mutex_t mutex;
+    filecache_entry_t *buckets[FILECACHE_BUCKETS];
+    filecache_entry_t *lru_head;                        // entry usata (LRU) o inserita (CLOCK) più di recente
+    filecache_entry_t *lru_tail;                        // prossima candidata all'eliminazione
+    filecache_chunk_t *partial[FILECACHE_CLASSES];      // blocchi con parti libere, per classe di dimensione
+    size_t mapped;                                      // memoria dei blocchi dell'arena
+    size_t budget;                                      // memoria massima dell'arena
+    size_t threshold;                                   // dimensione massima di un file in cache
+    filecache_policy_t policy;                          // politica di eliminazione
+    unsigned long long hits;                            // letture servite dalla cache
+    unsigned long long misses;                          // letture di file piccoli caricate dal disco
+} cache = { .mutex = PTHREAD_MUTEX_INITIALIZER, .policy = FILECACHE_CLOCK };
+
+
+
+/**
+ * Converte il nome di una politica di eliminazione ("lru" o "clock").
+ *
+ * @param str Il nome indicato sulla riga di comando.
+ * @param policy Puntatore dove memorizzare la politica.
+ * @return 1 se il nome è valido, 0 altrimenti.
+ */
+int parse_filecache_policy(const char *str, filecache_policy_t *policy)
+{
+    if (strcmp(str, "lru") == 0) {
+        *policy = FILECACHE_LRU;
+        return 1;
+    }
+    if (strcmp(str, "clock") == 0) {
+        *policy = FILECACHE_CLOCK;
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Restituisce il nome di una politica di eliminazione.
+ *
+ * @param policy La politica.
+ * @return "lru" oppure "clock".
+ */
+const char* filecache_policy_name(filecache_policy_t policy)
+{
+    return policy == FILECACHE_LRU ? "lru" : "clock";
+}
+
+
+
+/**
+ * Calcola il bucket (hash FNV-1a) di un percorso.
+ *
+ * @param key Il percorso normalizzato.
+ * @return L'indice del bucket.
+ */
+static unsigned int filecache_bucket(const char *key)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash % FILECACHE_BUCKETS;
+}
+
+
+
+/**
+ * Restituisce la classe di dimensione più piccola che contiene size byte.
+ *
+ * @param size I byte da memorizzare (al massimo FILECACHE_CHUNK_SIZE).
+ * @return L'indice della classe.
+ */
+static int size_class_of(size_t size)
+{
+    int size_class = 0;
+
+    while ((size_t)FILECACHE_MIN_BLOCK << size_class < size) {
+        size_class++;
+    }
+    return size_class;
+}
+
+
+
+/**
+ * Mappa un nuovo blocco dell'arena allineato a FILECACHE_CHUNK_SIZE, così il kernel può servirlo con una
+ * huge page, e lo aggiunge ai blocchi con parti libere della classe. Va chiamata con il mutex acquisito.
+ *
+ * @param size_class La classe di dimensione delle parti del blocco.
+ * @return Il blocco oppure NULL se la memoria non basta.
+ */
+static filecache_chunk_t* chunk_map(int size_class)
+{
+    filecache_chunk_t *chunk = (filecache_chunk_t *)calloc(1, sizeof(filecache_chunk_t));
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    // si mappa il doppio e si restituiscono le parti prima e dopo il tratto allineato
+    char *raw = (char *)mmap(NULL, 2 * FILECACHE_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        free(chunk);
+        return NULL;
+    }
+    char *base = (char *)(((uintptr_t)raw + FILECACHE_CHUNK_SIZE - 1) & ~(uintptr_t)(FILECACHE_CHUNK_SIZE - 1));
+    if (base > raw) {
+        munmap(raw, base - raw);
+    }
+    munmap(base + FILECACHE_CHUNK_SIZE, raw + FILECACHE_CHUNK_SIZE - base);
+#ifdef MADV_HUGEPAGE
+    madvise(base, FILECACHE_CHUNK_SIZE, MADV_HUGEPAGE);     // solo un suggerimento: senza THP restano pagine da 4 KiB
+#endif
+
+    chunk->base = base;
+    chunk->size_class = size_class;
+    chunk->next = cache.partial[size_class];
+    if (chunk->next != NULL) {
+        chunk->next->prev = chunk;
+    }
+    cache.partial[size_class] = chunk;
+    cache.mapped += FILECACHE_CHUNK_SIZE;
+    return chunk;
+}
+
+
+
+/**
+ * Toglie un blocco dalla lista dei blocchi con parti libere della sua classe. Va chiamata con il mutex acquisito.
+ *
+ * @param chunk Il blocco.
+ */
+static void chunk_unlink(filecache_chunk_t *chunk)
+{
+    if (chunk->prev != NULL) {
+        chunk->prev->next = chunk->next;
+    } else {
+        cache.partial[chunk->size_class] = chunk->next;
+    }
+    if (chunk->next != NULL) {
+        chunk->next->prev = chunk->prev;
+    }
+    chunk->prev = chunk->next = NULL;
+}
+
+
+
+/**
+ * Riserva nell'arena la memoria per il contenuto di un file. Va chiamata con il mutex acquisito.
+ *
+ * @param size I byte da riservare (tra 1 e FILECACHE_CHUNK_SIZE).
+ * @param chunk_out Puntatore dove memorizzare il blocco che contiene la memoria.
+ * @return La memoria oppure NULL se servirebbe un nuovo blocco oltre il limite.
+ */
+static char* arena_alloc(size_t size, filecache_chunk_t **chunk_out)
+{
+    int size_class = size_class_of(size);
+    size_t block = (size_t)FILECACHE_MIN_BLOCK << size_class;
+    unsigned int blocks = FILECACHE_CHUNK_SIZE / block;
+    char *data;
+
+    filecache_chunk_t *chunk = cache.partial[size_class];
+    if (chunk == NULL && (cache.mapped + FILECACHE_CHUNK_SIZE > cache.budget || (chunk = chunk_map(size_class)) == NULL)) {
+        return NULL;
+    }
+
+    if (chunk->free_list != NULL) {
+        data = (char *)chunk->free_list;
+        chunk->free_list = *(void **)data;
+    } else {
+        data = chunk->base + (size_t)chunk->carved * block;
+        chunk->carved++;
+    }
+    if (++chunk->used == blocks) {
+        chunk_unlink(chunk);
+    }
+    *chunk_out = chunk;
+    return data;
+}
+
+
+
+/**
+ * Restituisce all'arena la memoria di un'entry; un blocco rimasto senza parti in uso torna al sistema.
+ * Va chiamata con il mutex acquisito.
+ *
+ * @param data La memoria da restituire.
+ * @param chunk Il blocco che la contiene.
+ */
+static void arena_free(char *data, filecache_chunk_t *chunk)
+{
+    unsigned int blocks = FILECACHE_CHUNK_SIZE / ((size_t)FILECACHE_MIN_BLOCK << chunk->size_class);
+
+    if (chunk->used-- == blocks) {
+        chunk->next = cache.partial[chunk->size_class];     // era pieno: torna tra quelli con parti libere
+        if (chunk->next != NULL) {
+            chunk->next->prev = chunk;
+        }
+        cache.partial[chunk->size_class] = chunk;
+    }
+
+    if (chunk->used == 0) {
+        chunk_unlink(chunk);
+        munmap(chunk->base, FILECACHE_CHUNK_SIZE);
+        cache.mapped -= FILECACHE_CHUNK_SIZE;
+        free(chunk);
+        return;
+    }
+    *(void **)data = chunk->free_list;
+    chunk->free_list = data;
+}
+
+
+
+/**
+ * Rilascia un riferimento a un'entry e la libera con la sua memoria se era l'ultimo.
+ * Va chiamata con il mutex acquisito.
+ *
+ * @param entry L'entry.
+ */
+static void entry_put(filecache_entry_t *entry)
+{
+    if (--entry->refs > 0) {
+        return;
+    }
+    if (entry->data != NULL) {
+        arena_free(entry->data, entry->chunk);
+    }
+    free(entry->key);
+    free(entry);
+}
+
+
+
+/**
+ * Toglie un'entry da tabella e lista di eliminazione e rilascia il riferimento della tabella: gli invii
+ * in corso continuano a usarne il contenuto. Va chiamata con il mutex acquisito.
+ *
+ * @param entry L'entry.
+ */
+static void entry_remove(filecache_entry_t *entry)
+{
+    filecache_entry_t **link = &cache.buckets[entry->bucket];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache.lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache.lru_tail = entry->lru_prev;
+    }
+
+    entry_put(entry);
+}
+
+
+
+/**
+ * Porta un'entry della tabella in testa alla lista di eliminazione. Va chiamata con il mutex acquisito.
+ *
+ * @param entry L'entry.
+ */
+static void entry_to_head(filecache_entry_t *entry)
+{
+    if (entry == cache.lru_head) {
+        return;
+    }
+    entry->lru_prev->lru_next = entry->lru_next;
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache.lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = cache.lru_head;
+    cache.lru_head->lru_prev = entry;
+    cache.lru_head = entry;
+}
+
+
+
+/**
+ * Cerca un'entry nella tabella. Va chiamata con il mutex acquisito.
+ *
+ * @param key Il percorso normalizzato.
+ * @param bucket Il bucket del percorso.
+ * @return L'entry oppure NULL se il file non è in cache.
+ */
+static filecache_entry_t* entry_find(const char *key, unsigned int bucket)
+{
+    filecache_entry_t *entry = cache.buckets[bucket];
+
+    while (entry != NULL && strcmp(entry->key, key) != 0) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+
+
+/**
+ * Elimina un'entry secondo la politica: con LRU quella in coda alla lista, con CLOCK la prima in coda
+ * senza bit di riferimento (quelle con il bit lo perdono e tornano in testa). Va chiamata con il mutex acquisito.
+ *
+ * @return 1 se un'entry è stata eliminata, 0 se la cache è vuota.
+ */
+static int evict_one(void)
+{
+    while (cache.lru_tail != NULL)
+    {
+        filecache_entry_t *entry = cache.lru_tail;
+        if (cache.policy == FILECACHE_CLOCK && entry->referenced) {
+            entry->referenced = 0;
+            entry_to_head(entry);
+            continue;
+        }
+        entry_remove(entry);
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Controlla che un'entry corrisponda ancora al file su disco.
+ *
+ * @param entry L'entry.
+ * @param statbuf Le informazioni attuali sul file.
+ * @return 1 se file, dimensione e data di modifica sono gli stessi, 0 altrimenti.
+ */
+static int entry_matches(const filecache_entry_t *entry, const struct stat *statbuf)
+{
+    return entry->dev == statbuf->st_dev && entry->ino == statbuf->st_ino && entry->size == (size_t)statbuf->st_size &&
+           entry->mtime.tv_sec == statbuf->st_mtim.tv_sec && entry->mtime.tv_nsec == statbuf->st_mtim.tv_nsec;
+}
+
+
+
+/**
+ * Attiva la cache del contenuto dei file.
+ *
+ * @param budget La memoria massima dell'arena in byte (0 lascia la cache disattivata; almeno un blocco).
+ * @param threshold La dimensione massima di un file in cache (al massimo FILECACHE_CHUNK_SIZE).
+ * @param policy La politica di eliminazione.
+ * @return 0 in caso di successo (o cache disattivata).
+ */
+int filecache_init(size_t budget, size_t threshold, filecache_policy_t policy)
+{
+    if (budget == 0) {
+        return 0;
+    }
+    cache.budget = budget < FILECACHE_CHUNK_SIZE ? FILECACHE_CHUNK_SIZE : budget;
+    cache.threshold = threshold < FILECACHE_CHUNK_SIZE ? threshold : FILECACHE_CHUNK_SIZE;
+    cache.policy = policy;
+    cache.enabled = 1;
+    return 0;
+}
+
+
+
+/**
+ * Legge un file nell'arena e lo inserisce in cache, sostituendo un'eventuale copia superata.
+ * Il file viene scartato se cambia durante la lettura.
+ *
+ * @param path Il percorso del file.
+ * @param key Il percorso normalizzato (passa all'entry, o viene liberato).
+ * @param bucket Il bucket del percorso.
+ * @return L'entry con un riferimento per il chiamante, NULL se il file non si può mettere in cache.
+ */
+static filecache_entry_t* filecache_load(const char *path, char *key, unsigned int bucket)
+{
+    struct stat before, after;
+    filecache_entry_t *entry = NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &before) < 0 || !S_ISREG(before.st_mode) || (size_t)before.st_size > cache.threshold ||
+        (entry = (filecache_entry_t *)calloc(1, sizeof(filecache_entry_t))) == NULL)
+    {
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(key);
+        return NULL;
+    }
+    entry->key = key;
+    entry->bucket = bucket;
+    entry->size = before.st_size;
+    entry->dev = before.st_dev;
+    entry->ino = before.st_ino;
+    entry->mtime = before.st_mtim;
+    entry->refs = 1;
+
+    // la memoria si libera eliminando le entry secondo la politica finché il nuovo file ci sta
+    pthread_mutex_lock(&cache.mutex);
+    while (entry->size > 0 && (entry->data = arena_alloc(entry->size, &entry->chunk)) == NULL && evict_one()) {
+    }
+    pthread_mutex_unlock(&cache.mutex);
+
+    size_t done = 0;
+    while (entry->data != NULL && done < entry->size)
+    {
+        ssize_t n = pread(fd, entry->data + done, entry->size - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    int unchanged = (done == entry->size && fstat(fd, &after) == 0 && entry_matches(entry, &after));
+    close(fd);
+
+    pthread_mutex_lock(&cache.mutex);
+    if (!unchanged || (entry->size > 0 && entry->data == NULL)) {
+        entry_put(entry);
+        pthread_mutex_unlock(&cache.mutex);
+        return NULL;
+    }
+
+    filecache_entry_t *old = entry_find(key, bucket);
+    if (old != NULL) {
+        entry_remove(old);
+    }
+    entry->refs++;
+    entry->next = cache.buckets[bucket];
+    cache.buckets[bucket] = entry;
+    entry->lru_prev = NULL;
+    entry->lru_next = cache.lru_head;
+    if (cache.lru_head != NULL) {
+        cache.lru_head->lru_prev = entry;
+    } else {
+        cache.lru_tail = entry;
+    }
+    cache.lru_head = entry;
+    pthread_mutex_unlock(&cache.mutex);
+    return entry;
+}
+
+
+
+/**
+ * Restituisce il contenuto di un file regolare non più grande della soglia: dalla cache se l'entry
+ * corrisponde ancora al file (stesso inode, dimensione e data di modifica), altrimenti letto dal disco e
+ * messo in cache. Lo stat passa dalla cache dei metadati, così un successo non richiede chiamate di sistema.
+ *
+ * @param path Il percorso del file.
+ * @return L'entry con un riferimento da rilasciare con filecache_release, NULL se la cache è disattivata o il
+ *         file non si può mettere in cache (il chiamante lo legge dal disco come di consueto).
+ */
+filecache_entry_t* filecache_acquire(const char *path)
+{
+    struct stat statbuf;
+
+    if (!cache.enabled || metacache_stat(path, &statbuf) < 0 || !S_ISREG(statbuf.st_mode) ||
+        (size_t)statbuf.st_size > cache.threshold)
+    {
+        return NULL;
+    }
+    char *key = normalize_path(path);
+    if (key == NULL) {
+        return NULL;
+    }
+    unsigned int bucket = filecache_bucket(key);
+
+    pthread_mutex_lock(&cache.mutex);
+    filecache_entry_t *entry = entry_find(key, bucket);
+    if (entry != NULL && entry_matches(entry, &statbuf))
+    {
+        cache.hits++;
+        entry->refs++;
+        if (cache.policy == FILECACHE_LRU) {
+            entry_to_head(entry);
+        } else {
+            entry->referenced = 1;
+        }
+        pthread_mutex_unlock(&cache.mutex);
+        free(key);
+        return entry;
+    }
+    if (entry != NULL) {
+        entry_remove(entry);    // il file è cambiato
+    }
+    cache.misses++;
+    pthread_mutex_unlock(&cache.mutex);
+
+    return filecache_load(path, key, bucket);
+}
+
+
+
+/**
+ * Rilascia il riferimento ottenuto con filecache_acquire.
+ *
+ * @param entry L'entry (NULL è ignorato).
+ */
+void filecache_release(filecache_entry_t *entry)
+{
+    if (entry == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&cache.mutex);
+    entry_put(entry);
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+
+
+/**
+ * Elimina subito un file dalla cache dopo una scrittura del server, senza attendere che la data di
+ * modifica cambi (alcuni filesystem la registrano con una risoluzione di secondi).
+ *
+ * @param path Il percorso scritto.
+ */
+void filecache_invalidate(const char *path)
+{
+    if (!cache.enabled) {
+        return;
+    }
+    char *key = normalize_path(path);
+    if (key == NULL) {
+        return;
+    }
+    unsigned int bucket = filecache_bucket(key);
+
+    pthread_mutex_lock(&cache.mutex);
+    filecache_entry_t *entry = entry_find(key, bucket);
+    if (entry != NULL) {
+        entry_remove(entry);
+    }
+    pthread_mutex_unlock(&cache.mutex);
+    free(key);
+}
+
+
+
+/**
+ * Legge i contatori della cache.
+ *
+ * @param hits Puntatore dove memorizzare le letture servite dalla cache.
+ * @param misses Puntatore dove memorizzare le letture di file piccoli caricate dal disco.
+ */
+void filecache_stats(unsigned long long *hits, unsigned long long *misses)
+{
+    pthread_mutex_lock(&cache.mutex);
+    *hits = cache.hits;
+    *misses = cache.misses;
+    pthread_mutex_unlock(&cache.mutex);
+}
@@ -0,0 +1,63 @@
+#ifndef MY_FT_FILECACHE_H
+#define MY_FT_FILECACHE_H
+
+#include <stddef.h>         // per size_t
+#include <sys/types.h>      // per dev_t e ino_t
+#include <time.h>           // per struct timespec
+
+#define FILECACHE_CHUNK_SIZE (2 << 20)          // blocco dell'arena ottenuto con mmap: una huge page da 2 MiB
+#define FILECACHE_MIN_BLOCK 4096                // classe di dimensione più piccola dell'arena
+#define FILECACHE_CLASSES 10                    // classi da 4 KiB a 2 MiB, ognuna il doppio della precedente
+#define FILECACHE_DEFAULT_THRESHOLD_KB 16       // file più grandi non entrano in cache (opzione -S del server)
+#define FILECACHE_BUCKETS 1024                  // bucket della tabella hash delle entry
+
+
+// Politica con cui si sceglie l'entry da eliminare quando la memoria è esaurita
+typedef enum
+{
+    FILECACHE_LRU = 0,      // l'entry usata meno di recente (ogni successo la sposta in testa alla lista)
+    FILECACHE_CLOCK = 1     // seconda possibilità: un successo imposta solo il bit di riferimento
+} filecache_policy_t;
+
+
+// Blocco dell'arena, diviso in parti della stessa classe di dimensione
+typedef struct filecache_chunk
+{
+    char *base;                         // memoria del blocco (allineata a FILECACHE_CHUNK_SIZE)
+    int size_class;                     // classe di dimensione delle parti
+    unsigned int used;                  // parti assegnate a un'entry
+    unsigned int carved;                // parti già ricavate dal blocco almeno una volta
+    void *free_list;                    // parti restituite (collegate attraverso i loro primi byte)
+    struct filecache_chunk *prev;       // blocco precedente tra quelli della classe con parti libere
+    struct filecache_chunk *next;       // blocco successivo tra quelli della classe con parti libere
+} filecache_chunk_t;
+
+
+// Contenuto di un file in cache. I campi sono protetti dal mutex della cache; data e size non cambiano
+// finché l'entry ha riferimenti, quindi si possono inviare senza il mutex.
+typedef struct filecache_entry
+{
+    char *key;                          // percorso normalizzato
+    char *data;                         // contenuto del file (parte dell'arena, NULL se il file è vuoto)
+    size_t size;                        // dimensione del file
+    dev_t dev;                          // dispositivo e inode del file letto
+    ino_t ino;
+    struct timespec mtime;              // data di modifica del file letto
+    filecache_chunk_t *chunk;           // blocco dell'arena che contiene data
+    int refs;                           // 1 per la tabella più uno per ogni invio in corso
+    int referenced;                     // FILECACHE_CLOCK: usata dall'ultimo passaggio della lancetta
+    unsigned int bucket;                // bucket della tabella hash
+    struct filecache_entry *next;       // entry successiva nella catena del bucket
+    struct filecache_entry *lru_prev;   // entry più recente (LRU) o inserita dopo (CLOCK)
+    struct filecache_entry *lru_next;   // entry meno recente (LRU) o inserita prima (CLOCK)
+} filecache_entry_t;
+
+int parse_filecache_policy(const char *str, filecache_policy_t *policy);
+const char* filecache_policy_name(filecache_policy_t policy);
+int filecache_init(size_t budget, size_t threshold, filecache_policy_t policy);
+filecache_entry_t* filecache_acquire(const char *path);
+void filecache_release(filecache_entry_t *entry);
+void filecache_invalidate(const char *path);
+void filecache_stats(unsigned long long *hits, unsigned long long *misses);
+
+#endif // MY_FT_FILECACHE_H
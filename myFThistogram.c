@@ -0,0 +1,184 @@
+// ISTOGRAMMA DELLE LATENZE
+
+#include <string.h>
+#include "myFThistogram.h"
+
+#define HISTOGRAM_HALF (HISTOGRAM_SUB_BUCKETS / 2)     // bucket di ogni gruppo oltre il primo
+
+
+
+void histogram_init(histogram_t *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+
+
+/**
+ * Restituisce il bucket di un valore: i valori piccoli hanno un bucket ciascuno, per gli altri il bit più
+ * alto sceglie il gruppo e i HISTOGRAM_SUB_BITS - 1 bit successivi il bucket nel gruppo.
+ */
+size_t histogram_bucket_index(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    if (value >> HISTOGRAM_MAX_BITS) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    int magnitude = 63 - __builtin_clzll(value);            // >= HISTOGRAM_SUB_BITS
+    int shift = magnitude - (HISTOGRAM_SUB_BITS - 1);
+    size_t sub = (size_t)(value >> shift) - HISTOGRAM_HALF; // da 0 a HISTOGRAM_HALF - 1
+    return HISTOGRAM_SUB_BUCKETS + (size_t)(magnitude - HISTOGRAM_SUB_BITS) * HISTOGRAM_HALF + sub;
+}
+
+
+
+/**
+ * Restituisce il valore più grande che cade nel bucket indicato (come "highest equivalent value" di HDR).
+ */
+uint64_t histogram_bucket_value(size_t index)
+{
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    size_t k = index - HISTOGRAM_SUB_BUCKETS;
+    int shift = (int)(k / HISTOGRAM_HALF) + 1;
+    uint64_t sub = HISTOGRAM_HALF + k % HISTOGRAM_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+
+
+void histogram_record(histogram_t *h, uint64_t value)
+{
+    h->counts[histogram_bucket_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+
+
+/**
+ * Aggiunge a dst i campioni di src (es. gli istogrammi dei singoli thread a quello complessivo).
+ */
+void histogram_merge(histogram_t *dst, const histogram_t *src)
+{
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+
+
+// incremento di un campo scritto da un solo thread e letto da altri
+static void shared_add(uint64_t *field, uint64_t value)
+{
+    __atomic_store_n(field, __atomic_load_n(field, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+
+
+/**
+ * Registra un valore in un istogramma condiviso: come histogram_record, ma i campi restano leggibili da
+ * altri thread con histogram_merge_shared mentre il proprietario registra.
+ */
+void histogram_record_shared(histogram_t *h, uint64_t value)
+{
+    shared_add(&h->counts[histogram_bucket_index(value)], 1);
+    shared_add(&h->count, 1);
+    shared_add(&h->sum, value);
+    if (value < __atomic_load_n(&h->min, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&h->min, value, __ATOMIC_RELAXED);
+    }
+    if (value > __atomic_load_n(&h->max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+    }
+}
+
+
+
+/**
+ * Aggiunge a dst (privato) i campioni di un istogramma condiviso che il proprietario sta aggiornando. Il
+ * risultato può contare un campione nei bucket ma non ancora in count: i percentili usano i bucket.
+ */
+void histogram_merge_shared(histogram_t *dst, const histogram_t *src)
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        uint64_t n = __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+        dst->counts[i] += n;
+        count += n;
+    }
+    dst->count += count;
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+
+    uint64_t min = __atomic_load_n(&src->min, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    if (min < dst->min) {
+        dst->min = min;
+    }
+    if (max > dst->max) {
+        dst->max = max;
+    }
+}
+
+
+
+/**
+ * Restituisce il valore sotto cui cade la percentuale indicata dei campioni (0 se l'istogramma è vuoto).
+ *
+ * @param h L'istogramma.
+ * @param percentile La percentuale, da 0 a 100 (es. 99.9).
+ * @return Il valore più grande del bucket che contiene il percentile, limitato al massimo registrato.
+ */
+uint64_t histogram_percentile(const histogram_t *h, double percentile)
+{
+    if (h->count == 0) {
+        return 0;
+    }
+
+    // rango del campione cercato, da 1 a count
+    uint64_t rank = (uint64_t)(percentile / 100.0 * h->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > h->count) {
+        rank = h->count;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_bucket_value(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+
+
+double histogram_mean(const histogram_t *h)
+{
+    return h->count ? (double)h->sum / h->count : 0;
+}
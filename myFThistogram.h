@@ -0,0 +1,42 @@
+#ifndef MY_FT_HISTOGRAM_H
+#define MY_FT_HISTOGRAM_H
+
+#include <stdint.h>         // per i contatori a 64 bit
+#include <stddef.h>         // per size_t
+
+// Istogramma di latenze a dinamica elevata (stile HDR): i valori fino a HISTOGRAM_SUB_BUCKETS hanno un bucket
+// ciascuno, quelli più grandi sono divisi in gruppi per potenza di due, ognuno con HISTOGRAM_SUB_BUCKETS / 2
+// bucket della stessa larghezza. L'errore relativo di un percentile resta sotto 1 / (HISTOGRAM_SUB_BUCKETS / 2)
+// (circa l'1,6%) su tutto l'intervallo, con memoria fissa e indipendente dal numero di campioni.
+// I valori oltre 2^HISTOGRAM_MAX_BITS - 1 (circa 19 ore in microsecondi) finiscono nell'ultimo bucket.
+// Un istogramma condiviso ha un solo thread che registra (histogram_record_shared) mentre altri possono
+// leggerlo in qualsiasi momento (histogram_merge_shared): i campi vengono letti e scritti con accessi atomici
+// rilassati, senza lock né istruzioni atomiche di lettura-modifica-scrittura.
+
+#define HISTOGRAM_SUB_BITS 7                    // bit di precisione di ogni gruppo
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 36                   // bit del valore più grande distinto dagli altri
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS) * (HISTOGRAM_SUB_BUCKETS / 2))
+
+
+// Istogramma di un insieme di valori (es. latenze in microsecondi)
+typedef struct
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];     // campioni di ogni bucket
+    uint64_t count;                         // campioni registrati
+    uint64_t sum;                           // somma dei valori (per la media)
+    uint64_t min;                           // valore più piccolo (UINT64_MAX se vuoto)
+    uint64_t max;                           // valore più grande
+} histogram_t;
+
+void histogram_init(histogram_t *h);
+void histogram_record(histogram_t *h, uint64_t value);
+void histogram_merge(histogram_t *dst, const histogram_t *src);
+void histogram_record_shared(histogram_t *h, uint64_t value);
+void histogram_merge_shared(histogram_t *dst, const histogram_t *src);
+uint64_t histogram_percentile(const histogram_t *h, double percentile);
+double histogram_mean(const histogram_t *h);
+size_t histogram_bucket_index(uint64_t value);
+uint64_t histogram_bucket_value(size_t index);
+
+#endif // MY_FT_HISTOGRAM_H
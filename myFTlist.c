@@ -0,0 +1,503 @@
+// LISTA DELLE DIRECTORY
+
+#define _GNU_SOURCE         // necessaria per qsort_r
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>    // per SYS_getdents64
+#include "myFTlist.h"
+
+#define LIST_RECENT_SECONDS 15778476    // sei mesi: le date più vecchie mostrano l'anno invece dell'ora (come ls)
+
+
+// Voce restituita da getdents64
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+
+
+/**
+ * Libera i record raccolti da una directory.
+ *
+ * @param list La lista.
+ */
+void list_free(list_t *list)
+{
+    free(list->data);
+    free(list->offsets);
+    list->data = NULL;
+    list->offsets = NULL;
+    list->len = list->capacity = list->count = list->offsets_capacity = 0;
+}
+
+
+
+/**
+ * Aggiunge alla lista il record di una voce, ingrandendo i buffer quando sono pieni.
+ *
+ * @param list La lista.
+ * @param statbuf Le informazioni sulla voce.
+ * @param name Il nome della voce.
+ * @param name_len I byte del nome.
+ * @return 0 in caso di successo, -1 se la memoria non è sufficiente.
+ */
+static int list_append(list_t *list, const struct stat *statbuf, const char *name, size_t name_len)
+{
+    size_t needed = LIST_RECORD_SIZE + name_len;
+
+    if (list->len + needed > list->capacity) {
+        size_t capacity = list->capacity > 0 ? list->capacity : LIST_INITIAL_CAPACITY;
+        while (list->len + needed > capacity) {
+            capacity *= 2;
+        }
+        char *bigger = (char *)realloc(list->data, capacity);
+        if (bigger == NULL) {
+            return -1;
+        }
+        list->data = bigger;
+        list->capacity = capacity;
+    }
+    if (list->count == list->offsets_capacity) {
+        size_t capacity = list->offsets_capacity > 0 ? list->offsets_capacity * 2 : LIST_INITIAL_CAPACITY / 8;
+        size_t *bigger = (size_t *)realloc(list->offsets, capacity * sizeof(size_t));
+        if (bigger == NULL) {
+            return -1;
+        }
+        list->offsets = bigger;
+        list->offsets_capacity = capacity;
+    }
+
+    unsigned char *p = (unsigned char *)list->data + list->len;
+    ft_put_u64(p, (uint64_t)statbuf->st_ino);
+    ft_put_u64(p + 8, (uint64_t)statbuf->st_size);
+    ft_put_u64(p + 16, (uint64_t)(int64_t)statbuf->st_mtime);
+    p[24] = (unsigned char)(statbuf->st_mode >> 24);
+    p[25] = (unsigned char)(statbuf->st_mode >> 16);
+    p[26] = (unsigned char)(statbuf->st_mode >> 8);
+    p[27] = (unsigned char)statbuf->st_mode;
+    p[28] = (unsigned char)(name_len >> 8);
+    p[29] = (unsigned char)name_len;
+    memcpy(p + LIST_RECORD_SIZE, name, name_len);
+
+    list->offsets[list->count++] = list->len;
+    list->len += needed;
+    return 0;
+}
+
+
+
+/**
+ * Confronta i nomi di due record byte per byte (l'ordine di "LC_ALL=C ls").
+ *
+ * @param a La posizione del primo record.
+ * @param b La posizione del secondo record.
+ * @param data Il buffer dei record.
+ * @return Un valore negativo, nullo o positivo come strcmp.
+ */
+static int list_compare(const void *a, const void *b, void *data)
+{
+    const unsigned char *ra = (const unsigned char *)data + *(const size_t *)a;
+    const unsigned char *rb = (const unsigned char *)data + *(const size_t *)b;
+    size_t la = ((size_t)ra[28] << 8) | ra[29];
+    size_t lb = ((size_t)rb[28] << 8) | rb[29];
+
+    int cmp = memcmp(ra + LIST_RECORD_SIZE, rb + LIST_RECORD_SIZE, la < lb ? la : lb);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (la > lb) - (la < lb);
+}
+
+
+
+/**
+ * Ordina i record per nome e tiene solo la pagina richiesta, ricopiandoli contigui in un nuovo buffer.
+ *
+ * @param list La lista.
+ * @param first L'indice della prima voce della pagina.
+ * @param max Le voci al massimo della pagina.
+ * @param next Puntatore dove memorizzare l'indice della prima voce della pagina successiva (LIST_CURSOR_END dopo l'ultima).
+ * @return 0 in caso di successo, -1 se la memoria non è sufficiente.
+ */
+static int list_sort_page(list_t *list, uint64_t first, uint64_t max, uint64_t *next)
+{
+    qsort_r(list->offsets, list->count, sizeof(size_t), list_compare, list->data);
+
+    size_t start = first < list->count ? (size_t)first : list->count;
+    size_t end = (max < list->count - start) ? start + (size_t)max : list->count;
+    size_t len = 0;
+    for (size_t i = start; i < end; i++) {
+        len += LIST_RECORD_SIZE + (((size_t)(unsigned char)list->data[list->offsets[i] + 28] << 8) | (unsigned char)list->data[list->offsets[i] + 29]);
+    }
+
+    char *sorted = (char *)malloc(len > 0 ? len : 1);
+    if (sorted == NULL) {
+        return -1;
+    }
+    size_t pos = 0;
+    for (size_t i = start; i < end; i++) {
+        const char *record = list->data + list->offsets[i];
+        size_t record_len = LIST_RECORD_SIZE + (((size_t)(unsigned char)record[28] << 8) | (unsigned char)record[29]);
+        memcpy(sorted + pos, record, record_len);
+        list->offsets[i - start] = pos;
+        pos += record_len;
+    }
+
+    *next = (end < list->count) ? end : LIST_CURSOR_END;
+    free(list->data);
+    list->data = sorted;
+    list->len = list->capacity = len;
+    list->count = end - start;
+    return 0;
+}
+
+
+
+/**
+ * Raccoglie le voci di una directory nel processo, senza eseguire comandi esterni: i nomi arrivano a blocchi
+ * da getdents64 e le informazioni di ogni voce da fstatat relativo alla directory (nessun percorso da
+ * ricostruire, collegamenti simbolici non seguiti). Come "ls -la" la lista comprende "." e "..", e un
+ * percorso che non è una directory dà una sola voce con il suo nome.
+ * Senza ordinamento una pagina riprende con lseek dalla posizione nella directory in cui si era fermata la
+ * precedente e la lettura si ferma appena la pagina è piena; con l'ordinamento serve comunque l'intera
+ * directory per ogni pagina.
+ *
+ * @param path Il percorso da elencare.
+ * @param sorted 1 per ordinare le voci per nome, 0 per l'ordine della directory.
+ * @param cursor Il cursore della pagina (0 per la prima, vedi myFTlist.h).
+ * @param max Le voci al massimo da restituire (FT_LENGTH_UNKNOWN: tutte).
+ * @param list La lista (vuota) dove raccogliere i record.
+ * @param next Puntatore dove memorizzare il cursore della pagina successiva (LIST_CURSOR_END dopo l'ultima).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int list_directory(const char *path, int sorted, uint64_t cursor, uint64_t max, list_t *list, uint64_t *next)
+{
+    struct stat statbuf;
+
+    *next = LIST_CURSOR_END;
+    int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0)
+    {
+        if (errno != ENOTDIR || lstat(path, &statbuf) < 0) {
+            return -1;
+        }
+        const char *name = strrchr(path, '/');
+        name = (name != NULL) ? name + 1 : path;
+        if (cursor > 0 || max == 0) {
+            return 0;
+        }
+        return list_append(list, &statbuf, name, strlen(name));
+    }
+
+    char *dents = (char *)malloc(LIST_DENTS_SIZE);
+    if (dents == NULL || (!sorted && cursor > 0 && lseek(dir_fd, (off_t)cursor, SEEK_SET) < 0)) {
+        int saved_errno = errno;
+        free(dents);
+        close(dir_fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    int result = 0;
+    int done = (!sorted && max == 0);
+    if (done) {
+        *next = cursor;
+    }
+
+    while (!done)
+    {
+        long n = syscall(SYS_getdents64, dir_fd, dents, LIST_DENTS_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            result = (n < 0) ? -1 : 0;
+            break;
+        }
+
+        for (long pos = 0; pos < n && !done; )
+        {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(dents + pos);
+            pos += entry->d_reclen;
+
+            if (fstatat(dir_fd, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) < 0) {
+                continue;   // voce rimossa durante la lettura
+            }
+            if (list_append(list, &statbuf, entry->d_name, strlen(entry->d_name)) < 0) {
+                result = -1;
+                done = 1;
+            }
+            else if (!sorted && list->count >= max) {
+                // d_off è la posizione della voce che segue
+                *next = (uint64_t)entry->d_off;
+                done = 1;
+            }
+        }
+    }
+
+    int saved_errno = errno;
+    free(dents);
+    close(dir_fd);
+
+    if (result == 0 && sorted && list_sort_page(list, cursor, max, next) < 0) {
+        result = -1;
+        saved_errno = errno;
+    }
+    errno = saved_errno;
+    return result;
+}
+
+
+
+/**
+ * Costruisce la lista binaria di una directory (FT_FLAG_RECORDS), eventualmente ordinata (FT_FLAG_SORTED)
+ * e, con FT_FLAG_RANGE, limitata a una pagina preceduta dal cursore della pagina successiva.
+ *
+ * @param path Il percorso da elencare.
+ * @param flags I flag della richiesta.
+ * @param cursor Il cursore della pagina (0 per la prima).
+ * @param max Le voci al massimo (FT_LENGTH_UNKNOWN: tutte).
+ * @param len Puntatore dove memorizzare i byte della lista.
+ * @return Il buffer dei record (da liberare con free) oppure NULL in caso di errore (errno impostato).
+ */
+char* list_records(const char *path, uint16_t flags, uint64_t cursor, uint64_t max, size_t *len)
+{
+    list_t list = { NULL, 0, 0, NULL, 0, 0 };
+    uint64_t next;
+    size_t prefix = (flags & FT_FLAG_RANGE) ? LIST_CURSOR_SIZE : 0;
+
+    if (list_directory(path, (flags & FT_FLAG_SORTED) != 0, cursor, max, &list, &next) < 0) {
+        int saved_errno = errno;
+        list_free(&list);
+        errno = saved_errno;
+        return NULL;
+    }
+    free(list.offsets);
+
+    // il cursore precede il primo record (una directory vuota o una pagina oltre la fine non hanno record)
+    char *records = (char *)realloc(list.data, list.len + prefix > 0 ? list.len + prefix : 1);
+    if (records == NULL) {
+        free(list.data);
+        return NULL;
+    }
+    if (prefix > 0) {
+        memmove(records + prefix, records, list.len);
+        ft_put_u64((unsigned char *)records, next);
+    }
+    *len = list.len + prefix;
+    return records;
+}
+
+
+
+/**
+ * Copia una lista in buffer della dimensione esatta.
+ *
+ * @param dst La copia (vuota).
+ * @param src La lista da copiare.
+ * @return 0 in caso di successo, -1 se la memoria non è sufficiente.
+ */
+int list_copy(list_t *dst, const list_t *src)
+{
+    dst->data = (char *)malloc(src->len > 0 ? src->len : 1);
+    dst->offsets = (size_t *)malloc(src->count > 0 ? src->count * sizeof(size_t) : 1);
+    if (dst->data == NULL || dst->offsets == NULL) {
+        list_free(dst);
+        return -1;
+    }
+    memcpy(dst->data, src->data, src->len);
+    memcpy(dst->offsets, src->offsets, src->count * sizeof(size_t));
+    dst->len = dst->capacity = src->len;
+    dst->count = dst->offsets_capacity = src->count;
+    return 0;
+}
+
+
+
+/**
+ * Costruisce la lista binaria (FT_FLAG_RECORDS) da una lista completa già ordinata: tutte le voci oppure,
+ * con FT_FLAG_RANGE, la pagina che inizia dall'indice cursor preceduta dal cursore della successiva.
+ *
+ * @param list La lista completa, ordinata per nome.
+ * @param flags I flag della richiesta.
+ * @param cursor L'indice della prima voce della pagina.
+ * @param max Le voci al massimo della pagina.
+ * @param len Puntatore dove memorizzare i byte della lista.
+ * @return Il buffer dei record (da liberare con free) oppure NULL se la memoria non è sufficiente.
+ */
+char* list_page(const list_t *list, uint16_t flags, uint64_t cursor, uint64_t max, size_t *len)
+{
+    size_t prefix = (flags & FT_FLAG_RANGE) ? LIST_CURSOR_SIZE : 0;
+    size_t start = 0;
+    size_t end = list->count;
+
+    if (prefix > 0) {
+        start = cursor < list->count ? (size_t)cursor : list->count;
+        end = (max < list->count - start) ? start + (size_t)max : list->count;
+    }
+
+    // le voci sono contigue nel buffer: la pagina è un unico tratto
+    size_t from = (start < list->count) ? list->offsets[start] : list->len;
+    size_t to = (end < list->count) ? list->offsets[end] : list->len;
+
+    char *records = (char *)malloc(prefix + (to - from) > 0 ? prefix + (to - from) : 1);
+    if (records == NULL) {
+        return NULL;
+    }
+    if (prefix > 0) {
+        ft_put_u64((unsigned char *)records, end < list->count ? end : LIST_CURSOR_END);
+    }
+    memcpy(records + prefix, list->data + from, to - from);
+    *len = prefix + (to - from);
+    return records;
+}
+
+
+
+/**
+ * Scrive una riga "ls -la" per ogni voce di una lista.
+ *
+ * @param list La lista.
+ * @param len Puntatore dove memorizzare la lunghezza del testo.
+ * @return Il testo (da liberare con free) oppure NULL se la memoria non è sufficiente.
+ */
+char* list_render(const list_t *list, size_t *len)
+{
+    list_entry_t entry;
+    size_t off = 0;
+
+    // ogni riga supera il proprio record di al più LIST_LINE_MAX - LIST_NAME_MAX byte
+    size_t capacity = list->len + list->count * (LIST_LINE_MAX - LIST_NAME_MAX) + 1;
+    char *text = (char *)malloc(capacity);
+    *len = 0;
+
+    while (text != NULL && list_decode(list->data, list->len, &off, &entry) == 1) {
+        *len += list_format_entry(&entry, text + *len, capacity - *len);
+    }
+    return text;
+}
+
+
+
+/**
+ * Costruisce la lista testuale di una directory, una riga "ls -la" per voce in ordine di nome.
+ *
+ * @param path Il percorso da elencare.
+ * @param len Puntatore dove memorizzare la lunghezza del testo.
+ * @return Il testo (da liberare con free) oppure NULL in caso di errore (errno impostato).
+ */
+char* list_text(const char *path, size_t *len)
+{
+    list_t list = { NULL, 0, 0, NULL, 0, 0 };
+    uint64_t next;
+
+    if (list_directory(path, 1, 0, FT_LENGTH_UNKNOWN, &list, &next) < 0) {
+        int saved_errno = errno;
+        list_free(&list);
+        errno = saved_errno;
+        return NULL;
+    }
+    char *text = list_render(&list, len);
+    list_free(&list);
+    return text;
+}
+
+
+
+/**
+ * Decodifica il record che si trova alla posizione indicata e avanza al successivo.
+ *
+ * @param data Il buffer dei record.
+ * @param len I byte del buffer.
+ * @param off La posizione del record (aggiornata).
+ * @param entry La voce decodificata (il nome punta in data).
+ * @return 1 se è stata decodificata una voce, 0 alla fine del buffer, -1 se il record non è valido.
+ */
+int list_decode(const char *data, size_t len, size_t *off, list_entry_t *entry)
+{
+    if (*off == len) {
+        return 0;
+    }
+    if (len - *off < LIST_RECORD_SIZE) {
+        return -1;
+    }
+
+    const unsigned char *p = (const unsigned char *)data + *off;
+    entry->inode = ft_get_u64(p);
+    entry->size = ft_get_u64(p + 8);
+    entry->mtime = (int64_t)ft_get_u64(p + 16);
+    entry->mode = ((uint32_t)p[24] << 24) | ((uint32_t)p[25] << 16) | ((uint32_t)p[26] << 8) | p[27];
+    entry->name_len = (uint16_t)((p[28] << 8) | p[29]);
+    entry->name = data + *off + LIST_RECORD_SIZE;
+
+    if (entry->name_len > LIST_NAME_MAX || len - *off - LIST_RECORD_SIZE < entry->name_len) {
+        return -1;
+    }
+    *off += LIST_RECORD_SIZE + entry->name_len;
+    return 1;
+}
+
+
+
+/**
+ * Scrive la riga "ls -la" di una voce: tipo e permessi, inode, dimensione, data di modifica e nome.
+ *
+ * @param entry La voce.
+ * @param line Il buffer della riga (almeno LIST_LINE_MAX byte).
+ * @param size La dimensione del buffer.
+ * @return I caratteri scritti, '\n' compreso e terminatore escluso.
+ */
+int list_format_entry(const list_entry_t *entry, char *line, size_t size)
+{
+    char mode[11];
+    char date[32];
+    struct tm tm;
+    uint32_t m = entry->mode;
+
+    switch (m & S_IFMT) {
+        case S_IFDIR:  mode[0] = 'd'; break;
+        case S_IFLNK:  mode[0] = 'l'; break;
+        case S_IFCHR:  mode[0] = 'c'; break;
+        case S_IFBLK:  mode[0] = 'b'; break;
+        case S_IFIFO:  mode[0] = 'p'; break;
+        case S_IFSOCK: mode[0] = 's'; break;
+        default:       mode[0] = '-'; break;
+    }
+    mode[1] = (m & S_IRUSR) ? 'r' : '-';
+    mode[2] = (m & S_IWUSR) ? 'w' : '-';
+    mode[3] = (m & S_ISUID) ? ((m & S_IXUSR) ? 's' : 'S') : ((m & S_IXUSR) ? 'x' : '-');
+    mode[4] = (m & S_IRGRP) ? 'r' : '-';
+    mode[5] = (m & S_IWGRP) ? 'w' : '-';
+    mode[6] = (m & S_ISGID) ? ((m & S_IXGRP) ? 's' : 'S') : ((m & S_IXGRP) ? 'x' : '-');
+    mode[7] = (m & S_IROTH) ? 'r' : '-';
+    mode[8] = (m & S_IWOTH) ? 'w' : '-';
+    mode[9] = (m & S_ISVTX) ? ((m & S_IXOTH) ? 't' : 'T') : ((m & S_IXOTH) ? 'x' : '-');
+    mode[10] = '\0';
+
+    // come ls: ora e minuti per i file recenti, l'anno per quelli più vecchi di sei mesi o nel futuro
+    time_t mtime = (time_t)entry->mtime;
+    time_t now = time(NULL);
+    localtime_r(&mtime, &tm);
+    int recent = (mtime <= now && now - mtime < LIST_RECENT_SECONDS);
+    if (strftime(date, sizeof(date), recent ? "%b %e %H:%M" : "%b %e  %Y", &tm) == 0) {
+        date[0] = '\0';
+    }
+
+    int n = snprintf(line, size, "%s %8llu %10llu %s %.*s\n", mode, (unsigned long long)entry->inode,
+                     (unsigned long long)entry->size, date, (int)entry->name_len, entry->name);
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < size ? n : (int)size - 1;
+}
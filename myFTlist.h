@@ -0,0 +1,65 @@
+#ifndef MY_FT_LIST_H
+#define MY_FT_LIST_H
+
+#include <stdint.h>         // per i tipi a dimensione fissa dei record
+#include <stddef.h>         // per size_t
+#include "myFTprotocol.h"   // flag delle richieste di lista
+
+// Lista di una directory con FT_FLAG_RECORDS: un record per voce, tutti i campi in ordine di rete.
+//
+//   offset  dim  campo
+//   0       8    numero di inode
+//   8       8    dimensione in byte
+//   16      8    data di modifica (secondi dall'epoch, con segno)
+//   24      4    tipo e permessi (st_mode)
+//   28      2    lunghezza del nome
+//   30      n    nome (senza terminatore)
+//
+// Una pagina (FT_FLAG_RANGE) inizia con LIST_CURSOR_SIZE byte: il cursore da passare come posizione
+// dell'intervallo per ricevere la pagina successiva, LIST_CURSOR_END dopo l'ultima. Senza ordinamento il
+// cursore è la posizione nella directory restituita da getdents64 (il server riprende da lì con lseek),
+// con l'ordinamento è l'indice della prima voce della pagina successiva.
+
+#define LIST_RECORD_SIZE 30             // byte fissi di un record, seguiti dal nome
+#define LIST_NAME_MAX 255               // lunghezza massima del nome di una voce (NAME_MAX)
+#define LIST_LINE_MAX (LIST_NAME_MAX + 128)  // riga "ls -la" di una voce, terminatore compreso
+#define LIST_CURSOR_SIZE 8              // cursore della pagina successiva all'inizio di una pagina
+#define LIST_CURSOR_END FT_LENGTH_UNKNOWN   // cursore dopo l'ultima pagina
+#define LIST_DENTS_SIZE (256 * 1024)    // byte letti da getdents64 a ogni chiamata
+#define LIST_INITIAL_CAPACITY 65536     // capacità iniziale del buffer dei record
+
+
+// Una voce decodificata da un record
+typedef struct
+{
+    uint64_t inode;                 // numero di inode
+    uint64_t size;                  // dimensione in byte
+    int64_t mtime;                  // data di modifica (secondi)
+    uint32_t mode;                  // tipo e permessi
+    uint16_t name_len;              // byte del nome
+    const char *name;               // nome (punta nel buffer dei record, senza terminatore)
+} list_entry_t;
+
+
+// Record raccolti da una directory
+typedef struct
+{
+    char *data;                     // record codificati uno dopo l'altro
+    size_t len;                     // byte validi in data
+    size_t capacity;                // dimensione allocata di data
+    size_t *offsets;                // posizione di ogni record in data (per l'ordinamento)
+    size_t count;                   // numero di record
+    size_t offsets_capacity;        // dimensione allocata di offsets
+} list_t;
+
+int list_directory(const char *path, int sorted, uint64_t cursor, uint64_t max, list_t *list, uint64_t *next);
+char* list_records(const char *path, uint16_t flags, uint64_t cursor, uint64_t max, size_t *len);
+int list_copy(list_t *dst, const list_t *src);
+char* list_page(const list_t *list, uint16_t flags, uint64_t cursor, uint64_t max, size_t *len);
+char* list_render(const list_t *list, size_t *len);
+char* list_text(const char *path, size_t *len);
+void list_free(list_t *list);
+int list_decode(const char *data, size_t len, size_t *off, list_entry_t *entry);
+int list_format_entry(const list_entry_t *entry, char *line, size_t size);
+
+#endif // MY_FT_LIST_H
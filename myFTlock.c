@@ -0,0 +1,412 @@
+// LOCK TABLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "myFTlock.h"
+
+// ogni bucket ha un proprio mutex, così thread che lavorano su percorsi diversi non si contendono lo stesso lock
+static struct
+{
+    pthread_mutex_t mutex;
+    path_lock_t *head;
+} lock_table[LOCK_TABLE_BUCKETS];
+
+static pthread_once_t lock_table_once = PTHREAD_ONCE_INIT;
+
+
+
+/**
+ * Inizializza i mutex dei bucket della tabella (eseguita una sola volta tramite pthread_once).
+ */
+static void lock_table_init(void)
+{
+    for (int i = 0; i < LOCK_TABLE_BUCKETS; i++)
+    {
+        pthread_mutex_init(&lock_table[i].mutex, NULL);
+        lock_table[i].head = NULL;
+    }
+}
+
+
+
+/**
+ * Calcola l'hash (FNV-1a) di una stringa.
+ *
+ * @param str La stringa di cui calcolare l'hash.
+ * @return L'hash della stringa.
+ */
+static unsigned int hash_key(const char *str)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+
+/**
+ * Normalizza lessicalmente un percorso: elimina gli '/' ripetuti, i componenti '.' e risolve i '..'.
+ *
+ * @param path Il percorso da normalizzare.
+ * @return Una nuova stringa con il percorso normalizzato (da liberare con free) oppure NULL in caso di errore.
+ */
+char* normalize_path(const char *path)
+{
+    size_t len = strlen(path);
+    char *result = (char *)malloc(len + 2);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    size_t out = 0;
+    int absolute = (path[0] == '/');
+    if (absolute) {
+        result[out++] = '/';
+    }
+
+    const char *p = path;
+    while (*p)
+    {
+        // salta gli '/' consecutivi
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        const char *end = strchr(p, '/');
+        size_t comp_len = end ? (size_t)(end - p) : strlen(p);
+
+        if (comp_len == 1 && p[0] == '.') {
+            // componente '.', non cambia il percorso
+        } else if (comp_len == 2 && p[0] == '.' && p[1] == '.') {
+            // componente '..', torna indietro di un livello (se possibile)
+            size_t base = absolute ? 1 : 0;
+            size_t last = out;
+            while (last > base && result[last - 1] != '/') {
+                last--;
+            }
+            int last_is_parent = (out - last == 2 && result[last] == '.' && result[last + 1] == '.');
+
+            if (out > base && !last_is_parent) {
+                out = (last > base) ? last - 1 : last;
+            } else if (!absolute) {
+                if (out > 0) {
+                    result[out++] = '/';
+                }
+                memcpy(result + out, "..", 2);
+                out += 2;
+            }
+        } else {
+            if (out > 0 && result[out - 1] != '/') {
+                result[out++] = '/';
+            }
+            memcpy(result + out, p, comp_len);
+            out += comp_len;
+        }
+        p += comp_len;
+    }
+
+    if (out == 0) {
+        result[out++] = '.';
+    }
+    result[out] = '\0';
+    return result;
+}
+
+
+
+/**
+ * Risolve il percorso completo nella chiave usata dalla tabella dei lock.
+ * La directory viene risolta con realpath (link simbolici e '..' inclusi), mentre il nome del file
+ * viene aggiunto così com'è perché il file potrebbe non esistere ancora (scrittura). Se la directory
+ * non esiste ancora si ripiega su una normalizzazione lessicale del percorso.
+ *
+ * @param fullpath Il percorso completo del file o della directory.
+ * @return La chiave allocata dinamicamente (da liberare con free) oppure NULL in caso di errore.
+ */
+char* resolve_lock_key(const char *fullpath)
+{
+    char *normalized = normalize_path(fullpath);
+    if (normalized == NULL) {
+        return NULL;
+    }
+
+    // prova prima a risolvere l'intero percorso (file o directory esistente)
+    char *resolved = realpath(normalized, NULL);
+    if (resolved != NULL) {
+        free(normalized);
+        return resolved;
+    }
+
+    // il file non esiste ancora: risolve solo la directory che lo contiene
+    char *last_slash = strrchr(normalized, '/');
+    if (last_slash != NULL && last_slash != normalized)
+    {
+        *last_slash = '\0';
+        char *resolved_dir = realpath(normalized, NULL);
+        *last_slash = '/';
+
+        if (resolved_dir != NULL)
+        {
+            size_t len = strlen(resolved_dir) + strlen(last_slash) + 1;
+            char *key = (char *)malloc(len);
+            if (key != NULL) {
+                snprintf(key, len, "%s%s", resolved_dir, last_slash);
+            }
+            free(resolved_dir);
+            free(normalized);
+            return key;
+        }
+    }
+
+    return normalized;
+}
+
+
+
+/**
+ * Cerca nel bucket l'entry associata alla chiave, creandola se non esiste, e ne incrementa il
+ * contatore di riferimenti. Va chiamata con il mutex del bucket acquisito.
+ *
+ * @param key La chiave risolta (la funzione ne prende possesso).
+ * @param bucket L'indice del bucket.
+ * @return L'entry oppure NULL in caso di errore di allocazione.
+ */
+static path_lock_t* lookup_entry(char *key, unsigned int bucket)
+{
+    // cerca un'entry già esistente per lo stesso percorso
+    path_lock_t *lock = lock_table[bucket].head;
+    while (lock != NULL && strcmp(lock->key, key) != 0) {
+        lock = lock->next;
+    }
+
+    if (lock != NULL) {
+        free(key);
+    } else {
+        // nessuno sta usando il percorso: crea una nuova entry in testa alla catena
+        lock = (path_lock_t *)calloc(1, sizeof(path_lock_t));
+        if (lock == NULL) {
+            fprintf(stderr, "Errore durante l'allocazione del lock: %s\n", strerror(errno));
+            free(key);
+            return NULL;
+        }
+
+        pthread_cond_init(&lock->cond, NULL);
+        lock->key = key;
+        lock->bucket = bucket;
+        lock->next = lock_table[bucket].head;
+        lock_table[bucket].head = lock;
+    }
+    lock->refcount++;
+    return lock;
+}
+
+
+
+/**
+ * Decrementa il contatore di riferimenti di un'entry e, se nessuno la usa più, la stacca dalla
+ * catena del bucket e la libera. Va chiamata con il mutex del bucket acquisito.
+ *
+ * @param lock L'entry da rilasciare.
+ */
+static void put_entry(path_lock_t *lock)
+{
+    if (--lock->refcount > 0) {
+        return;
+    }
+
+    path_lock_t **link = &lock_table[lock->bucket].head;
+    while (*link != lock) {
+        link = &(*link)->next;
+    }
+    *link = lock->next;
+
+    pthread_cond_destroy(&lock->cond);
+    free(lock->key);
+    free(lock);
+}
+
+
+
+/**
+ * Acquisisce il lock associato a un percorso, in modalità condivisa (lettura) o esclusiva (scrittura).
+ * L'entry viene creata se non esiste e il suo contatore di riferimenti viene incrementato prima di
+ * mettersi in attesa, così non può essere liberata mentre un thread la sta aspettando. Gli scrittori
+ * in attesa hanno la precedenza sui nuovi lettori, altrimenti un flusso continuo di letture potrebbe
+ * bloccare un upload all'infinito.
+ *
+ * @param fullpath Il percorso completo del file o della directory da bloccare.
+ * @param exclusive 1 per un lock esclusivo (scrittori), 0 per un lock condiviso (lettori).
+ * @return Il lock acquisito, da rilasciare con path_lock_release, oppure NULL in caso di errore.
+ */
+path_lock_t* path_lock_acquire(const char *fullpath, int exclusive)
+{
+    pthread_once(&lock_table_once, lock_table_init);
+
+    char *key = resolve_lock_key(fullpath);
+    if (key == NULL) {
+        fprintf(stderr, "Errore durante la risoluzione del percorso da bloccare: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    unsigned int bucket = hash_key(key) % LOCK_TABLE_BUCKETS;
+    pthread_mutex_t *mutex = &lock_table[bucket].mutex;
+
+    pthread_mutex_lock(mutex);
+
+    path_lock_t *lock = lookup_entry(key, bucket);
+    if (lock != NULL)
+    {
+        if (exclusive) {
+            lock->writers_waiting++;
+            while (lock->writer || lock->readers > 0) {
+                pthread_cond_wait(&lock->cond, mutex);     // l'attesa rilascia il mutex del bucket
+            }
+            lock->writers_waiting--;
+            lock->writer = 1;
+        } else {
+            while (lock->writer || lock->writers_waiting > 0) {
+                pthread_cond_wait(&lock->cond, mutex);
+            }
+            lock->readers++;
+        }
+    }
+
+    pthread_mutex_unlock(mutex);
+    return lock;
+}
+
+
+
+/**
+ * Prova ad acquisire il lock associato a un percorso senza mettersi in attesa. Usata dal server a
+ * eventi, in cui un thread non può bloccarsi senza fermare tutte le connessioni che gestisce.
+ * Uno scrittore che non ottiene il lock resta registrato sull'entry come scrittore in attesa, con
+ * la stessa precedenza sui nuovi lettori di path_lock_acquire: *pending riceve l'entry, da passare
+ * ai tentativi successivi oppure a path_lock_cancel se lo scrittore rinuncia.
+ *
+ * @param fullpath Il percorso completo del file o della directory da bloccare.
+ * @param exclusive 1 per un lock esclusivo (scrittori), 0 per un lock condiviso (lettori).
+ * @param pending Entry su cui lo scrittore è già in attesa (NULL al primo tentativo); aggiornata dalla funzione.
+ * @return Il lock acquisito oppure NULL se è occupato (errno = EBUSY) o in caso di errore.
+ */
+path_lock_t* path_lock_try_acquire(const char *fullpath, int exclusive, path_lock_t **pending)
+{
+    path_lock_t *lock = *pending;
+
+    pthread_once(&lock_table_once, lock_table_init);
+
+    if (lock != NULL)
+    {
+        // tentativo successivo di uno scrittore già in attesa: l'entry e il riferimento sono già suoi
+        pthread_mutex_t *mutex = &lock_table[lock->bucket].mutex;
+        pthread_mutex_lock(mutex);
+        if (!lock->writer && lock->readers == 0) {
+            lock->writers_waiting--;
+            lock->writer = 1;
+            *pending = NULL;
+        } else {
+            lock = NULL;
+            errno = EBUSY;
+        }
+        pthread_mutex_unlock(mutex);
+        return lock;
+    }
+
+    char *key = resolve_lock_key(fullpath);
+    if (key == NULL) {
+        fprintf(stderr, "Errore durante la risoluzione del percorso da bloccare: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    unsigned int bucket = hash_key(key) % LOCK_TABLE_BUCKETS;
+    pthread_mutex_lock(&lock_table[bucket].mutex);
+
+    lock = lookup_entry(key, bucket);
+    if (lock != NULL)
+    {
+        if (exclusive && !lock->writer && lock->readers == 0) {
+            lock->writer = 1;
+        } else if (!exclusive && !lock->writer && lock->writers_waiting == 0) {
+            lock->readers++;
+        } else if (exclusive) {
+            // lo scrittore tiene il riferimento all'entry finché non acquisisce il lock o rinuncia
+            lock->writers_waiting++;
+            *pending = lock;
+            lock = NULL;
+            errno = EBUSY;
+        } else {
+            put_entry(lock);
+            lock = NULL;
+            errno = EBUSY;
+        }
+    }
+
+    pthread_mutex_unlock(&lock_table[bucket].mutex);
+    return lock;
+}
+
+
+
+/**
+ * Annulla l'attesa di uno scrittore registrata da path_lock_try_acquire (es. il client si è disconnesso)
+ * e risveglia i lettori che la precedenza dello scrittore teneva fermi.
+ *
+ * @param pending L'entry su cui lo scrittore era in attesa (può essere NULL).
+ */
+void path_lock_cancel(path_lock_t *pending)
+{
+    if (pending == NULL) {
+        return;
+    }
+
+    pthread_mutex_t *mutex = &lock_table[pending->bucket].mutex;
+    pthread_mutex_lock(mutex);
+
+    pending->writers_waiting--;
+    if (pending->refcount > 1) {
+        pthread_cond_broadcast(&pending->cond);
+    }
+    put_entry(pending);
+
+    pthread_mutex_unlock(mutex);
+}
+
+
+
+/**
+ * Rilascia un lock acquisito con path_lock_acquire o path_lock_try_acquire e risveglia i thread in
+ * attesa. Quando nessun thread usa più l'entry, questa viene rimossa dalla tabella e liberata.
+ *
+ * @param lock Il lock da rilasciare (può essere NULL).
+ */
+void path_lock_release(path_lock_t *lock)
+{
+    if (lock == NULL) {
+        return;
+    }
+
+    pthread_mutex_t *mutex = &lock_table[lock->bucket].mutex;
+    pthread_mutex_lock(mutex);
+
+    if (lock->writer) {
+        lock->writer = 0;
+    } else {
+        lock->readers--;
+    }
+
+    if (lock->refcount > 1) {
+        pthread_cond_broadcast(&lock->cond);
+    }
+    put_entry(lock);
+
+    pthread_mutex_unlock(mutex);
+}
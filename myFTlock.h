@@ -0,0 +1,31 @@
+#ifndef MY_FT_LOCK_H
+#define MY_FT_LOCK_H
+
+#include <pthread.h>        // per pthread_mutex_t e pthread_cond_t
+
+#define LOCK_TABLE_BUCKETS 256      // numero di bucket (e di mutex) della tabella dei lock
+
+
+// Entry della tabella dei lock: un lock lettori/scrittori per ogni percorso attualmente in uso.
+// Tutti i campi sono protetti dal mutex del bucket; a differenza di un pthread_rwlock_t il lock può
+// essere rilasciato anche da un thread diverso da quello che l'ha acquisito.
+typedef struct path_lock
+{
+    char *key;                      // percorso risolto usato come chiave
+    pthread_cond_t cond;            // segnalata quando il lock viene rilasciato
+    int readers;                    // numero di lettori che tengono il lock
+    int writer;                     // 1 se uno scrittore tiene il lock
+    int writers_waiting;            // scrittori in attesa (hanno la precedenza sui nuovi lettori)
+    int refcount;                   // numero di thread che usano o attendono l'entry
+    unsigned int bucket;            // indice del bucket di appartenenza
+    struct path_lock *next;         // entry successiva nella catena del bucket
+} path_lock_t;
+
+char* normalize_path(const char *path);
+char* resolve_lock_key(const char *fullpath);
+path_lock_t* path_lock_acquire(const char *fullpath, int exclusive);
+path_lock_t* path_lock_try_acquire(const char *fullpath, int exclusive, path_lock_t **pending);
+void path_lock_cancel(path_lock_t *pending);
+void path_lock_release(path_lock_t *lock);
+
+#endif // MY_FT_LOCK_H
@@ -0,0 +1,440 @@
+// LOG ASINCRONO
+
+#define _GNU_SOURCE         // necessaria per localtime_r e le estensioni Linux
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>         // per i messaggi con argomenti variabili
+#include <time.h>           // per clock_gettime, nanosleep e localtime_r
+#include <unistd.h>
+#include <pthread.h>        // per il thread di scarico e la chiave dell'anello di ogni thread
+#include <sys/uio.h>        // per writev()
+#include <limits.h>         // per IOV_MAX
+#include "myFTlog.h"
+
+#define LOG_BATCH_BYTES (64 * 1024)         // testo formattato di un blocco di righe
+#define LOG_LINE_MAX 2048                   // byte al massimo di una riga formattata (JSON con caratteri da codificare)
+
+// righe da scrivere con una writev sullo stesso descrittore
+typedef struct
+{
+    int fd;
+    struct iovec iov[LOG_BATCH_LINES * 3];  // fino a tre parti per riga (intestazione, testo, a capo)
+    int count;
+    char buffer[LOG_BATCH_BYTES];           // intestazioni (e righe JSON) formattate
+    size_t used;
+} log_batch_t;
+
+int log_level = LOG_LEVEL_INFO;
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+static log_ring_t *rings = NULL;                    // tutti gli anelli mai creati (solo inserimenti in testa)
+static pthread_key_t ring_key;                      // anello del thread corrente
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;    // un solo consumatore alla volta (scarico e uscita)
+static const char *log_source = "SERVER";           // prefisso delle righe di testo
+static int log_json = 0;                            // 1 per le righe JSON
+static int log_started = 0;                         // 1 quando il thread di scarico è attivo
+static unsigned long long dropped_reported = 0;     // messaggi scartati già segnalati (protetto da drain_mutex)
+static log_batch_t out_batch = { .fd = STDOUT_FILENO };
+static log_batch_t err_batch = { .fd = STDERR_FILENO };
+
+
+
+/**
+ * Converte il nome di un livello nel valore corrispondente.
+ *
+ * @param str Il nome del livello ("error", "warn", "info" o "debug").
+ * @param level Puntatore dove memorizzare il livello.
+ * @return 1 se il nome è valido, 0 altrimenti.
+ */
+int parse_log_level(const char *str, log_level_t *level)
+{
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_DEBUG; i++) {
+        if (strcmp(str, level_names[i]) == 0) {
+            *level = (log_level_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+// il thread termina: l'anello, con i messaggi non ancora scritti, passa al prossimo thread che ne chiede uno
+static void ring_release(void *arg)
+{
+    log_ring_t *ring = (log_ring_t *)arg;
+
+    __atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+
+
+static void ring_key_create(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+}
+
+
+
+/**
+ * Restituisce l'anello del thread corrente: al primo uso adotta quello lasciato da un thread terminato oppure
+ * ne crea uno nuovo e lo inserisce nella lista globale con un compare-and-swap.
+ *
+ * @return L'anello, NULL se la memoria non basta (i messaggi del thread vengono scritti subito).
+ */
+static log_ring_t* log_ring(void)
+{
+    pthread_once(&ring_once, ring_key_create);
+
+    log_ring_t *ring = (log_ring_t *)pthread_getspecific(ring_key);
+    if (ring != NULL) {
+        return ring;
+    }
+
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&ring->owned, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (ring == NULL) {
+        void *memory = NULL;
+        if (posix_memalign(&memory, 64, sizeof(log_ring_t)) != 0) {
+            return NULL;
+        }
+        ring = (log_ring_t *)memory;
+        memset(ring, 0, sizeof(*ring));
+        ring->owned = 1;
+
+        log_ring_t *head = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        do {
+            ring->next = head;
+        } while (!__atomic_compare_exchange_n(&rings, &head, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    if (pthread_setspecific(ring_key, ring) != 0) {
+        __atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    ring->uid = 0;
+    ring->opcode = '\0';
+    return ring;
+}
+
+
+
+// scrive tutti i vettori, riprendendo dopo le scritture parziali
+static void writev_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t n = writev(fd, iov, count > IOV_MAX ? IOV_MAX : count);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;                 // standard output chiuso o pieno di errori: i messaggi vanno persi
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+
+
+// formatta l'intestazione di una riga di testo: ora, sorgente e, se presenti, client e operazione
+static size_t format_prefix(const log_record_t *record, char *out, size_t size)
+{
+    struct tm tm;
+    time_t seconds = (time_t)(record->time_us / 1000000);
+    int len;
+
+    localtime_r(&seconds, &tm);
+    len = snprintf(out, size, "%02d:%02d:%02d.%03d %s: ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+                   (int)(record->time_us % 1000000 / 1000), log_source);
+    if (record->uid != 0 && len > 0 && (size_t)len < size) {
+        len += snprintf(out + len, size - len, record->opcode ? "[%d %c] " : "[%d] ", record->uid, record->opcode);
+    }
+    return (len > 0 && (size_t)len < size) ? (size_t)len : 0;
+}
+
+
+
+// formatta un record come riga JSON completa (con l'a capo)
+static size_t format_json(const log_record_t *record, char *out, size_t size)
+{
+    struct tm tm;
+    time_t seconds = (time_t)(record->time_us / 1000000);
+    size_t len;
+
+    gmtime_r(&seconds, &tm);
+    len = (size_t)snprintf(out, size, "{\"ts\":\"%04d-%02d-%02dT%02d:%02d:%02d.%06dZ\",\"level\":\"%s\"",
+                           tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                           (int)(record->time_us % 1000000), level_names[record->level]);
+    if (record->uid != 0) {
+        len += (size_t)snprintf(out + len, size - len, ",\"uid\":%d", record->uid);
+    }
+    if (record->opcode > ' ' && record->opcode != '"' && record->opcode != '\\') {
+        len += (size_t)snprintf(out + len, size - len, ",\"op\":\"%c\"", record->opcode);
+    }
+    len += (size_t)snprintf(out + len, size - len, ",\"msg\":\"");
+
+    // il testo può contenere percorsi arbitrari: virgolette, barre e caratteri di controllo vanno codificati
+    for (uint16_t i = 0; i < record->len && len + 8 < size; i++)
+    {
+        unsigned char c = (unsigned char)record->text[i];
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = (char)c;
+        } else if (c < 0x20) {
+            len += (size_t)snprintf(out + len, size - len, "\\u%04x", c);
+        } else {
+            out[len++] = (char)c;
+        }
+    }
+    out[len++] = '"';
+    out[len++] = '}';
+    out[len++] = '\n';
+    return len;
+}
+
+
+
+static void batch_flush(log_batch_t *batch)
+{
+    writev_all(batch->fd, batch->iov, batch->count);
+    batch->count = 0;
+    batch->used = 0;
+}
+
+
+
+/**
+ * Aggiunge un record al blocco di righe: il testo di una riga semplice viene scritto direttamente dall'anello,
+ * senza copie. Va chiamata con drain_mutex acquisito, e il record deve restare valido fino a batch_flush.
+ */
+static void batch_add(log_batch_t *batch, const log_record_t *record)
+{
+    static char newline = '\n';
+
+    if (batch->count + 3 > LOG_BATCH_LINES * 3 || batch->used + LOG_LINE_MAX > LOG_BATCH_BYTES) {
+        batch_flush(batch);
+    }
+
+    char *line = batch->buffer + batch->used;
+    if (log_json) {
+        size_t len = format_json(record, line, LOG_LINE_MAX);
+        batch->iov[batch->count].iov_base = line;
+        batch->iov[batch->count++].iov_len = len;
+        batch->used += len;
+        return;
+    }
+
+    size_t len = format_prefix(record, line, LOG_LINE_MAX);
+    batch->iov[batch->count].iov_base = line;
+    batch->iov[batch->count++].iov_len = len;
+    batch->iov[batch->count].iov_base = (void *)record->text;
+    batch->iov[batch->count++].iov_len = record->len;
+    batch->iov[batch->count].iov_base = &newline;
+    batch->iov[batch->count++].iov_len = 1;
+    batch->used += len;
+}
+
+
+
+static uint64_t realtime_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+
+
+/**
+ * Scrive i messaggi in attesa in tutti gli anelli e segnala quelli scartati dall'ultimo scarico.
+ * Un anello torna disponibile al suo proprietario solo dopo che le sue righe sono state scritte.
+ */
+static void log_drain(void)
+{
+    pthread_mutex_lock(&drain_mutex);
+
+    unsigned long long dropped = 0;
+    for (log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+    {
+        uint64_t head = ring->head;     // scritto solo qui
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        for (uint64_t i = head; i < tail; i++) {
+            const log_record_t *record = &ring->records[i & (LOG_RING_RECORDS - 1)];
+            batch_add(record->level <= LOG_LEVEL_WARN ? &err_batch : &out_batch, record);
+        }
+        if (tail != head) {
+            batch_flush(&out_batch);
+            batch_flush(&err_batch);
+            __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE);
+        }
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+
+    if (dropped > dropped_reported) {
+        log_record_t record;
+        record.time_us = realtime_us();
+        record.uid = 0;
+        record.opcode = '\0';
+        record.level = LOG_LEVEL_WARN;
+        record.len = (uint16_t)snprintf(record.text, sizeof(record.text), "%llu messaggi di log scartati: buffer pieno",
+                                        dropped - dropped_reported);
+        batch_add(&err_batch, &record);
+        batch_flush(&err_batch);
+        dropped_reported = dropped;
+    }
+    pthread_mutex_unlock(&drain_mutex);
+}
+
+
+
+static void* log_flusher(void *arg)
+{
+    (void)arg;
+    struct timespec interval = { 0, LOG_FLUSH_MS * 1000000L };
+
+    while (1) {
+        nanosleep(&interval, NULL);
+        log_drain();
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Avvia il thread di scarico: da qui in poi i messaggi passano dagli anelli dei thread.
+ * Prima di log_init (e se il thread non parte) ogni messaggio viene scritto subito.
+ *
+ * @param source Il prefisso delle righe di testo (es. "SERVER").
+ * @param json 1 per scrivere righe JSON invece del testo.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int log_init(const char *source, int json)
+{
+    pthread_t tid;
+
+    log_source = source;
+    log_json = json;
+    if (pthread_create(&tid, NULL, log_flusher, NULL) != 0) {
+        fprintf(stderr, "Errore creazione del thread di scarico del log: %s\n", strerror(errno));
+        return -1;
+    }
+    pthread_detach(tid);
+    atexit(log_drain);          // all'uscita del processo si scrive quello che resta
+    log_started = 1;
+    return 0;
+}
+
+
+
+/**
+ * Imposta client e operazione a cui si riferiscono i messaggi successivi del thread corrente.
+ *
+ * @param uid Il client (0 se nessuno).
+ * @param opcode L'operazione in corso ('\0' se nessuna).
+ */
+void log_context(int uid, char opcode)
+{
+    log_ring_t *ring = log_started ? log_ring() : NULL;
+
+    if (ring != NULL) {
+        ring->uid = uid;
+        ring->opcode = opcode;
+    }
+}
+
+
+
+/**
+ * Registra un messaggio (senza a capo finale): viene copiato nell'anello del thread e scritto dal thread di
+ * scarico, oppure scartato se l'anello è pieno. Il chiamante non attende mai lo standard output.
+ *
+ * @param level Il livello del messaggio (LOG_AT e le macro collegate controllano prima log_level).
+ * @param format Il formato, come printf.
+ */
+void log_write(log_level_t level, const char *format, ...)
+{
+    log_ring_t *ring = log_started ? log_ring() : NULL;
+    log_record_t direct;
+    log_record_t *record = &direct;
+    uint64_t tail = 0;
+
+    if (ring != NULL)
+    {
+        tail = ring->tail;          // scritto solo da questo thread
+        if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= LOG_RING_RECORDS) {
+            __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+            return;
+        }
+        record = &ring->records[tail & (LOG_RING_RECORDS - 1)];
+    }
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(record->text, sizeof(record->text), format, args);
+    va_end(args);
+
+    record->time_us = realtime_us();
+    record->uid = ring != NULL ? ring->uid : 0;
+    record->opcode = ring != NULL ? ring->opcode : '\0';
+    record->level = (uint8_t)level;
+    record->len = (uint16_t)(len < 0 ? 0 : (len < (int)sizeof(record->text) ? len : (int)sizeof(record->text) - 1));
+
+    if (ring != NULL) {
+        __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // thread di scarico non ancora attivo: la riga si scrive subito
+    char line[LOG_LINE_MAX];
+    struct iovec iov[3];
+    int count = 1;
+    if (log_json) {
+        iov[0].iov_len = format_json(record, line, sizeof(line));
+    } else {
+        iov[0].iov_len = format_prefix(record, line, sizeof(line));
+        iov[1].iov_base = record->text;
+        iov[1].iov_len = record->len;
+        iov[2].iov_base = "\n";
+        iov[2].iov_len = 1;
+        count = 3;
+    }
+    iov[0].iov_base = line;
+    fflush(stdout);             // dopo i messaggi di avvio già scritti con printf
+    writev_all(level <= LOG_LEVEL_WARN ? STDERR_FILENO : STDOUT_FILENO, iov, count);
+}
+
+
+
+/**
+ * Restituisce i messaggi scartati finora perché l'anello del thread era pieno.
+ */
+unsigned long long log_dropped(void)
+{
+    unsigned long long dropped = 0;
+
+    for (log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    return dropped;
+}
@@ -0,0 +1,68 @@
+#ifndef MY_FT_LOG_H
+#define MY_FT_LOG_H
+
+#include <stdint.h>         // per i campi a dimensione fissa dei record
+
+// Log asincrono del server: chi scrive un messaggio lo formatta in un record del proprio anello (un anello per
+// thread, un solo produttore e un solo consumatore, senza lock) e prosegue; un thread di scarico raccoglie ogni
+// LOG_FLUSH_MS millisecondi i record di tutti gli anelli e li scrive con writev, a blocchi, sullo standard output
+// (info e debug) o sullo standard error (avvisi ed errori). Se l'anello è pieno il messaggio viene scartato e
+// contato, senza mai bloccare il trasferimento. I record portano ora, livello, client e operazione correnti del
+// thread (log_context) e vengono scritti come testo oppure, con log_init(..., 1), come righe JSON.
+
+#define LOG_RING_RECORDS 256                // record di ogni anello (potenza di 2)
+#define LOG_MESSAGE_MAX 232                 // byte di testo di un record (il resto di un messaggio viene troncato)
+#define LOG_FLUSH_MS 20                     // intervallo tra due scarichi
+#define LOG_BATCH_LINES 128                 // righe scritte al massimo da una writev
+
+// Livelli dei messaggi, dal più grave
+typedef enum
+{
+    LOG_LEVEL_ERROR = 0,    // operazione fallita
+    LOG_LEVEL_WARN = 1,     // condizione anomala gestita (es. dati danneggiati, spazio insufficiente)
+    LOG_LEVEL_INFO = 2,     // esito dei trasferimenti e delle sessioni
+    LOG_LEVEL_DEBUG = 3     // dettaglio di ogni richiesta (operazione, percorso, thread)
+} log_level_t;
+
+
+// Un messaggio in attesa di essere scritto
+typedef struct
+{
+    uint64_t time_us;                       // ora del messaggio (CLOCK_REALTIME, microsecondi)
+    int32_t uid;                            // client a cui si riferisce (0 se nessuno)
+    char opcode;                            // operazione in corso ('\0' se nessuna)
+    uint8_t level;                          // log_level_t
+    uint16_t len;                           // byte validi di text
+    char text[LOG_MESSAGE_MAX];
+} log_record_t;
+
+
+// Anello dei messaggi di un thread: tail è scritto solo dal thread proprietario, head solo dal thread di scarico
+typedef struct log_ring
+{
+    log_record_t records[LOG_RING_RECORDS];
+    uint64_t tail __attribute__((aligned(64)));     // prossimo record da riempire
+    uint64_t dropped;                       // messaggi scartati con l'anello pieno
+    int32_t uid;                            // contesto corrente del proprietario (log_context)
+    char opcode;
+    int owned;                              // 1 se un thread sta usando l'anello
+    struct log_ring *next;                  // anello successivo nella lista globale (solo inserimenti in testa)
+    uint64_t head __attribute__((aligned(64)));     // prossimo record da scrivere
+} log_ring_t;
+
+
+extern int log_level;                       // messaggi scritti fino a questo livello (log_level_t)
+
+#define LOG_AT(level, ...) do { if ((int)(level) <= log_level) log_write((level), __VA_ARGS__); } while (0)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+int parse_log_level(const char *str, log_level_t *level);
+int log_init(const char *source, int json);
+void log_context(int uid, char opcode);
+void log_write(log_level_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+unsigned long long log_dropped(void);
+
+#endif // MY_FT_LOG_H
@@ -0,0 +1,391 @@
+// METRICHE DEL SERVER
+
+#define _GNU_SOURCE         // necessaria per open_memstream() con versioni datate di glibc
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>           // per clock_gettime()
+#include <pthread.h>        // per la chiave del blocco di ogni thread
+#include "myFTmetrics.h"
+#include "myFTlog.h"        // per i messaggi di log scartati
+#include "myFTcache.h"      // per i contatori della cache dei metadati
+#include "myFTfilecache.h"  // per i contatori della cache del contenuto
+#include "myFTstore.h"      // per i byte risparmiati dalla deduplicazione
+
+#define METRICS_ALIGN 64    // allineamento dei blocchi: due thread non scrivono mai sulla stessa linea di cache
+
+static const char *op_names[METRICS_OPS] = {"write", "read", "list", "info", "dedup", "stats"};
+
+static metrics_block_t *blocks = NULL;              // tutti i blocchi mai creati (solo inserimenti in testa)
+static pthread_key_t block_key;                     // blocco del thread corrente
+static pthread_once_t block_once = PTHREAD_ONCE_INIT;
+static uint64_t start_time_us = 0;                  // avvio del server, per l'uptime
+
+
+
+// incremento di un contatore scritto solo dal thread proprietario del blocco e letto da metrics_format
+static void counter_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+
+
+// il thread termina: il blocco, con i valori accumulati, passa al prossimo thread che ne chiede uno
+static void block_release(void *arg)
+{
+    metrics_block_t *block = (metrics_block_t *)arg;
+
+    __atomic_store_n(&block->owned, 0, __ATOMIC_RELEASE);
+}
+
+
+
+static void block_key_create(void)
+{
+    pthread_key_create(&block_key, block_release);
+}
+
+
+
+/**
+ * Restituisce il blocco di metriche del thread corrente: al primo uso adotta un blocco lasciato da un thread
+ * terminato oppure ne crea uno nuovo e lo inserisce nella lista globale con un compare-and-swap.
+ *
+ * @return Il blocco, NULL se la memoria non basta (le metriche del thread vengono perse).
+ */
+static metrics_block_t* metrics_block(void)
+{
+    pthread_once(&block_once, block_key_create);
+
+    metrics_block_t *block = (metrics_block_t *)pthread_getspecific(block_key);
+    if (block != NULL) {
+        return block;
+    }
+
+    for (block = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&block->owned, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (block == NULL) {
+        void *memory = NULL;
+        if (posix_memalign(&memory, METRICS_ALIGN, sizeof(metrics_block_t)) != 0) {
+            return NULL;
+        }
+        block = (metrics_block_t *)memory;
+        memset(block, 0, sizeof(*block));
+        block->owned = 1;
+
+        metrics_block_t *head = __atomic_load_n(&blocks, __ATOMIC_RELAXED);
+        do {
+            block->next = head;
+        } while (!__atomic_compare_exchange_n(&blocks, &head, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    if (pthread_setspecific(block_key, block) != 0) {
+        __atomic_store_n(&block->owned, 0, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    return block;
+}
+
+
+
+/**
+ * Restituisce l'istogramma indicato del blocco, allocandolo al primo campione: viene pubblicato solo dopo
+ * l'inizializzazione, così metrics_format non vede mai un istogramma a metà.
+ */
+static histogram_t* block_histogram(histogram_t **slot)
+{
+    histogram_t *h = *slot;     // scritto solo dal thread proprietario
+
+    if (h == NULL) {
+        h = (histogram_t *)malloc(sizeof(histogram_t));
+        if (h == NULL) {
+            return NULL;
+        }
+        histogram_init(h);
+        __atomic_store_n(slot, h, __ATOMIC_RELEASE);
+    }
+    return h;
+}
+
+
+
+// indice delle metriche di un'operazione, -1 se l'opcode non è tra quelli contati
+static int op_index(char opcode)
+{
+    const char *p = opcode != '\0' ? strchr(METRICS_OPCODES, opcode) : NULL;
+
+    return p != NULL ? (int)(p - METRICS_OPCODES) : -1;
+}
+
+
+
+void metrics_init(void)
+{
+    start_time_us = metrics_now_us();
+}
+
+
+
+uint64_t metrics_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+
+
+/**
+ * Registra una richiesta conclusa (con qualsiasi esito): una operazione in più e la sua latenza.
+ *
+ * @param opcode L'operazione richiesta (gli opcode non riconosciuti sono ignorati).
+ * @param start_us L'istante di arrivo della richiesta, da metrics_now_us.
+ */
+void metrics_request(char opcode, uint64_t start_us)
+{
+    int op = op_index(opcode);
+    metrics_block_t *block = metrics_block();
+
+    if (op < 0 || block == NULL) {
+        return;
+    }
+    counter_add(&block->ops[op], 1);
+
+    histogram_t *h = block_histogram(&block->latency[op]);
+    if (h != NULL) {
+        uint64_t now = metrics_now_us();
+        histogram_record_shared(h, now > start_us ? now - start_us : 0);
+    }
+}
+
+
+
+/**
+ * Aggiunge i byte di dati ricevuti e inviati da una richiesta.
+ */
+void metrics_bytes(unsigned long long in, unsigned long long out)
+{
+    metrics_block_t *block = metrics_block();
+
+    if (block == NULL) {
+        return;
+    }
+    if (in > 0) {
+        counter_add(&block->bytes_in, in);
+    }
+    if (out > 0) {
+        counter_add(&block->bytes_out, out);
+    }
+}
+
+
+
+/**
+ * Conta una risposta con esito di errore (gli esiti positivi sono ignorati).
+ */
+void metrics_error(ft_status_t status)
+{
+    metrics_block_t *block = metrics_block();
+
+    if (status < FT_STATUS_BAD_REQUEST || status >= METRICS_STATUSES || block == NULL) {
+        return;
+    }
+    counter_add(&block->errors[status], 1);
+}
+
+
+
+/**
+ * Conta una richiesta interrotta senza risposta, o dopo la quale la connessione va chiusa.
+ */
+void metrics_abort(void)
+{
+    metrics_block_t *block = metrics_block();
+
+    if (block != NULL) {
+        counter_add(&block->aborted, 1);
+    }
+}
+
+
+
+void metrics_connection_opened(void)
+{
+    metrics_block_t *block = metrics_block();
+
+    if (block != NULL) {
+        counter_add(&block->opened, 1);
+    }
+}
+
+
+
+void metrics_connection_closed(void)
+{
+    metrics_block_t *block = metrics_block();
+
+    if (block != NULL) {
+        counter_add(&block->closed, 1);
+    }
+}
+
+
+
+/**
+ * Registra il tempo passato da una connessione nella coda del pool prima di essere presa da un worker.
+ */
+void metrics_queue_wait(uint64_t wait_us)
+{
+    metrics_block_t *block = metrics_block();
+    histogram_t *h = block != NULL ? block_histogram(&block->queue_wait) : NULL;
+
+    if (h != NULL) {
+        histogram_record_shared(h, wait_us);
+    }
+}
+
+
+
+/**
+ * Registra il tempo passato da una richiesta nella coda della sua classe prima di ottenere un posto dallo
+ * scheduler (0 per le richieste partite subito).
+ */
+void metrics_class_wait(sched_class_t klass, uint64_t wait_us)
+{
+    metrics_block_t *block = metrics_block();
+    histogram_t *h = block != NULL ? block_histogram(&block->class_wait[klass]) : NULL;
+
+    if (h != NULL) {
+        histogram_record_shared(h, wait_us);
+    }
+}
+
+
+
+// somma a un istogramma privato quello (eventualmente non ancora allocato) di un blocco
+static void merge_slot(histogram_t *dst, histogram_t **slot)
+{
+    const histogram_t *h = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+    if (h != NULL) {
+        histogram_merge_shared(dst, h);
+    }
+}
+
+
+
+static void format_latency(FILE *out, const histogram_t *h)
+{
+    fprintf(out, "\"count\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu",
+            (unsigned long long)h->count, histogram_mean(h),
+            (unsigned long long)histogram_percentile(h, 50), (unsigned long long)histogram_percentile(h, 90),
+            (unsigned long long)histogram_percentile(h, 99), (unsigned long long)histogram_percentile(h, 99.9),
+            (unsigned long long)h->max);
+}
+
+
+
+/**
+ * Somma le metriche di tutti i thread e le restituisce come documento JSON (risposta dell'opcode 's').
+ * I valori sono letti mentre i thread continuano ad aggiornarli: ogni contatore è coerente, ma contatori
+ * diversi possono riferirsi a istanti di poco diversi.
+ *
+ * @param len Puntatore dove memorizzare la lunghezza del documento.
+ * @return Il documento (da liberare con free), NULL se la memoria non basta.
+ */
+char* metrics_format(size_t *len)
+{
+    metrics_block_t total;
+    histogram_t *latency = (histogram_t *)malloc((METRICS_OPS + 1 + SCHED_CLASSES) * sizeof(histogram_t));
+    histogram_t *queue_wait = latency + METRICS_OPS;
+    histogram_t *class_wait = queue_wait + 1;
+    unsigned running[SCHED_CLASSES], queued[SCHED_CLASSES];
+    int capacity, reserved;
+    unsigned long long meta_hits, meta_misses, file_hits, file_misses, dedup_saved, dedup_received;
+    char *document = NULL;
+
+    if (latency == NULL) {
+        return NULL;
+    }
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < METRICS_OPS + 1 + SCHED_CLASSES; i++) {
+        histogram_init(&latency[i]);
+    }
+
+    for (metrics_block_t *block = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        total.bytes_in += __atomic_load_n(&block->bytes_in, __ATOMIC_RELAXED);
+        total.bytes_out += __atomic_load_n(&block->bytes_out, __ATOMIC_RELAXED);
+        for (int op = 0; op < METRICS_OPS; op++) {
+            total.ops[op] += __atomic_load_n(&block->ops[op], __ATOMIC_RELAXED);
+            merge_slot(&latency[op], &block->latency[op]);
+        }
+        for (int s = 0; s < METRICS_STATUSES; s++) {
+            total.errors[s] += __atomic_load_n(&block->errors[s], __ATOMIC_RELAXED);
+        }
+        total.aborted += __atomic_load_n(&block->aborted, __ATOMIC_RELAXED);
+        total.opened += __atomic_load_n(&block->opened, __ATOMIC_RELAXED);
+        total.closed += __atomic_load_n(&block->closed, __ATOMIC_RELAXED);
+        merge_slot(queue_wait, &block->queue_wait);
+        for (int k = 0; k < SCHED_CLASSES; k++) {
+            merge_slot(&class_wait[k], &block->class_wait[k]);
+        }
+    }
+    sched_snapshot(&capacity, &reserved, running, queued);
+    metacache_stats(&meta_hits, &meta_misses);
+    filecache_stats(&file_hits, &file_misses);
+    store_stats(&dedup_saved, &dedup_received);
+
+    FILE *out = open_memstream(&document, len);
+    if (out == NULL) {
+        free(latency);
+        return NULL;
+    }
+
+    // una connessione può essere aperta da un thread e chiusa da un altro: la differenza va letta sui totali
+    unsigned long long active = total.opened > total.closed ? total.opened - total.closed : 0;
+
+    fprintf(out, "{\n  \"uptime_sec\": %.3f,\n", (metrics_now_us() - start_time_us) / 1e6);
+    fprintf(out, "  \"connections\": {\"opened\": %llu, \"active\": %llu},\n", (unsigned long long)total.opened, active);
+    fprintf(out, "  \"bytes\": {\"in\": %llu, \"out\": %llu},\n",
+            (unsigned long long)total.bytes_in, (unsigned long long)total.bytes_out);
+    fprintf(out, "  \"ops\": {\n");
+    for (int op = 0; op < METRICS_OPS; op++) {
+        fprintf(out, "    \"%s\": {\"count\": %llu, \"latency_us\": {", op_names[op], (unsigned long long)total.ops[op]);
+        format_latency(out, &latency[op]);
+        fprintf(out, "}}%s\n", op + 1 < METRICS_OPS ? "," : "");
+    }
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"errors\": {\"bad_request\": %llu, \"not_found\": %llu, \"denied\": %llu, \"no_space\": %llu, "
+                 "\"io_error\": %llu, \"busy\": %llu, \"corrupt\": %llu, \"aborted\": %llu},\n",
+            (unsigned long long)total.errors[FT_STATUS_BAD_REQUEST], (unsigned long long)total.errors[FT_STATUS_NOT_FOUND],
+            (unsigned long long)total.errors[FT_STATUS_DENIED], (unsigned long long)total.errors[FT_STATUS_NO_SPACE],
+            (unsigned long long)total.errors[FT_STATUS_IO_ERROR], (unsigned long long)total.errors[FT_STATUS_BUSY],
+            (unsigned long long)total.errors[FT_STATUS_CORRUPT], (unsigned long long)total.aborted);
+    fprintf(out, "  \"queue_wait_us\": {");
+    format_latency(out, queue_wait);
+    fprintf(out, "},\n  \"scheduler\": {\"capacity\": %d, \"reserved\": %d,\n", capacity, reserved);
+    for (int k = 0; k < SCHED_CLASSES; k++) {
+        fprintf(out, "    \"%s\": {\"running\": %u, \"queued\": %u, \"queue_wait_us\": {", sched_class_name(k), running[k], queued[k]);
+        format_latency(out, &class_wait[k]);
+        fprintf(out, "}}%s\n", k + 1 < SCHED_CLASSES ? "," : "");
+    }
+    fprintf(out, "  },\n  \"metacache\": {\"hits\": %llu, \"misses\": %llu},\n", meta_hits, meta_misses);
+    fprintf(out, "  \"filecache\": {\"hits\": %llu, \"misses\": %llu},\n", file_hits, file_misses);
+    fprintf(out, "  \"dedup\": {\"bytes_saved\": %llu, \"bytes_received\": %llu},\n", dedup_saved, dedup_received);
+    fprintf(out, "  \"log_dropped\": %llu\n}\n", log_dropped());
+
+    free(latency);
+    if (fclose(out) != 0) {
+        free(document);
+        return NULL;
+    }
+    return document;
+}
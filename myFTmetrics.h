@@ -0,0 +1,49 @@
+#ifndef MY_FT_METRICS_H
+#define MY_FT_METRICS_H
+
+#include <stdint.h>         // per i contatori a 64 bit
+#include <stddef.h>         // per size_t
+#include "myFTprotocol.h"   // esiti delle richieste
+#include "myFThistogram.h"  // istogrammi delle latenze
+#include "myFTsched.h"      // classi delle richieste nello scheduler
+
+// Metriche del server raccolte senza lock: ogni thread aggiorna un proprio blocco di contatori e istogrammi
+// (un solo scrittore, accessi atomici rilassati) e l'opcode 's' li somma su richiesta. I blocchi non vengono
+// mai liberati: quando un thread termina il suo blocco passa al primo thread nuovo, e i valori, cumulativi,
+// restano validi. Il costo nel percorso di una richiesta è qualche incremento nella cache del thread.
+
+#define METRICS_OPCODES "wrlids"            // operazioni con contatori e latenze proprie, nell'ordine dei blocchi
+#define METRICS_OPS 6                       // strlen(METRICS_OPCODES)
+#define METRICS_STATUSES (FT_STATUS_CORRUPT + 1)    // esiti contati (solo quelli di errore sono usati)
+
+
+// Metriche di un thread: scritte solo dal thread che possiede il blocco
+typedef struct metrics_block
+{
+    uint64_t bytes_in;                      // byte di dati ricevuti dai client (file, manifest, firme)
+    uint64_t bytes_out;                     // byte di dati inviati ai client (file, liste, informazioni)
+    uint64_t ops[METRICS_OPS];              // richieste concluse per operazione
+    uint64_t errors[METRICS_STATUSES];      // risposte per esito di errore
+    uint64_t aborted;                       // richieste interrotte (disconnessione, connessione non più allineata)
+    uint64_t opened;                        // connessioni prese in carico dal thread
+    uint64_t closed;                        // connessioni chiuse dal thread
+    histogram_t *latency[METRICS_OPS];      // latenza per operazione in µs (allocato al primo uso)
+    histogram_t *queue_wait;                // attesa in coda del pool in µs (allocato al primo uso)
+    histogram_t *class_wait[SCHED_CLASSES]; // attesa di un posto nello scheduler per classe in µs (allocato al primo uso)
+    int owned;                              // 1 se un thread sta usando il blocco
+    struct metrics_block *next;             // blocco successivo nella lista globale (solo inserimenti in testa)
+} metrics_block_t;
+
+void metrics_init(void);
+uint64_t metrics_now_us(void);
+void metrics_request(char opcode, uint64_t start_us);
+void metrics_bytes(unsigned long long in, unsigned long long out);
+void metrics_error(ft_status_t status);
+void metrics_abort(void);
+void metrics_connection_opened(void);
+void metrics_connection_closed(void);
+void metrics_queue_wait(uint64_t wait_us);
+void metrics_class_wait(sched_class_t klass, uint64_t wait_us);
+char* metrics_format(size_t *len);
+
+#endif // MY_FT_METRICS_H
@@ -0,0 +1,273 @@
+// POOL DI WORKER
+
+#include <poll.h>           // per poll (scarto dei dati di una connessione rifiutata)
+#include "myFTpool.h"
+
+// argomento passato a ciascun thread del pool
+typedef struct
+{
+    worker_pool_t *pool;
+    int index;
+} worker_arg_t;
+
+
+
+/**
+ * Restituisce il numero di worker da usare di default.
+ *
+ * @return POOL_DEFAULT_WORKERS_PER_CORE worker per ogni core disponibile.
+ */
+int default_pool_workers(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0 ? (int)cores : 1) * POOL_DEFAULT_WORKERS_PER_CORE;
+}
+
+
+
+/**
+ * Inserisce un job in fondo alla coda di un worker.
+ *
+ * @param deque La coda.
+ * @param job Il job da inserire.
+ * @return 0 in caso di successo, -1 se la coda è piena.
+ */
+static int deque_push(job_deque_t *deque, client_data_t *job)
+{
+    int result = -1;
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count < deque->capacity) {
+        deque->jobs[(deque->head + deque->count) % deque->capacity] = job;
+        deque->count++;
+        result = 0;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return result;
+}
+
+
+
+/**
+ * Preleva un job dalla coda: dalla testa se è la coda del worker stesso, dal fondo se lo sta rubando.
+ *
+ * @param deque La coda.
+ * @param steal 1 se il job viene rubato da un altro worker.
+ * @return Il job prelevato oppure NULL se la coda è vuota.
+ */
+static client_data_t* deque_pop(job_deque_t *deque, int steal)
+{
+    client_data_t *job = NULL;
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0)
+    {
+        if (steal) {
+            job = deque->jobs[(deque->head + deque->count - 1) % deque->capacity];
+        } else {
+            job = deque->jobs[deque->head];
+            deque->head = (deque->head + 1) % deque->capacity;
+        }
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return job;
+}
+
+
+
+/**
+ * Ciclo di un worker: attende che ci sia un job in coda, lo preleva dalla propria coda oppure lo ruba
+ * a un altro worker, e gestisce la connessione con handle_client. Un job è una connessione nuova oppure
+ * una connessione la cui richiesta ha appena ottenuto il suo posto dallo scheduler (parked).
+ *
+ * @param arg Puntatore al worker_arg_t del worker.
+ * @return NULL (il ciclo non termina).
+ */
+static void *worker_run(void *arg)
+{
+    worker_pool_t *pool = ((worker_arg_t *)arg)->pool;
+    int index = ((worker_arg_t *)arg)->index;
+    free(arg);
+
+    while (1)
+    {
+        // ogni gettone del semaforo corrisponde a un job in coda, quindi dopo sem_wait un job esiste di sicuro
+        if (sem_wait(&pool->available) < 0) {
+            continue;   // EINTR
+        }
+
+        client_data_t *job = deque_pop(&pool->deques[index], 0);
+        for (int i = 1; job == NULL; i++) {
+            job = deque_pop(&pool->deques[(index + i) % pool->size], 1);
+        }
+
+        __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_RELAXED);
+        if (!job->parked) {
+            uint64_t now = metrics_now_us();
+            metrics_queue_wait(now > job->queued_us ? now - job->queued_us : 0);
+        }
+        handle_client(job);
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Inizializza il pool e avvia i worker.
+ *
+ * @param pool Il pool da inizializzare.
+ * @param size Numero di worker.
+ * @param depth Numero massimo di job in attesa.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int pool_init(worker_pool_t *pool, int size, int depth)
+{
+    pool->size = size;
+    pool->depth = depth;
+    pool->queued = 0;
+    pool->next = 0;
+    pool->deques = (job_deque_t *)calloc(size, sizeof(job_deque_t));
+    pool->threads = (pthread_t *)calloc(size, sizeof(pthread_t));
+
+    if (pool->deques == NULL || pool->threads == NULL || sem_init(&pool->available, 0, 0) < 0) {
+        fprintf(stderr, "Errore durante l'inizializzazione del pool di worker: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+        // ogni coda può contenere l'intera profondità: il limite vero è pool->depth sul totale, a cui si
+        // aggiungono al massimo size richieste riprese dallo scheduler (una per posto, e i posti non superano i worker)
+        pool->deques[i].capacity = depth + size;
+        pool->deques[i].jobs = (client_data_t **)malloc((depth + size) * sizeof(client_data_t *));
+        if (pool->deques[i].jobs == NULL) {
+            fprintf(stderr, "Errore durante l'allocazione della coda del worker: %s\n", strerror(errno));
+            return -1;
+        }
+        pthread_mutex_init(&pool->deques[i].mutex, NULL);
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+        worker_arg_t *arg = (worker_arg_t *)malloc(sizeof(worker_arg_t));
+        if (arg == NULL) {
+            return -1;
+        }
+        arg->pool = pool;
+        arg->index = i;
+
+        if (pthread_create(&pool->threads[i], NULL, worker_run, arg) != 0) {
+            fprintf(stderr, "Errore creazione del thread: %s\n", strerror(errno));
+            free(arg);
+            return -1;
+        }
+        pthread_detach(pool->threads[i]);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Inserisce un job in una coda dei worker, a turno, e lo segnala con un gettone del semaforo.
+ *
+ * @param pool Il pool.
+ * @param job La connessione da gestire.
+ * @return 0 se il job è stato accodato, -1 se tutte le code sono piene.
+ */
+static int pool_push(worker_pool_t *pool, client_data_t *job)
+{
+    job->queued_us = metrics_now_us();
+
+    // le code non possono essere piene se il totale è sotto la profondità, ma si prova comunque sulle altre
+    for (int i = 0; i < pool->size; i++)
+    {
+        unsigned int index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED) % pool->size;
+        if (deque_push(&pool->deques[index], job) == 0) {
+            __atomic_fetch_add(&pool->queued, 1, __ATOMIC_RELAXED);
+            sem_post(&pool->available);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+
+/**
+ * Accoda una connessione accettata, assegnandola a turno alle code dei worker.
+ *
+ * @param pool Il pool.
+ * @param job La connessione da gestire.
+ * @return 0 se il job è stato accodato, -1 se la coda ha raggiunto la profondità massima.
+ */
+int pool_submit(worker_pool_t *pool, client_data_t *job)
+{
+    if (__atomic_load_n(&pool->queued, __ATOMIC_RELAXED) >= pool->depth) {
+        return -1;
+    }
+    return pool_push(pool, job);
+}
+
+
+
+/**
+ * Riprende una connessione la cui richiesta attendeva nello scheduler (funzione di sched_init): la accoda
+ * ai worker senza il limite di profondità, perché il suo posto è già stato assegnato.
+ *
+ * @param context Il pool.
+ * @param item La richiesta a cui tocca.
+ */
+void pool_resume(void *context, sched_item_t *item)
+{
+    if (pool_push((worker_pool_t *)context, (client_data_t *)item->arg) < 0) {
+        LOG_ERROR("Errore, nessuna coda libera per riprendere una richiesta");
+    }
+}
+
+
+
+/**
+ * Rifiuta una connessione quando il server è sovraccarico: invia il byte di stato STATUS_BUSY, chiude il
+ * lato di scrittura e scarta quanto il client aveva già inviato fino alla sua chiusura. Chiudere subito con
+ * dati non letti farebbe inviare un RST al kernel, e il client potrebbe perdere il byte di stato. La funzione
+ * è chiamata dal thread che accetta le connessioni, quindi lo scarto ha una scadenza complessiva
+ * (REFUSE_DRAIN_TIMEOUT_MS) e un limite di byte (REFUSE_DRAIN_MAX_BYTES): un client che continua a inviare
+ * non può fermare l'accettazione delle altre connessioni.
+ *
+ * @param sockfd La socket della connessione da rifiutare.
+ */
+void refuse_connection(int sockfd)
+{
+    char status = STATUS_BUSY;
+    char discard[BUFFER_SIZE];
+
+    metrics_error(FT_STATUS_BUSY);
+
+    if (send(sockfd, &status, 1, MSG_NOSIGNAL | MSG_DONTWAIT) == 1) {
+        shutdown(sockfd, SHUT_WR);
+
+        uint64_t deadline = metrics_now_us() + REFUSE_DRAIN_TIMEOUT_MS * 1000;
+        size_t drained = 0;
+        while (drained < REFUSE_DRAIN_MAX_BYTES)
+        {
+            uint64_t now = metrics_now_us();
+            if (now >= deadline) {
+                break;
+            }
+
+            struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+            if (poll(&pfd, 1, (int)((deadline - now + 999) / 1000)) <= 0) {
+                break;                      // scadenza raggiunta o errore
+            }
+            ssize_t n = recv(sockfd, discard, sizeof(discard), MSG_DONTWAIT);
+            if (n <= 0) {
+                break;                      // il client ha chiuso (o errore)
+            }
+            drained += (size_t)n;
+        }
+    }
+    close(sockfd);
+}
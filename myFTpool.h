@@ -0,0 +1,43 @@
+#ifndef MY_FT_POOL_H
+#define MY_FT_POOL_H
+
+#include <semaphore.h>      // per sem_t
+#include "myFTserver.h"
+
+#define POOL_DEFAULT_WORKERS_PER_CORE 4     // worker per core di default (il lavoro è dominato da I/O bloccante)
+#define POOL_DEFAULT_QUEUE_DEPTH 1024       // connessioni in coda al massimo di default
+#define REFUSE_DRAIN_TIMEOUT_MS 20          // attesa massima in tutto della chiusura del client dopo un rifiuto
+#define REFUSE_DRAIN_MAX_BYTES (64 << 10)   // byte scartati al massimo da una connessione rifiutata
+
+
+// Coda di un worker: buffer circolare di job protetto da un mutex. Il proprietario preleva dalla testa
+// (il job più vecchio), gli altri worker rubano dalla coda (il più recente).
+typedef struct
+{
+    client_data_t **jobs;           // buffer circolare dei job
+    int capacity;                   // dimensione del buffer
+    int head;                       // indice del job più vecchio
+    int count;                      // job presenti
+    pthread_mutex_t mutex;          // protegge la coda
+} job_deque_t;
+
+
+// Pool di worker di dimensione fissa
+typedef struct
+{
+    int size;                       // numero di worker
+    int depth;                      // job in attesa al massimo (oltre si rifiutano le connessioni)
+    job_deque_t *deques;            // una coda per worker
+    pthread_t *threads;             // thread dei worker
+    sem_t available;                // un gettone per ogni job in coda
+    int queued;                     // job in coda non ancora prelevati (aggiornato atomicamente)
+    unsigned int next;              // prossima coda a cui assegnare un job (atomico: anche i worker riaccodano le richieste riprese)
+} worker_pool_t;
+
+int default_pool_workers(void);
+int pool_init(worker_pool_t *pool, int size, int depth);
+int pool_submit(worker_pool_t *pool, client_data_t *job);
+void pool_resume(void *context, sched_item_t *item);
+void refuse_connection(int sockfd);
+
+#endif // MY_FT_POOL_H
@@ -0,0 +1,408 @@
+// PROTOCOLLO
+
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "myFTprotocol.h"
+#include "myFTtransfer.h"
+
+
+
+/**
+ * Scrive un intero a 16 bit in ordine di rete.
+ */
+static void put_u16(unsigned char *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+
+
+/**
+ * Scrive un intero a 32 bit in ordine di rete.
+ */
+static void put_u32(unsigned char *p, uint32_t value)
+{
+    put_u16(p, value >> 16);
+    put_u16(p + 2, value & 0xFFFF);
+}
+
+
+
+/**
+ * Scrive un intero a 64 bit in ordine di rete.
+ */
+void ft_put_u64(unsigned char *p, uint64_t value)
+{
+    for (int i = 7; i >= 0; i--) {
+        p[i] = value;
+        value >>= 8;
+    }
+}
+
+
+
+/**
+ * Legge un intero a 16 bit in ordine di rete.
+ */
+static uint16_t get_u16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+
+
+/**
+ * Legge un intero a 32 bit in ordine di rete.
+ */
+static uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)get_u16(p) << 16 | get_u16(p + 2);
+}
+
+
+
+/**
+ * Legge un intero a 64 bit in ordine di rete.
+ */
+uint64_t ft_get_u64(const unsigned char *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+
+
+/**
+ * Inizializza un'intestazione della versione corrente senza flag e senza percorso.
+ *
+ * @param header L'intestazione da inizializzare.
+ * @param opcode L'operazione ('w', 'r', 'l').
+ * @param status L'esito (FT_STATUS_OK nelle richieste).
+ * @param payload_len I byte di dati che seguono.
+ */
+void ft_header_init(ft_header_t *header, char opcode, ft_status_t status, uint64_t payload_len)
+{
+    memset(header, 0, sizeof(*header));
+    header->version = FT_VERSION;
+    header->opcode = opcode;
+    header->status = status;
+    header->payload_len = payload_len;
+}
+
+
+
+/**
+ * Codifica un'intestazione nel formato sul filo.
+ *
+ * @param header L'intestazione.
+ * @param buffer Il buffer di destinazione (almeno FT_HEADER_SIZE byte).
+ */
+void ft_header_encode(const ft_header_t *header, unsigned char *buffer)
+{
+    put_u32(buffer, FT_MAGIC);
+    buffer[4] = header->version;
+    buffer[5] = header->opcode;
+    put_u16(buffer + 6, header->flags);
+    put_u16(buffer + 8, header->status);
+    put_u16(buffer + 10, header->path_len);
+    ft_put_u64(buffer + 12, header->payload_len);
+}
+
+
+
+/**
+ * Decodifica un'intestazione ricevuta e ne controlla la validità.
+ *
+ * @param buffer I FT_HEADER_SIZE byte ricevuti.
+ * @param header L'intestazione decodificata.
+ * @return 0 se l'intestazione è valida, -1 se magic, versione o lunghezza del percorso non sono validi.
+ */
+int ft_header_decode(const unsigned char *buffer, ft_header_t *header)
+{
+    uint32_t magic = (uint32_t)buffer[0] << 24 | buffer[1] << 16 | buffer[2] << 8 | buffer[3];
+
+    header->version = buffer[4];
+    header->opcode = (char)buffer[5];
+    header->flags = get_u16(buffer + 6);
+    header->status = get_u16(buffer + 8);
+    header->path_len = get_u16(buffer + 10);
+    header->payload_len = ft_get_u64(buffer + 12);
+    header->range_offset = 0;
+    header->range_length = 0;
+
+    if (magic != FT_MAGIC || header->version != FT_VERSION || header->path_len > FT_PATH_MAX) {
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Decodifica l'estensione FT_FLAG_RANGE ricevuta dopo il percorso.
+ *
+ * @param buffer I FT_RANGE_SIZE byte ricevuti.
+ * @param header L'intestazione a cui aggiungere l'intervallo.
+ */
+void ft_range_decode(const unsigned char *buffer, ft_header_t *header)
+{
+    header->range_offset = ft_get_u64(buffer);
+    header->range_length = ft_get_u64(buffer + 8);
+}
+
+
+
+/**
+ * Invia una richiesta: intestazione e percorso con un'unica chiamata.
+ *
+ * @param sock La socket connessa al server.
+ * @param opcode L'operazione ('w', 'r', 'l', 'i').
+ * @param flags I flag della richiesta (FT_FLAG_*, senza FT_FLAG_RANGE).
+ * @param path Il percorso remoto.
+ * @param payload_len I byte di dati che seguiranno (scritture), 0 altrimenti.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int ft_send_request(int sock, char opcode, uint16_t flags, const char *path, uint64_t payload_len)
+{
+    return ft_send_range_request(sock, opcode, flags & ~FT_FLAG_RANGE, path, payload_len, 0, 0);
+}
+
+
+
+/**
+ * Invia una richiesta con un'unica chiamata: intestazione, percorso e, con FT_FLAG_RANGE, l'intervallo.
+ *
+ * @param sock La socket connessa al server.
+ * @param opcode L'operazione ('w', 'r', 'l', 'i').
+ * @param flags I flag della richiesta (FT_FLAG_*).
+ * @param path Il percorso remoto.
+ * @param payload_len I byte di dati che seguiranno (scritture), 0 altrimenti.
+ * @param offset Posizione del primo byte dell'intervallo (solo con FT_FLAG_RANGE).
+ * @param range_length Byte da leggere, oppure dimensione finale del file in scrittura (solo con FT_FLAG_RANGE).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int ft_send_range_request(int sock, char opcode, uint16_t flags, const char *path, uint64_t payload_len, uint64_t offset, uint64_t range_length)
+{
+    unsigned char buffer[FT_HEADER_SIZE + FT_PATH_MAX + FT_RANGE_SIZE];
+    size_t path_len = strlen(path);
+    size_t len = FT_HEADER_SIZE + path_len;
+    ft_header_t header;
+
+    if (path_len > FT_PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    ft_header_init(&header, opcode, FT_STATUS_OK, payload_len);
+    header.flags = flags;
+    header.path_len = path_len;
+    ft_header_encode(&header, buffer);
+    memcpy(buffer + FT_HEADER_SIZE, path, path_len);
+    if (flags & FT_FLAG_RANGE) {
+        ft_put_u64(buffer + len, offset);
+        ft_put_u64(buffer + len + 8, range_length);
+        len += FT_RANGE_SIZE;
+    }
+
+    // se i dati seguono subito, MSG_MORE li fa partire nello stesso segmento della richiesta
+    int more = (flags & FT_FLAG_NO_CONTINUE) && payload_len > 0;
+    return send_all(sock, buffer, len, more ? MSG_MORE : 0);
+}
+
+
+
+/**
+ * Invia una risposta senza percorso.
+ *
+ * @param sock La socket connessa al client.
+ * @param opcode L'operazione a cui si risponde.
+ * @param status L'esito.
+ * @param payload_len I byte di dati che seguiranno la risposta.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int ft_send_response(int sock, char opcode, ft_status_t status, uint64_t payload_len)
+{
+    return ft_send_response_flags(sock, opcode, status, 0, payload_len);
+}
+
+
+
+/**
+ * Invia una risposta senza percorso con dei flag (es. FT_FLAG_COMPRESS quando i dati seguono compressi).
+ *
+ * @param sock La socket connessa al client.
+ * @param opcode L'operazione a cui si risponde.
+ * @param status L'esito.
+ * @param flags I flag della risposta.
+ * @param payload_len I byte di dati che seguiranno la risposta.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int ft_send_response_flags(int sock, char opcode, ft_status_t status, uint16_t flags, uint64_t payload_len)
+{
+    unsigned char buffer[FT_HEADER_SIZE];
+    ft_header_t header;
+
+    ft_header_init(&header, opcode, status, payload_len);
+    header.flags = flags;
+    ft_header_encode(&header, buffer);
+
+    // se i dati seguono subito, MSG_MORE li fa partire nello stesso segmento della risposta
+    int more = (status == FT_STATUS_OK && payload_len > 0);
+    return send_all(sock, buffer, sizeof(buffer), more ? MSG_MORE : 0);
+}
+
+
+
+/**
+ * Riceve un'intestazione di risposta. Un server sovraccarico risponde con il solo byte STATUS_BUSY
+ * prima di aver letto la richiesta: in quel caso l'intestazione riporta FT_STATUS_BUSY.
+ *
+ * @param sock La socket connessa al server.
+ * @param header L'intestazione ricevuta.
+ * @return 0 in caso di successo, -1 in caso di errore o di intestazione non valida (errno impostato).
+ */
+int ft_recv_header(int sock, ft_header_t *header)
+{
+    unsigned char buffer[FT_HEADER_SIZE];
+
+    if (recv_all(sock, buffer, 1) < 0) {
+        return -1;
+    }
+    if (buffer[0] == STATUS_BUSY) {
+        ft_header_init(header, 0, FT_STATUS_BUSY, 0);
+        return 0;
+    }
+
+    if (recv_all(sock, buffer + 1, FT_HEADER_SIZE - 1) < 0) {
+        return -1;
+    }
+    if (ft_header_decode(buffer, header) < 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Codifica il trailer che segue i dati con FT_FLAG_TRAILER.
+ *
+ * @param buffer Buffer di almeno FT_TRAILER_SIZE byte.
+ * @param crc Il CRC32C dei dati.
+ */
+void ft_trailer_encode(unsigned char *buffer, uint32_t crc)
+{
+    put_u32(buffer, crc);
+}
+
+
+
+/**
+ * Decodifica il trailer che segue i dati con FT_FLAG_TRAILER.
+ *
+ * @param buffer I FT_TRAILER_SIZE byte ricevuti.
+ * @return Il CRC32C annunciato da chi ha inviato i dati.
+ */
+uint32_t ft_trailer_decode(const unsigned char *buffer)
+{
+    return get_u32(buffer);
+}
+
+
+
+/**
+ * Invia il trailer che segue i dati con FT_FLAG_TRAILER.
+ *
+ * @param sock La socket.
+ * @param crc Il CRC32C dei dati inviati.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int ft_send_trailer(int sock, uint32_t crc)
+{
+    unsigned char buffer[FT_TRAILER_SIZE];
+
+    ft_trailer_encode(buffer, crc);
+    return send_all(sock, buffer, sizeof(buffer), 0);
+}
+
+
+
+/**
+ * Riceve il trailer che segue i dati con FT_FLAG_TRAILER.
+ *
+ * @param sock La socket.
+ * @param crc Puntatore dove memorizzare il CRC32C annunciato da chi ha inviato i dati.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int ft_recv_trailer(int sock, uint32_t *crc)
+{
+    unsigned char buffer[FT_TRAILER_SIZE];
+
+    if (recv_all(sock, buffer, sizeof(buffer)) < 0) {
+        return -1;
+    }
+    *crc = ft_trailer_decode(buffer);
+    return 0;
+}
+
+
+
+/**
+ * Converte un codice errno nell'esito da riportare al client.
+ *
+ * @param err Il codice di errore.
+ * @return L'esito corrispondente.
+ */
+ft_status_t ft_status_from_errno(int err)
+{
+    switch (err)
+    {
+        case ENOENT:
+        case ENOTDIR:
+            return FT_STATUS_NOT_FOUND;
+        case EACCES:
+        case EPERM:
+        case EROFS:
+            return FT_STATUS_DENIED;
+        case ENOSPC:
+        case EDQUOT:
+        case EFBIG:
+            return FT_STATUS_NO_SPACE;
+        case ENAMETOOLONG:
+        case EISDIR:
+            return FT_STATUS_BAD_REQUEST;
+        default:
+            return FT_STATUS_IO_ERROR;
+    }
+}
+
+
+
+/**
+ * Restituisce la descrizione leggibile di un esito.
+ *
+ * @param status L'esito.
+ * @return La descrizione.
+ */
+const char* ft_status_message(int status)
+{
+    switch (status)
+    {
+        case FT_STATUS_OK:          return "operazione eseguita";
+        case FT_STATUS_CONTINUE:    return "in attesa dei dati";
+        case FT_STATUS_BAD_REQUEST: return "richiesta non valida";
+        case FT_STATUS_NOT_FOUND:   return "file o directory inesistente";
+        case FT_STATUS_DENIED:      return "permesso negato";
+        case FT_STATUS_NO_SPACE:    return "spazio insufficiente sul server";
+        case FT_STATUS_IO_ERROR:    return "errore di lettura o scrittura sul server";
+        case FT_STATUS_BUSY:        return "server occupato, riprovare più tardi";
+        case FT_STATUS_CORRUPT:     return "dati danneggiati durante il trasferimento (checksum diverso)";
+        default:                    return "esito sconosciuto";
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef MY_FT_PROTOCOL_H
+#define MY_FT_PROTOCOL_H
+
+#include <stdint.h>         // per i tipi a dimensione fissa dell'intestazione
+
+// Protocollo con intestazione binaria. Ogni richiesta è un'intestazione di FT_HEADER_SIZE byte seguita da
+// path_len byte di percorso (senza terminatore) e, per le scritture, da payload_len byte di dati.
+// Ogni risposta è un'intestazione con lo stato seguita da payload_len byte di dati (letture e liste).
+//
+//   offset  dim  campo
+//   0       4    magic (FT_MAGIC, "MYFT")
+//   4       1    versione (FT_VERSION)
+//   5       1    opcode ('w', 'r', 'l', 'i', 'd', 's')
+//   6       2    flag
+//   8       2    stato (ft_status_t, 0 nelle richieste)
+//   10      2    lunghezza del percorso
+//   12      8    lunghezza del payload (FT_LENGTH_UNKNOWN: fino alla chiusura del lato di scrittura)
+//
+// Tutti i campi sono in ordine di rete (big-endian). In una scrittura il server risponde FT_STATUS_CONTINUE
+// prima di ricevere i dati (oppure subito con l'errore) e invia l'esito finale dopo averli scritti.
+// Con FT_FLAG_KEEP_ALIVE la stessa connessione trasporta più richieste, anche inviate una dietro l'altra
+// senza attendere le risposte (pipelining): il server le esegue in ordine e risponde nello stesso ordine.
+// Le scritture in pipelining usano FT_FLAG_NO_CONTINUE; in caso di errore il server scarta i dati annunciati
+// per restare allineato alla richiesta successiva.
+// Con FT_FLAG_RANGE il percorso è seguito da FT_RANGE_SIZE byte che limitano la richiesta a un intervallo del
+// file: posizione del primo byte (8 byte) e, per le letture, byte da leggere (FT_LENGTH_UNKNOWN: fino alla fine),
+// per le scritture la dimensione finale del file. Una scrittura di un intervallo invia payload_len byte dalla
+// posizione indicata senza troncare il file, così più connessioni possono scrivere parti diverse dello stesso file.
+// L'opcode 'i' restituisce FT_INFO_SIZE byte con dimensione e data di modifica (secondi) del file e, con
+// FT_FLAG_CHECKSUM, il CRC32C (4 byte) di ogni blocco completo di FT_CHECKSUM_BLOCK byte: confrontandoli con
+// quelli del file locale il client trova il primo byte da cui riprendere un trasferimento interrotto.
+// Con FT_FLAG_PARTIAL 'i' e 'w' si riferiscono al file parziale "<percorso>.part" di un caricamento da
+// riprendere; la scrittura che completa il file lo rinomina atomicamente nel percorso richiesto.
+// Con FT_FLAG_RECORDS la lista di una directory è binaria, un record per voce (formato in myFTlist.h),
+// ordinata per nome con FT_FLAG_SORTED; con FT_FLAG_RANGE la lista arriva a pagine: la posizione
+// dell'intervallo è il cursore restituito dalla pagina precedente (0 per la prima) e la lunghezza le voci
+// al massimo della pagina.
+// L'opcode 'd' carica un file con deduplicazione: il payload è il manifest del file (formato in myFTchunk.h),
+// inviato subito dopo la richiesta. Se il server ha già il contenuto risponde FT_STATUS_OK; altrimenti risponde
+// FT_STATUS_CONTINUE seguito da una bitmap di ceil(chunk / 8) byte (bit 7 del primo byte = primo chunk) dei chunk
+// che gli mancano, il client invia quei chunk uno dopo l'altro nell'ordine del file e il server risponde con l'esito.
+// Con FT_FLAG_DELTA si trasferiscono solo le differenze rispetto a una versione già presente dall'altra parte
+// (formati in myFTdelta.h): 'i' aggiunge alle informazioni la firma del file; 'w' invia come dati il delta
+// calcolato su quella firma e il server ricostruisce il file accanto all'originale, che sostituisce
+// atomicamente; 'r' invia subito dopo la richiesta la firma del file locale e il server risponde con il delta.
+// Con FT_FLAG_COMPRESS i dati di 'w' e 'r' viaggiano in frame compressi (formato in myFTcompress.h) e payload_len
+// resta la dimensione del file. Chi riceve i dati annuncia i codec che accetta: in lettura il client nella
+// richiesta, in scrittura il server nella risposta FT_STATUS_CONTINUE. Il server comprime una lettura o accetta
+// una scrittura compressa solo se riporta FT_FLAG_COMPRESS nella risposta, altrimenti i dati viaggiano come sempre.
+// Con FT_FLAG_TRAILER i dati di 'w' e 'r' sono seguiti da FT_TRAILER_SIZE byte con il CRC32C dei byte del file
+// (prima di un'eventuale compressione), che chi riceve confronta con quello calcolato durante la ricezione.
+// Come per la compressione chi invia i dati aggiunge il trailer solo se l'altra parte lo ha chiesto e il server
+// lo ha riportato nella propria risposta (FT_STATUS_OK di 'r', FT_STATUS_CONTINUE di 'w'); una scrittura con il
+// checksum diverso riceve FT_STATUS_CORRUPT.
+// L'opcode 's' non riguarda un file (path_len può essere 0, il percorso è ignorato): il server risponde con le
+// proprie metriche (connessioni, byte, operazioni e latenze, errori per esito) come documento JSON.
+// Il protocollo precedente (opzione, percorso preceduto da 5 byte nulli, conferma 'T', dati fino alla
+// chiusura) resta supportato: il server distingue i due dal primo byte ricevuto.
+
+#define FT_MAGIC 0x4D594654u            // "MYFT": il primo byte 'M' non è un'opzione del protocollo precedente
+#define FT_VERSION 1                    // versione corrente del protocollo
+#define FT_HEADER_SIZE 20               // dimensione dell'intestazione sul filo
+#define FT_PATH_MAX 4096                // lunghezza massima del percorso in una richiesta
+#define FT_LENGTH_UNKNOWN UINT64_MAX    // dimensione non nota: i dati arrivano fino a shutdown(SHUT_WR)
+#define FT_RANGE_SIZE 16                // estensione che segue il percorso con FT_FLAG_RANGE
+#define FT_INFO_SIZE 16                 // dati della risposta a 'i' (seguiti dai checksum dei blocchi con FT_FLAG_CHECKSUM)
+#define FT_CHECKSUM_BLOCK (1 << 20)     // byte di ogni blocco di cui 'i' restituisce il CRC32C
+#define FT_PARTIAL_SUFFIX ".part"       // suffisso del file parziale di un caricamento da riprendere
+#define FT_TRAILER_SIZE 4               // CRC32C che segue i dati con FT_FLAG_TRAILER
+
+#define FT_FLAG_KEEP_ALIVE 0x0001       // dopo la risposta la connessione resta aperta per la richiesta successiva
+#define FT_FLAG_NO_CONTINUE 0x0002      // scrittura: i dati seguono subito la richiesta, senza attendere FT_STATUS_CONTINUE
+#define FT_FLAG_RECURSIVE 0x0004        // lista: tutti i file regolari sotto la directory, uno per record "<dimensione> <percorso relativo>\0"
+#define FT_FLAG_RANGE 0x0008            // lettura o scrittura di un intervallo del file (segue l'estensione FT_RANGE_SIZE)
+#define FT_FLAG_PARTIAL 0x0010          // 'i' e 'w' sul file parziale "<percorso>.part", rinominato quando è completo
+#define FT_FLAG_CHECKSUM 0x0020         // 'i': la risposta riporta anche il CRC32C di ogni blocco completo
+#define FT_FLAG_RECORDS 0x0040          // lista: un record binario per voce invece delle righe di testo
+#define FT_FLAG_SORTED 0x0080           // lista con FT_FLAG_RECORDS: voci ordinate per nome
+#define FT_FLAG_DELTA 0x0100            // 'i': segue la firma del file; 'w' e 'r': i dati sono un delta (myFTdelta.h)
+#define FT_FLAG_COMPRESS 0x0200         // 'w' e 'r': i dati viaggiano in frame compressi (myFTcompress.h)
+#define FT_FLAG_LZ4 0x0400              // con FT_FLAG_COMPRESS: chi riceve accetta anche frame lz4
+#define FT_FLAG_ZSTD 0x0800             // con FT_FLAG_COMPRESS: chi riceve accetta anche frame zstd
+#define FT_FLAG_TRAILER 0x1000          // 'w' e 'r': i dati sono seguiti dal loro CRC32C
+
+#define LEGACY_ACK 'T'                  // conferma del protocollo precedente
+#define LEGACY_PATH_PADDING 5           // byte nulli che precedono il percorso nel protocollo precedente
+#define STATUS_BUSY 'B'                 // byte inviato al posto di qualsiasi risposta quando il server rifiuta la connessione perché sovraccarico
+
+
+// Esito di una richiesta
+typedef enum
+{
+    FT_STATUS_OK = 0,               // richiesta eseguita (seguono payload_len byte, se presenti)
+    FT_STATUS_CONTINUE = 1,         // scrittura accettata: il client può inviare i dati
+    FT_STATUS_BAD_REQUEST = 2,      // intestazione, versione, opcode o percorso non validi
+    FT_STATUS_NOT_FOUND = 3,        // file o directory inesistente
+    FT_STATUS_DENIED = 4,           // permessi insufficienti
+    FT_STATUS_NO_SPACE = 5,         // spazio insufficiente sul dispositivo
+    FT_STATUS_IO_ERROR = 6,         // errore di lettura o scrittura
+    FT_STATUS_BUSY = 7,             // server sovraccarico
+    FT_STATUS_CORRUPT = 8           // il checksum dei dati ricevuti non corrisponde al trailer
+} ft_status_t;
+
+
+// Intestazione decodificata
+typedef struct
+{
+    uint8_t version;                // versione del protocollo
+    char opcode;                    // operazione ('w', 'r', 'l', 'i', 'd', 's')
+    uint16_t flags;                 // flag della richiesta
+    uint16_t status;                // esito (solo nelle risposte)
+    uint16_t path_len;              // byte di percorso che seguono l'intestazione
+    uint64_t payload_len;           // byte di dati che seguono (FT_LENGTH_UNKNOWN se non noti)
+    uint64_t range_offset;          // FT_FLAG_RANGE: posizione del primo byte dell'intervallo
+    uint64_t range_length;          // FT_FLAG_RANGE: byte da leggere, oppure dimensione finale del file in scrittura
+} ft_header_t;
+
+void ft_header_init(ft_header_t *header, char opcode, ft_status_t status, uint64_t payload_len);
+void ft_header_encode(const ft_header_t *header, unsigned char *buffer);
+int ft_header_decode(const unsigned char *buffer, ft_header_t *header);
+void ft_put_u64(unsigned char *p, uint64_t value);
+uint64_t ft_get_u64(const unsigned char *p);
+void ft_range_decode(const unsigned char *buffer, ft_header_t *header);
+int ft_send_request(int sock, char opcode, uint16_t flags, const char *path, uint64_t payload_len);
+int ft_send_range_request(int sock, char opcode, uint16_t flags, const char *path, uint64_t payload_len, uint64_t offset, uint64_t range_length);
+int ft_send_response(int sock, char opcode, ft_status_t status, uint64_t payload_len);
+int ft_send_response_flags(int sock, char opcode, ft_status_t status, uint16_t flags, uint64_t payload_len);
+int ft_recv_header(int sock, ft_header_t *header);
+void ft_trailer_encode(unsigned char *buffer, uint32_t crc);
+uint32_t ft_trailer_decode(const unsigned char *buffer);
+int ft_send_trailer(int sock, uint32_t crc);
+int ft_recv_trailer(int sock, uint32_t *crc);
+ft_status_t ft_status_from_errno(int err);
+const char* ft_status_message(int status);
+
+#endif // MY_FT_PROTOCOL_H
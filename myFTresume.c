@@ -0,0 +1,202 @@
+// RIPRESA DEI TRASFERIMENTI INTERROTTI
+
+#include "myFTresume.h"
+
+
+
+/**
+ * Confronta i blocchi del file locale con i checksum ricevuti dal server e restituisce la lunghezza del
+ * prefisso comune: il trasferimento riprende dal primo blocco diverso (o mancante). I blocchi vengono
+ * letti solo fino al primo che non coincide.
+ *
+ * @param fd - Il file descriptor del file locale.
+ * @param size - I byte del file locale da considerare.
+ * @param checksums - Il CRC32C di ogni blocco completo del file remoto.
+ * @param count - Il numero di checksum.
+ * @return I byte del prefisso comune, multiplo di FT_CHECKSUM_BLOCK.
+ */
+unsigned long long matching_prefix(int fd, unsigned long long size, const uint32_t *checksums, size_t count)
+{
+    size_t blocks = 0;
+    uint32_t crc;
+
+    while (blocks < count && (unsigned long long)(blocks + 1) * FT_CHECKSUM_BLOCK <= size) {
+        if (file_crc32c(fd, (off_t)blocks * FT_CHECKSUM_BLOCK, FT_CHECKSUM_BLOCK, &crc) < 0 || crc != checksums[blocks]) {
+            break;
+        }
+        blocks++;
+    }
+    return (unsigned long long)blocks * FT_CHECKSUM_BLOCK;
+}
+
+
+
+/**
+ * Invia un file al server riprendendo un caricamento interrotto. Il server conserva i dati ricevuti nel
+ * file parziale "<remoto>.part": il client ne chiede i checksum dei blocchi, trova il primo blocco che non
+ * coincide con il file locale e invia solo i byte da lì in poi. Quando il file è completo il server lo
+ * rinomina atomicamente nel percorso richiesto.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param from_path - Il percorso del file locale da inviare.
+ * @param destination_path - Il percorso remoto in cui scrivere il file.
+ * @return 0 se il server ha salvato il file, -1 in caso di errore.
+ */
+int request_resume_write(int client_sock, const char *from_path, const char *destination_path)
+{
+    struct stat statbuf;
+    ft_header_t response;
+    uint32_t *checksums = NULL;
+    size_t count = 0;
+    unsigned long long remote_size;
+    unsigned long long offset = 0;
+
+    int file_fd = open(from_path, O_RDONLY);
+    if (file_fd < 0) {
+        fprintf(stderr, "Errore durante l' apertura del file: %s\n", strerror(errno));
+        return -1;
+    }
+    if (fstat(file_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+        fprintf(stderr, "Errore, la ripresa richiede un file regolare: '%s'\n", from_path);
+        close(file_fd);
+        return -1;
+    }
+    unsigned long long size = statbuf.st_size;
+
+    // file parziale sul server: la stessa connessione resta aperta per la scrittura
+    int info = request_info(client_sock, destination_path, FT_FLAG_KEEP_ALIVE | FT_FLAG_PARTIAL | FT_FLAG_CHECKSUM, &remote_size, &checksums, &count);
+    if (info < 0) {
+        close(file_fd);
+        return -1;
+    }
+    if (info == 0) {
+        offset = matching_prefix(file_fd, size, checksums, count);
+        free(checksums);
+        printf("CLIENT: Sul server ci sono già %llu byte, ripresa dal byte %llu di %llu\n", remote_size, offset, size);
+    }
+
+    if (ft_send_range_request(client_sock, 'w', FT_FLAG_PARTIAL | FT_FLAG_RANGE, destination_path, size - offset, offset, size) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    printf("CLIENT: Richiesta di scrittura su '%s' inviata al server\n", destination_path);
+
+    if (recv_response(client_sock, &response) < 0 || response.status != FT_STATUS_CONTINUE) {
+        close(file_fd);
+        return -1;
+    }
+
+    int sent = -1;
+    if (lseek(file_fd, (off_t)offset, SEEK_SET) < 0) {
+        fprintf(stderr, "Errore durante il posizionamento nel file: %s\n", strerror(errno));
+    } else {
+        sent = send_data(file_fd, client_sock, (long long)(size - offset), 0);
+    }
+    close(file_fd);
+
+    // anche se l'invio è fallito il server potrebbe aver inviato il motivo (es. spazio esaurito)
+    if (recv_response(client_sock, &response) < 0 || sent < 0) {
+        return -1;
+    }
+    printf("CLIENT: Il server ha salvato il file\n");
+    return 0;
+}
+
+
+
+/**
+ * Riceve un file dal server riprendendo una lettura interrotta. I dati vengono scritti nel file parziale
+ * locale "<locale>.part": il client chiede i checksum dei blocchi del file remoto, conserva il prefisso
+ * del file parziale che coincide e chiede solo l'intervallo restante. A ricezione completata il file
+ * parziale viene rinominato nel percorso richiesto.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param remote_path - Il percorso remoto del file da leggere.
+ * @param destination_path - Il percorso del file locale dove scrivere i dati ricevuti.
+ * @return 0 se il file è stato ricevuto interamente, -1 in caso di errore.
+ */
+int request_resume_read(int client_sock, const char *remote_path, const char *destination_path)
+{
+    struct stat statbuf;
+    ft_header_t response;
+    transfer_stats_t stats;
+    uint32_t *checksums = NULL;
+    size_t count = 0;
+    unsigned long long size;
+    int result = -1;
+
+    int info = request_info(client_sock, remote_path, FT_FLAG_KEEP_ALIVE | FT_FLAG_CHECKSUM, &size, &checksums, &count);
+    if (info != 0) {
+        if (info == 1) {
+            fprintf(stderr, "Errore dal server: %s\n", ft_status_message(FT_STATUS_NOT_FOUND));
+        }
+        return -1;
+    }
+
+    // crea la directory specificata se non esiste
+    size_t len = strlen(destination_path) + strlen(FT_PARTIAL_SUFFIX);
+    char *part = (char *)malloc(len + 1);
+    if (part == NULL || !create_dir(destination_path)) {
+        free(part);
+        free(checksums);
+        return -1;
+    }
+    strcpy(part, destination_path);
+    strcat(part, FT_PARTIAL_SUFFIX);
+
+    int file_fd = open(part, O_RDWR | O_CREAT, 0644);
+    if (file_fd < 0 || fstat(file_fd, &statbuf) < 0) {
+        fprintf(stderr, "Errore apertura file: %s\n", strerror(errno));
+        goto out;
+    }
+
+    // si conserva il prefisso che coincide con il file remoto, il resto del file parziale viene scartato
+    unsigned long long local_size = statbuf.st_size;
+    unsigned long long offset = matching_prefix(file_fd, local_size < size ? local_size : size, checksums, count);
+    printf("CLIENT: In locale ci sono già %llu byte, ripresa dal byte %llu di %llu\n", local_size, offset, size);
+    if (ftruncate(file_fd, (off_t)offset) < 0 || lseek(file_fd, (off_t)offset, SEEK_SET) < 0) {
+        fprintf(stderr, "Errore durante la preparazione del file parziale: %s\n", strerror(errno));
+        goto out;
+    }
+
+    if (ft_send_range_request(client_sock, 'r', FT_FLAG_RANGE, remote_path, 0, offset, size - offset) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        goto out;
+    }
+    printf("CLIENT: Richiesta di lettura di '%s' inviata al server\n", remote_path);
+
+    if (recv_response(client_sock, &response) < 0) {
+        goto out;
+    }
+    // un intervallo più corto significa che il file è cambiato dopo la richiesta dei checksum
+    if (response.payload_len != size - offset) {
+        fprintf(stderr, "Errore, il file '%s' è cambiato durante la lettura\n", remote_path);
+        goto out;
+    }
+    printf("CLIENT: Il server invia %llu byte\n", (unsigned long long)response.payload_len);
+
+    if (recv_file(client_sock, file_fd, (long long)(size - offset), available_bytes(part), client_transfer_mode, &stats, NULL) < 0) {
+        if (errno == ENOSPC) {
+            fprintf(stderr, "Memoria piena: \n");
+        } else {
+            fprintf(stderr, "Errore durante la ricezione dei dati: %s\n", strerror(errno));
+        }
+        goto out;
+    }
+
+    // il file completo sostituisce atomicamente quello richiesto
+    if (rename(part, destination_path) < 0) {
+        fprintf(stderr, "Errore durante il completamento del file '%s': %s\n", destination_path, strerror(errno));
+        goto out;
+    }
+    result = 0;
+
+out:
+    if (file_fd >= 0) {
+        close(file_fd);
+    }
+    free(part);
+    free(checksums);
+    return result;
+}
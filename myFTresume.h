@@ -0,0 +1,12 @@
+#ifndef MY_FT_RESUME_H
+#define MY_FT_RESUME_H
+
+#include "myFTclient.h"
+#include "myFTchecksum.h"       // CRC32C dei blocchi del file locale
+
+
+unsigned long long matching_prefix(int fd, unsigned long long size, const uint32_t *checksums, size_t count);
+int request_resume_write(int client_sock, const char *from_path, const char *destination_path);
+int request_resume_read(int client_sock, const char *remote_path, const char *destination_path);
+
+#endif // MY_FT_RESUME_H
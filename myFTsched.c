@@ -0,0 +1,262 @@
+// SCHEDULER DELLE RICHIESTE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include "myFTsched.h"
+#include "myFTmetrics.h"    // per l'attesa in coda di ogni classe
+
+static const char *class_names[SCHED_CLASSES] = {"list", "small", "large"};
+
+static struct
+{
+    int capacity;                           // richieste eseguite insieme al massimo (0 = nessun limite, scheduler disattivato)
+    int reserved;                           // posti che i trasferimenti grandi non possono occupare
+    unsigned long long small_limit;         // byte al massimo di un trasferimento piccolo
+    sched_resume_t resume;                  // riprende le richieste senza un thread in attesa
+    void *context;                          // primo argomento di resume
+    pthread_mutex_t mutex;                  // protegge i campi seguenti
+    unsigned running[SCHED_CLASSES];        // richieste in esecuzione per classe
+    unsigned queued[SCHED_CLASSES];         // richieste in coda per classe
+    sched_item_t *head[SCHED_CLASSES];      // richiesta più vecchia di ogni coda
+    sched_item_t *tail[SCHED_CLASSES];      // richiesta più recente di ogni coda
+    uint64_t deficit[SCHED_CLASSES];        // credito in byte di ogni classe
+    int turn;                               // classe a cui tocca nel round robin
+} sched = { .small_limit = SCHED_DEFAULT_SMALL, .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+
+
+/**
+ * Configura lo scheduler, prima di avviare i thread che servono le richieste.
+ *
+ * @param capacity Richieste eseguite insieme al massimo (0 = nessun limite: ogni richiesta parte subito).
+ * @param reserved Posti riservati a liste e trasferimenti piccoli, minore di capacity.
+ * @param small_limit Byte al massimo di un trasferimento piccolo.
+ * @param resume Funzione che riprende una richiesta rimasta in coda senza un thread in attesa (vedi sched_enter).
+ * @param context Primo argomento di resume.
+ * @return 1 se lo scheduler limita le richieste, 0 altrimenti.
+ */
+int sched_init(int capacity, int reserved, unsigned long long small_limit, sched_resume_t resume, void *context)
+{
+    sched.capacity = capacity > 0 ? capacity : 0;
+    sched.reserved = (reserved > 0 && reserved < capacity) ? reserved : 0;
+    sched.small_limit = small_limit;
+    sched.resume = resume;
+    sched.context = context;
+    return sched.capacity > 0;
+}
+
+
+
+const char* sched_class_name(sched_class_t klass)
+{
+    return class_names[klass];
+}
+
+
+
+/**
+ * Assegna a una richiesta la sua classe e il suo costo.
+ *
+ * @param item La richiesta.
+ * @param opcode L'operazione richiesta.
+ * @param size I byte che la richiesta trasferirà (-1 se non noti).
+ */
+void sched_prepare(sched_item_t *item, char opcode, long long size)
+{
+    if (opcode == 'l' || opcode == 'i') {
+        item->klass = SCHED_LIST;
+    } else if (size >= 0 && (unsigned long long)size <= sched.small_limit) {
+        item->klass = SCHED_SMALL;
+    } else {
+        item->klass = SCHED_LARGE;
+    }
+    // una dimensione non nota costa un giro intero: la richiesta non passa davanti a quelle già in coda
+    item->cost = size < 0 ? SCHED_QUANTUM : (size > SCHED_MIN_COST ? (uint64_t)size : SCHED_MIN_COST);
+    item->queued_us = 0;
+    item->wake = NULL;
+    item->arg = NULL;
+    item->next = NULL;
+}
+
+
+
+// 1 se una richiesta della classe può occupare un posto adesso (con il mutex)
+static int can_run(int klass)
+{
+    unsigned total = sched.running[SCHED_LIST] + sched.running[SCHED_SMALL] + sched.running[SCHED_LARGE];
+
+    return total < (unsigned)sched.capacity && (klass != SCHED_LARGE || sched.running[SCHED_LARGE] < (unsigned)(sched.capacity - sched.reserved));
+}
+
+
+
+/**
+ * Sceglie la prossima richiesta da eseguire con il deficit round robin (con il mutex). La classe di turno
+ * esegue le sue richieste finché il credito le copre, poi il turno passa alla successiva, che riceve
+ * SCHED_QUANTUM byte di credito. Solo le classi che possono occupare un posto partecipano al giro.
+ *
+ * @return La richiesta tolta dalla sua coda, NULL se nessuna può partire.
+ */
+static sched_item_t* sched_pick(void)
+{
+    int eligible = 0;
+
+    for (int k = 0; k < SCHED_CLASSES; k++) {
+        if (sched.head[k] == NULL) {
+            sched.deficit[k] = 0;           // una classe senza richieste in attesa non accumula credito
+        } else if (can_run(k)) {
+            eligible = 1;
+        }
+    }
+    if (!eligible) {
+        return NULL;
+    }
+
+    while (1)
+    {
+        for (int i = 0; i < SCHED_CLASSES; i++)
+        {
+            int k = sched.turn;
+            sched_item_t *item = sched.head[k];
+
+            if (item != NULL && can_run(k) && item->cost <= sched.deficit[k]) {
+                sched.deficit[k] -= item->cost;
+                sched.head[k] = item->next;
+                if (sched.head[k] == NULL) {
+                    sched.tail[k] = NULL;
+                    sched.deficit[k] = 0;
+                }
+                sched.queued[k]--;
+                item->next = NULL;
+                return item;
+            }
+            sched.turn = (k + 1) % SCHED_CLASSES;
+            if (sched.head[sched.turn] != NULL && can_run(sched.turn)) {
+                sched.deficit[sched.turn] += SCHED_QUANTUM;
+            }
+        }
+
+        // un giro intero senza richieste coperte dal credito (trasferimenti molto grandi): si accreditano
+        // insieme i giri che mancano alla prima, invece di ripeterli uno alla volta
+        uint64_t rounds = UINT64_MAX;
+        for (int k = 0; k < SCHED_CLASSES; k++) {
+            if (sched.head[k] != NULL && can_run(k)) {
+                uint64_t missing = (sched.head[k]->cost - sched.deficit[k] + SCHED_QUANTUM - 1) / SCHED_QUANTUM;
+                rounds = missing < rounds ? missing : rounds;
+            }
+        }
+        for (int k = 0; k < SCHED_CLASSES; k++) {
+            if (sched.head[k] != NULL && can_run(k)) {
+                sched.deficit[k] += rounds * SCHED_QUANTUM;
+            }
+        }
+    }
+}
+
+
+
+/**
+ * Chiede un posto per eseguire una richiesta. Se la sua classe non ha richieste in coda e c'è un posto libero
+ * (tra quelli non riservati, per un trasferimento grande) la richiesta parte subito, altrimenti entra nella coda
+ * della sua classe: con item->wake il thread attende lì il suo turno, senza la richiesta riparte più tardi con
+ * la funzione di sched_init, chiamata dal thread che libera il posto.
+ *
+ * @param item La richiesta, preparata con sched_prepare.
+ * @return 1 se la richiesta può essere eseguita dal thread chiamante, 0 se è rimasta in coda.
+ */
+int sched_enter(sched_item_t *item)
+{
+    if (sched.capacity == 0) {
+        metrics_class_wait(item->klass, 0);
+        return 1;
+    }
+
+    pthread_mutex_lock(&sched.mutex);
+    if (sched.head[item->klass] == NULL && can_run(item->klass)) {
+        sched.running[item->klass]++;
+        pthread_mutex_unlock(&sched.mutex);
+        metrics_class_wait(item->klass, 0);
+        return 1;
+    }
+    item->queued_us = metrics_now_us();
+    item->next = NULL;
+    if (sched.tail[item->klass] != NULL) {
+        sched.tail[item->klass]->next = item;
+    } else {
+        sched.head[item->klass] = item;
+    }
+    sched.tail[item->klass] = item;
+    sched.queued[item->klass]++;
+    pthread_mutex_unlock(&sched.mutex);
+
+    if (item->wake == NULL) {
+        return 0;
+    }
+    while (sem_wait(item->wake) < 0 && errno == EINTR) {
+    }
+    return 1;
+}
+
+
+
+/**
+ * Libera il posto di una richiesta conclusa e fa partire le richieste in coda a cui tocca.
+ *
+ * @param item La richiesta conclusa.
+ */
+void sched_leave(sched_item_t *item)
+{
+    sched_item_t *granted = NULL;
+    sched_item_t **last = &granted;
+
+    if (sched.capacity == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&sched.mutex);
+    sched.running[item->klass]--;
+    for (sched_item_t *next = sched_pick(); next != NULL; next = sched_pick()) {
+        sched.running[next->klass]++;
+        *last = next;
+        last = &next->next;
+    }
+    pthread_mutex_unlock(&sched.mutex);
+
+    // fuori dal mutex: chi riprende una richiesta può accodarne subito un'altra
+    uint64_t now = metrics_now_us();
+    while (granted != NULL)
+    {
+        sched_item_t *next = granted->next;     // dopo il risveglio la richiesta appartiene al suo thread
+        metrics_class_wait(granted->klass, now > granted->queued_us ? now - granted->queued_us : 0);
+        if (granted->wake != NULL) {
+            sem_post(granted->wake);
+        } else {
+            sched.resume(sched.context, granted);
+        }
+        granted = next;
+    }
+}
+
+
+
+/**
+ * Legge configurazione e occupazione dello scheduler (metriche).
+ *
+ * @param capacity Puntatore dove memorizzare i posti (0 = nessun limite).
+ * @param reserved Puntatore dove memorizzare i posti riservati.
+ * @param running Richieste in esecuzione per classe.
+ * @param queued Richieste in coda per classe.
+ */
+void sched_snapshot(int *capacity, int *reserved, unsigned running[SCHED_CLASSES], unsigned queued[SCHED_CLASSES])
+{
+    pthread_mutex_lock(&sched.mutex);
+    *capacity = sched.capacity;
+    *reserved = sched.reserved;
+    for (int k = 0; k < SCHED_CLASSES; k++) {
+        running[k] = sched.running[k];
+        queued[k] = sched.queued[k];
+    }
+    pthread_mutex_unlock(&sched.mutex);
+}
@@ -0,0 +1,51 @@
+#ifndef MY_FT_SCHED_H
+#define MY_FT_SCHED_H
+
+#include <stdint.h>
+#include <semaphore.h>      // per sem_t
+
+// Scheduler delle richieste tra la ricezione di una richiesta e la sua esecuzione (-m thread e -m pool). Ogni
+// richiesta ha una classe: liste e informazioni, trasferimenti piccoli (fino a -T byte, dalla dimensione del file
+// o da quella annunciata) e trasferimenti grandi o di dimensione non nota. Al massimo -P richieste sono eseguite
+// insieme e -R di questi posti sono riservati alle prime due classi, così un'operazione breve non resta mai
+// dietro ai trasferimenti grandi. Quando un posto si libera la prossima richiesta si sceglie tra le code delle
+// classi con un deficit round robin sui byte: ogni classe con richieste in attesa riceve SCHED_QUANTUM byte di
+// credito a ogni giro e parte la prima richiesta che il credito della sua classe copre.
+
+#define SCHED_DEFAULT_SMALL (256 << 10)     // byte al massimo di un trasferimento piccolo (opzione -T)
+#define SCHED_QUANTUM (1 << 20)             // credito in byte di una classe a ogni giro del round robin
+#define SCHED_MIN_COST (16 << 10)           // costo minimo di una richiesta (liste, informazioni, file vuoti)
+
+
+// Classe di una richiesta
+typedef enum
+{
+    SCHED_LIST = 0,         // liste e informazioni sui file
+    SCHED_SMALL = 1,        // letture e scritture fino a -T byte
+    SCHED_LARGE = 2,        // trasferimenti più grandi o di dimensione non nota
+    SCHED_CLASSES = 3
+} sched_class_t;
+
+
+// Richiesta nello scheduler
+typedef struct sched_item
+{
+    sched_class_t klass;            // classe della richiesta
+    uint64_t cost;                  // byte da trasferire (almeno SCHED_MIN_COST)
+    uint64_t queued_us;             // ingresso nella coda della classe (metriche)
+    sem_t *wake;                    // semaforo del thread che attende il suo turno (NULL: la richiesta riparte con la funzione di sched_init)
+    void *arg;                      // argomento per chi riprende la richiesta
+    struct sched_item *next;        // richiesta successiva nella coda della classe
+} sched_item_t;
+
+// Funzione che riprende una richiesta rimasta in coda quando arriva il suo turno
+typedef void (*sched_resume_t)(void *context, sched_item_t *item);
+
+int sched_init(int capacity, int reserved, unsigned long long small_limit, sched_resume_t resume, void *context);
+const char* sched_class_name(sched_class_t klass);
+void sched_prepare(sched_item_t *item, char opcode, long long size);
+int sched_enter(sched_item_t *item);
+void sched_leave(sched_item_t *item);
+void sched_snapshot(int *capacity, int *reserved, unsigned running[SCHED_CLASSES], unsigned queued[SCHED_CLASSES]);
+
+#endif // MY_FT_SCHED_H
@@ -1,10 +1,18 @@
 // SERVER
 
 #include "myFTserver.h"
+#include "myFTevent.h"
+#include "myFTpool.h"
+#include "myFTuring.h"
 
-client_t *clients[MAX_CLIENTS];                             // array di puntatori ai client connessi
+client_t **clients = NULL;                                  // array (dinamico) di puntatori ai client connessi
+int clients_count = 0;                                      // numero di client connessi
+int clients_capacity = 0;                                   // dimensione allocata dell'array dei client
 pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;  // mutex per accesso thread-safe all'array dei client (macro poichè dichiarato come variabile globale) 
 int uid_counter = 10;                                       // contatore globale per gli UID
+transfer_mode_t server_transfer_mode = TRANSFER_ZEROCOPY;   // modalità di invio/ricezione dei file (opzione -t)
+int server_compress_codec = CODEC_AUTO;                     // codec delle letture compresse (opzione -z)
+static unsigned int spool_sequence = 0;                     // contatore per i nomi dei file temporanei delle scritture
 
 /**
  * Restituisce il numero di byte disponibili sul dispositivo specificato dal percorso.
@@ -27,94 +35,127 @@ unsigned long long int available_bytes(const char *path)
 }
 
 /**
- * Aggiunge un client all'array dei client connessi.
+ * Aggiunge un client all'array dei client connessi, ingrandendolo se è pieno.
  * @param cl Puntatore al client da aggiungere.
+ * @return 0 in caso di successo, -1 se non è stato possibile ingrandire l'array.
  */
-void add_client(client_t *cl)
+int add_client(client_t *cl)
 {
     pthread_mutex_lock(&clients_mutex);     // rimane in attesa che il mutex sia disponibile ed effettua un lock su di esso
     
-    // scorre la lista per inserire il nodo in coda
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+    // se l'array è pieno ne raddoppia la capacità: non c'è un limite fisso al numero di client
+    if (clients_count == clients_capacity)
     {
-        if (!clients[i])        // se la posizione è libera
-        {      
-            clients[i] = cl;    // aggiunge il client
-            break;
+        int new_capacity = clients_capacity ? clients_capacity * 2 : CLIENTS_INITIAL_CAPACITY;
+        client_t **new_clients = (client_t **)realloc(clients, new_capacity * sizeof(client_t *));
+        if (new_clients == NULL) {
+            pthread_mutex_unlock(&clients_mutex);
+            fprintf(stderr, "Errore durante l'allocazione del registro dei client: %s\n", strerror(errno));
+            return -1;
         }
+        clients = new_clients;
+        clients_capacity = new_capacity;
     }
+
+    // inserisce il client in coda e ne ricorda la posizione per la rimozione
+    cl->slot = clients_count;
+    clients[clients_count++] = cl;
+
     pthread_mutex_unlock(&clients_mutex);   // sblocca il mutex
+    return 0;
 }
 
 
 
 /**
  * Rimuove un client dall'array dei client connessi.
- * @param uid L'ID univoco del client da rimuovere.
+ * @param cl Puntatore al client da rimuovere.
  */
-void remove_client(int uid)
+void remove_client(client_t *cl)
 {
     pthread_mutex_lock(&clients_mutex);     // rimane in attesa che il mutex sia disponibile ed effettua un lock su di esso
     
-    // scorre la lista per cercare e rimuvere il nodo con id specificato in input
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+    // sposta l'ultimo client nella posizione liberata, così la rimozione non richiede di scorrere l'array
+    int slot = cl->slot;
+    if (slot >= 0 && slot < clients_count && clients[slot] == cl)
     {
-        if (clients[i]) // se la posizione non è libera
-        {  
-            if (clients[i]->uid == uid) // se l'UID corrisponde
-            {  
-                clients[i] = NULL;          // rimuove il client dall'array
-                break;
-            }
-        }
+        clients[slot] = clients[--clients_count];
+        clients[slot]->slot = slot;
+        cl->slot = -1;
     }
     pthread_mutex_unlock(&clients_mutex);  // sblocca il mutex
 }
 
 
 
+/**
+ * Invia l'intestazione di risposta, contando nelle metriche gli esiti di errore.
+ * @param client_sock Socket del client.
+ * @param opcode Operazione a cui si risponde.
+ * @param status Esito della richiesta.
+ * @param payload_len Byte di dati che seguono la risposta.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int send_response(int client_sock, char opcode, ft_status_t status, uint64_t payload_len)
+{
+    metrics_error(status);
+    return ft_send_response(client_sock, opcode, status, payload_len);
+}
+
+
+
 /**
  * Invia il contenuto di un file al client tramite una socket.
  * @param fd File descriptor del file da inviare.
  * @param client_sock Socket del client a cui inviare il file.
+ * @param length Byte da inviare (dimensione annunciata al client), -1 per inviare fino alla fine del file.
+ * @param trailer 1 per far seguire i dati dal loro CRC32C (FT_FLAG_TRAILER).
+ * @return 0 se il file è stato inviato interamente, -1 in caso di errore.
  * 
- * La funzione utilizza un buffer per leggere il file in blocchi di dati e inviarli attraverso la socket 
- * fino a quando tutto il contenuto del file è stato trasmesso.
+ * In modalità zerocopy i dati vengono passati dal page cache alla socket con sendfile, senza copie
+ * in user space; se sendfile non è supportato si ripiega sul ciclo read/send con un buffer.
+ * Il file descriptor e la socket restano aperti: la loro chiusura spetta al chiamante.
  */
-void send_data(int fd, int client_sock) 
+int send_data(int fd, int client_sock, long long length, int trailer) 
 {
-    char buffer[BUFFER_SIZE];   // array di caratteri che funge da buffer temporaneo per i dati letti dal file
-    ssize_t bytes_read;         // memorizzare il numero di byte letti dal file in ogni iterazione.
+    transfer_stats_t stats;     // byte inviati e chiamate di sistema eseguite
+    uint32_t crc;               // CRC32C dei dati inviati
 
-    // ciclo di lettura dal file e invio tramite la socket
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) 
-    {
-        ssize_t total_sent = 0;         // variabile per tracciare il totale dei byte inviati in ogni iterazione
-        
-        // ciclo che garantisce che tutti i dati siano inviati, anche se send invia solo una parte
-        while (total_sent < bytes_read) 
-        {
-            // buffer + total_sent = inizio del buffer di dati da inviare
-            // bytes_read - total_sent = byte che rimangono da inviare
-            ssize_t bytes_sent = send(client_sock, buffer + total_sent, bytes_read - total_sent, 0); 
-            
-            // gestione degli errori di invio
-            if (bytes_sent < 0) 
-            {
-                fprintf(stderr, "Errore durante l'invio dei dati del file al client: %s\n", strerror(errno));
-                close(fd);
-                close(client_sock); // chiusura della socket in caso di errore
-                return;
-            }
-            total_sent += bytes_sent; // aggiorna il totale dei byte inviati
-        }
+    if (send_file(fd, client_sock, length, server_transfer_mode, &stats, trailer ? &crc : NULL) < 0 ||
+        (trailer && ft_send_trailer(client_sock, crc) < 0)) {
+        LOG_ERROR("Errore durante l'invio dei dati del file al client: %s", strerror(errno));
+        return -1;
     }
 
-    if (bytes_read < 0) {
-        fprintf(stderr, "Errore durante la lettura del file: %s\n", strerror(errno));
-    }    
+    LOG_INFO("Inviati %llu byte con %llu chiamate di sistema (%s)", stats.bytes, stats.syscalls, transfer_path_name(&stats));
+    metrics_bytes(0, stats.bytes);
+    return 0;
+}
+
+
+
+/**
+ * Invia i dati del file come frame compressi, con il codec dell'opzione -z tra quelli accettati dal client.
+ * @param fd File descriptor del file da inviare, posizionato sul primo byte.
+ * @param client_sock Socket del client a cui inviare i dati.
+ * @param length Byte da inviare.
+ * @param codecs Codec accettati dal client.
+ * @param trailer 1 per far seguire i dati dal CRC32C dei byte del file (FT_FLAG_TRAILER).
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int send_compressed_data(int fd, int client_sock, long long length, unsigned codecs, int trailer)
+{
+    compress_stats_t stats;     // byte del file, byte inviati, codec scelto e CRC32C
+
+    if (send_compressed(fd, client_sock, length, codecs, server_compress_codec, &stats) < 0 ||
+        (trailer && ft_send_trailer(client_sock, stats.crc) < 0)) {
+        LOG_ERROR("Errore durante l'invio dei dati compressi al client: %s", strerror(errno));
+        return -1;
+    }
 
-    close(fd);  // assicurarsi che il file descriptor venga sempre chiuso alla fine della funzione
+    LOG_INFO("Inviati %llu byte in %llu byte compressi (%s, %llu frame)", stats.bytes, stats.wire_bytes, compress_codec_name(stats.codec), stats.frames);
+    metrics_bytes(0, stats.wire_bytes);
+    return 0;
 }
 
 
@@ -123,59 +164,528 @@ void send_data(int fd, int client_sock)
  * Scrive il contenuto ricevuto da una socket in un file.
  * @param path Il percorso del file dove scrivere i dati.
  * @param client_sock Socket del client da cui ricevere i dati.
+ * @param length Dimensione annunciata del file, -1 se i dati arrivano fino alla chiusura della connessione.
+ * @param request L'intestazione della richiesta, NULL per il protocollo precedente.
+ * @return FT_STATUS_OK se il file è stato ricevuto interamente, altrimenti l'esito dell'errore.
+ *
+ * Lo spazio su disco viene preallocato con fallocate; in modalità zerocopy i dati passano dalla socket
+ * al file con splice (socket -> pipe -> file) senza essere copiati in user space.
+ * Con l'intestazione binaria prima di ricevere i dati si invia FT_STATUS_CONTINUE, a meno che il client li stia
+ * già inviando (FT_FLAG_NO_CONTINUE); in caso di errore i byte annunciati e non ancora ricevuti vengono scartati,
+ * così la connessione resta allineata alla richiesta successiva. Con FT_FLAG_TRAILER il CRC32C dei dati,
+ * calcolato durante la ricezione, deve coincidere con quello che il client invia dopo i dati: una scrittura
+ * intera si riceve in un file temporaneo, che prende il posto del file solo se i due checksum coincidono.
  */
-void write_file_in_dir(const char *path, int client_sock) 
+ft_status_t write_file_in_dir(const char *path, int client_sock, long long length, const ft_header_t *request) 
 {
-    ssize_t bytes_received;         // variabile per memorizzare il numero di byte ricevuti
-    char buffer[BUFFER_SIZE];       // buffer per contenere i dati ricevuti
+    transfer_stats_t stats;         // byte ricevuti e chiamate di sistema eseguite
+    uint32_t crc = 0;               // CRC32C dei dati ricevuti
+    uint32_t expected;              // CRC32C annunciato dal client
+    int trailer = 0;                // 1 se il client fa seguire i dati dal loro CRC32C
+    char *dirpath = NULL;
+    char *filename = NULL;
+    char *spool = NULL;             // file temporaneo di una scrittura intera seguita dal checksum
+    ft_status_t status;
+    int sending = (request != NULL && (request->flags & FT_FLAG_NO_CONTINUE));    // 1 se i dati sono già in arrivo
+    memset(&stats, 0, sizeof(stats));
+
+    // controllo se ho abbastanza memoria per salvare il file: lo spazio si misura sulla directory di
+    // destinazione, così una richiesta troppo grande viene rifiutata prima di troncare il file esistente
+    divide_dirpath_from_filename(path, &dirpath, &filename);
+    unsigned long long int bytes_on_device = available_bytes(dirpath[0] ? dirpath : "/"); // bytes disponibili nel filesystem
+    free(dirpath);
+    free(filename);
+
+    int file_fd = -1;
+
+    // gestisco il caso di errore della funzione available_bytes
+    if (bytes_on_device == 0) {
+        LOG_ERROR("Errore nel controllo della memoria disponibile sul dispositivo");
+        status = FT_STATUS_IO_ERROR;
+        goto discard;
+    }
+    if (length >= 0 && (unsigned long long)length > bytes_on_device) {
+        LOG_WARN("Memoria piena, il file annunciato è di %lld byte", length);
+        status = FT_STATUS_NO_SPACE;
+        goto discard;
+    }
 
-    // apri il file locale in scrittura, crealo se non esiste, e tronca il file se esiste (qualsiasi contenuto preesistente nel file verrà eliminato prima di scrivere i nuovi dati ricevuti dal client)
-    int file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644); 
+    // apri il file locale in scrittura, crealo se non esiste, e tronca il file se esiste (qualsiasi contenuto preesistente nel file verrà eliminato prima di scrivere i nuovi dati ricevuti dal client).
+    // Un intervallo invece si scrive nel file esistente, portato alla dimensione finale, senza toccare il resto
+    // un file collegato all'archivio dei contenuti deduplicati va prima separato, altrimenti la scrittura lo modificherebbe
+    int range = (request != NULL && (request->flags & FT_FLAG_RANGE));
+    int delta = (request != NULL && (request->flags & FT_FLAG_DELTA));
+    int checked = (request != NULL && !sending && !range && !delta && length >= 0 && (request->flags & FT_FLAG_TRAILER));
+    if (delta) {
+        // un delta si riceve in un file temporaneo della stessa directory: il file da aggiornare deve esistere
+        file_fd = open_delta_spool(path);
+    } else if (checked) {
+        // una scrittura intera seguita dal checksum sostituisce il file solo se il checksum coincide
+        file_fd = open_write_spool(path, &spool);
+    } else if (store_unshare(path, range) == 0) {
+        file_fd = open(path, range ? O_RDWR | O_CREAT : O_RDWR | O_CREAT | O_TRUNC, 0644);   // anche in lettura per il checksum dei byte ricevuti con splice
+    }
 
     // controlla se il file è stato aperto correttamente
-    if (file_fd < 0) {
-        fprintf(stderr, "Errore apertura file: %s\n", strerror(errno));
-        return;
+    if (file_fd < 0 || (range && prepare_range_file(file_fd, request) < 0)) {
+        LOG_ERROR("Errore apertura file: %s", strerror(errno));
+        status = ft_status_from_errno(errno);
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        goto discard;
+    }
+
+    // il client comprime i dati e li fa seguire dal loro checksum solo se il via libera lo prevede
+    int compressed = (request != NULL && !sending && !delta && length > 0 && server_compress_codec != CODEC_NONE && compress_codecs(request->flags) != 0);
+    trailer = (request != NULL && !sending && !delta && length >= 0 && (request->flags & FT_FLAG_TRAILER));
+    uint16_t flags = (compressed ? compress_flags(CODEC_AUTO) : 0) | (trailer ? FT_FLAG_TRAILER : 0);
+
+    // con l'intestazione binaria il client attende il via libera prima di inviare i dati
+    if (request != NULL && !sending && ft_send_response_flags(client_sock, 'w', FT_STATUS_CONTINUE, flags, 0) < 0) {
+        LOG_ERROR("Errore durante l'invio della conferma di ricezione al client: %s", strerror(errno));
+        close(file_fd);
+        status = FT_STATUS_IO_ERROR;
+        goto done;
+    }
+    sending = (request != NULL);
+
+    // frame compressi: in caso di errore quelli restanti sono già stati scartati (o la connessione è persa)
+    if (compressed) {
+        compress_stats_t cstats;
+        if (recv_compressed(client_sock, file_fd, length, bytes_on_device, &cstats) < 0) {
+            LOG_ERROR("Errore durante la ricezione dei dati compressi: %s", strerror(errno));
+            status = (errno == EBADMSG) ? FT_STATUS_BAD_REQUEST : ft_status_from_errno(errno);
+            if (trailer && errno != EBADMSG) {
+                recv_discard(client_sock, FT_TRAILER_SIZE);
+            }
+            close(file_fd);
+            goto done;
+        }
+        crc = cstats.crc;
+        LOG_INFO("Ricevuti %llu byte in %llu byte compressi (%s, %llu frame)", cstats.bytes, cstats.wire_bytes, compress_codec_name(cstats.codec), cstats.frames);
+        metrics_bytes(cstats.wire_bytes, 0);
     }
 
-    // controllo se ho abbastanza memoria per salvare il file
+    // riceve i dati dalla socket e li scrive nel file (ENOSPC se si superano i byte disponibili)
+    else if (recv_file(client_sock, file_fd, length, bytes_on_device, server_transfer_mode, &stats, trailer ? &crc : NULL) < 0) {
+        status = ft_status_from_errno(errno);
+        if (errno == ENOSPC) {
+            LOG_WARN("Memoria piena");
+        } else {
+            LOG_ERROR("Errore durante la ricezione dei dati: %s", strerror(errno));
+        }
+        close(file_fd);
+        goto discard;
+    }
+    else {
+        LOG_INFO("Ricevuti %llu byte con %llu chiamate di sistema (%s)", stats.bytes, stats.syscalls, transfer_path_name(&stats));
+        metrics_bytes(stats.bytes, 0);
+    }
 
-    unsigned long long int bytes_on_device = available_bytes(path); // bytes disponibili nel filesystem
+    // il checksum del client segue i dati: se non coincide il file richiesto non viene sostituito
+    if (trailer) {
+        if (ft_recv_trailer(client_sock, &expected) < 0) {
+            LOG_ERROR("Errore durante la ricezione del checksum dei dati: %s", strerror(errno));
+            close(file_fd);
+            status = FT_STATUS_IO_ERROR;
+            goto done;
+        }
+        if (expected != crc) {
+            LOG_WARN("Dati danneggiati, checksum %08x invece di %08x", crc, expected);
+            close(file_fd);
+            status = FT_STATUS_CORRUPT;
+            goto done;
+        }
+    }
 
-    // gestisco il caso di errore della funzione available_bytes
-    if (bytes_on_device == 0) {
-        fprintf(stderr, "Errore nel controllo della memoria disponibile sul dispositivo\n");
+    if (delta) {
+        status = finish_delta(path, file_fd, length);
         close(file_fd);
-        return;
+        return status;
     }
 
-    // ciclo per ricevere dati dal socket e scriverli nel file
-    while ((bytes_received = recv(client_sock, buffer, sizeof(buffer), 0)) > 0) 
+    // un errore alla chiusura (es. quota superata su filesystem di rete) significa che il file non è stato salvato
+    status = FT_STATUS_OK;
+    if (close(file_fd) < 0) {
+        LOG_ERROR("Errore durante la chiusura del file: %s", strerror(errno));
+        status = ft_status_from_errno(errno);
+    }
+    goto done;
+
+discard:
+    // il client sta già inviando i dati: si scartano quelli non ricevuti per restare allineati alla richiesta successiva
+    if (sending && (length < 0 || stats.bytes < (unsigned long long)length)) {
+        recv_discard(client_sock, length < 0 ? -1 : length - (long long)stats.bytes + (trailer ? FT_TRAILER_SIZE : 0));
+    } else if (sending && trailer) {
+        recv_discard(client_sock, FT_TRAILER_SIZE);
+    }
+
+done:
+    // il file temporaneo prende il posto di quello richiesto solo se la scrittura è riuscita
+    if (spool != NULL) {
+        status = finish_write_spool(path, spool, status);
+    }
+    return status;
+}
+
+
+
+/**
+ * Controlla l'intervallo di una richiesta con FT_FLAG_RANGE. In una scrittura i byte annunciati devono
+ * essere noti e cadere entro la dimensione finale del file.
+ * @param request L'intestazione della richiesta.
+ * @return 1 se l'intervallo è valido (o la richiesta non ne ha uno), 0 altrimenti.
+ */
+int valid_range(const ft_header_t *request)
+{
+    if (!(request->flags & FT_FLAG_RANGE)) {
+        return 1;
+    }
+    if (request->opcode == 'r') {
+        return request->range_offset <= INT64_MAX;
+    }
+    return request->opcode == 'w' && request->payload_len != FT_LENGTH_UNKNOWN &&
+           request->range_length <= INT64_MAX && request->range_offset <= request->range_length &&
+           request->payload_len <= request->range_length - request->range_offset;
+}
+
+
+
+/**
+ * Prepara un file aperto per la scrittura di un intervallo: lo porta alla dimensione finale annunciata
+ * (le altre connessioni della stessa copia scrivono le parti mancanti) e si posiziona sul primo byte.
+ * @param fd File descriptor del file aperto in scrittura.
+ * @param request L'intestazione della richiesta (FT_FLAG_RANGE).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int prepare_range_file(int fd, const ft_header_t *request)
+{
+    struct stat statbuf;
+
+    if (fstat(fd, &statbuf) < 0) {
+        return -1;
+    }
+    if (!S_ISREG(statbuf.st_mode)) {
+        errno = EISDIR;
+        return -1;
+    }
+
+    // tutte le connessioni portano il file alla stessa dimensione: solo la prima cambia davvero qualcosa
+    if ((uint64_t)statbuf.st_size != request->range_length && ftruncate(fd, (off_t)request->range_length) < 0) {
+        return -1;
+    }
+    if (lseek(fd, (off_t)request->range_offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Calcola i byte da inviare per la lettura di un intervallo, limitata alla fine del file.
+ * @param request L'intestazione della richiesta (FT_FLAG_RANGE).
+ * @param size La dimensione del file.
+ * @return I byte dell'intervallo presenti nel file (0 se inizia oltre la fine).
+ */
+long long range_read_length(const ft_header_t *request, long long size)
+{
+    if (request->range_offset >= (uint64_t)size) {
+        return 0;
+    }
+    uint64_t available = (uint64_t)size - request->range_offset;
+    return (long long)(request->range_length < available ? request->range_length : available);
+}
+
+
+
+/**
+ * Raccoglie dimensione e data di modifica di un file nel formato della risposta a 'i' e, se richiesto,
+ * il CRC32C di ogni blocco completo di FT_CHECKSUM_BLOCK byte e la firma del file per il trasferimento
+ * delle differenze. Il calcolo legge tutti i blocchi del file, ma costa molto meno che ritrasferirlo.
+ * @param fullpath Il percorso completo del file.
+ * @param flags I flag della richiesta: FT_FLAG_CHECKSUM aggiunge i checksum dei blocchi, FT_FLAG_DELTA la firma.
+ * @param len Puntatore dove memorizzare la lunghezza dei dati.
+ * @return I dati allocati dinamicamente (da liberare con free) oppure NULL in caso di errore (errno impostato,
+ *         EISDIR se il percorso non è un file regolare).
+ */
+char* build_info(const char *fullpath, uint16_t flags, size_t *len)
+{
+    struct stat statbuf;
+    delta_signature_t sig;
+    unsigned char *signature = NULL;
+    size_t signature_len = 0;
+
+    // senza checksum né firma bastano dimensione e data di modifica, che possono venire dalla cache dei metadati
+    if (!(flags & (FT_FLAG_CHECKSUM | FT_FLAG_DELTA)))
     {
-        bytes_on_device -= bytes_received;
+        if (metacache_stat(fullpath, &statbuf) < 0) {
+            return NULL;
+        }
+        if (!S_ISREG(statbuf.st_mode)) {
+            errno = EISDIR;
+            return NULL;
+        }
+        unsigned char *info = (unsigned char *)malloc(FT_INFO_SIZE);
+        if (info == NULL) {
+            return NULL;
+        }
+        ft_put_u64(info, (uint64_t)statbuf.st_size);
+        ft_put_u64(info + 8, (uint64_t)statbuf.st_mtime);
+        *len = FT_INFO_SIZE;
+        return (char *)info;
+    }
 
-        // ERRORE: memoria piena
-        if (bytes_on_device < 0){
-            printf("SERVER: Memoria piena");
-            close(file_fd);
-            return;
+    int fd = open(fullpath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+        close(fd);
+        errno = EISDIR;
+        return NULL;
+    }
+
+    // la firma si calcola sullo stesso file aperto, così descrive proprio la versione di cui si riportano i dati
+    if (flags & FT_FLAG_DELTA) {
+        if (delta_signature_build(fd, &sig) < 0) {
+            LOG_ERROR("Errore durante il calcolo della firma di '%s': %s", fullpath, strerror(errno));
+            close(fd);
+            return NULL;
         }
+        signature = delta_signature_encode(&sig, &signature_len);
+        delta_signature_free(&sig);
+        if (signature == NULL) {
+            close(fd);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
 
-        // scrivo i dati che ricevo dal socket nel file identificato dal file descriptor
-        if (write(file_fd, buffer, bytes_received) < 0) {
-            fprintf(stderr, "Errore nella scrittura dei byte nel file: %s\n", strerror(errno));
-            close(file_fd);
-            return;
+    size_t blocks = (flags & FT_FLAG_CHECKSUM) ? (size_t)(statbuf.st_size / FT_CHECKSUM_BLOCK) : 0;
+    unsigned char *info = (unsigned char *)malloc(FT_INFO_SIZE + 4 * blocks + signature_len);
+    if (info == NULL) {
+        free(signature);
+        close(fd);
+        return NULL;
+    }
+    ft_put_u64(info, (uint64_t)statbuf.st_size);
+    ft_put_u64(info + 8, (uint64_t)statbuf.st_mtime);
+
+    for (size_t i = 0; i < blocks; i++) {
+        uint32_t crc;
+        if (file_crc32c(fd, (off_t)i * FT_CHECKSUM_BLOCK, FT_CHECKSUM_BLOCK, &crc) < 0) {
+            LOG_ERROR("Errore durante il calcolo del checksum di '%s': %s", fullpath, strerror(errno));
+            free(signature);
+            free(info);
+            close(fd);
+            return NULL;
         }
-        
+        unsigned char *p = info + FT_INFO_SIZE + 4 * i;
+        p[0] = crc >> 24;
+        p[1] = crc >> 16;
+        p[2] = crc >> 8;
+        p[3] = crc;
+    }
+    if (signature != NULL) {
+        memcpy(info + FT_INFO_SIZE + 4 * blocks, signature, signature_len);
+        free(signature);
+    }
+
+    close(fd);
+    *len = FT_INFO_SIZE + 4 * blocks + signature_len;
+    return (char *)info;
+}
+
+
+
+/**
+ * Costruisce il percorso del file parziale di un caricamento da riprendere ("<percorso>.part").
+ * @param fullpath Il percorso completo del file.
+ * @return Il percorso allocato dinamicamente (da liberare con free) oppure NULL in caso di errore (errno impostato).
+ */
+char* partial_path(const char *fullpath)
+{
+    size_t len = strlen(fullpath) + strlen(FT_PARTIAL_SUFFIX);
+    if (len >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    char *path = (char *)malloc(len + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    strcpy(path, fullpath);
+    strcat(path, FT_PARTIAL_SUFFIX);
+    return path;
+}
+
+
+
+/**
+ * Indica se una scrittura con FT_FLAG_PARTIAL completa il file: l'intero file oppure l'ultimo intervallo.
+ * @param request L'intestazione della richiesta.
+ * @return 1 se dopo la scrittura il file parziale va rinominato nel percorso richiesto, 0 altrimenti.
+ */
+int partial_complete(const ft_header_t *request)
+{
+    if (!(request->flags & FT_FLAG_RANGE)) {
+        return 1;
     }
+    return request->range_offset + request->payload_len == request->range_length;
+}
 
-    // controlla se si è verificato un errore durante la ricezione dei dati
-    if (bytes_received < 0) {
-        fprintf(stderr, "Errore durante la ricezione dei dati: %s\n", strerror(errno));
+
+
+/**
+ * Rende visibile un caricamento completato: il file parziale sostituisce atomicamente il percorso richiesto,
+ * così nessun lettore vede mai un file a metà.
+ * @param fullpath Il percorso completo del file.
+ * @return FT_STATUS_OK in caso di successo, altrimenti l'esito dell'errore.
+ */
+ft_status_t finish_partial(const char *fullpath)
+{
+    char *part = partial_path(fullpath);
+    if (part != NULL) {
+        metacache_invalidate(part);
+        filecache_invalidate(part);
+    }
+    if (part == NULL || rename(part, fullpath) < 0) {
+        int saved_errno = errno;
+        LOG_ERROR("Errore durante il completamento del file '%s': %s", fullpath, strerror(saved_errno));
+        free(part);
+        return ft_status_from_errno(saved_errno);
     }
+    metacache_invalidate(fullpath);
+    filecache_invalidate(fullpath);
+    LOG_INFO("File parziale completato -> %s", fullpath);
+    free(part);
+    return FT_STATUS_OK;
+}
 
-    close(file_fd);
+
+
+/**
+ * Apre il file in cui ricevere il delta di un file esistente: un file temporaneo anonimo nella stessa
+ * directory, così lo spazio si misura sullo stesso filesystem.
+ * @param fullpath Il percorso completo del file da aggiornare.
+ * @return Il file descriptor del file temporaneo, -1 in caso di errore (ENOENT se il file non esiste).
+ */
+int open_delta_spool(const char *fullpath)
+{
+    struct stat statbuf;
+    char *dirpath = NULL;
+    char *filename = NULL;
+
+    if (stat(fullpath, &statbuf) < 0) {
+        return -1;
+    }
+    if (!S_ISREG(statbuf.st_mode)) {
+        errno = EISDIR;
+        return -1;
+    }
+    divide_dirpath_from_filename(fullpath, &dirpath, &filename);
+    int fd = delta_spool(dirpath[0] ? dirpath : "/");
+    free(dirpath);
+    free(filename);
+    return fd;
+}
+
+
+
+/**
+ * Completa un aggiornamento con delta: il nuovo file si costruisce dal delta ricevuto e dal file esistente,
+ * poi lo sostituisce atomicamente.
+ * @param fullpath Il percorso completo del file da aggiornare.
+ * @param spool_fd Il file temporaneo con il delta ricevuto.
+ * @param length La dimensione del delta.
+ * @return FT_STATUS_OK in caso di successo, altrimenti l'esito dell'errore (FT_STATUS_BAD_REQUEST se il
+ *         delta non è valido o il file è cambiato dopo la firma).
+ */
+ft_status_t finish_delta(const char *fullpath, int spool_fd, long long length)
+{
+    if (lseek(spool_fd, 0, SEEK_SET) < 0 || delta_patch(fullpath, spool_fd, (uint64_t)length) < 0) {
+        int saved_errno = errno;
+        LOG_ERROR("Errore durante l'applicazione del delta a '%s': %s", fullpath, strerror(saved_errno));
+        return (saved_errno == EINVAL || saved_errno == ESTALE) ? FT_STATUS_BAD_REQUEST : ft_status_from_errno(saved_errno);
+    }
+    metacache_invalidate(fullpath);
+    filecache_invalidate(fullpath);
+    LOG_INFO("File aggiornato con un delta di %lld byte -> %s", length, fullpath);
+    return FT_STATUS_OK;
+}
+
+
+
+/**
+ * Apre il file temporaneo in cui ricevere una scrittura intera seguita dal checksum (FT_FLAG_TRAILER):
+ * sta nella stessa directory del file richiesto, con i suoi permessi se esiste, e lo sostituisce solo se
+ * il checksum coincide, così dati danneggiati non prendono mai il posto del file.
+ * @param fullpath Il percorso completo del file da scrivere.
+ * @param spool Puntatore dove memorizzare il percorso del file temporaneo (da liberare con free).
+ * @return Il file descriptor del file temporaneo, -1 in caso di errore (errno impostato).
+ */
+int open_write_spool(const char *fullpath, char **spool)
+{
+    struct stat statbuf;
+    int exists = (stat(fullpath, &statbuf) == 0);
+
+    if (exists && !S_ISREG(statbuf.st_mode)) {
+        errno = EISDIR;
+        return -1;
+    }
+    *spool = (char *)malloc(PATH_MAX);
+    if (*spool == NULL) {
+        return -1;
+    }
+    unsigned int sequence = __atomic_fetch_add(&spool_sequence, 1, __ATOMIC_RELAXED);
+    if (snprintf(*spool, PATH_MAX, "%s.write-%d-%u", fullpath, (int)getpid(), sequence) >= PATH_MAX) {
+        free(*spool);
+        *spool = NULL;
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    // anche in lettura per il checksum dei byte ricevuti con splice
+    int fd = open(*spool, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd >= 0 && exists && fchmod(fd, statbuf.st_mode & 07777) < 0) {
+        int saved_errno = errno;
+        close(fd);
+        unlink(*spool);
+        fd = -1;
+        errno = saved_errno;
+    }
+    if (fd < 0) {
+        int saved_errno = errno;
+        free(*spool);
+        *spool = NULL;
+        errno = saved_errno;
+    }
+    return fd;
+}
+
+
+
+/**
+ * Conclude una scrittura ricevuta nel file temporaneo: se è riuscita il file temporaneo sostituisce
+ * atomicamente quello richiesto, altrimenti viene rimosso e il file richiesto resta com'era.
+ * @param fullpath Il percorso completo del file richiesto.
+ * @param spool Il percorso del file temporaneo (viene liberato).
+ * @param status L'esito della ricezione.
+ * @return L'esito della scrittura: status, oppure l'errore della sostituzione.
+ */
+ft_status_t finish_write_spool(const char *fullpath, char *spool, ft_status_t status)
+{
+    if (status == FT_STATUS_OK && rename(spool, fullpath) < 0) {
+        LOG_ERROR("Errore durante la sostituzione di '%s': %s", fullpath, strerror(errno));
+        status = ft_status_from_errno(errno);
+    }
+    if (status != FT_STATUS_OK) {
+        unlink(spool);
+    }
+    free(spool);
+    return status;
 }
 
 
@@ -228,16 +738,17 @@ int ensure_directory_exists(const char *dirpath)
         // controlla se il percorso esiste già
         if (stat(current_path, &statbuf) != 0) 
         {
-            // se il percorso non esiste, crea la directory
-            if (mkdir(current_path, 0777) == -1) {
-                fprintf(stderr, "Errore nella creazione della directory: %s\n", strerror(errno));
+            // se il percorso non esiste, crea la directory (EEXIST: un altro client l'ha appena creata in concorrenza)
+            if (mkdir(current_path, 0777) == -1 && errno != EEXIST) {
+                LOG_ERROR("Errore nella creazione della directory: %s", strerror(errno));
                 free(path_copy); 
                 return 0;                
             }
         } else {
             // se il percorso esiste, assicurati che sia una directory
             if (!S_ISDIR(statbuf.st_mode)) {
-                fprintf(stderr, "Errore, il path '%s' non si riferisce a una directory\n", current_path);
+                LOG_ERROR("Errore, il path '%s' non si riferisce a una directory", current_path);
+                errno = ENOTDIR;
                 free(path_copy); 
                 return 0;
             }
@@ -253,55 +764,102 @@ int ensure_directory_exists(const char *dirpath)
 
 
 /**
- * Riceve il percorso inviato dal client attraverso la socket. Pulisce l'input dai caratteri \0 iniziali.
+ * Riceve il percorso inviato dal client con il protocollo precedente: LEGACY_PATH_PADDING byte nulli, il
+ * percorso e il terminatore '\0'. I dati vengono prima osservati con MSG_PEEK e poi consumati solo fino al
+ * terminatore, così un percorso diviso su più segmenti TCP viene ricomposto e gli eventuali byte successivi
+ * restano nella socket.
  * @param cli Puntatore al client.
  * @return Il percorso ricevuto o NULL in caso di errore.
  */
 char* receive_path(client_t *cli) 
 {
-    char buffer[BUFFER_SIZE];  // buffer per memorizzare il messaggio ricevuto dal client
+    char buffer[BUFFER_SIZE];   // percorso ricevuto finora
+    char chunk[BUFFER_SIZE];    // dati disponibili nella socket
+    size_t len = 0;             // lunghezza del percorso ricevuto finora
+    int padding_seen = 0;       // byte nulli iniziali già ricevuti
+    int complete = 0;           // 1 quando si è ricevuto il terminatore
 
-    // riceve il messaggio dal client
-    int receive = recv(cli->sockfd, buffer, sizeof(buffer) - 1, 0);  // sizeof(buffer) - 1 garantisce spazio per il terminatore di stringa \0
-
-    // se il messaggio è valido
-    if (receive > 0) 
+    while (!complete)
     {
-        buffer[receive] = '\0';  // aggiunge il terminatore di stringa
+        // osserva i dati disponibili senza consumarli (attende se non ce ne sono)
+        ssize_t receive = recv(cli->sockfd, chunk, sizeof(chunk), MSG_PEEK);
+
+        // se il client si disconnette o si verifica un errore nella ricezione
+        if (receive == 0) {
+            LOG_INFO("Il client %d si è disconnesso", cli->uid);  // messaggio di disconnessione
+            return NULL;
+        } else if (receive < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Errore durante la ricezione del percorso: %s", strerror(errno));
+            return NULL;
+        }
 
-        // trova il primo carattere non null nel buffer
-        int i = 0;
-        while (buffer[i] == '\0' && i < receive) {
-            i++;
+        ssize_t i;
+        for (i = 0; i < receive && !complete; i++)
+        {
+            if (chunk[i] == '\0' && len == 0 && padding_seen < LEGACY_PATH_PADDING) {
+                padding_seen++;                 // byte nullo iniziale
+            } else if (chunk[i] == '\0') {
+                complete = 1;                   // terminatore: percorso completo
+            } else if (len + 1 < sizeof(buffer)) {
+                buffer[len++] = chunk[i];
+            } else {
+                LOG_ERROR("Errore, percorso ricevuto dal client %d troppo lungo", cli->uid);
+                return NULL;
+            }
+        }
+
+        // consuma solo i byte esaminati (fino al terminatore compreso)
+        if (recv_all(cli->sockfd, chunk, i) < 0) {
+            LOG_ERROR("Errore durante la ricezione del percorso: %s", strerror(errno));
+            return NULL;
         }
+    }
+    buffer[len] = '\0';
 
-        // sposta il contenuto significativo all'inizio del buffer
-        memmove(buffer, buffer + i, receive - i + 1);  // +1 per includere il terminatore di stringa \0
-        receive -= i;  // aggiorna la lunghezza dei dati significativi
+    // stampa il percorso ricevuto
+    LOG_DEBUG("Il client %d ha mandato questo percorso -> %s", cli->uid, buffer);
 
-        // stampa il percorso ricevuto
-        printf("SERVER: Il client %d ha mandato questo percorso -> %s\n", cli->uid, buffer);
+    // alloca memoria per il percorso da restituire
+    char* path = strdup(buffer);
+    if (path == NULL) {
+        LOG_ERROR("Errore durante l'allocazione di memoria per il percorso: %s", strerror(errno));
     }
+    return path;
+}
 
-    // se il client si disconnette o si verifica un errore nella ricezione
-    else if (receive == 0) {
-        printf("SERVER: Il client %d si è disconnesso\n", cli->uid);  // messaggio di disconnessione
-        return NULL;
-    } else {
-        fprintf(stderr, "Errore durante la ricezione del percorso: %s\n", strerror(errno));
+
+
+/**
+ * Riceve il percorso di una richiesta con intestazione binaria: esattamente request->path_len byte.
+ * @param cli Puntatore al client.
+ * @param request L'intestazione della richiesta.
+ * @return Il percorso ricevuto o NULL in caso di errore o di percorso non valido (contenente '\0').
+ */
+char* receive_framed_path(client_t *cli, const ft_header_t *request)
+{
+    char *path = (char *)malloc(request->path_len + 1);
+    if (path == NULL) {
+        LOG_ERROR("Errore durante l'allocazione di memoria per il percorso: %s", strerror(errno));
         return NULL;
     }
 
-    // alloca memoria per il percorso da restituire
-    char* path = (char*)malloc((receive + 1) * sizeof(char));  // usa receive + 1 per allocare la dimensione corretta della stringa
-    if (path == NULL) {
-        fprintf(stderr, "Errore durante l'allocazione di memoria per il percorso: %s\n", strerror(errno));
+    if (recv_all(cli->sockfd, path, request->path_len) < 0) {
+        LOG_ERROR("Errore durante la ricezione del percorso: %s", strerror(errno));
+        free(path);
         return NULL;
     }
+    path[request->path_len] = '\0';
 
-    // copia il percorso ricevuto nel buffer allocato
-    strncpy(path, buffer, receive + 1);
+    if (strlen(path) != request->path_len) {
+        LOG_ERROR("Errore, il percorso ricevuto dal client %d contiene byte nulli", cli->uid);
+        free(path);
+        return NULL;
+    }
 
+    LOG_DEBUG("Il client %d ha mandato questo percorso -> %s", cli->uid, path);
     return path;
 }
 
@@ -319,7 +877,7 @@ char* receive_path(client_t *cli)
 char* construct_full_path(const char *root_directory, char *relative_path)
 {
     if (root_directory == NULL || relative_path == NULL) {
-        fprintf(stderr, "Input non valido: root_directory e/o relative_path non possono essere vuoti\n");
+        LOG_ERROR("Input non valido: root_directory e/o relative_path non possono essere vuoti");
         return NULL;
     }
 
@@ -333,7 +891,7 @@ char* construct_full_path(const char *root_directory, char *relative_path)
     // alloca memoria per il percorso completo
     char *full_path = (char *)malloc(len);
     if (full_path == NULL) {
-        fprintf(stderr, "Errore durante l'allocazione della memoria per il percorso completo: %s\n", strerror(errno));
+        LOG_ERROR("Errore durante l'allocazione della memoria per il percorso completo: %s", strerror(errno));
         return NULL;
     }
 
@@ -384,50 +942,282 @@ int is_ip_reachable(const char *ip_str)
  * 
  * @param cli Il puntatore al client che ha inviato la richiesta.
  * @param fullpath Il percorso completo del file su cui operare.
+ * @param request L'intestazione della richiesta, NULL per il protocollo precedente.
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
  */ 
-void handle_write(client_t *cli, const char *fullpath) 
+int handle_write(client_t *cli, const char *fullpath, const ft_header_t *request) 
 {
     char *dirpath = NULL;
     char *filename = NULL;
+    ft_status_t status;
 
     divide_dirpath_from_filename(fullpath, &dirpath, &filename);
 
-    int is_dir = ensure_directory_exists(dirpath);   // crea la directory se non esiste
+    // un caricamento da riprendere si scrive nel file parziale, che diventa il file richiesto solo quando è completo
+    int partial = (request != NULL && (request->flags & FT_FLAG_PARTIAL));
+    char *part = partial ? partial_path(fullpath) : NULL;
+    int is_dir = ensure_directory_exists(dirpath) && (!partial || part != NULL);   // crea la directory se non esiste
+
+    // l'archivio dei contenuti deduplicati non si scrive direttamente
+    if (is_dir && store_contains(fullpath)) {
+        is_dir = 0;
+        errno = EACCES;
+    }
     
-    printf("SERVER: Gestisce la scrittura su questo percorso -> %s\n", fullpath);
+    LOG_DEBUG("Gestisce la scrittura su questo percorso -> %s", part ? part : fullpath);
+
+    // dimensione annunciata dal client (il protocollo precedente la segnala solo chiudendo la connessione)
+    long long length = -1;
+    int valid_length = 1;
+    if (request != NULL && request->payload_len != FT_LENGTH_UNKNOWN) {
+        length = (long long)request->payload_len;
+        valid_length = (length >= 0);   // dimensioni oltre 2^63 - 1 non sono rappresentabili
+    }
+    if (request != NULL && !valid_range(request)) {
+        valid_length = 0;
+    }
+    // un delta ha una lunghezza nota e sostituisce l'intero file: non si combina con intervalli e file parziali
+    if (request != NULL && (request->flags & FT_FLAG_DELTA) && (length < 0 || (request->flags & (FT_FLAG_RANGE | FT_FLAG_PARTIAL)))) {
+        valid_length = 0;
+    }
 
     // se la directory esiste o è stata creata con successo
-    if (is_dir) {
-        write_file_in_dir(fullpath, cli->sockfd); // scrivi il file nella directory
-        printf("SERVER: Compito eseguito con successo\n");
+    if (!is_dir) {
+        status = ft_status_from_errno(errno);
+    } else if (!valid_length) {
+        status = FT_STATUS_BAD_REQUEST;
+    } else {
+        status = write_file_in_dir(part ? part : fullpath, cli->sockfd, length, request); // scrivi il file nella directory
+        if (status == FT_STATUS_OK && partial && partial_complete(request)) {
+            status = finish_partial(fullpath);
+        }
+    }
+
+    // i dati di una scrittura in pipelining rifiutata prima di aprire il file sono già in arrivo: vanno scartati
+    int in_sync = (request != NULL && length >= 0);
+    if ((!is_dir || !valid_length) && request != NULL && (request->flags & FT_FLAG_NO_CONTINUE)) {
+        in_sync = ((valid_length || length >= 0) && recv_discard(cli->sockfd, length) == 0 && length >= 0);
+    }
+
+    // le cache non devono attendere l'evento inotify o il cambio della data di modifica per vedere la scrittura
+    metacache_invalidate(part ? part : fullpath);
+    filecache_invalidate(part ? part : fullpath);
+
+    if (status == FT_STATUS_OK) {
+        LOG_INFO("Compito eseguito con successo");
+    }
+
+    // con l'intestazione binaria il client riceve sempre l'esito finale della scrittura
+    if (request != NULL && send_response(cli->sockfd, 'w', status, 0) < 0) {
+        LOG_ERROR("Errore durante l'invio dell'esito al client: %s", strerror(errno));
+        in_sync = 0;
     }
+    free(part);
     free(dirpath);
     free(filename);
+    return in_sync ? 0 : -1;
 }
 
 
 
 /**
- * Gestisce l'operazione di lettura ('r') richiesta dal client.
+ * Gestisce un caricamento con deduplicazione ('d') richiesto dal client.
  * 
  * @param cli Il puntatore al client che ha inviato la richiesta.
- * @param fullpath Il percorso completo del file su cui operare.
- */ 
-void handle_read(client_t *cli, const char *fullpath) 
+ * @param fullpath Il percorso completo del file da scrivere.
+ * @param request L'intestazione della richiesta (il payload è il manifest del file).
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
+ *
+ * Il manifest arriva subito dopo la richiesta. Se l'archivio ha già il contenuto il percorso viene solo
+ * collegato; altrimenti il server risponde FT_STATUS_CONTINUE con la bitmap dei chunk mancanti, riceve
+ * solo quelli e costruisce il contenuto copiando gli altri dall'archivio. In ogni caso il client riceve l'esito.
+ */
+int handle_dedup(client_t *cli, const char *fullpath, const ft_header_t *request)
 {
-    int file_fd = open(fullpath, O_RDONLY); // apri il file locale in lettura
+    char *dirpath = NULL;
+    char *filename = NULL;
+    unsigned char *manifest = NULL;
+    store_plan_t *plan = NULL;
+    transfer_stats_t stats;
+    ft_status_t status = FT_STATUS_OK;
+    int in_sync = 1;
+
+    LOG_DEBUG("Gestisce il caricamento con deduplicazione su questo percorso -> %s", fullpath);
+
+    // senza una dimensione nota del manifest non si sa dove inizi la richiesta successiva
+    long long length = (long long)request->payload_len;
+    if (request->payload_len == FT_LENGTH_UNKNOWN || length < 0) {
+        send_response(cli->sockfd, 'd', FT_STATUS_BAD_REQUEST, 0);
+        return -1;
+    }
 
-    // un valore di file descriptor < 0 indica un errore o una situazione anomala
-    if (file_fd < 0) {
-        fprintf(stderr, "Errore apertura file: %s\n", strerror(errno));
-        return;
+    divide_dirpath_from_filename(fullpath, &dirpath, &filename);
+    if (!store_enabled()) {
+        LOG_WARN("Deduplicazione non attiva (opzione -D)");
+        status = FT_STATUS_BAD_REQUEST;
+    } else if (length == 0 || length > MANIFEST_MAX_SIZE || (request->flags & (FT_FLAG_RANGE | FT_FLAG_PARTIAL))) {
+        status = FT_STATUS_BAD_REQUEST;
+    } else if (store_contains(fullpath)) {
+        status = FT_STATUS_DENIED;
+    } else if (!ensure_directory_exists(dirpath)) {
+        status = ft_status_from_errno(errno);
+    } else if ((manifest = (unsigned char *)malloc(length)) == NULL) {
+        status = FT_STATUS_IO_ERROR;
     }
+    free(dirpath);
+    free(filename);
 
-    // invia il contenuto del file al client
-    send_data(file_fd, cli->sockfd); 
-    
-    close(file_fd);    // chiude il file
-    printf("SERVER: Compito eseguito con successo\n");
+    // il manifest è già in arrivo: in caso di errore si scarta per restare allineati
+    if (status != FT_STATUS_OK) {
+        in_sync = (recv_discard(cli->sockfd, length) == 0);
+        goto reply;
+    }
+    if (recv_all(cli->sockfd, manifest, length) < 0) {
+        LOG_ERROR("Errore durante la ricezione del manifest: %s", strerror(errno));
+        free(manifest);
+        return -1;
+    }
+    metrics_bytes(length, 0);
+
+    status = store_plan(manifest, length, &plan);
+    free(manifest);
+    if (status == FT_STATUS_OK && !plan->whole)
+    {
+        int spool_fd = store_open_spool();
+        if (spool_fd < 0) {
+            status = ft_status_from_errno(errno);
+            goto reply;
+        }
+        LOG_INFO("Mancano %llu byte su %llu", plan->missing_bytes, (unsigned long long)plan->manifest.size);
+
+        // via libera con la bitmap dei chunk mancanti nello stesso segmento
+        unsigned char header_buffer[FT_HEADER_SIZE];
+        ft_header_t response;
+        ft_header_init(&response, 'd', FT_STATUS_CONTINUE, plan->missing_len);
+        ft_header_encode(&response, header_buffer);
+        struct iovec iov[2] = { { header_buffer, FT_HEADER_SIZE }, { plan->missing, plan->missing_len } };
+        if (send_all_iov(cli->sockfd, iov, 2) < 0) {
+            LOG_ERROR("Errore durante l'invio dei chunk mancanti al client: %s", strerror(errno));
+            close(spool_fd);
+            store_free_plan(plan);
+            return -1;
+        }
+
+        memset(&stats, 0, sizeof(stats));
+        if (plan->missing_bytes > 0 && recv_file(cli->sockfd, spool_fd, (long long)plan->missing_bytes, plan->missing_bytes, server_transfer_mode, &stats, NULL) < 0) {
+            LOG_ERROR("Errore durante la ricezione dei dati: %s", strerror(errno));
+            status = ft_status_from_errno(errno);
+            in_sync = (stats.bytes < plan->missing_bytes && recv_discard(cli->sockfd, (long long)(plan->missing_bytes - stats.bytes)) == 0);
+        } else {
+            status = store_commit(plan, spool_fd, fullpath);
+        }
+        metrics_bytes(stats.bytes, 0);
+        close(spool_fd);
+    }
+    else if (status == FT_STATUS_OK) {
+        LOG_INFO("Contenuto già presente nell'archivio, nessun dato da ricevere");
+        status = store_commit(plan, -1, fullpath);
+    }
+
+reply:
+    // le cache non devono attendere l'evento inotify per vedere il nuovo file
+    metacache_invalidate(fullpath);
+    filecache_invalidate(fullpath);
+    store_free_plan(plan);
+
+    if (status == FT_STATUS_OK) {
+        LOG_INFO("Compito eseguito con successo");
+    }
+    if (send_response(cli->sockfd, 'd', status, 0) < 0) {
+        LOG_ERROR("Errore durante l'invio dell'esito al client: %s", strerror(errno));
+        in_sync = 0;
+    }
+    return in_sync ? 0 : -1;
+}
+
+
+
+/**
+ * Calcola la parte del contenuto di un file in cache da inviare: tutto il file oppure, con FT_FLAG_RANGE,
+ * l'intervallo richiesto limitato alla fine del file.
+ * @param entry Il file in cache.
+ * @param request L'intestazione della richiesta, NULL per il protocollo precedente.
+ * @param offset Puntatore dove memorizzare la posizione del primo byte da inviare.
+ * @return I byte da inviare, -1 se l'intervallo non è valido.
+ */
+long long cached_read_length(const filecache_entry_t *entry, const ft_header_t *request, size_t *offset)
+{
+    *offset = 0;
+    if (request == NULL || !(request->flags & FT_FLAG_RANGE)) {
+        return (long long)entry->size;
+    }
+    if (!valid_range(request)) {
+        return -1;
+    }
+    long long length = range_read_length(request, (long long)entry->size);
+    if (length > 0) {
+        *offset = (size_t)request->range_offset;
+    }
+    return length;
+}
+
+
+
+/**
+ * Invia al client un file dalla cache del contenuto: l'intestazione della risposta, i dati e con
+ * FT_FLAG_TRAILER il loro CRC32C partono con una sola sendmsg, senza aprire né leggere il file.
+ * Rilascia il riferimento all'entry.
+ * @param cli Il puntatore al client che ha inviato la richiesta.
+ * @param entry Il file in cache (ottenuto con filecache_acquire).
+ * @param request L'intestazione della richiesta, NULL per il protocollo precedente.
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
+ */
+int send_cached_file(client_t *cli, filecache_entry_t *entry, const ft_header_t *request)
+{
+    unsigned char header[FT_HEADER_SIZE];
+    unsigned char trailer[FT_TRAILER_SIZE];
+    struct iovec iov[3];
+    int count = 0;
+    size_t offset;
+    unsigned long long hits, misses;
+
+    long long length = cached_read_length(entry, request, &offset);
+    if (length < 0) {
+        filecache_release(entry);
+        return send_response(cli->sockfd, 'r', FT_STATUS_BAD_REQUEST, 0);
+    }
+
+    int with_trailer = (request != NULL && (request->flags & FT_FLAG_TRAILER));
+    if (request != NULL) {
+        ft_header_t response;
+        ft_header_init(&response, 'r', FT_STATUS_OK, (uint64_t)length);
+        response.flags = with_trailer ? FT_FLAG_TRAILER : 0;
+        ft_header_encode(&response, header);
+        iov[count].iov_base = header;
+        iov[count++].iov_len = FT_HEADER_SIZE;
+    }
+    if (length > 0) {
+        iov[count].iov_base = entry->data + offset;
+        iov[count++].iov_len = (size_t)length;
+    }
+    if (with_trailer) {
+        ft_trailer_encode(trailer, crc32c(0, entry->data + offset, (size_t)length));
+        iov[count].iov_base = trailer;
+        iov[count++].iov_len = FT_TRAILER_SIZE;
+    }
+
+    int sent = (count > 0) ? send_all_iov(cli->sockfd, iov, count) : 0;
+    if (sent < 0) {
+        LOG_ERROR("Errore durante l'invio dei dati del file al client: %s", strerror(errno));
+    } else {
+        filecache_stats(&hits, &misses);
+        LOG_INFO("Inviati %lld byte dalla cache dei file (%llu successi, %llu mancati)", length, hits, misses);
+        LOG_INFO("Compito eseguito con successo");
+        metrics_bytes(0, (unsigned long long)length);
+        transfer_paced((size_t)length);
+    }
+    filecache_release(entry);
+    return (request != NULL && sent == 0) ? 0 : -1;
 }
 
 
@@ -437,122 +1227,704 @@ void handle_read(client_t *cli, const char *fullpath)
  * 
  * @param cli Il puntatore al client che ha inviato la richiesta.
  * @param fullpath Il percorso completo del file su cui operare.
+ * @param request L'intestazione della richiesta, NULL per il protocollo precedente.
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
+ */ 
+int handle_read(client_t *cli, const char *fullpath, const ft_header_t *request) 
+{
+    struct stat statbuf;
+
+    if (request != NULL && (request->flags & FT_FLAG_DELTA)) {
+        return handle_delta_read(cli, fullpath, request);
+    }
+
+    // codec accettati dal client per una lettura compressa (0 se i dati viaggiano così come sono)
+    unsigned codecs = (request != NULL && server_compress_codec != CODEC_NONE) ? compress_codecs(request->flags) : 0;
+
+    // un file piccolo letto spesso parte dalla memoria, senza aprirlo
+    filecache_entry_t *cached = codecs ? NULL : filecache_acquire(fullpath);
+    if (cached != NULL) {
+        return send_cached_file(cli, cached, request);
+    }
+
+    int file_fd = open(fullpath, O_RDONLY); // apri il file locale in lettura
+
+    // un valore di file descriptor < 0 indica un errore o una situazione anomala
+    if (file_fd < 0) {
+        LOG_ERROR("Errore apertura file: %s", strerror(errno));
+        if (request != NULL && send_response(cli->sockfd, 'r', ft_status_from_errno(errno), 0) == 0) {
+            return 0;
+        }
+        return -1;
+    }
+
+    long long length = -1;      // il protocollo precedente invia fino alla fine del file
+    int trailer = 0;            // 1 se il client ha chiesto il CRC32C dopo i dati
+    if (request != NULL)
+    {
+        // la dimensione annunciata è stabile: il lock condiviso esclude le scritture sullo stesso percorso
+        if (fstat(file_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+            LOG_ERROR("Errore, il percorso '%s' non è un file regolare", fullpath);
+            close(file_fd);
+            return send_response(cli->sockfd, 'r', FT_STATUS_BAD_REQUEST, 0);
+        }
+        length = statbuf.st_size;
+
+        // un intervallo viene limitato alla fine del file e letto dalla sua posizione
+        if (request->flags & FT_FLAG_RANGE) {
+            length = range_read_length(request, length);
+            if (!valid_range(request) || lseek(file_fd, (off_t)request->range_offset, SEEK_SET) < 0) {
+                close(file_fd);
+                return send_response(cli->sockfd, 'r', FT_STATUS_BAD_REQUEST, 0);
+            }
+        }
+        if (length == 0) {
+            codecs = 0;
+        }
+        trailer = (request->flags & FT_FLAG_TRAILER) != 0;
+        if (ft_send_response_flags(cli->sockfd, 'r', FT_STATUS_OK, (codecs ? FT_FLAG_COMPRESS : 0) | (trailer ? FT_FLAG_TRAILER : 0), length) < 0) {
+            LOG_ERROR("Errore durante l'invio dell'esito al client: %s", strerror(errno));
+            close(file_fd);
+            return -1;
+        }
+    }
+
+    // invia il contenuto del file al client
+    int sent = codecs ? send_compressed_data(file_fd, cli->sockfd, length, codecs, trailer) : send_data(file_fd, cli->sockfd, length, trailer); 
+    
+    close(file_fd);    // chiude il file
+    if (sent == 0) {
+        LOG_INFO("Compito eseguito con successo");
+    }
+    return (request != NULL && sent == 0) ? 0 : -1;
+}
+
+
+
+/**
+ * Gestisce la lettura delle sole differenze ('r' con FT_FLAG_DELTA): la firma della copia del client
+ * arriva subito dopo la richiesta, il server calcola il delta del file rispetto a quella copia e lo invia
+ * come dati della risposta. I dati nuovi partono direttamente dal file con sendfile.
+ * 
+ * @param cli Il puntatore al client che ha inviato la richiesta.
+ * @param fullpath Il percorso completo del file da leggere.
+ * @param request L'intestazione della richiesta (il payload è la firma).
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
+ */ 
+int handle_delta_read(client_t *cli, const char *fullpath, const ft_header_t *request)
+{
+    delta_signature_t sig;
+    delta_t delta;
+    ft_status_t status = FT_STATUS_OK;
+    unsigned char *buffer = NULL;
+
+    // senza una dimensione nota della firma non si sa dove inizi la richiesta successiva
+    long long length = (long long)request->payload_len;
+    if (request->payload_len == FT_LENGTH_UNKNOWN || length < 0) {
+        send_response(cli->sockfd, 'r', FT_STATUS_BAD_REQUEST, 0);
+        return -1;
+    }
+    if ((unsigned long long)length > SIGNATURE_MAX_SIZE || (request->flags & FT_FLAG_RANGE)) {
+        status = FT_STATUS_BAD_REQUEST;
+    } else if ((buffer = (unsigned char *)malloc(length > 0 ? length : 1)) == NULL) {
+        status = FT_STATUS_IO_ERROR;
+    }
+    if (status != FT_STATUS_OK) {
+        if (recv_discard(cli->sockfd, length) < 0) {
+            return -1;
+        }
+        return send_response(cli->sockfd, 'r', status, 0) == 0 ? 0 : -1;
+    }
+
+    if (recv_all(cli->sockfd, buffer, length) < 0) {
+        LOG_ERROR("Errore durante la ricezione della firma: %s", strerror(errno));
+        free(buffer);
+        return -1;
+    }
+    int decoded = delta_signature_decode(buffer, length, &sig);
+    free(buffer);
+    if (decoded < 0) {
+        return send_response(cli->sockfd, 'r', errno == EINVAL ? FT_STATUS_BAD_REQUEST : FT_STATUS_IO_ERROR, 0) == 0 ? 0 : -1;
+    }
+
+    int file_fd = open(fullpath, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0 || delta_compute(file_fd, &sig, &delta) < 0) {
+        LOG_ERROR("Errore durante il calcolo delle differenze di '%s': %s", fullpath, strerror(errno));
+        status = ft_status_from_errno(errno);
+        delta_signature_free(&sig);
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        return send_response(cli->sockfd, 'r', status, 0) == 0 ? 0 : -1;
+    }
+    delta_signature_free(&sig);
+
+    uint64_t size = delta_encoded_size(&delta);
+    LOG_INFO("Differenze di %s: %llu byte nuovi su %llu, delta di %llu byte", fullpath,
+                (unsigned long long)delta.literal_bytes, (unsigned long long)delta.size, (unsigned long long)size);
+
+    int result = 0;
+    if (send_response(cli->sockfd, 'r', FT_STATUS_OK, size) < 0 || delta_send(cli->sockfd, file_fd, &delta) < 0) {
+        LOG_ERROR("Errore durante l'invio del delta al client: %s", strerror(errno));
+        result = -1;
+    } else {
+        LOG_INFO("Compito eseguito con successo");
+        metrics_bytes(0, size);
+        transfer_paced((size_t)size);
+    }
+    delta_free(&delta);
+    close(file_fd);
+    return result;
+}
+
+
+
+/**
+ * Gestisce la richiesta di informazioni ('i') su un file: dimensione, data di modifica e, con
+ * FT_FLAG_CHECKSUM, i checksum dei blocchi, con FT_FLAG_DELTA la firma. Con FT_FLAG_PARTIAL riguarda il file parziale.
+ * 
+ * @param cli Il puntatore al client che ha inviato la richiesta.
+ * @param fullpath Il percorso completo del file.
+ * @param request L'intestazione della richiesta.
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
  */ 
-void handle_list(client_t *cli, const char *fullpath)
+int handle_info(client_t *cli, const char *fullpath, const ft_header_t *request)
 {
-    // creazione del comando per eseguire "ls -la" sul percorso specificato
-    char command[BUFFER_SIZE];
-    snprintf(command, sizeof(command), "ls -la %s 2>&1", fullpath);  // redirige lo stderr (flusso di errore) allo stdout (flusso standard). Questo permette a popen di catturare sia l'output che gli errori.
+    size_t len;
+    char *path = (request->flags & FT_FLAG_PARTIAL) ? partial_path(fullpath) : strdup(fullpath);
+    char *info = (path != NULL) ? build_info(path, request->flags, &len) : NULL;
+    free(path);
+
+    if (info == NULL) {
+        return send_response(cli->sockfd, 'i', ft_status_from_errno(errno), 0);
+    }
+    int result = 0;
+    if (send_response(cli->sockfd, 'i', FT_STATUS_OK, len) < 0 || send_all(cli->sockfd, info, len, 0) < 0) {
+        LOG_ERROR("Errore durante l'invio di dati al client: %s", strerror(errno));
+        result = -1;
+    } else {
+        LOG_INFO("Compito eseguito con successo");
+        metrics_bytes(0, len);
+    }
+    free(info);
+    return result;
+}
+
+
+
+/**
+ * Costruisce la lista del percorso specificato senza processi esterni: i record binari con FT_FLAG_RECORDS
+ * (ordinati e a pagine secondo la richiesta), altrimenti una riga "ls -la" per voce. Le liste complete e
+ * quelle ordinate partono dalla cache dei metadati. Al protocollo precedente, che non ha un esito, un errore
+ * arriva come il messaggio di ls che il client riconosce.
+ * 
+ * @param fullpath Il percorso completo della directory da elencare.
+ * @param request L'intestazione della richiesta, NULL per il protocollo precedente.
+ * @param len Puntatore dove memorizzare la lunghezza della lista.
+ * @return Il buffer allocato dinamicamente con la lista (da liberare con free) oppure NULL in caso di errore (errno impostato).
+ */ 
+char* build_listing(const char *fullpath, const ft_header_t *request, size_t *len)
+{
+    list_t list = { NULL, 0, 0, NULL, 0, 0 };
+    unsigned long long hits, misses;
+    uint16_t flags = (request != NULL) ? request->flags : 0;
+    char *output = NULL;
+
+    // le pagine senza ordinamento seguono la posizione nella directory: si leggono sempre dal disco
+    if ((flags & (FT_FLAG_RECORDS | FT_FLAG_RANGE | FT_FLAG_SORTED)) == (FT_FLAG_RECORDS | FT_FLAG_RANGE)) {
+        return list_records(fullpath, flags, request->range_offset, request->range_length, len);
+    }
+
+    // lista completa e ordinata, dalla cache dei metadati quando possibile
+    int cached = metacache_list(fullpath, &list);
+    if (cached >= 0) {
+        metacache_stats(&hits, &misses);
+        LOG_INFO("Lista di '%s' %s (cache: %llu successi, %llu mancati)", fullpath, cached ? "dalla cache" : "letta dal disco", hits, misses);
+        if (flags & FT_FLAG_RECORDS) {
+            output = list_page(&list, flags, request->range_offset, request->range_length, len);
+        } else {
+            output = list_render(&list, len);
+        }
+    }
+    int saved_errno = errno;
+    list_free(&list);
+
+    if (output == NULL)
+    {
+        LOG_ERROR("Errore durante la lista di '%s': %s", fullpath, strerror(saved_errno));
+        if (request == NULL) {
+            output = (char *)malloc(BUFFER_SIZE);
+            if (output != NULL) {
+                *len = snprintf(output, BUFFER_SIZE, "ls: cannot access '%s': %s\n", fullpath, strerror(saved_errno));
+                if (*len >= BUFFER_SIZE) {
+                    *len = BUFFER_SIZE - 1;
+                }
+            }
+        }
+    }
+    errno = saved_errno;
+    return output;
+}
+
+
 
-    // apertura di un processo per eseguire il comando e ottenere il suo output
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Errore nell' apertura del processo che esegue il comando ls -la: %s\n", strerror(errno));
-        return;
+/**
+ * Aggiunge alla lista ricorsiva i file regolari contenuti in una directory e nelle sue sottodirectory.
+ * I collegamenti simbolici vengono ignorati, così la visita non esce dalla directory richiesta.
+ * 
+ * @param dirpath La directory da visitare.
+ * @param base_len I caratteri iniziali da togliere ai percorsi per renderli relativi alla directory richiesta.
+ * @param output Il buffer della lista (ingrandito secondo necessità).
+ * @param len I byte validi nel buffer.
+ * @param capacity La dimensione allocata del buffer.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */ 
+int append_tree(const char *dirpath, size_t base_len, char **output, size_t *len, size_t *capacity)
+{
+    DIR *dir = opendir(dirpath);
+    if (dir == NULL) {
+        return -1;
     }
 
-    // lettura dell'output del comando e invio al client
-    char result[BUFFER_SIZE];
+    struct dirent *entry;
+    struct stat statbuf;
+    char path[PATH_MAX];
+    int result = 0;
 
-    /* fgets legge una riga di testo dall'output del comando, che è gestito dal file pointer fp.
-    sizeof(result) specifica la quantità massima di caratteri che fgets può leggere in una volta.
-    Il ciclo continua fino a quando ci sono righe da leggere (ovvero, fino a quando fgets non restituisce NULL).*/
-    while (fgets(result, sizeof(result), fp) != NULL)
+    while (result == 0 && (entry = readdir(dir)) != NULL)
     {
-        if (send(cli->sockfd, result, strlen(result), 0) < 0)
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if ((size_t)snprintf(path, sizeof(path), "%s/%s", dirpath, entry->d_name) >= sizeof(path) || lstat(path, &statbuf) < 0) {
+            continue;   // percorsi troppo lunghi o file appena rimossi non fanno parte della lista
+        }
+
+        if (S_ISDIR(statbuf.st_mode)) {
+            result = append_tree(path, base_len, output, len, capacity);
+        }
+        else if (S_ISREG(statbuf.st_mode))
         {
-            fprintf(stderr, "Errore durante l'invio di dati al client: %s\n", strerror(errno));
-            pclose(fp);
-            return;
+            // record: dimensione, spazio, percorso relativo e terminatore '\0'
+            size_t needed = strlen(path + base_len) + 32;
+            while (*len + needed > *capacity) {
+                char *bigger = (char *)realloc(*output, *capacity * 2);
+                if (bigger == NULL) {
+                    result = -1;
+                    break;
+                }
+                *output = bigger;
+                *capacity *= 2;
+            }
+            if (result == 0) {
+                *len += sprintf(*output + *len, "%lld %s", (long long)statbuf.st_size, path + base_len) + 1;
+            }
         }
     }
-    // chiusura del processo
-    if (pclose(fp) == -1) {
-        fprintf(stderr, "Errore durante la chiusura del processo: %s\n", strerror(errno));
-    } 
-    printf("SERVER: Compito eseguito con successo\n");
+
+    closedir(dir);
+    return result;
 }
 
 
 
 /**
- * Gestisce la comunicazione con il client.
+ * Costruisce la lista ricorsiva dei file regolari sotto una directory (FT_FLAG_RECURSIVE).
  * 
- * @param arg Il parametro passato al thread, che è un puntatore a client_data_t.
- * @return NULL alla fine dell'esecuzione della funzione.
+ * @param fullpath Il percorso completo della directory.
+ * @param len Puntatore dove memorizzare la lunghezza della lista.
+ * @return Il buffer allocato dinamicamente con la lista (da liberare con free) oppure NULL in caso di errore (errno impostato).
+ */ 
+char* build_tree_listing(const char *fullpath, size_t *len)
+{
+    char root[PATH_MAX];
+    size_t root_len = strlen(fullpath);
+
+    // la directory senza '/' finali: i percorsi nella lista iniziano subito dopo il separatore
+    if (root_len >= sizeof(root)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    memcpy(root, fullpath, root_len + 1);
+    while (root_len > 1 && root[root_len - 1] == '/') {
+        root[--root_len] = '\0';
+    }
+
+    size_t capacity = BUFFER_SIZE;
+    char *output = (char *)malloc(capacity);
+    *len = 0;
+
+    if (output == NULL || append_tree(root, root_len + 1, &output, len, &capacity) < 0) {
+        int saved_errno = errno;
+        LOG_ERROR("Errore durante la costruzione della lista ricorsiva: %s", strerror(errno));
+        free(output);
+        errno = saved_errno;
+        return NULL;
+    }
+    return output;
+}
+
+
+
+/**
+ * Gestisce l'operazione di lista ('l') richiesta dal client.
  * 
- * Questa funzione gestisce la comunicazione con il client identificato da `arg`.
- * Riceve l'operazione richiesta dal client, il percorso relativo del file o directory,
- * costruisce il percorso completo utilizzando la directory di root, e gestisce l'operazione
- * richiesta (scrittura, lettura, elenco).
- * Libera la memoria allocata per le risorse utilizzate.
- */
-void *handle_client(void *arg) 
+ * @param cli Il puntatore al client che ha inviato la richiesta.
+ * @param fullpath Il percorso completo del file su cui operare.
+ * @param request L'intestazione della richiesta, NULL per il protocollo precedente.
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
+ */ 
+int handle_list(client_t *cli, const char *fullpath, const ft_header_t *request)
 {
-    char opz;                   //char per salvare l'opzione richiesta dal client
-    char conferma_ricezione;    //char per inviare un carattere al client che gli comunica l'esito del operazione richiesta
+    struct stat statbuf;
+    size_t len;
+    int result = -1;
 
-    // cast del parametro di tipo void* a client_data_t* e assegnamento parametri
-    client_data_t *data = (client_data_t *)arg;    
-    client_t *cli = data->client;
-    const char *ft_root_directory = data->ft_root_directory;    
+    // con l'intestazione binaria un percorso inesistente è segnalato dall'esito invece che da un messaggio nella lista
+    if (request != NULL && metacache_stat(fullpath, &statbuf) < 0) {
+        return send_response(cli->sockfd, 'l', ft_status_from_errno(errno), 0);
+    }
 
-    printf("SERVER: Siamo nel thread del client con UID -> %d\n", cli->uid); // log per sapere quale client stiamo gestendo
+    int recursive = (request != NULL && (request->flags & FT_FLAG_RECURSIVE));
+    char *listing = recursive ? build_tree_listing(fullpath, &len) : build_listing(fullpath, request, &len);
+    if (listing == NULL) {
+        if (request != NULL) {
+            return send_response(cli->sockfd, 'l', ft_status_from_errno(errno), 0);
+        }
+        return -1;
+    }
 
-    // ricezione dell'operazione richiesta dal client
-    if (recv(cli->sockfd, &opz, 1, 0) <= 0) {
-        fprintf(stderr, "Errore durante la ricezione del operazione richiesta dal client: %s\n", strerror(errno));
-        goto cleanup;
+    // invio della lista al client (preceduto dalla sua lunghezza con l'intestazione binaria)
+    if ((request != NULL && send_response(cli->sockfd, 'l', FT_STATUS_OK, len) < 0) || send_all(cli->sockfd, listing, len, 0) < 0) {
+        LOG_ERROR("Errore durante l'invio di dati al client: %s", strerror(errno));
+    } else {
+        LOG_INFO("Compito eseguito con successo");
+        metrics_bytes(0, len);
+        result = (request != NULL) ? 0 : -1;
     }
+    free(listing);
+    return result;
+}
 
-    printf("SERVER: Operazione richiesta -> %c \n", opz);  // log per sapere quale operazione è stata richiesta dal client
 
-    char* relative_path = receive_path(cli);             // ricezione del percorso relativo del file o directory
 
-    if (relative_path == NULL) {
-        fprintf(stderr, "Errore durante la ricezione del percorso\n");
-        goto cleanup;
+/**
+ * Invia al client le metriche del server (opcode 's'), sommate su tutti i thread.
+ *
+ * @param cli Il puntatore al client che ha inviato la richiesta.
+ * @return 0 se la connessione è allineata alla richiesta successiva, -1 altrimenti.
+ */
+int handle_stats(client_t *cli)
+{
+    size_t len;
+    char *document = metrics_format(&len);
+
+    if (document == NULL) {
+        return send_response(cli->sockfd, 's', FT_STATUS_IO_ERROR, 0);
     }
+    int result = 0;
+    if (send_response(cli->sockfd, 's', FT_STATUS_OK, len) < 0 || send_all(cli->sockfd, document, len, 0) < 0) {
+        LOG_ERROR("Errore durante l'invio delle metriche al client: %s", strerror(errno));
+        result = -1;
+    } else {
+        LOG_INFO("Metriche inviate al client %d", cli->uid);
+    }
+    free(document);
+    return result;
+}
+
+
+
+/**
+ * Stima i byte che una richiesta trasferirà, per assegnarle la classe nello scheduler: la dimensione annunciata
+ * di una scrittura, quella del file (o dell'intervallo) di una lettura.
+ *
+ * @param fullpath Il percorso completo richiesto.
+ * @param opz L'operazione richiesta.
+ * @param request L'intestazione della richiesta (NULL con il protocollo precedente).
+ * @return I byte, 0 per le operazioni senza dati da trasferire, -1 se non noti (scritture senza dimensione,
+ *         caricamenti con deduplicazione).
+ */
+long long request_size(const char *fullpath, char opz, const ft_header_t *request)
+{
+    struct stat statbuf;
 
-    // invio della conferma di ricezione dell'operazione e del percorso
-    conferma_ricezione = 'T'; // T sta per true
-    if (send(cli->sockfd, &conferma_ricezione, 1, 0) <= 0) {
-        fprintf(stderr, "Errore durante l'invio della conferma di ricezione al client: %s\n", strerror(errno));
-        goto cleanup;
+    if (opz == 'w') {
+        return (request == NULL || request->payload_len == FT_LENGTH_UNKNOWN) ? -1 : (long long)request->payload_len;
+    }
+    if (opz == 'd') {
+        return -1;
+    }
+    if (opz != 'r' || metacache_stat(fullpath, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+        return 0;               // una lettura che fallisce costa solo la risposta
     }
+    if (request != NULL && (request->flags & FT_FLAG_RANGE)) {
+        return range_read_length(request, statbuf.st_size);
+    }
+    return statbuf.st_size;
+}
 
-    // costruzione del percorso completo combinando la directory di root con il percorso relativo
-    char* fullpath = construct_full_path(ft_root_directory, relative_path); 
-    free(relative_path);  
-    if (fullpath == NULL) {
-        fprintf(stderr, "Errore nella costruzione del percorso completo\n");
-        goto cleanup;
+
+
+/**
+ * Esegue la richiesta in corso della connessione, che ha già ottenuto il suo posto dallo scheduler, e lo libera.
+ *
+ * @param data La connessione.
+ * @return SERVE_NEXT se la connessione resta aperta per la richiesta successiva (FT_FLAG_KEEP_ALIVE), SERVE_CLOSE se va chiusa.
+ */
+int execute_request(client_data_t *data)
+{
+    client_t *cli = data->client;
+    server_request_t *req = &data->request;
+    const ft_header_t *request = req->framed ? &req->header : NULL;    // NULL con il protocollo precedente
+    char opz = req->opz;
+    int in_sync;                // 0 se la connessione è allineata alla richiesta successiva
+
+    log_context(cli->uid, opz);
+
+    // lock sul solo percorso coinvolto: esclusivo per le scritture, condiviso per letture e liste.
+    // In questo modo operazioni su file diversi (o letture dello stesso file) procedono in parallelo.
+    // Le scritture di un intervallo condividono il lock: le connessioni di una stessa copia scrivono parti diverse del file
+    // (non quelle di un file parziale, che alla fine sostituisce il percorso); un caricamento con deduplicazione è esclusivo
+    int exclusive = (opz == 'd' || (opz == 'w' && (request == NULL || (request->flags & (FT_FLAG_RANGE | FT_FLAG_PARTIAL)) != FT_FLAG_RANGE)));
+    path_lock_t *lock = path_lock_acquire(req->fullpath, exclusive);
+    if (lock == NULL) {
+        sched_leave(&req->item);
+        free(req->fullpath);
+        return SERVE_CLOSE;
     }
 
-    pthread_mutex_lock(&clients_mutex);
     // gestione dell'operazione richiesta dal client
     switch (opz) {
         case 'w':
-            handle_write(cli, fullpath);
+            in_sync = handle_write(cli, req->fullpath, request);
             break;
         case 'r':
-            handle_read(cli, fullpath);
+            shape_flow_begin(&cli->shape);      // il download entra nella divisione della banda
+            shape_bind(&cli->shape);
+            in_sync = handle_read(cli, req->fullpath, request);
+            shape_bind(NULL);
+            shape_flow_end(&cli->shape);
             break;
         case 'l':
-            handle_list(cli, fullpath);
+            in_sync = handle_list(cli, req->fullpath, request);
+            break;
+        case 'i':
+            in_sync = handle_info(cli, req->fullpath, request);
+            break;
+        case 'd':
+            in_sync = handle_dedup(cli, req->fullpath, request);
             break;
         default:
-            fprintf(stderr, "Operazione %c non valida\n", opz);
+            LOG_ERROR("Operazione %c non valida", opz);
+            in_sync = -1;
             break;
     }
-    pthread_mutex_unlock(&clients_mutex);
-    free(fullpath);  // libera la memoria allocata per il percorso completo
+    path_lock_release(lock);
+    sched_leave(&req->item);
+    free(req->fullpath);  // libera la memoria allocata per il percorso completo
+
+    metrics_request(opz, req->start);
+    if (request != NULL && in_sync < 0) {
+        metrics_abort();        // la connessione non è più allineata e va chiusa
+    }
+    return (request != NULL && (request->flags & FT_FLAG_KEEP_ALIVE) && in_sync == 0) ? SERVE_NEXT : SERVE_CLOSE;
+}
+
+
+
+/**
+ * Riceve ed esegue una richiesta del client.
+ * 
+ * @param data La connessione che ha inviato la richiesta.
+ * @param first 1 per la prima richiesta della connessione, 0 per le successive.
+ * @return SERVE_NEXT se la connessione resta aperta per la richiesta successiva (FT_FLAG_KEEP_ALIVE), SERVE_CLOSE
+ *         se va chiusa, SERVE_PARKED se la richiesta attende nello scheduler (con il pool: la riprende un worker).
+ * 
+ * Riceve l'operazione richiesta dal client, il percorso relativo del file o directory,
+ * costruisce il percorso completo utilizzando la directory di root, attende il turno della
+ * richiesta nello scheduler e gestisce l'operazione richiesta (scrittura, lettura, elenco).
+ */
+int serve_request(client_data_t *data, int first)
+{
+    client_t *cli = data->client;
+    server_request_t *req = &data->request;
+    char opz;                   //char per salvare l'opzione richiesta dal client
+    char conferma_ricezione;    //char per inviare un carattere al client che gli comunica l'esito del operazione richiesta
+    char* relative_path;        // percorso relativo ricevuto dal client
+    unsigned char header_buffer[FT_HEADER_SIZE];    // intestazione binaria ricevuta
+    ft_header_t *header = &req->header;             // intestazione decodificata
+    ft_header_t *request = NULL;    // punta a header se il client usa l'intestazione binaria
+    int in_sync;                // 0 se la connessione è allineata alla richiesta successiva
+
+    log_context(cli->uid, '\0');
+
+    // ricezione del primo byte: l'operazione richiesta oppure l'inizio del magic dell'intestazione binaria
+    if (recv_all(cli->sockfd, header_buffer, 1) < 0) {
+        // la chiusura tra una richiesta e l'altra è la normale fine di una sessione
+        if (!first && errno == ECONNRESET) {
+            LOG_INFO("Il client %d ha chiuso la sessione", cli->uid);
+        } else {
+            LOG_ERROR("Errore durante la ricezione del operazione richiesta dal client: %s", strerror(errno));
+        }
+        return SERVE_CLOSE;
+    }
+    req->start = metrics_now_us();
+
+    if (header_buffer[0] == (unsigned char)(FT_MAGIC >> 24))
+    {
+        // intestazione binaria: il resto dell'intestazione e poi esattamente path_len byte di percorso
+        if (recv_all(cli->sockfd, header_buffer + 1, FT_HEADER_SIZE - 1) < 0) {
+            LOG_ERROR("Errore durante la ricezione dell'intestazione: %s", strerror(errno));
+            return SERVE_CLOSE;
+        }
+        if (ft_header_decode(header_buffer, header) < 0) {
+            LOG_ERROR("Errore, intestazione non valida dal client %d", cli->uid);
+            send_response(cli->sockfd, header->opcode, FT_STATUS_BAD_REQUEST, 0);
+            return SERVE_CLOSE;
+        }
+        request = header;
+        opz = header->opcode;
+        log_context(cli->uid, opz);
+
+        LOG_DEBUG("Operazione richiesta -> %c (intestazione v%d, %llu byte)", opz, header->version, (unsigned long long)header->payload_len);
+
+        relative_path = receive_framed_path(cli, request);
+
+        // l'intervallo segue il percorso
+        unsigned char range[FT_RANGE_SIZE];
+        if (relative_path != NULL && (header->flags & FT_FLAG_RANGE)) {
+            if (recv_all(cli->sockfd, range, sizeof(range)) < 0) {
+                LOG_ERROR("Errore durante la ricezione dell'intervallo: %s", strerror(errno));
+                free(relative_path);
+                return SERVE_CLOSE;
+            }
+            ft_range_decode(range, header);
+        }
+
+        if (relative_path == NULL || (opz != 'w' && opz != 'r' && opz != 'l' && opz != 'i' && opz != 'd' && opz != 's')) {
+            LOG_ERROR("Errore, richiesta non valida dal client %d", cli->uid);
+            send_response(cli->sockfd, opz, FT_STATUS_BAD_REQUEST, 0);
+            free(relative_path);
+            return SERVE_CLOSE;
+        }
+
+        // in una sessione le risposte brevi non devono attendere l'algoritmo di Nagle
+        if (first && (header->flags & FT_FLAG_KEEP_ALIVE)) {
+            int nodelay = 1;
+            setsockopt(cli->sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        }
+
+        // le metriche non riguardano un percorso: nessun lock e nessuna attesa nello scheduler
+        if (opz == 's') {
+            free(relative_path);
+            in_sync = handle_stats(cli);
+            metrics_request(opz, req->start);
+            return ((header->flags & FT_FLAG_KEEP_ALIVE) && in_sync == 0) ? SERVE_NEXT : SERVE_CLOSE;
+        }
+    }
+    else
+    {
+        opz = header_buffer[0];
+        log_context(cli->uid, opz);
+
+        LOG_DEBUG("Operazione richiesta -> %c", opz);  // log per sapere quale operazione è stata richiesta dal client
+
+        relative_path = receive_path(cli);             // ricezione del percorso relativo del file o directory
+
+        if (relative_path == NULL) {
+            LOG_ERROR("Errore durante la ricezione del percorso");
+            return SERVE_CLOSE;
+        }
+
+        // invio della conferma di ricezione dell'operazione e del percorso
+        conferma_ricezione = LEGACY_ACK; // T sta per true
+        if (send(cli->sockfd, &conferma_ricezione, 1, MSG_NOSIGNAL) <= 0) {
+            LOG_ERROR("Errore durante l'invio della conferma di ricezione al client: %s", strerror(errno));
+            free(relative_path);
+            return SERVE_CLOSE;
+        }
+    }
+
+    // costruzione del percorso completo combinando la directory di root con il percorso relativo
+    req->fullpath = construct_full_path(data->ft_root_directory, relative_path); 
+    free(relative_path);  
+    if (req->fullpath == NULL) {
+        LOG_ERROR("Errore nella costruzione del percorso completo");
+        return SERVE_CLOSE;
+    }
+    req->opz = opz;
+    req->framed = (request != NULL);
+
+    // la richiesta attende il turno della sua classe: il thread di una connessione resta in attesa, il worker
+    // del pool la lascia in coda e passa ad altre connessioni
+    sched_prepare(&req->item, opz, request_size(req->fullpath, opz, request));
+    req->item.wake = data->own_thread ? &data->wake : NULL;
+    req->item.arg = data;
+    sched_class_t klass = req->item.klass;
+
+    // parked va impostato prima: un altro worker può riprendere la connessione appena la richiesta è in coda,
+    // e da quel momento questo thread non la tocca più
+    data->parked = !data->own_thread;
+    if (!sched_enter(&req->item)) {
+        LOG_DEBUG("Richiesta in coda nello scheduler (classe %s)", sched_class_name(klass));
+        return SERVE_PARKED;
+    }
+    data->parked = 0;
+    return execute_request(data);
+}
+
+
+
+/**
+ * Gestisce la comunicazione con il client.
+ * 
+ * @param arg Il parametro passato al thread, che è un puntatore a client_data_t.
+ * @return NULL alla fine dell'esecuzione della funzione.
+ * 
+ * Questa funzione gestisce la comunicazione con il client identificato da `arg`: esegue una richiesta,
+ * oppure tutte le richieste di una sessione finché il client chiede di mantenere aperta la connessione.
+ * Con il pool una richiesta che attende nello scheduler lascia la connessione in sospeso: il worker che la
+ * riprende richiama questa funzione, che esegue la richiesta e continua la sessione.
+ * Libera la memoria allocata per le risorse utilizzate.
+ */
+void *handle_client(void *arg) 
+{
+    // cast del parametro di tipo void* a client_data_t* e assegnamento parametri
+    client_data_t *data = (client_data_t *)arg;    
+    client_t *cli = data->client;
+    int result;
+
+    log_context(cli->uid, '\0');    // i messaggi del thread riguardano questo client
+    if (data->parked) {
+        data->parked = 0;
+        result = execute_request(data);
+    } else {
+        LOG_DEBUG("Siamo nel thread del client con UID -> %d", cli->uid); // log per sapere quale client stiamo gestendo
+        metrics_connection_opened();
+        if (data->own_thread) {
+            sem_init(&data->wake, 0, 0);
+        }
+        result = serve_request(data, 1);
+    }
+
+    while (result == SERVE_NEXT) {
+        result = serve_request(data, 0);
+    }
+    if (result == SERVE_PARKED) {
+        log_context(0, '\0');
+        return NULL;            // la connessione appartiene alla coda dello scheduler
+    }
 
-cleanup:
     close(cli->sockfd);         // chiude la socket del client
-    remove_client(cli->uid);    // rimuove il client dall'array
+    metrics_connection_closed();
+    remove_client(cli);         // rimuove il client dall'array
+    if (data->own_thread) {
+        sem_destroy(&data->wake);
+    }
     free(cli);                  // libera la memoria allocata per il client
     free(data);                 // libera la memoria allocata per la struttura
+    log_context(0, '\0');
     return NULL;
 }
 
@@ -576,6 +1948,25 @@ int main(int argc, char* argv[])
 
     char *ft_root_directory = NULL;         // puntatore per memorizzare la directory root del file transfer
     int port = 0;                           // porta su cui il server ascolterà
+    server_model_t model = SERVER_POOL;     // modello di concorrenza (opzione -m)
+    int event_threads = 0;                  // thread del server a eventi (opzione -n, 0 = uno per core)
+    int pool_workers = 0;                   // worker del pool (opzione -w, 0 = default in base ai core)
+    int queue_depth = POOL_DEFAULT_QUEUE_DEPTH; // connessioni in coda al massimo nel pool (opzione -q)
+    int cache_mb = METACACHE_DEFAULT_MB;    // memoria della cache dei metadati in MiB (opzione -C, 0 la disattiva)
+    int file_cache_mb = 0;                  // memoria della cache del contenuto dei file in MiB (opzione -F, 0 = disattivata)
+    int file_cache_kb = FILECACHE_DEFAULT_THRESHOLD_KB;    // dimensione massima di un file in cache in KiB (opzione -S)
+    filecache_policy_t file_cache_policy = FILECACHE_CLOCK;   // politica di eliminazione della cache dei file (opzione -E)
+    int dedup = 0;                          // 1 per accettare i caricamenti con deduplicazione (opzione -D)
+    int sqpoll_ms = 0;                      // inattività in ms del thread SQPOLL di io_uring (opzione -K, 0 = disattivato)
+    int log_json = 0;                       // 1 per scrivere i messaggi come righe JSON (opzione -J)
+    unsigned long long rate_global = 0;     // byte al secondo inviati da tutto il server (opzione -L, 0 = nessun limite)
+    unsigned long long rate_ip = 0;         // byte al secondo inviati a ogni indirizzo (opzione -I)
+    unsigned long long rate_conn = 0;       // byte al secondo inviati su ogni connessione (opzione -c)
+    unsigned long long rate_burst = 0;      // burst dei limiti di banda (opzione -B, 0 = SHAPE_DEFAULT_BURST)
+    int sched_slots = -1;                   // richieste eseguite insieme al massimo (opzione -P, -1 = default del modello)
+    int sched_reserved = -1;                // posti riservati alle operazioni brevi (opzione -R, -1 = un quarto dei posti)
+    unsigned long long sched_small = SCHED_DEFAULT_SMALL;  // byte al massimo di un trasferimento piccolo (opzione -T)
+    worker_pool_t pool;                     // pool di worker (modello SERVER_POOL)
 
     struct sockaddr_in server_address;      // struttura per l'indirizzo del server
     server_address.sin_family = AF_INET;    // assegna la famiglia di indirizzi IPv4
@@ -611,6 +2002,183 @@ int main(int argc, char* argv[])
         else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {  
             ft_root_directory = argv[++i];  // assegna la directory root del file transfer
         }
+
+        // controlla se l'argomento corrente è "-t" (modalità di trasferimento: zerocopy, buffered, pipeline o uring)
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            if (!parse_transfer_mode(argv[++i], &server_transfer_mode)) {
+                fprintf(stderr, "Modalità di trasferimento '%s' non valida. Usa zerocopy, buffered, pipeline o uring (con liburing)\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-b" (dimensione in KiB dei blocchi del percorso bufferizzato)
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            char *end;
+            long chunk_kb = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || chunk_kb > (TRANSFER_CHUNK_MAX >> 10) || transfer_set_chunk_size((size_t)(chunk_kb < 0 ? 0 : chunk_kb) << 10) < 0) {
+                fprintf(stderr, "Dimensione dei blocchi '%s' non valida. Il valore dovrebbe essere tra %d e %d KiB\n", argv[i], TRANSFER_CHUNK_MIN >> 10, TRANSFER_CHUNK_MAX >> 10);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-K" (con -t uring, millisecondi di inattività del thread SQPOLL del kernel)
+        else if (strcmp(argv[i], "-K") == 0 && i + 1 < argc) {
+            char *end;
+            sqpoll_ms = (int)strtol(argv[++i], &end, 10);
+            if (*end != '\0' || sqpoll_ms < 0) {
+                fprintf(stderr, "Tempo di inattività '%s' non valido\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-m" (modello di concorrenza: pool, thread o epoll)
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "pool") == 0) {
+                model = SERVER_POOL;
+            } else if (strcmp(argv[i], "thread") == 0) {
+                model = SERVER_THREADS;
+            } else if (strcmp(argv[i], "epoll") == 0) {
+                model = SERVER_EPOLL;
+            } else {
+                fprintf(stderr, "Modello '%s' non valido. Usa pool, thread o epoll\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-n" (numero di thread del server a eventi)
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            event_threads = atoi(argv[++i]);
+            if (event_threads < 1) {
+                fprintf(stderr, "Numero di thread '%s' non valido\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-w" (numero di worker del pool)
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            pool_workers = atoi(argv[++i]);
+            if (pool_workers < 1) {
+                fprintf(stderr, "Numero di worker '%s' non valido\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-q" (profondità della coda del pool)
+        else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            queue_depth = atoi(argv[++i]);
+            if (queue_depth < 1) {
+                fprintf(stderr, "Profondità della coda '%s' non valida\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-P" o "-R" (posti dello scheduler e posti riservati alle operazioni brevi)
+        else if ((strcmp(argv[i], "-P") == 0 || strcmp(argv[i], "-R") == 0) && i + 1 < argc) {
+            char *end;
+            int *target = (argv[i][1] == 'P') ? &sched_slots : &sched_reserved;
+            *target = (int)strtol(argv[++i], &end, 10);
+            if (*end != '\0' || *target < 0) {
+                fprintf(stderr, "Numero di posti '%s' non valido\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-T" (soglia dei trasferimenti piccoli nello scheduler, con suffisso k, m o g)
+        else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            if (!shape_parse_rate(argv[++i], &sched_small)) {
+                fprintf(stderr, "Soglia '%s' non valida. Usa byte o un suffisso k, m, g (es. 256k)\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-C" (memoria della cache dei metadati)
+        else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+            char *end;
+            cache_mb = (int)strtol(argv[++i], &end, 10);
+            if (*end != '\0' || cache_mb < 0) {
+                fprintf(stderr, "Dimensione della cache '%s' non valida\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-F" (memoria della cache del contenuto dei file)
+        else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            char *end;
+            file_cache_mb = (int)strtol(argv[++i], &end, 10);
+            if (*end != '\0' || file_cache_mb < 0) {
+                fprintf(stderr, "Dimensione della cache '%s' non valida\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-S" (dimensione massima di un file nella cache del contenuto)
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            char *end;
+            file_cache_kb = (int)strtol(argv[++i], &end, 10);
+            if (*end != '\0' || file_cache_kb < 1 || file_cache_kb > (FILECACHE_CHUNK_SIZE >> 10)) {
+                fprintf(stderr, "Soglia '%s' non valida. Il valore dovrebbe essere tra 1 e %d KiB\n", argv[i], FILECACHE_CHUNK_SIZE >> 10);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-D" (archivio dei contenuti deduplicati nella root)
+        else if (strcmp(argv[i], "-D") == 0) {
+            dedup = 1;
+        }
+
+        // controlla se l'argomento corrente è "-Q" (nessun messaggio per le singole richieste e connessioni, come -v warn)
+        else if (strcmp(argv[i], "-Q") == 0) {
+            log_level = LOG_LEVEL_WARN;
+        }
+
+        // controlla se l'argomento corrente è "-v" (livello dei messaggi: error, warn, info o debug)
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            log_level_t level;
+            if (!parse_log_level(argv[++i], &level)) {
+                fprintf(stderr, "Livello '%s' non valido. Usa error, warn, info o debug\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            log_level = level;
+        }
+
+        // controlla se l'argomento corrente è "-J" (messaggi come righe JSON)
+        else if (strcmp(argv[i], "-J") == 0) {
+            log_json = 1;
+        }
+
+        // controlla se l'argomento corrente è "-L", "-I", "-c" o "-B" (limiti di banda e burst, con suffisso k, m o g)
+        else if ((strcmp(argv[i], "-L") == 0 || strcmp(argv[i], "-I") == 0 || strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-B") == 0) && i + 1 < argc) {
+            unsigned long long *target = (argv[i][1] == 'L') ? &rate_global : (argv[i][1] == 'I') ? &rate_ip : (argv[i][1] == 'c') ? &rate_conn : &rate_burst;
+            if (!shape_parse_rate(argv[++i], target)) {
+                fprintf(stderr, "Valore '%s' non valido. Usa byte al secondo o un suffisso k, m, g (es. 10m)\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-W" (peso di un indirizzo nella divisione della banda globale)
+        else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc) {
+            if (!shape_set_weight(argv[++i])) {
+                fprintf(stderr, "Peso '%s' non valido. Usa indirizzo:peso con un peso da 1 a 1000 (es. 10.0.0.5:4)\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-z" (codec delle letture compresse: auto, none per disattivare la compressione, o un codec)
+        else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+            if (!compress_parse_codec(argv[++i], &server_compress_codec)) {
+                fprintf(stderr, "Codec '%s' non valido o non disponibile. Usa auto, none, ftlz, lz4 o zstd\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // controlla se l'argomento corrente è "-E" (politica di eliminazione della cache del contenuto: lru o clock)
+        else if (strcmp(argv[i], "-E") == 0 && i + 1 < argc) {
+            if (!parse_filecache_policy(argv[++i], &file_cache_policy)) {
+                fprintf(stderr, "Politica '%s' non valida. Usa lru o clock\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 
     // check per la validità della directory root
@@ -619,11 +2187,65 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
+    // una scrittura su una socket chiusa dal client (send/sendfile) non deve terminare il server con SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    metrics_init();
+    if (log_init("SERVER", log_json) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // limiti di banda sui dati inviati ai client (opzionali)
+    if (shape_init(rate_global, rate_ip, rate_conn, rate_burst)) {
+        printf("SERVER: Limiti di banda: globale %llu, per indirizzo %llu, per connessione %llu byte/s (0 = nessuno), burst %llu byte\n",
+               rate_global, rate_ip, rate_conn, rate_burst > 0 ? rate_burst : (unsigned long long)SHAPE_DEFAULT_BURST);
+    }
+
+    // cache dei metadati: senza inotify il server funziona comunque, leggendo sempre dal disco
+    if (metacache_init((size_t)cache_mb << 20) == 0 && cache_mb > 0) {
+        printf("SERVER: Cache dei metadati di %d MiB\n", cache_mb);
+    }
+
+    // cache del contenuto dei file piccoli (opzionale)
+    if (filecache_init((size_t)file_cache_mb << 20, (size_t)file_cache_kb << 10, file_cache_policy) == 0 && file_cache_mb > 0) {
+        printf("SERVER: Cache dei file fino a %d KiB: %d MiB, eliminazione %s\n", file_cache_kb, file_cache_mb, filecache_policy_name(file_cache_policy));
+    }
+
+    // archivio dei contenuti deduplicati (opzionale): richiede la directory root
+    if (dedup && (ft_root_directory == NULL || store_init(ft_root_directory) < 0)) {
+        fprintf(stderr, "Errore durante l'attivazione della deduplicazione\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // coda io_uring condivisa (accept multishot e thread SQPOLL), prima di avviare i thread che la usano;
+    // il server a eventi non usa send_file/recv_file e trasferisce come con -t buffered
+    if (server_transfer_mode == TRANSFER_URING && model != SERVER_EPOLL)
+    {
+        if (uring_init((unsigned)sqpoll_ms) < 0) {
+            fprintf(stderr, "Errore durante l'inizializzazione di io_uring: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (sqpoll_ms > 0) {
+            printf("SERVER: io_uring con SQPOLL, inattivo dopo %d ms\n", sqpoll_ms);
+        }
+    }
+
+    // server a eventi: ogni thread apre la propria socket di ascolto sulla stessa porta
+    if (model == SERVER_EPOLL) {
+        if (event_threads == 0) {
+            event_threads = default_event_threads();
+        }
+        if (run_event_loops(&server_address, event_threads, ft_root_directory) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
     // creazione della socket del server
     if ((server_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         fprintf(stderr, "Errore durante la creazione della socket del server: %s\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
+    transfer_tune_socket(server_socket);    // le connessioni accettate ereditano i buffer della socket di ascolto
 
     // binding dell'indirizzo alla socket
     if (bind(server_socket, (struct sockaddr *)&server_address, sizeof(server_address)) < 0) {
@@ -632,14 +2254,49 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
-    // messa in ascolto della socket
-    if (listen(server_socket, MAX_CLIENTS) < 0) {
+    // messa in ascolto della socket (la coda delle connessioni in attesa è la massima consentita dal sistema)
+    if (listen(server_socket, SOMAXCONN) < 0) {
         fprintf(stderr, "Errore listen: %s\n", strerror(errno));
         close(server_socket);
         exit(EXIT_FAILURE);
     }
 
+    // avvio dei worker del pool prima di accettare connessioni
+    if (model == SERVER_POOL)
+    {
+        if (pool_workers == 0) {
+            pool_workers = default_pool_workers();
+        }
+        if (pool_init(&pool, pool_workers, queue_depth) < 0) {
+            close(server_socket);
+            exit(EXIT_FAILURE);
+        }
+        printf("SERVER: Pool di %d worker, coda massima di %d connessioni\n", pool_workers, queue_depth);
+    }
+
+    // scheduler delle richieste: con il pool un posto per worker (di più non servirebbero), con un thread per
+    // connessione nessun limite se non indicato con -P
+    if (model == SERVER_POOL && (sched_slots < 0 || sched_slots > pool_workers)) {
+        sched_slots = pool_workers;
+    }
+    if (sched_slots < 0) {
+        sched_slots = 0;
+    }
+    if (sched_reserved < 0) {
+        sched_reserved = (sched_slots > 1) ? (sched_slots + 3) / 4 : 0;
+    }
+    if (sched_slots > 0 && sched_reserved >= sched_slots) {
+        fprintf(stderr, "Errore, i posti riservati (%d) devono essere meno dei posti dello scheduler (%d)\n", sched_reserved, sched_slots);
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+    if (sched_init(sched_slots, sched_reserved, sched_small, pool_resume, &pool)) {
+        printf("SERVER: Scheduler: %d richieste insieme, %d posti riservati a liste e trasferimenti fino a %llu byte\n",
+               sched_slots, sched_reserved, sched_small);
+    }
+
     printf("SERVER: Ascolto sulla porta -> %d\n\n", port); // stampa la porta su cui il server è in ascolto
+    fflush(stdout);         // i messaggi successivi arrivano dal thread di scarico del log, direttamente sul descrittore
 
 
     while (1) 
@@ -647,12 +2304,17 @@ int main(int argc, char* argv[])
         struct sockaddr_in client_address;                  // struttura per memorizzare l'indirizzo del client
         socklen_t client_len = sizeof(client_address);      // lunghezza della struttura dell'indirizzo del client
   
-        // accetta una nuova connessione
-        if ((new_socket = accept(server_socket, (struct sockaddr *)&client_address, &client_len)) < 0) {
-            fprintf(stderr, "\nErrore durante l' accettazione del client: %s\n", strerror(errno));
+        // accetta una nuova connessione (con -t uring dalla richiesta di accept multishot)
+        if (server_transfer_mode == TRANSFER_URING) {
+            new_socket = uring_accept(server_socket, (struct sockaddr *)&client_address, &client_len);
+        } else {
+            new_socket = accept(server_socket, (struct sockaddr *)&client_address, &client_len);
+        }
+        if (new_socket < 0) {
+            LOG_ERROR("Errore durante l' accettazione del client: %s", strerror(errno));
             continue;    // continua ad accettare altre connessioni se c'è un errore
         } else {
-            printf("\nSERVER: Il server accetta il client con successo\n");
+            LOG_DEBUG("Il server accetta il client con successo");
         }
 
         // allocazione memoria per la struttura client_data_t e client_t
@@ -660,19 +2322,44 @@ int main(int argc, char* argv[])
         cli->client = (client_t *)malloc(sizeof(client_t)); 
 
         cli->ft_root_directory = ft_root_directory;  // assegna la directory root del file transfer al client
+        cli->own_thread = (model == SERVER_THREADS);  // con -m thread la connessione attende lo scheduler nel suo thread
+        cli->parked = 0;
 
         cli->client->address = client_address;       // assegna l'indirizzo del client
         cli->client->sockfd = new_socket;            // assegna il file descriptor della nuova connessione
         cli->client->uid = uid_counter++;            // assegna un UID univoco al client e incrementa il contatore
+        shape_flow_init(&cli->client->shape, &client_address);
         
-        add_client(cli->client);              // aggiunge il client all'array dei client connessi
+        // aggiunge il client all'array dei client connessi
+        if (add_client(cli->client) < 0) {
+            close(new_socket);
+            free(cli->client);
+            free(cli);
+            continue;
+        }
+
+        // accoda la connessione al pool; se la coda è piena la rifiuta con STATUS_BUSY invece di creare altri thread
+        if (model == SERVER_POOL)
+        {
+            if (pool_submit(&pool, cli) < 0) {
+                LOG_INFO("Coda piena, connessione rifiutata");
+                remove_client(cli->client);
+                refuse_connection(new_socket);
+                free(cli->client);
+                free(cli);
+            }
+            continue;
+        }
 
         // crea un nuovo thread per gestire la comunicazione con il client
         pthread_t tid;
         if (pthread_create(&tid, NULL, handle_client, (void *)cli) != 0) {
-            fprintf(stderr, "Errore creazione del thread: %s\n", strerror(errno));
+            LOG_ERROR("Errore creazione del thread: %s", strerror(errno));
             close(new_socket);
+            remove_client(cli->client);
+            free(cli->client);
             free(cli);
+            continue;
         }
         /* indica che il thread tid non deve mai essere unito con PTHREAD_JOIN. Le risorse di tid saranno quindi 
         liberate immediatamente quando termina, invece di attendere che un altro thread esegua PTHREAD_JOIN su di esso.*/
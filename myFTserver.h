@@ -11,14 +11,36 @@
 #include <arpa/inet.h>      // per funzioni di conversione di indirizzi e gestione socket, come inet_pton()
 #include <pthread.h>        // per la gestione dei thread, permettendo la programmazione concorrente con pthread_create(), pthread_join()
 #include <netinet/in.h>     // per l'utilizzo delle strutture e costanti per i protocolli internet, come sockaddr_in
+#include <netinet/tcp.h>    // per TCP_NODELAY nelle sessioni persistenti
 #include <fcntl.h>          // per funzioni di controllo dei file descriptor, come open(), O_RDONLY
 #include <string.h>         // per funzioni di manipolazione delle stringhe
 #include <sys/statvfs.h>    // necessaria per fstatvfs
+#include <signal.h>         // per ignorare SIGPIPE
+#include <dirent.h>         // per opendir/readdir nella lista ricorsiva
+#include <semaphore.h>      // per il semaforo con cui il thread di una connessione attende lo scheduler
+#include "myFTlock.h"       // tabella dei lock per percorso (lettori/scrittori)
+#include "myFTtransfer.h"   // invio e ricezione dei file (zero-copy con sendfile/splice o bufferizzato)
+#include "myFTprotocol.h"   // intestazione binaria delle richieste e delle risposte
+#include "myFTchecksum.h"   // CRC32C dei blocchi per riprendere i trasferimenti interrotti e dei dati trasferiti
+#include "myFTlist.h"       // lista delle directory senza processi esterni
+#include "myFTcache.h"      // cache dei metadati (stat e liste) invalidata da inotify
+#include "myFTfilecache.h"  // cache del contenuto dei file piccoli letti spesso
+#include "myFTstore.h"      // archivio dei contenuti deduplicati
+#include "myFTdelta.h"      // firme e delta per trasferire solo le differenze
+#include "myFTcompress.h"   // compressione dei dati sul filo
+#include "myFTmetrics.h"    // metriche per thread, restituite dall'opcode 's'
+#include "myFTlog.h"        // log asincrono dei messaggi per richiesta
+#include "myFTshape.h"      // limiti di banda globali, per indirizzo e per connessione
+#include "myFTsched.h"      // scheduler delle richieste per classe (liste, trasferimenti piccoli e grandi)
 
-#define MAX_CLIENTS 10      // definisce il numero massimo di client che possono connettersi contemporaneamente
-#define BUFFER_SIZE 1024    // definisce la dimensione del buffer usato per leggere e inviare dati
+#define CLIENTS_INITIAL_CAPACITY 16   // capacità iniziale del registro dei client (cresce secondo necessità)
+#define BUFFER_SIZE 1024    // buffer dei percorsi e dei messaggi brevi (i dati dei file usano i blocchi del pool, vedi transfer_buffer_acquire)
 #define PATH_MAX 4096       // definisce la dimensione del buffer usato per unire ft_root_directory e relative_path
 
+#define SERVE_CLOSE 0       // esito di serve_request: la connessione va chiusa
+#define SERVE_NEXT 1        // la connessione resta aperta per la richiesta successiva
+#define SERVE_PARKED 2      // la richiesta attende il suo turno nello scheduler e la connessione passa a chi la riprenderà
+
 
 // Struttura per memorizzare le informazioni sul client
 typedef struct
@@ -26,34 +48,92 @@ typedef struct
     struct sockaddr_in address;     // indirizzo del client
     int sockfd;                     // file descriptor della socket del client
     int uid;                        // ID univoco del client
+    int slot;                       // posizione nell'array dei client connessi
+    shape_flow_t shape;             // limiti di banda della connessione
 } client_t;
 
 
-client_t *clients[MAX_CLIENTS];         // array di puntatori ai client connessi
-pthread_mutex_t clients_mutex;          // mutex per accesso thread-safe all'array dei client (macro poichè dichiarato come variabile globale) 
-int uid_counter;                        // contatore globale per gli UID
+// Modello di concorrenza del server
+typedef enum
+{
+    SERVER_THREADS = 0,     // un thread per connessione
+    SERVER_EPOLL = 1,       // N thread con un ciclo a eventi epoll ciascuno
+    SERVER_POOL = 2         // pool di worker di dimensione fissa con code a furto di lavoro
+} server_model_t;
+
+
+extern client_t **clients;                  // array (dinamico) di puntatori ai client connessi
+extern int clients_count;                   // numero di client connessi
+extern int clients_capacity;                // dimensione allocata dell'array dei client
+extern pthread_mutex_t clients_mutex;       // mutex per accesso thread-safe all'array dei client (protegge solo il registro, non i trasferimenti)
+extern int uid_counter;                     // contatore globale per gli UID
+extern transfer_mode_t server_transfer_mode;    // modalità di invio/ricezione dei file (zerocopy o buffered)
+extern int server_compress_codec;               // codec delle letture compresse (CODEC_AUTO, CODEC_NONE disattiva la compressione)
 
 
 
+// Richiesta ricevuta da un client (intestazione e percorso) che attende o sta eseguendo la sua operazione
+typedef struct
+{
+    char opz;                       // operazione richiesta
+    int framed;                     // 1 se il client usa l'intestazione binaria (header è valida)
+    ft_header_t header;             // intestazione decodificata
+    char *fullpath;                 // percorso completo nella root
+    uint64_t start;                 // arrivo della richiesta (latenza nelle metriche)
+    sched_item_t item;              // posto nello scheduler
+} server_request_t;
+
+
 // Struttura che mi serve per poter passare tutte le informazioni necessarie a handle_client in un unico argomento
 typedef struct {
     client_t *client;
     const char *ft_root_directory;
+    uint64_t queued_us;             // istante in cui la connessione è entrata nella coda del pool (metriche)
+    int own_thread;                 // 1 con -m thread: il thread della connessione attende lo scheduler sul semaforo wake
+    sem_t wake;                     // semaforo di own_thread
+    int parked;                     // 1 se request attende nello scheduler: il worker che riprende la connessione la esegue
+    server_request_t request;       // richiesta in corso
 } client_data_t;
 
 unsigned long long int available_bytes(const char *path);
-void add_client(client_t *cl);
-void remove_client(int uid);
-void send_data(int fd, int client_sock);
-void write_file_in_dir(const char *path, int client_sock);
+int add_client(client_t *cl);
+void remove_client(client_t *cl);
+int send_response(int client_sock, char opcode, ft_status_t status, uint64_t payload_len);
+int send_data(int fd, int client_sock, long long length, int trailer);
+int send_compressed_data(int fd, int client_sock, long long length, unsigned codecs, int trailer);
+ft_status_t write_file_in_dir(const char *path, int client_sock, long long length, const ft_header_t *request);
+int valid_range(const ft_header_t *request);
+int prepare_range_file(int fd, const ft_header_t *request);
+long long range_read_length(const ft_header_t *request, long long size);
+char* build_info(const char *fullpath, uint16_t flags, size_t *len);
+char* partial_path(const char *fullpath);
+int partial_complete(const ft_header_t *request);
+ft_status_t finish_partial(const char *fullpath);
+int open_delta_spool(const char *fullpath);
+ft_status_t finish_delta(const char *fullpath, int spool_fd, long long length);
+int open_write_spool(const char *fullpath, char **spool);
+ft_status_t finish_write_spool(const char *fullpath, char *spool, ft_status_t status);
 void divide_dirpath_from_filename(const char *path, char **dirpath, char **filename);
 int ensure_directory_exists(const char *dirpath);
 char* receive_path(client_t *cli);
+char* receive_framed_path(client_t *cli, const ft_header_t *request);
 char* construct_full_path(const char *root_directory, char *relative_path);
 int is_ip_reachable(const char *ip_str);
-void handle_write(client_t *cli, const char *fullpath);
-void handle_read(client_t *cli, const char *fullpath);
-void handle_list(client_t *cli, const char *fullpath);
+int handle_write(client_t *cli, const char *fullpath, const ft_header_t *request);
+int handle_dedup(client_t *cli, const char *fullpath, const ft_header_t *request);
+long long cached_read_length(const filecache_entry_t *entry, const ft_header_t *request, size_t *offset);
+int send_cached_file(client_t *cli, filecache_entry_t *entry, const ft_header_t *request);
+int handle_read(client_t *cli, const char *fullpath, const ft_header_t *request);
+int handle_delta_read(client_t *cli, const char *fullpath, const ft_header_t *request);
+int handle_info(client_t *cli, const char *fullpath, const ft_header_t *request);
+char* build_listing(const char *fullpath, const ft_header_t *request, size_t *len);
+int append_tree(const char *dirpath, size_t base_len, char **output, size_t *len, size_t *capacity);
+char* build_tree_listing(const char *fullpath, size_t *len);
+int handle_list(client_t *cli, const char *fullpath, const ft_header_t *request);
+int handle_stats(client_t *cli);
+long long request_size(const char *fullpath, char opz, const ft_header_t *request);
+int execute_request(client_data_t *data);
+int serve_request(client_data_t *data, int first);
 void *handle_client(void *arg);
 
 #endif // MY_FT_SERVER_H
\ No newline at end of file
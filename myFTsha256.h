@@ -0,0 +1,27 @@
+#ifndef MY_FT_SHA256_H
+#define MY_FT_SHA256_H
+
+#include <stdint.h>         // per i tipi a dimensione fissa
+#include <stddef.h>         // per size_t
+
+#define SHA256_DIGEST_SIZE 32           // byte di un digest SHA-256
+#define SHA256_HEX_SIZE 65              // digest in esadecimale, terminatore compreso
+#define SHA256_BLOCK_SIZE 64            // byte elaborati da ogni passo della compressione
+
+
+// Stato di un calcolo SHA-256 incrementale
+typedef struct
+{
+    uint32_t state[8];                          // valori intermedi dell'hash
+    uint64_t length;                            // byte elaborati finora
+    unsigned char block[SHA256_BLOCK_SIZE];     // byte in attesa di formare un blocco completo
+    size_t block_len;                           // byte validi in block
+} sha256_t;
+
+void sha256_init(sha256_t *ctx);
+void sha256_update(sha256_t *ctx, const void *data, size_t len);
+void sha256_final(sha256_t *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+void sha256(const void *data, size_t len, unsigned char digest[SHA256_DIGEST_SIZE]);
+void sha256_hex(const unsigned char digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]);
+
+#endif // MY_FT_SHA256_H
@@ -0,0 +1,429 @@
+// LIMITI DI BANDA
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>           // per clock_gettime e nanosleep
+#include <pthread.h>        // per la chiave dello stato di ogni thread
+#include <arpa/inet.h>      // per inet_pton
+#include "myFTshape.h"
+#include "myFTtransfer.h"   // per transfer_set_pace
+
+#define SHAPE_REFILL_MAX_US 10000000ULL     // intervallo massimo considerato da un riempimento (evita overflow)
+
+// stato di un thread: la parte del bucket globale da cui preleva e la connessione di cui invia i dati
+typedef struct
+{
+    unsigned int shard;
+    shape_flow_t *flow;                     // connessione legata con shape_bind (NULL se nessuna)
+} shape_thread_t;
+
+static struct
+{
+    int enabled;                            // 1 se almeno un limite è attivo
+    unsigned long long global;              // byte al secondo di tutto il server (0 = nessun limite)
+    unsigned long long per_ip;              // byte al secondo di ogni indirizzo
+    unsigned long long per_connection;      // byte al secondo di ogni connessione
+    int64_t burst;
+    uint32_t active_weight;                 // somma dei pesi dei trasferimenti attivi (atomico)
+    unsigned int next_shard;                // parte assegnata al prossimo thread (atomico)
+    shape_bucket_t shards[SHAPE_SHARDS];
+    shape_ip_t ips[SHAPE_IP_SLOTS];
+} shape;
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+
+
+/**
+ * Converte una velocità in byte al secondo con suffisso facoltativo k, m o g (potenze di 1024), es. "500k" o "10m".
+ *
+ * @param str La stringa da convertire.
+ * @param rate Puntatore dove memorizzare la velocità (0 = nessun limite).
+ * @return 1 se la stringa è valida, 0 altrimenti.
+ */
+int shape_parse_rate(const char *str, unsigned long long *rate)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+
+    if (errno != 0 || end == str || *str == '-') {
+        return 0;
+    }
+    switch (*end) {
+        case 'g': case 'G': value <<= 10;   // fall through
+        case 'm': case 'M': value <<= 10;   // fall through
+        case 'k': case 'K': value <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    if (*end != '\0' || value > (1ULL << 40)) {
+        return 0;
+    }
+    *rate = value;
+    return 1;
+}
+
+
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+
+
+static void bucket_init(shape_bucket_t *bucket, uint64_t rate, int64_t burst)
+{
+    bucket->rate = rate;
+    bucket->burst = burst;
+    bucket->tokens = burst;
+    bucket->last_us = 0;                    // il primo riempimento lo trova già pieno
+}
+
+
+
+/**
+ * Aggiunge i gettoni maturati dall'ultimo riempimento. Il thread che sposta last_us con il compare-and-swap
+ * si prende l'intervallo: due thread non accreditano mai lo stesso tempo.
+ */
+static void bucket_refill(shape_bucket_t *bucket, uint64_t now)
+{
+    uint64_t last = __atomic_load_n(&bucket->last_us, __ATOMIC_RELAXED);
+    uint64_t elapsed = now > last ? now - last : 0;
+
+    if (elapsed > SHAPE_REFILL_MAX_US) {
+        elapsed = SHAPE_REFILL_MAX_US;
+    }
+    int64_t add = (int64_t)(elapsed * bucket->rate / 1000000);
+    if (add == 0) {
+        return;                             // meno di un gettone: il tempo resta da accreditare
+    }
+    // si avanza solo del tempo che corrisponde ai gettoni accreditati, così i resti non si perdono
+    uint64_t next = (now - last > SHAPE_REFILL_MAX_US) ? now : last + (uint64_t)add * 1000000 / bucket->rate;
+    if (!__atomic_compare_exchange_n(&bucket->last_us, &last, next, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;                             // un altro thread ha appena riempito il bucket
+    }
+
+    int64_t tokens = __atomic_load_n(&bucket->tokens, __ATOMIC_RELAXED);
+    int64_t filled;
+    do {
+        filled = tokens + add > bucket->burst ? bucket->burst : tokens + add;
+    } while (!__atomic_compare_exchange_n(&bucket->tokens, &tokens, filled, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+
+/**
+ * Preleva i byte inviati dal bucket.
+ *
+ * @return I microsecondi da attendere perché il bucket torni in pari (0 se non è in debito).
+ */
+static uint64_t bucket_take(shape_bucket_t *bucket, size_t bytes, uint64_t now)
+{
+    if (bucket->rate == 0) {
+        return 0;
+    }
+    bucket_refill(bucket, now);
+    int64_t tokens = __atomic_sub_fetch(&bucket->tokens, (int64_t)bytes, __ATOMIC_RELAXED);
+    return tokens >= 0 ? 0 : (uint64_t)(-tokens) * 1000000 / bucket->rate;
+}
+
+
+
+static void thread_key_create(void)
+{
+    pthread_key_create(&thread_key, free);
+}
+
+
+
+// stato del thread corrente, creato al primo uso con la prossima parte del bucket globale
+static shape_thread_t* shape_thread(void)
+{
+    pthread_once(&thread_once, thread_key_create);
+
+    shape_thread_t *state = (shape_thread_t *)pthread_getspecific(thread_key);
+    if (state == NULL) {
+        state = (shape_thread_t *)calloc(1, sizeof(shape_thread_t));
+        if (state == NULL || pthread_setspecific(thread_key, state) != 0) {
+            free(state);
+            return NULL;
+        }
+        state->shard = __atomic_fetch_add(&shape.next_shard, 1, __ATOMIC_RELAXED) % SHAPE_SHARDS;
+    }
+    return state;
+}
+
+
+
+/**
+ * Preleva i byte dal bucket globale: prima dalla parte del thread e poi, se non basta, i gettoni avanzati nelle
+ * altre, così la banda delle parti inattive non va persa. Solo quando tutte sono esaurite il resto diventa un
+ * debito, diviso tra le parti.
+ */
+static uint64_t global_take(size_t bytes, uint64_t now)
+{
+    shape_thread_t *state = shape_thread();
+    unsigned int own = state != NULL ? state->shard : 0;
+    int64_t need = (int64_t)bytes;
+
+    for (unsigned int i = 0; i < SHAPE_SHARDS && need > 0; i++)
+    {
+        shape_bucket_t *bucket = &shape.shards[(own + i) % SHAPE_SHARDS];
+        bucket_refill(bucket, now);
+
+        int64_t available = __atomic_load_n(&bucket->tokens, __ATOMIC_RELAXED);
+        while (available > 0) {
+            int64_t part = available < need ? available : need;
+            if (__atomic_compare_exchange_n(&bucket->tokens, &available, available - part, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                need -= part;
+                break;
+            }
+        }
+    }
+    if (need == 0) {
+        return 0;
+    }
+
+    // il debito si divide tra tutte le parti: ognuna lo sconta riempiendosi e nessuna, restando al massimo,
+    // perde i gettoni maturati durante l'attesa
+    uint64_t wait = 0;
+    for (unsigned int i = 0; i < SHAPE_SHARDS; i++)
+    {
+        shape_bucket_t *bucket = &shape.shards[(own + i) % SHAPE_SHARDS];
+        int64_t part = need / SHAPE_SHARDS + (i < (unsigned int)(need % SHAPE_SHARDS) ? 1 : 0);
+        int64_t tokens = __atomic_sub_fetch(&bucket->tokens, part, __ATOMIC_RELAXED);
+        if (tokens < 0 && (uint64_t)(-tokens) * 1000000 / bucket->rate > wait) {
+            wait = (uint64_t)(-tokens) * 1000000 / bucket->rate;
+        }
+    }
+    return wait;
+}
+
+
+
+/**
+ * Cerca (o registra) lo stato di un indirizzo IP nella tabella, senza lock: una posizione libera si occupa con
+ * un compare-and-swap sull'indirizzo. Con la tabella piena l'indirizzo condivide lo stato della sua posizione.
+ *
+ * @param address Indirizzo IPv4 in ordine di rete.
+ * @return Lo stato dell'indirizzo.
+ */
+static shape_ip_t* ip_lookup(uint32_t address)
+{
+    unsigned int start = (address * 2654435761u) % SHAPE_IP_SLOTS;
+
+    for (unsigned int i = 0; i < SHAPE_IP_SLOTS; i++)
+    {
+        shape_ip_t *ip = &shape.ips[(start + i) % SHAPE_IP_SLOTS];
+        uint32_t current = __atomic_load_n(&ip->address, __ATOMIC_ACQUIRE);
+        if (current == address) {
+            return ip;
+        }
+        if (current == 0) {
+            uint32_t expected = 0;
+            if (__atomic_compare_exchange_n(&ip->address, &expected, address, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || expected == address) {
+                return ip;
+            }
+        }
+    }
+    return &shape.ips[start];
+}
+
+
+
+/**
+ * Imposta il peso di un indirizzo nella divisione della banda globale (opzione -W, va chiamata prima di shape_init).
+ *
+ * @param spec Indirizzo e peso nella forma "indirizzo:peso", es. "10.0.0.5:4" (da 1 a 1000).
+ * @return 1 se la specifica è valida, 0 altrimenti.
+ */
+int shape_set_weight(const char *spec)
+{
+    char address[INET_ADDRSTRLEN];
+    const char *colon = strchr(spec, ':');
+    struct in_addr parsed;
+    char *end = NULL;
+
+    if (colon == NULL || (size_t)(colon - spec) >= sizeof(address)) {
+        return 0;
+    }
+    memcpy(address, spec, colon - spec);
+    address[colon - spec] = '\0';
+
+    long weight = strtol(colon + 1, &end, 10);
+    if (inet_pton(AF_INET, address, &parsed) != 1 || parsed.s_addr == 0 || end == colon + 1 || *end != '\0' || weight < 1 || weight > 1000) {
+        return 0;
+    }
+    ip_lookup(parsed.s_addr)->weight = (uint32_t)weight;
+    return 1;
+}
+
+
+
+/**
+ * Attiva i limiti di banda e aggancia shape_pace ai percorsi di invio dei file.
+ *
+ * @param global Byte al secondo di tutto il server (0 = nessun limite).
+ * @param per_ip Byte al secondo di ogni indirizzo IP dei client (0 = nessun limite).
+ * @param per_connection Byte al secondo di ogni connessione (0 = nessun limite).
+ * @param burst Byte inviati al massimo senza attese da un bucket pieno (0 = SHAPE_DEFAULT_BURST).
+ * @return 1 se almeno un limite è attivo, 0 altrimenti.
+ */
+int shape_init(unsigned long long global, unsigned long long per_ip, unsigned long long per_connection, unsigned long long burst)
+{
+    shape.global = global;
+    shape.per_ip = per_ip;
+    shape.per_connection = per_connection;
+    shape.burst = burst > 0 ? (int64_t)burst : SHAPE_DEFAULT_BURST;
+    shape.enabled = (global > 0 || per_ip > 0 || per_connection > 0);
+    if (!shape.enabled) {
+        return 0;
+    }
+
+    // ogni parte del bucket globale ha una quota della velocità e del burst
+    for (int i = 0; i < SHAPE_SHARDS; i++) {
+        uint64_t rate = global / SHAPE_SHARDS + (i < (int)(global % SHAPE_SHARDS) ? 1 : 0);
+        bucket_init(&shape.shards[i], global > 0 && rate == 0 ? 1 : rate, shape.burst / SHAPE_SHARDS + 1);
+    }
+    for (int i = 0; i < SHAPE_IP_SLOTS; i++) {
+        bucket_init(&shape.ips[i].bucket, per_ip, shape.burst);
+    }
+    transfer_set_pace(shape_pace);
+    return 1;
+}
+
+
+
+/**
+ * Prepara i limiti di una nuova connessione.
+ *
+ * @param flow Lo stato della connessione.
+ * @param address Indirizzo del client.
+ */
+void shape_flow_init(shape_flow_t *flow, const struct sockaddr_in *address)
+{
+    memset(flow, 0, sizeof(*flow));
+    if (!shape.enabled) {
+        return;
+    }
+    flow->ip = ip_lookup(address->sin_addr.s_addr != 0 ? address->sin_addr.s_addr : 1);
+    bucket_init(&flow->bucket, 0, shape.burst);
+}
+
+
+
+/**
+ * Un trasferimento verso il client inizia: la connessione entra nella divisione della banda.
+ */
+void shape_flow_begin(shape_flow_t *flow)
+{
+    if (flow->ip == NULL || flow->active) {
+        return;
+    }
+    flow->active = 1;
+    __atomic_add_fetch(&shape.active_weight, flow->ip->weight ? flow->ip->weight : 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&flow->ip->active, 1, __ATOMIC_RELAXED);
+}
+
+
+
+/**
+ * Il trasferimento è concluso (o interrotto): la sua quota torna agli altri.
+ */
+void shape_flow_end(shape_flow_t *flow)
+{
+    if (flow->ip == NULL || !flow->active) {
+        return;
+    }
+    flow->active = 0;
+    __atomic_sub_fetch(&shape.active_weight, flow->ip->weight ? flow->ip->weight : 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&flow->ip->active, 1, __ATOMIC_RELAXED);
+}
+
+
+
+/**
+ * Preleva i byte appena inviati da una connessione dai bucket della connessione, del suo indirizzo e globale.
+ * La velocità del bucket della connessione è la sua quota del momento: la banda globale divisa per i pesi dei
+ * trasferimenti attivi e quella dell'indirizzo divisa tra i suoi trasferimenti, al massimo il limite -c.
+ *
+ * @param flow Lo stato della connessione.
+ * @param bytes I byte inviati.
+ * @return I microsecondi da attendere prima di inviare ancora (0 se nessun limite è superato).
+ */
+uint64_t shape_take(shape_flow_t *flow, size_t bytes)
+{
+    if (flow == NULL || !flow->active || bytes == 0) {
+        return 0;
+    }
+
+    uint64_t now = now_us();
+    uint64_t rate = shape.per_connection;
+    uint32_t weight = flow->ip->weight ? flow->ip->weight : 1;
+    uint32_t total = __atomic_load_n(&shape.active_weight, __ATOMIC_RELAXED);
+    uint32_t siblings = __atomic_load_n(&flow->ip->active, __ATOMIC_RELAXED);
+
+    if (shape.global > 0 && total > weight) {
+        uint64_t share = shape.global * weight / total;
+        rate = (rate == 0 || share < rate) ? share : rate;
+    }
+    if (shape.per_ip > 0 && siblings > 1) {
+        uint64_t share = shape.per_ip / siblings;
+        rate = (rate == 0 || share < rate) ? share : rate;
+    }
+    flow->bucket.rate = rate;
+
+    uint64_t wait = bucket_take(&flow->bucket, bytes, now);
+    uint64_t ip_wait = bucket_take(&flow->ip->bucket, bytes, now);
+    uint64_t global_wait = shape.global > 0 ? global_take(bytes, now) : 0;
+
+    wait = ip_wait > wait ? ip_wait : wait;
+    return global_wait > wait ? global_wait : wait;
+}
+
+
+
+/**
+ * Lega una connessione al thread corrente: i dati inviati dal thread con send_file e gli altri percorsi di
+ * transfer_paced vengono prelevati dai suoi bucket.
+ *
+ * @param flow La connessione (NULL per sciogliere il legame).
+ */
+void shape_bind(shape_flow_t *flow)
+{
+    shape_thread_t *state = shape.enabled ? shape_thread() : NULL;
+
+    if (state != NULL) {
+        state->flow = flow;
+    }
+}
+
+
+
+/**
+ * Aggancio dei percorsi di invio (transfer_set_pace): preleva i byte appena inviati dalla connessione legata al
+ * thread e attende l'eventuale debito. I thread a eventi usano shape_take e non si fermano mai.
+ *
+ * @param bytes I byte inviati.
+ */
+void shape_pace(size_t bytes)
+{
+    shape_thread_t *state = shape_thread();
+    uint64_t wait = (state != NULL) ? shape_take(state->flow, bytes) : 0;
+
+    if (wait > 0) {
+        struct timespec ts = { (time_t)(wait / 1000000), (long)(wait % 1000000) * 1000 };
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+        }
+    }
+}
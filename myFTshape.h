@@ -0,0 +1,59 @@
+#ifndef MY_FT_SHAPE_H
+#define MY_FT_SHAPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>     // per struct sockaddr_in
+
+// Limiti di banda dei dati inviati ai client, con token bucket: globale (opzione -L), per indirizzo IP del client
+// (-I) e per connessione (-c). Ogni bucket si riempie alla propria velocità fino alla dimensione del burst (-B) e
+// chi invia preleva i byte già inviati: se il bucket va in negativo il debito diventa un'attesa prima del blocco
+// successivo, quindi nessun controllo richiede un lock. Il bucket globale è diviso in SHAPE_SHARDS parti con una
+// quota ciascuna, e un thread che ha esaurito la propria prende i gettoni avanzati nelle altre.
+// I trasferimenti attivi si dividono la banda globale in proporzione al peso dell'indirizzo del client (-W) e quella
+// di un indirizzo in parti uguali: il bucket di ogni connessione si riempie alla quota che le spetta in quel momento.
+
+#define SHAPE_SHARDS 16                     // parti del bucket globale
+#define SHAPE_IP_SLOTS 1024                 // indirizzi con un bucket proprio (gli altri condividono quello di un indirizzo già visto)
+#define SHAPE_DEFAULT_BURST (1 << 20)       // byte inviati al massimo senza attese da un bucket pieno
+
+
+// Bucket di gettoni (byte): tokens negativo è un debito da scontare prima di inviare ancora
+typedef struct
+{
+    int64_t tokens;                         // gettoni disponibili (atomico)
+    uint64_t last_us;                       // ultimo riempimento (atomico)
+    uint64_t rate;                          // byte al secondo (0 = nessun limite)
+    int64_t burst;                          // gettoni al massimo
+} __attribute__((aligned(64))) shape_bucket_t;
+
+
+// Stato di un indirizzo IP: bucket condiviso dalle sue connessioni e trasferimenti attivi
+typedef struct
+{
+    uint32_t address;                       // indirizzo IPv4 in ordine di rete (0 = posizione libera)
+    uint32_t weight;                        // peso nella divisione della banda globale (opzione -W, default 1)
+    uint32_t active;                        // trasferimenti in corso da questo indirizzo (atomico)
+    shape_bucket_t bucket;
+} shape_ip_t;
+
+
+// Limiti di una connessione: il bucket si riempie alla quota della connessione tra i trasferimenti attivi
+typedef struct
+{
+    shape_bucket_t bucket;
+    shape_ip_t *ip;                         // NULL se i limiti sono disattivati
+    int active;                             // 1 durante un trasferimento (shape_flow_begin)
+} shape_flow_t;
+
+int shape_parse_rate(const char *str, unsigned long long *rate);
+int shape_set_weight(const char *spec);
+int shape_init(unsigned long long global, unsigned long long per_ip, unsigned long long per_connection, unsigned long long burst);
+void shape_flow_init(shape_flow_t *flow, const struct sockaddr_in *address);
+void shape_flow_begin(shape_flow_t *flow);
+void shape_flow_end(shape_flow_t *flow);
+uint64_t shape_take(shape_flow_t *flow, size_t bytes);
+void shape_bind(shape_flow_t *flow);
+void shape_pace(size_t bytes);
+
+#endif // MY_FT_SHAPE_H
@@ -0,0 +1,987 @@
+// ARCHIVIO DEI CONTENUTI DEDUPLICATI
+
+#define _GNU_SOURCE         // necessaria per copy_file_range e qsort_r
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>         // per PATH_MAX
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>       // per FICLONE
+#include "myFTstore.h"
+#include "myFTlock.h"       // per normalize_path
+#include "myFTlog.h"
+
+
+// Stato dell'archivio: il mutex protegge l'indice dei chunk, la tabella dei contenuti e i contatori.
+// I file si leggono e si scrivono fuori dal mutex; contenuti e chunk registrati non vengono mai liberati,
+// quindi un piano può conservarne i puntatori.
+static struct
+{
+    int enabled;                                    // 0 se la deduplicazione è disattivata
+    pthread_mutex_t mutex;
+    char dir[PATH_MAX - 256];                       // directory dell'archivio (lascia spazio ai nomi dei contenuti)
+    char *normalized;                               // la stessa, normalizzata (per store_contains)
+    store_chunk_t **chunks;                         // indice dei chunk per hash
+    size_t buckets;                                 // bucket dell'indice (potenza di 2)
+    size_t chunk_count;                             // chunk nell'indice
+    store_blob_t *blobs[STORE_BLOB_BUCKETS];        // contenuti per inode (per riconoscere i file collegati)
+    unsigned long long blob_count;                  // contenuti nell'archivio
+    unsigned long long saved;                       // byte non ricevuti perché già presenti
+    unsigned long long received;                    // byte ricevuti dai caricamenti con deduplicazione
+    unsigned int sequence;                          // contatore per i nomi temporanei
+} store = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+
+
+/**
+ * Calcola il bucket di un hash nell'indice dei chunk. Va chiamata con il mutex acquisito.
+ *
+ * @param hash Lo SHA-256 del chunk (già uniforme: bastano i primi 8 byte).
+ * @return L'indice del bucket.
+ */
+static size_t chunk_bucket(const unsigned char *hash)
+{
+    uint64_t value;
+
+    memcpy(&value, hash, sizeof(value));
+    return (size_t)value & (store.buckets - 1);
+}
+
+
+
+/**
+ * Cerca un chunk nell'indice. Va chiamata con il mutex acquisito.
+ *
+ * @param hash Lo SHA-256 del chunk.
+ * @param length I byte del chunk.
+ * @return La posizione del chunk nell'archivio oppure NULL se non c'è.
+ */
+static store_chunk_t* index_find(const unsigned char *hash, uint32_t length)
+{
+    store_chunk_t *chunk = store.chunks[chunk_bucket(hash)];
+
+    while (chunk != NULL && (chunk->length != length || memcmp(chunk->hash, hash, SHA256_DIGEST_SIZE) != 0)) {
+        chunk = chunk->next;
+    }
+    return chunk;
+}
+
+
+
+/**
+ * Raddoppia i bucket dell'indice dei chunk. Va chiamata con il mutex acquisito.
+ *
+ * @return 0 in caso di successo, -1 se la memoria non basta (l'indice resta valido).
+ */
+static int index_grow(void)
+{
+    size_t old_buckets = store.buckets;
+    store_chunk_t **old = store.chunks;
+    store_chunk_t **chunks = (store_chunk_t **)calloc(old_buckets * 2, sizeof(store_chunk_t *));
+    if (chunks == NULL) {
+        return -1;
+    }
+
+    store.chunks = chunks;
+    store.buckets = old_buckets * 2;
+    for (size_t i = 0; i < old_buckets; i++) {
+        while (old[i] != NULL) {
+            store_chunk_t *chunk = old[i];
+            old[i] = chunk->next;
+            size_t bucket = chunk_bucket(chunk->hash);
+            chunk->next = store.chunks[bucket];
+            store.chunks[bucket] = chunk;
+        }
+    }
+    free(old);
+    return 0;
+}
+
+
+
+/**
+ * Registra un contenuto e i suoi chunk non ancora presenti nell'indice. Va chiamata con il mutex acquisito.
+ *
+ * @param id L'identità del contenuto in esadecimale.
+ * @param path Il percorso del file del contenuto.
+ * @param statbuf Le informazioni sul file del contenuto.
+ * @param manifest Il manifest del contenuto.
+ * @return 0 in caso di successo, -1 se la memoria non basta.
+ */
+static int index_add(const char *id, const char *path, const struct stat *statbuf, const manifest_t *manifest)
+{
+    store_blob_t *blob = (store_blob_t *)calloc(1, sizeof(store_blob_t));
+    if (blob == NULL || (blob->path = strdup(path)) == NULL) {
+        free(blob);
+        return -1;
+    }
+    strcpy(blob->id, id);
+    blob->dev = statbuf->st_dev;
+    blob->ino = statbuf->st_ino;
+    blob->next = store.blobs[blob->ino % STORE_BLOB_BUCKETS];
+    store.blobs[blob->ino % STORE_BLOB_BUCKETS] = blob;
+    store.blob_count++;
+
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < manifest->count; i++)
+    {
+        const chunk_ref_t *ref = &manifest->chunks[i];
+        if (index_find(ref->hash, ref->length) == NULL)
+        {
+            store_chunk_t *chunk = (store_chunk_t *)malloc(sizeof(store_chunk_t));
+            if (chunk == NULL) {
+                return -1;
+            }
+            memcpy(chunk->hash, ref->hash, SHA256_DIGEST_SIZE);
+            chunk->blob = blob;
+            chunk->offset = offset;
+            chunk->length = ref->length;
+            size_t bucket = chunk_bucket(ref->hash);
+            chunk->next = store.chunks[bucket];
+            store.chunks[bucket] = chunk;
+            if (++store.chunk_count > store.buckets) {
+                index_grow();
+            }
+        }
+        offset += ref->length;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Cerca il contenuto dell'archivio che ha un certo inode. Va chiamata con il mutex acquisito.
+ *
+ * @param statbuf Le informazioni sul file.
+ * @return Il contenuto oppure NULL se il file non è un contenuto dell'archivio.
+ */
+static store_blob_t* blob_by_inode(const struct stat *statbuf)
+{
+    store_blob_t *blob = store.blobs[statbuf->st_ino % STORE_BLOB_BUCKETS];
+
+    while (blob != NULL && (blob->ino != statbuf->st_ino || blob->dev != statbuf->st_dev)) {
+        blob = blob->next;
+    }
+    return blob;
+}
+
+
+
+/**
+ * Costruisce il percorso di un file nella directory objects dell'archivio.
+ *
+ * @param path Il buffer di PATH_MAX byte dove scrivere il percorso.
+ * @param id L'identità del contenuto in esadecimale.
+ * @param suffix Il suffisso del file ("" per il contenuto, ".chunks" per il manifest).
+ * @return 0 in caso di successo, -1 se il percorso è troppo lungo.
+ */
+static int object_path(char *path, const char *id, const char *suffix)
+{
+    return (size_t)snprintf(path, PATH_MAX, "%s/objects/%.2s/%s%s", store.dir, id, id, suffix) < PATH_MAX ? 0 : -1;
+}
+
+
+
+/**
+ * Legge in memoria il manifest di un contenuto salvato nell'archivio.
+ *
+ * @param path Il percorso del file del manifest.
+ * @param manifest Il manifest da riempire (da liberare con manifest_free).
+ * @return 0 in caso di successo, -1 se il file non si può leggere o non è valido.
+ */
+static int read_manifest(const char *path, manifest_t *manifest)
+{
+    struct stat statbuf;
+    int result = -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    unsigned char *buffer = NULL;
+    if (fstat(fd, &statbuf) == 0 && statbuf.st_size <= MANIFEST_MAX_SIZE &&
+        (buffer = (unsigned char *)malloc(statbuf.st_size ? statbuf.st_size : 1)) != NULL &&
+        read(fd, buffer, statbuf.st_size) == statbuf.st_size)
+    {
+        result = manifest_decode(buffer, statbuf.st_size, manifest);
+    }
+    free(buffer);
+    close(fd);
+    return result;
+}
+
+
+
+/**
+ * Registra nell'indice i contenuti di una sottodirectory di objects, controllando che ogni manifest
+ * corrisponda al nome e alla dimensione del contenuto.
+ *
+ * @param subdir La sottodirectory (i primi due caratteri delle identità).
+ */
+static void load_objects(const char *subdir)
+{
+    char path[PATH_MAX];
+    char blob_path[PATH_MAX];
+    struct stat statbuf;
+
+    DIR *dir = opendir(subdir);
+    if (dir == NULL) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t len = strlen(entry->d_name);
+        if (len != SHA256_HEX_SIZE - 1 + strlen(".chunks") || strcmp(entry->d_name + SHA256_HEX_SIZE - 1, ".chunks") != 0 ||
+            (size_t)snprintf(path, sizeof(path), "%s/%s", subdir, entry->d_name) >= sizeof(path))
+        {
+            continue;
+        }
+
+        manifest_t manifest;
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        char id[SHA256_HEX_SIZE];
+        if (read_manifest(path, &manifest) < 0) {
+            fprintf(stderr, "Errore, manifest non valido nell'archivio: %s\n", path);
+            continue;
+        }
+        manifest_id(&manifest, digest);
+        sha256_hex(digest, id);
+
+        if (strncmp(id, entry->d_name, SHA256_HEX_SIZE - 1) == 0 && object_path(blob_path, id, "") == 0 &&
+            stat(blob_path, &statbuf) == 0 && (uint64_t)statbuf.st_size == manifest.size)
+        {
+            pthread_mutex_lock(&store.mutex);
+            index_add(id, blob_path, &statbuf, &manifest);
+            pthread_mutex_unlock(&store.mutex);
+        }
+        manifest_free(&manifest);
+    }
+    closedir(dir);
+}
+
+
+
+/**
+ * Rimuove i file temporanei rimasti da un'esecuzione precedente interrotta.
+ *
+ * @param tmpdir La directory dei file temporanei dell'archivio.
+ */
+static void clean_tmp(const char *tmpdir)
+{
+    char path[PATH_MAX];
+
+    DIR *dir = opendir(tmpdir);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.' && (size_t)snprintf(path, sizeof(path), "%s/%s", tmpdir, entry->d_name) < sizeof(path)) {
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+
+
+/**
+ * Attiva la deduplicazione: crea la directory dell'archivio nella root del server (se non esiste)
+ * e ricostruisce l'indice dei chunk dai manifest salvati.
+ *
+ * @param root_directory La directory root del server.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int store_init(const char *root_directory)
+{
+    char path[PATH_MAX];
+
+    if ((size_t)snprintf(store.dir, sizeof(store.dir), "%s/%s", root_directory, STORE_DIR_NAME) >= sizeof(store.dir)) {
+        fprintf(stderr, "Errore, percorso dell'archivio troppo lungo\n");
+        return -1;
+    }
+    store.normalized = normalize_path(store.dir);
+    store.buckets = STORE_INITIAL_BUCKETS;
+    store.chunks = (store_chunk_t **)calloc(store.buckets, sizeof(store_chunk_t *));
+    if (store.normalized == NULL || store.chunks == NULL) {
+        fprintf(stderr, "Errore durante l'allocazione dell'archivio: %s\n", strerror(errno));
+        return -1;
+    }
+
+    const char *subdirs[] = { "", "/objects", "/tmp" };
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s%s", store.dir, subdirs[i]);
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+            fprintf(stderr, "Errore durante la creazione della directory '%s': %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    clean_tmp(path);
+
+    // objects contiene solo le sottodirectory di due caratteri esadecimali
+    snprintf(path, sizeof(path), "%s/objects", store.dir);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "Errore durante l'apertura della directory '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char subdir[PATH_MAX];
+        if (strlen(entry->d_name) == 2 && entry->d_name[0] != '.' &&
+            (size_t)snprintf(subdir, sizeof(subdir), "%s/%s", path, entry->d_name) < sizeof(subdir))
+        {
+            load_objects(subdir);
+        }
+    }
+    closedir(dir);
+
+    store.enabled = 1;
+    printf("SERVER: Archivio deduplicato in %s: %llu contenuti, %zu chunk\n", store.dir, store.blob_count, store.chunk_count);
+    return 0;
+}
+
+
+
+/**
+ * Indica se la deduplicazione è attiva.
+ *
+ * @return 1 se il server accetta i caricamenti con deduplicazione, 0 altrimenti.
+ */
+int store_enabled(void)
+{
+    return store.enabled;
+}
+
+
+
+/**
+ * Controlla se un percorso cade dentro l'archivio, che i client non devono poter modificare.
+ *
+ * @param path Il percorso completo.
+ * @return 1 se il percorso è l'archivio o un suo file, 0 altrimenti.
+ */
+int store_contains(const char *path)
+{
+    if (!store.enabled) {
+        return 0;
+    }
+    char *normalized = normalize_path(path);
+    if (normalized == NULL) {
+        return 1;       // nel dubbio il percorso viene rifiutato
+    }
+    size_t len = strlen(store.normalized);
+    int inside = (strncmp(normalized, store.normalized, len) == 0 && (normalized[len] == '\0' || normalized[len] == '/'));
+    free(normalized);
+    return inside;
+}
+
+
+
+/**
+ * Confronta due chunk di un manifest per hash e, a parità di hash, per posizione (qsort_r).
+ *
+ * @param a Puntatore all'indice del primo chunk.
+ * @param b Puntatore all'indice del secondo chunk.
+ * @param arg I chunk del manifest.
+ * @return Negativo, zero o positivo come strcmp.
+ */
+static int compare_chunks(const void *a, const void *b, void *arg)
+{
+    const chunk_ref_t *chunks = (const chunk_ref_t *)arg;
+    uint32_t i = *(const uint32_t *)a;
+    uint32_t j = *(const uint32_t *)b;
+
+    int cmp = memcmp(chunks[i].hash, chunks[j].hash, SHA256_DIGEST_SIZE);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (i > j) - (i < j);
+}
+
+
+
+/**
+ * Segna i chunk che compaiono più volte nel file: ogni ripetizione si copia dalla prima occorrenza,
+ * così il client invia una volta sola anche un blocco ripetuto (es. una regione di zeri).
+ *
+ * @param plan Il piano.
+ * @return 0 in caso di successo, -1 se la memoria non basta.
+ */
+static int find_repeats(store_plan_t *plan)
+{
+    const manifest_t *manifest = &plan->manifest;
+    uint32_t *order = (uint32_t *)malloc((manifest->count ? manifest->count : 1) * sizeof(uint32_t));
+    if (order == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < manifest->count; i++) {
+        order[i] = i;
+        plan->repeats[i] = UINT32_MAX;
+    }
+    qsort_r(order, manifest->count, sizeof(uint32_t), compare_chunks, manifest->chunks);
+
+    uint32_t first = manifest->count ? order[0] : 0;      // prima occorrenza del gruppo di chunk uguali
+    for (uint32_t k = 1; k < manifest->count; k++)
+    {
+        const chunk_ref_t *prev = &manifest->chunks[order[k - 1]];
+        const chunk_ref_t *cur = &manifest->chunks[order[k]];
+        if (memcmp(prev->hash, cur->hash, SHA256_DIGEST_SIZE) != 0 || prev->length != cur->length) {
+            first = order[k];
+        } else {
+            plan->repeats[order[k]] = first;
+        }
+    }
+    free(order);
+    return 0;
+}
+
+
+
+/**
+ * Decodifica il manifest di un caricamento e stabilisce quali chunk il client deve inviare: quelli
+ * che non sono né nell'archivio né già comparsi prima nello stesso file.
+ *
+ * @param manifest Il manifest ricevuto dal client.
+ * @param len I byte del manifest.
+ * @param plan Puntatore dove memorizzare il piano (da liberare con store_free_plan, anche in caso di errore).
+ * @return FT_STATUS_OK, FT_STATUS_BAD_REQUEST per un manifest non valido, FT_STATUS_NO_SPACE se il
+ *         contenuto non sta nel dispositivo dell'archivio, FT_STATUS_IO_ERROR se la memoria non basta.
+ */
+ft_status_t store_plan(const unsigned char *manifest, size_t len, store_plan_t **plan)
+{
+    char path[PATH_MAX];
+    struct stat statbuf;
+    struct statvfs vfs;
+
+    store_plan_t *p = (store_plan_t *)calloc(1, sizeof(store_plan_t));
+    *plan = p;
+    if (p == NULL) {
+        return FT_STATUS_IO_ERROR;
+    }
+    if (manifest_decode(manifest, len, &p->manifest) < 0) {
+        return errno == ENOMEM ? FT_STATUS_IO_ERROR : FT_STATUS_BAD_REQUEST;
+    }
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    manifest_id(&p->manifest, digest);
+    sha256_hex(digest, p->id);
+
+    uint32_t count = p->manifest.count;
+    p->missing_len = (count + 7) / 8;
+    p->missing = (unsigned char *)calloc(p->missing_len ? p->missing_len : 1, 1);
+    p->sources = (store_chunk_t **)calloc(count ? count : 1, sizeof(store_chunk_t *));
+    p->repeats = (uint32_t *)malloc((count ? count : 1) * sizeof(uint32_t));
+    if (p->missing == NULL || p->sources == NULL || p->repeats == NULL || find_repeats(p) < 0) {
+        return FT_STATUS_IO_ERROR;
+    }
+
+    // il contenuto intero è già nell'archivio: basta collegarlo
+    if (object_path(path, p->id, "") == 0 && stat(path, &statbuf) == 0 && (uint64_t)statbuf.st_size == p->manifest.size) {
+        p->whole = 1;
+        return FT_STATUS_OK;
+    }
+
+    pthread_mutex_lock(&store.mutex);
+    for (uint32_t i = 0; i < count; i++) {
+        if (p->repeats[i] == UINT32_MAX) {
+            p->sources[i] = index_find(p->manifest.chunks[i].hash, p->manifest.chunks[i].length);
+        }
+    }
+    pthread_mutex_unlock(&store.mutex);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (p->repeats[i] == UINT32_MAX && p->sources[i] == NULL) {
+            p->missing[i / 8] |= (unsigned char)(0x80 >> (i % 8));
+            p->missing_bytes += p->manifest.chunks[i].length;
+        }
+    }
+
+    // il nuovo contenuto occupa tutta la sua dimensione nell'archivio (meno, se il filesystem condivide i blocchi copiati)
+    if (statvfs(store.dir, &vfs) < 0) {
+        return ft_status_from_errno(errno);
+    }
+    if (p->manifest.size > (unsigned long long)vfs.f_bavail * vfs.f_frsize) {
+        LOG_WARN("Memoria piena, il contenuto annunciato è di %llu byte", (unsigned long long)p->manifest.size);
+        return FT_STATUS_NO_SPACE;
+    }
+    return FT_STATUS_OK;
+}
+
+
+
+/**
+ * Apre un file temporaneo anonimo nell'archivio dove ricevere i chunk mancanti di un caricamento.
+ *
+ * @return Il file descriptor (da chiudere dal chiamante) oppure -1 in caso di errore.
+ */
+int store_open_spool(void)
+{
+    char path[PATH_MAX];
+
+    if ((size_t)snprintf(path, sizeof(path), "%s/tmp/spool-XXXXXX", store.dir) >= sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("Errore durante la creazione del file temporaneo: %s", strerror(errno));
+        return -1;
+    }
+    unlink(path);       // il file sparisce alla chiusura
+    return fd;
+}
+
+
+
+/**
+ * Copia un intervallo da un file a un altro (o nello stesso file, senza sovrapposizioni) con
+ * copy_file_range, che sui filesystem che lo supportano condivide i blocchi invece di copiarli;
+ * altrimenti attraverso il buffer.
+ *
+ * @param in_fd Il file di origine.
+ * @param in_off La posizione dei dati nel file di origine.
+ * @param out_fd Il file di destinazione.
+ * @param out_off La posizione dei dati nel file di destinazione.
+ * @param len I byte da copiare.
+ * @param buffer Un buffer di CHUNK_MAX_SIZE byte per il percorso senza copy_file_range.
+ * @return 0 in caso di successo, -1 in caso di errore (EIO se il file di origine è più corto).
+ */
+static int copy_range(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len, unsigned char *buffer)
+{
+    int fallback = 0;
+
+    while (len > 0 && !fallback)
+    {
+        ssize_t n = copy_file_range(in_fd, &in_off, out_fd, &out_off, len, 0);
+        if (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+            fallback = 1;
+        } else if (n < 0 && errno != EINTR) {
+            return -1;
+        } else if (n == 0) {
+            errno = EIO;
+            return -1;
+        } else if (n > 0) {
+            len -= n;
+        }
+    }
+
+    while (len > 0)
+    {
+        size_t step = len < CHUNK_MAX_SIZE ? len : CHUNK_MAX_SIZE;
+        ssize_t n = pread(in_fd, buffer, step, in_off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            errno = (n == 0) ? EIO : errno;
+            return -1;
+        }
+        if (pwrite(out_fd, buffer, n, out_off) != n) {
+            return -1;
+        }
+        in_off += n;
+        out_off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Crea una copia privata di un file: un reflink (stessi blocchi su disco, copiati solo quando uno dei
+ * due viene modificato) se il filesystem lo supporta, altrimenti, se permesso, una copia dei dati.
+ *
+ * @param from Il file da copiare.
+ * @param to Il nuovo file (non deve esistere).
+ * @param reflink_only 1 per non ripiegare sulla copia dei dati.
+ * @return 1 se la copia è un reflink, 0 se è una copia dei dati, -1 in caso di errore (to non viene creato).
+ */
+static int clone_file(const char *from, const char *to, int reflink_only)
+{
+    struct stat statbuf;
+    int result = -1;
+
+    int in_fd = open(from, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        return -1;
+    }
+    int out_fd = (fstat(in_fd, &statbuf) == 0) ? open(to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, statbuf.st_mode & 07777) : -1;
+    if (out_fd < 0) {
+        close(in_fd);
+        return -1;
+    }
+
+#ifdef FICLONE
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+        result = 1;
+    }
+#endif
+    if (result < 0 && !reflink_only) {
+        unsigned char *buffer = (unsigned char *)malloc(CHUNK_MAX_SIZE);
+        if (buffer != NULL && copy_range(in_fd, 0, out_fd, 0, statbuf.st_size, buffer) == 0) {
+            result = 0;
+        }
+        free(buffer);
+    }
+
+    int saved_errno = errno;
+    close(in_fd);
+    if (close(out_fd) < 0 && result >= 0) {
+        saved_errno = errno;
+        result = -1;
+    }
+    if (result < 0) {
+        unlink(to);
+    }
+    errno = saved_errno;
+    return result;
+}
+
+
+
+/**
+ * Scrive il manifest di un contenuto accanto al contenuto, passando per un file temporaneo.
+ *
+ * @param plan Il piano del caricamento.
+ * @param tmp_path Il percorso del contenuto in costruzione (a cui si aggiunge ".chunks").
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+static int write_manifest(const store_plan_t *plan, const char *tmp_path)
+{
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    size_t len;
+
+    unsigned char *buffer = manifest_encode(&plan->manifest, &len);
+    if (buffer == NULL || object_path(path, plan->id, ".chunks") < 0 ||
+        (size_t)snprintf(tmp, sizeof(tmp), "%s.chunks", tmp_path) >= sizeof(tmp))
+    {
+        free(buffer);
+        return -1;
+    }
+
+    int result = -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        result = (write(fd, buffer, len) == (ssize_t)len) ? 0 : -1;
+        if (close(fd) < 0 || (result == 0 && rename(tmp, path) < 0)) {
+            result = -1;
+        }
+        if (result < 0) {
+            unlink(tmp);
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+
+
+/**
+ * Costruisce un nuovo contenuto dell'archivio: i chunk già presenti vengono copiati dai contenuti che
+ * li contengono (o dalla loro prima occorrenza nel file), quelli ricevuti vengono letti dal file
+ * temporaneo e verificati con il loro SHA-256. Il contenuto entra nell'archivio solo se è completo.
+ *
+ * @param plan Il piano del caricamento.
+ * @param spool_fd Il file con i chunk ricevuti, nell'ordine del file.
+ * @return FT_STATUS_OK in caso di successo, FT_STATUS_BAD_REQUEST se un chunk ricevuto non corrisponde
+ *         al manifest, altrimenti l'esito dell'errore.
+ */
+static ft_status_t store_assemble(const store_plan_t *plan, int spool_fd)
+{
+    char tmp[PATH_MAX];
+    char path[PATH_MAX];
+    char subdir[PATH_MAX];
+    struct stat statbuf;
+    ft_status_t status = FT_STATUS_OK;
+    const manifest_t *manifest = &plan->manifest;
+
+    unsigned char *buffer = (unsigned char *)malloc(CHUNK_MAX_SIZE);
+    uint64_t *offsets = (uint64_t *)malloc((manifest->count ? manifest->count : 1) * sizeof(uint64_t));
+    int fd = -1;
+    if (buffer == NULL || offsets == NULL ||
+        (size_t)snprintf(tmp, sizeof(tmp), "%s/tmp/%s.XXXXXX", store.dir, plan->id) >= sizeof(tmp) ||
+        (fd = mkostemp(tmp, O_CLOEXEC)) < 0 || fchmod(fd, 0644) < 0)
+    {
+        LOG_ERROR("Errore durante la creazione del file temporaneo: %s", strerror(errno));
+        free(buffer);
+        free(offsets);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        return FT_STATUS_IO_ERROR;
+    }
+
+    store_blob_t *blob = NULL;      // contenuto aperto in blob_fd
+    int blob_fd = -1;
+    uint64_t offset = 0;
+    off_t spool_off = 0;
+
+    for (uint32_t i = 0; i < manifest->count && status == FT_STATUS_OK; i++)
+    {
+        const chunk_ref_t *ref = &manifest->chunks[i];
+        store_chunk_t *source = plan->sources[i];
+        int result;
+        offsets[i] = offset;
+
+        if (plan->repeats[i] != UINT32_MAX) {
+            result = copy_range(fd, (off_t)offsets[plan->repeats[i]], fd, (off_t)offset, ref->length, buffer);
+        } else if (source != NULL) {
+            if (source->blob != blob) {
+                if (blob_fd >= 0) {
+                    close(blob_fd);
+                }
+                blob = source->blob;
+                blob_fd = open(blob->path, O_RDONLY | O_CLOEXEC);
+            }
+            result = (blob_fd >= 0) ? copy_range(blob_fd, (off_t)source->offset, fd, (off_t)offset, ref->length, buffer) : -1;
+        } else {
+            unsigned char digest[SHA256_DIGEST_SIZE];
+            ssize_t n = pread(spool_fd, buffer, ref->length, spool_off);
+            if (n != (ssize_t)ref->length) {
+                result = -1;
+                errno = (n < 0) ? errno : EIO;
+            } else {
+                sha256(buffer, ref->length, digest);
+                if (memcmp(digest, ref->hash, SHA256_DIGEST_SIZE) != 0) {
+                    LOG_ERROR("Errore, il chunk %u ricevuto non corrisponde al manifest", i);
+                    status = FT_STATUS_BAD_REQUEST;
+                    break;
+                }
+                result = (pwrite(fd, buffer, ref->length, (off_t)offset) == (ssize_t)ref->length) ? 0 : -1;
+            }
+            spool_off += ref->length;
+        }
+
+        if (result < 0) {
+            LOG_ERROR("Errore durante la costruzione del contenuto %s: %s", plan->id, strerror(errno));
+            status = ft_status_from_errno(errno);
+        }
+        offset += ref->length;
+    }
+    if (blob_fd >= 0) {
+        close(blob_fd);
+    }
+    free(buffer);
+    free(offsets);
+
+    if (close(fd) < 0 && status == FT_STATUS_OK) {
+        LOG_ERROR("Errore durante la chiusura del file: %s", strerror(errno));
+        status = ft_status_from_errno(errno);
+    }
+
+    // prima il manifest, poi il contenuto: all'avvio si registrano solo i contenuti con il loro manifest
+    if (status == FT_STATUS_OK)
+    {
+        snprintf(subdir, sizeof(subdir), "%s/objects/%.2s", store.dir, plan->id);
+        if ((mkdir(subdir, 0755) < 0 && errno != EEXIST) || object_path(path, plan->id, "") < 0 || write_manifest(plan, tmp) < 0) {
+            LOG_ERROR("Errore durante il salvataggio del manifest di %s: %s", plan->id, strerror(errno));
+            status = ft_status_from_errno(errno);
+        }
+        // un caricamento concorrente dello stesso contenuto può averlo già aggiunto
+        else if (link(tmp, path) == 0 && stat(path, &statbuf) == 0) {
+            pthread_mutex_lock(&store.mutex);
+            index_add(plan->id, path, &statbuf, manifest);
+            pthread_mutex_unlock(&store.mutex);
+        }
+        else if (errno != EEXIST) {
+            LOG_ERROR("Errore durante l'aggiunta del contenuto %s all'archivio: %s", plan->id, strerror(errno));
+            status = ft_status_from_errno(errno);
+        }
+    }
+    unlink(tmp);
+    return status;
+}
+
+
+
+/**
+ * Restituisce un nome temporaneo accanto a un percorso, da rinominare poi atomicamente sul percorso.
+ *
+ * @param tmp Il buffer di PATH_MAX byte dove scrivere il nome.
+ * @param path Il percorso.
+ * @return 0 in caso di successo, -1 se il nome è troppo lungo.
+ */
+static int sibling_tmp(char *tmp, const char *path)
+{
+    unsigned int sequence = __atomic_fetch_add(&store.sequence, 1, __ATOMIC_RELAXED);
+
+    if ((size_t)snprintf(tmp, PATH_MAX, "%s.myft-%d-%u", path, (int)getpid(), sequence) >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Fa comparire un contenuto dell'archivio nel percorso richiesto: reflink se il filesystem lo supporta,
+ * altrimenti hardlink, altrimenti (altro filesystem o troppi collegamenti) una copia. Il nuovo file
+ * sostituisce atomicamente quello esistente.
+ *
+ * @param plan Il piano del caricamento.
+ * @param fullpath Il percorso completo richiesto dal client.
+ * @return FT_STATUS_OK in caso di successo, altrimenti l'esito dell'errore.
+ */
+static ft_status_t store_link(const store_plan_t *plan, const char *fullpath)
+{
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    struct stat blob_stat, target_stat;
+    const char *method = "reflink";
+
+    if (object_path(path, plan->id, "") < 0 || stat(path, &blob_stat) < 0 || sibling_tmp(tmp, fullpath) < 0) {
+        LOG_ERROR("Errore, contenuto %s non disponibile: %s", plan->id, strerror(errno));
+        return ft_status_from_errno(errno);
+    }
+
+    // il percorso è già un collegamento a questo contenuto (rename tra due nomi dello stesso inode non fa nulla)
+    if (stat(fullpath, &target_stat) == 0 && target_stat.st_dev == blob_stat.st_dev && target_stat.st_ino == blob_stat.st_ino) {
+        LOG_INFO("%s è già il contenuto %.16s", fullpath, plan->id);
+        return FT_STATUS_OK;
+    }
+
+    int result = clone_file(path, tmp, 1);
+    if (result < 0) {
+        method = "hardlink";
+        result = link(path, tmp);
+    }
+    if (result < 0 && errno != ENOENT && errno != EACCES && errno != ENOSPC) {
+        method = "copia";
+        result = clone_file(path, tmp, 0);
+    }
+    if (result < 0 || rename(tmp, fullpath) < 0) {
+        int saved_errno = errno;
+        LOG_ERROR("Errore durante il collegamento di '%s' all'archivio: %s", fullpath, strerror(saved_errno));
+        unlink(tmp);
+        return ft_status_from_errno(saved_errno);
+    }
+    LOG_INFO("%s -> contenuto %.16s (%s)", fullpath, plan->id, method);
+    return FT_STATUS_OK;
+}
+
+
+
+/**
+ * Conclude un caricamento con deduplicazione: costruisce il contenuto (se non è già nell'archivio)
+ * e lo collega al percorso richiesto.
+ *
+ * @param plan Il piano del caricamento.
+ * @param spool_fd Il file con i chunk ricevuti (ignorato se il contenuto era già nell'archivio).
+ * @param fullpath Il percorso completo richiesto dal client.
+ * @return FT_STATUS_OK in caso di successo, altrimenti l'esito dell'errore.
+ */
+ft_status_t store_commit(store_plan_t *plan, int spool_fd, const char *fullpath)
+{
+    ft_status_t status = plan->whole ? FT_STATUS_OK : store_assemble(plan, spool_fd);
+
+    if (status == FT_STATUS_OK) {
+        status = store_link(plan, fullpath);
+    }
+    if (status == FT_STATUS_OK) {
+        unsigned long long received = plan->whole ? 0 : plan->missing_bytes;
+        pthread_mutex_lock(&store.mutex);
+        store.saved += plan->manifest.size - received;
+        store.received += received;
+        unsigned long long total = store.saved;
+        pthread_mutex_unlock(&store.mutex);
+        LOG_INFO("Deduplicazione: ricevuti %llu byte su %llu (%llu risparmiati, %llu in totale)",
+                 received, (unsigned long long)plan->manifest.size, (unsigned long long)plan->manifest.size - received, total);
+    }
+    return status;
+}
+
+
+
+/**
+ * Libera un piano.
+ *
+ * @param plan Il piano (NULL è ignorato).
+ */
+void store_free_plan(store_plan_t *plan)
+{
+    if (plan == NULL) {
+        return;
+    }
+    manifest_free(&plan->manifest);
+    free(plan->missing);
+    free(plan->sources);
+    free(plan->repeats);
+    free(plan);
+}
+
+
+
+/**
+ * Separa un file dall'archivio prima che il server lo scriva: se il percorso è un hardlink a un contenuto,
+ * scriverlo modificherebbe il contenuto e tutti gli altri file collegati. Una scrittura che sostituisce il
+ * file rimuove solo il collegamento; una che ne modifica una parte (intervallo) lavora su una copia privata.
+ *
+ * @param path Il percorso completo che sta per essere scritto.
+ * @param keep 1 se il contenuto attuale del file va conservato (scrittura di un intervallo).
+ * @return 0 in caso di successo (o se il file non è collegato all'archivio), -1 in caso di errore.
+ */
+int store_unshare(const char *path, int keep)
+{
+    char tmp[PATH_MAX];
+    struct stat statbuf;
+    int result = 0;
+
+    if (!store.enabled || lstat(path, &statbuf) < 0 || !S_ISREG(statbuf.st_mode) || statbuf.st_nlink < 2) {
+        return 0;
+    }
+
+    // il controllo si ripete con il mutex: le scritture di un intervallo condividono il lock sul percorso
+    pthread_mutex_lock(&store.mutex);
+    if (lstat(path, &statbuf) == 0 && blob_by_inode(&statbuf) != NULL)
+    {
+        if (!keep) {
+            result = (unlink(path) < 0 && errno != ENOENT) ? -1 : 0;
+        } else if (sibling_tmp(tmp, path) < 0 || clone_file(path, tmp, 0) < 0) {
+            result = -1;
+        } else if (rename(tmp, path) < 0) {
+            result = -1;
+            unlink(tmp);
+        }
+        if (result == 0) {
+            LOG_INFO("%s separato dall'archivio prima della scrittura", path);
+        }
+    }
+    pthread_mutex_unlock(&store.mutex);
+
+    if (result < 0) {
+        LOG_ERROR("Errore durante la separazione di '%s' dall'archivio: %s", path, strerror(errno));
+    }
+    return result;
+}
+
+
+
+/**
+ * Legge i contatori della deduplicazione.
+ *
+ * @param saved Puntatore dove memorizzare i byte che non è stato necessario ricevere.
+ * @param received Puntatore dove memorizzare i byte ricevuti dai caricamenti con deduplicazione.
+ */
+void store_stats(unsigned long long *saved, unsigned long long *received)
+{
+    pthread_mutex_lock(&store.mutex);
+    *saved = store.saved;
+    *received = store.received;
+    pthread_mutex_unlock(&store.mutex);
+}
@@ -0,0 +1,68 @@
+#ifndef MY_FT_STORE_H
+#define MY_FT_STORE_H
+
+#include <stdint.h>         // per i tipi a dimensione fissa
+#include <sys/types.h>      // per dev_t e ino_t
+#include "myFTchunk.h"      // manifest e hash dei chunk
+#include "myFTprotocol.h"   // per ft_status_t
+
+// Archivio dei contenuti caricati con deduplicazione ('d'), nella directory STORE_DIR_NAME della root:
+//
+//   objects/ab/<id>           contenuto del file, nominato dall'identità del manifest (id in esadecimale)
+//   objects/ab/<id>.chunks    manifest del contenuto, da cui si ricostruisce l'indice dei chunk all'avvio
+//   tmp/                      file in costruzione e dati ricevuti in attesa di verifica
+//
+// Il percorso richiesto diventa un reflink (se il filesystem lo supporta) o un hardlink del contenuto.
+// I contenuti non vengono mai rimossi dall'archivio.
+
+#define STORE_DIR_NAME ".myft-store"            // directory dell'archivio nella root del server
+#define STORE_INITIAL_BUCKETS 4096              // bucket iniziali dell'indice dei chunk (raddoppiano secondo necessità)
+#define STORE_BLOB_BUCKETS 4096                 // bucket della tabella dei contenuti per inode
+
+
+// Un contenuto dell'archivio. Una volta registrato non viene più liberato.
+typedef struct store_blob
+{
+    char id[SHA256_HEX_SIZE];           // identità del contenuto in esadecimale
+    char *path;                         // percorso del file del contenuto
+    dev_t dev;                          // dispositivo e inode del file del contenuto
+    ino_t ino;
+    struct store_blob *next;            // contenuto successivo nella catena del bucket (per inode)
+} store_blob_t;
+
+
+// Un chunk dell'indice: dove si trova nell'archivio un contenuto con un certo hash
+typedef struct store_chunk
+{
+    unsigned char hash[SHA256_DIGEST_SIZE];
+    store_blob_t *blob;                 // contenuto che contiene il chunk
+    uint64_t offset;                    // posizione del chunk nel contenuto
+    uint32_t length;                    // byte del chunk
+    struct store_chunk *next;           // chunk successivo nella catena del bucket
+} store_chunk_t;
+
+
+// Piano di un caricamento: quali chunk del manifest mancano all'archivio e da dove copiare gli altri
+typedef struct
+{
+    manifest_t manifest;                        // manifest ricevuto dal client
+    char id[SHA256_HEX_SIZE];                   // identità del contenuto in esadecimale
+    int whole;                                  // 1 se il contenuto è già nell'archivio: non si riceve nulla
+    unsigned char *missing;                     // bitmap dei chunk da ricevere (bit 7 del byte 0 = primo chunk)
+    size_t missing_len;                         // byte della bitmap
+    unsigned long long missing_bytes;           // byte da ricevere (i chunk della bitmap, nell'ordine del file)
+    store_chunk_t **sources;                    // per ogni chunk presente nell'archivio la sua posizione, altrimenti NULL
+    uint32_t *repeats;                          // per ogni chunk ripetuto nel file la sua prima occorrenza, altrimenti UINT32_MAX
+} store_plan_t;
+
+int store_init(const char *root_directory);
+int store_enabled(void);
+int store_contains(const char *path);
+ft_status_t store_plan(const unsigned char *manifest, size_t len, store_plan_t **plan);
+int store_open_spool(void);
+ft_status_t store_commit(store_plan_t *plan, int spool_fd, const char *fullpath);
+void store_free_plan(store_plan_t *plan);
+int store_unshare(const char *path, int keep);
+void store_stats(unsigned long long *saved, unsigned long long *received);
+
+#endif // MY_FT_STORE_H
@@ -0,0 +1,238 @@
+// TRASFERIMENTO DI UN FILE SU PIÙ FLUSSI PARALLELI
+
+#include "myFTstream.h"
+
+
+
+/**
+ * Trasferisce una parte del file su una connessione dedicata: in scrittura invia i byte della parte, che il
+ * server scrive dalla loro posizione in un file già della dimensione finale; in lettura riceve l'intervallo
+ * e lo scrive dalla stessa posizione nel file locale. Ogni parte usa il proprio file descriptor, così le
+ * posizioni nel file delle diverse connessioni sono indipendenti.
+ *
+ * @param part - La parte da trasferire (part->result riporta l'esito).
+ * @return 0 se la parte è stata trasferita, -1 in caso di errore.
+ */
+int transfer_part(stream_part_t *part)
+{
+    transfer_stats_t stats;
+    ft_header_t response;
+    int sock = -1;
+    int result = -1;
+
+    int file_fd = open(part->local_path, part->opz == 'w' ? O_RDONLY : O_WRONLY);
+    if (file_fd < 0 || lseek(file_fd, (off_t)part->offset, SEEK_SET) < 0) {
+        fprintf(stderr, "Errore durante l' apertura del file: %s\n", strerror(errno));
+        goto out;
+    }
+
+    sock = connect_server(part->server_address, part->port);
+    if (sock < 0) {
+        goto out;
+    }
+
+    if (part->opz == 'w')
+    {
+        if (ft_send_range_request(sock, 'w', FT_FLAG_RANGE, part->remote_path, part->length, part->offset, part->total) < 0) {
+            fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+            goto out;
+        }
+        if (recv_response(sock, &response) < 0 || response.status != FT_STATUS_CONTINUE) {
+            goto out;
+        }
+        if (send_file(file_fd, sock, (long long)part->length, client_transfer_mode, &stats, NULL) < 0) {
+            fprintf(stderr, "Errore durante l' invio dei dati del file al server: %s\n", strerror(errno));
+        }
+        // anche se l'invio è fallito il server potrebbe aver inviato il motivo (es. spazio esaurito)
+        if (recv_response(sock, &response) < 0 || stats.bytes < part->length) {
+            goto out;
+        }
+    }
+    else
+    {
+        if (ft_send_range_request(sock, 'r', FT_FLAG_RANGE, part->remote_path, 0, part->offset, part->length) < 0) {
+            fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+            goto out;
+        }
+        if (recv_response(sock, &response) < 0) {
+            goto out;
+        }
+        // un intervallo più corto significa che il file è cambiato dopo la richiesta della sua dimensione
+        if (response.payload_len != part->length) {
+            fprintf(stderr, "Errore, il file '%s' è cambiato durante la lettura\n", part->remote_path);
+            goto out;
+        }
+        if (recv_file(sock, file_fd, (long long)part->length, part->max_bytes, client_transfer_mode, &stats, NULL) < 0) {
+            fprintf(stderr, "Errore durante la ricezione dei dati: %s\n", strerror(errno));
+            goto out;
+        }
+    }
+    result = 0;
+
+out:
+    if (sock >= 0) {
+        close(sock);
+    }
+    if (file_fd >= 0) {
+        close(file_fd);
+    }
+    part->result = result;
+    return result;
+}
+
+
+
+/**
+ * Thread che trasferisce una parte del file.
+ *
+ * @param arg - La parte (stream_part_t*).
+ * @return NULL al termine del trasferimento.
+ */
+static void *stream_worker(void *arg)
+{
+    transfer_part((stream_part_t *)arg);
+    return NULL;
+}
+
+
+
+/**
+ * Prepara il file locale di una lettura su più flussi: crea la directory, controlla lo spazio e porta il
+ * file alla dimensione finale, così ogni connessione scrive la propria parte al suo posto.
+ *
+ * @param local_path - Il file locale.
+ * @param total - La dimensione del file remoto.
+ * @param max_bytes - Puntatore dove memorizzare i byte disponibili sul dispositivo.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+static int prepare_local_file(const char *local_path, unsigned long long total, unsigned long long *max_bytes)
+{
+    if (!create_dir(local_path)) {
+        return -1;
+    }
+
+    int file_fd = open(local_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_fd < 0) {
+        fprintf(stderr, "Errore apertura file: %s\n", strerror(errno));
+        return -1;
+    }
+
+    *max_bytes = available_bytes(local_path);
+    if (total > *max_bytes) {
+        fprintf(stderr, "Memoria piena: il file è di %llu byte\n", total);
+        close(file_fd);
+        return -1;
+    }
+    if (ftruncate(file_fd, (off_t)total) < 0) {
+        fprintf(stderr, "Errore durante il ridimensionamento del file: %s\n", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    close(file_fd);
+    return 0;
+}
+
+
+
+/**
+ * Trasferisce un singolo file dividendolo in parti contigue, ciascuna su una propria connessione e un
+ * proprio thread. Con un solo flusso TCP il trasferimento è limitato dalla finestra di congestione e da un
+ * solo core che copia i dati; più flussi in parallelo sommano le finestre e distribuiscono il lavoro.
+ * Le parti sono allineate a STREAM_PART_ALIGN e non più piccole di STREAM_MIN_PART (un file piccolo usa
+ * meno flussi). Al termine stampa byte, tempo e throughput.
+ *
+ * @param server_address - L'indirizzo del server.
+ * @param port - La porta del server.
+ * @param opz - L'operazione ('w' per inviare il file locale, 'r' per ricevere quello remoto).
+ * @param local_path - Il file locale.
+ * @param remote_path - Il file sul server.
+ * @param streams - Il numero di flussi richiesto.
+ * @return 0 se tutte le parti sono state trasferite, -1 altrimenti.
+ */
+int run_streams(const char *server_address, int port, char opz, const char *local_path, const char *remote_path, int streams)
+{
+    struct timespec start, end;
+    struct stat statbuf;
+    unsigned long long total = 0;
+    unsigned long long max_bytes = 0;
+    stream_part_t parts[STREAM_MAX];
+    pthread_t threads[STREAM_MAX];
+    int started[STREAM_MAX] = {0};
+    int failed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // dimensione del file: locale per le scritture, chiesta al server per le letture
+    if (opz == 'w') {
+        if (stat(local_path, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+            fprintf(stderr, "Errore, il percorso '%s' non è un file regolare\n", local_path);
+            return -1;
+        }
+        total = statbuf.st_size;
+    } else {
+        int sock = connect_server(server_address, port);
+        if (sock < 0) {
+            return -1;
+        }
+        int info = request_info(sock, remote_path, 0, &total, NULL, NULL);
+        close(sock);
+        if (info == 1) {
+            fprintf(stderr, "Errore dal server: %s\n", ft_status_message(FT_STATUS_NOT_FOUND));
+        }
+        if (info != 0 || prepare_local_file(local_path, total, &max_bytes) < 0) {
+            return -1;
+        }
+    }
+
+    // parti di uguale dimensione, arrotondate all'allineamento; l'ultima prende il resto
+    unsigned long long wanted = total / STREAM_MIN_PART;
+    if (wanted < (unsigned long long)streams) {
+        streams = wanted > 0 ? (int)wanted : 1;
+    }
+    unsigned long long part_size = (total + streams - 1) / streams;
+    part_size = (part_size + STREAM_PART_ALIGN - 1) / STREAM_PART_ALIGN * STREAM_PART_ALIGN;
+    if (part_size == 0) {
+        part_size = STREAM_PART_ALIGN;
+    }
+
+    int count = 0;
+    for (unsigned long long offset = 0; count == 0 || offset < total; offset += part_size, count++)
+    {
+        stream_part_t *part = &parts[count];
+        part->server_address = server_address;
+        part->port = port;
+        part->opz = opz;
+        part->local_path = local_path;
+        part->remote_path = remote_path;
+        part->offset = offset;
+        part->length = (total - offset < part_size) ? total - offset : part_size;
+        part->total = total;
+        part->max_bytes = max_bytes;
+        part->result = -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, stream_worker, &parts[i]) == 0);
+        if (!started[i]) {
+            fprintf(stderr, "Errore durante la creazione del thread del flusso %d\n", i);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        if (parts[i].result < 0) {
+            failed++;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (failed > 0) {
+        fprintf(stderr, "Errore, %d parti su %d non sono state trasferite\n", failed, count);
+        return -1;
+    }
+    printf("CLIENT: %llu byte trasferiti in %.3f s su %d flussi: %.1f MB/s\n", total, elapsed, count, elapsed > 0 ? total / elapsed / 1048576 : 0.0);
+    return 0;
+}
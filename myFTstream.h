@@ -0,0 +1,30 @@
+#ifndef MY_FT_STREAM_H
+#define MY_FT_STREAM_H
+
+#include <time.h>               // per clock_gettime
+#include "myFTclient.h"
+
+#define STREAM_MAX 16                   // flussi al massimo per un singolo file (opzione -S)
+#define STREAM_MIN_PART (4 << 20)       // byte minimi di una parte: i file più piccoli usano meno flussi
+#define STREAM_PART_ALIGN (1 << 20)     // le parti iniziano su multipli di questa dimensione
+
+
+// Una parte di un file trasferita su una propria connessione
+typedef struct
+{
+    const char *server_address; // indirizzo del server
+    int port;                   // porta del server
+    char opz;                   // operazione ('w' o 'r')
+    const char *local_path;     // file locale da inviare o in cui scrivere
+    const char *remote_path;    // file sul server
+    unsigned long long offset;  // posizione del primo byte della parte
+    unsigned long long length;  // byte della parte
+    unsigned long long total;   // dimensione del file
+    unsigned long long max_bytes;   // byte disponibili sul dispositivo locale (letture)
+    int result;                 // 0 se la parte è stata trasferita, -1 altrimenti
+} stream_part_t;
+
+int transfer_part(stream_part_t *part);
+int run_streams(const char *server_address, int port, char opz, const char *local_path, const char *remote_path, int streams);
+
+#endif // MY_FT_STREAM_H
@@ -0,0 +1,172 @@
+// AGGIORNAMENTO DEI FILE CON IL SOLO DELTA
+
+#include "myFTsync.h"
+
+
+
+/**
+ * Aggiorna un file sul server inviando solo le differenze. Il client chiede la firma della versione del
+ * server ('i' con FT_FLAG_DELTA), riconosce nel file locale i blocchi che il server ha già (anche spostati)
+ * e invia il delta: istruzioni di copia e i soli byte nuovi. Il server ricostruisce il file accanto
+ * all'originale e lo sostituisce atomicamente. Se il file non esiste sul server viene inviato per intero.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param from_path - Il percorso del file locale da inviare.
+ * @param destination_path - Il percorso remoto del file da aggiornare.
+ * @return 0 se il server ha salvato il file, -1 in caso di errore.
+ */
+int request_delta_write(int client_sock, const char *from_path, const char *destination_path)
+{
+    struct stat statbuf;
+    ft_header_t response;
+    delta_signature_t sig;
+    delta_t delta;
+    unsigned char *buffer = NULL;
+    int result = -1;
+
+    int file_fd = open(from_path, O_RDONLY);
+    if (file_fd < 0) {
+        fprintf(stderr, "Errore durante l' apertura del file: %s\n", strerror(errno));
+        return -1;
+    }
+    if (fstat(file_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+        fprintf(stderr, "Errore, l'aggiornamento con delta richiede un file regolare: '%s'\n", from_path);
+        close(file_fd);
+        return -1;
+    }
+
+    // firma della versione del server: la stessa connessione resta aperta per la scrittura
+    if (ft_send_request(client_sock, 'i', FT_FLAG_KEEP_ALIVE | FT_FLAG_DELTA, destination_path, 0) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    if (ft_recv_header(client_sock, &response) < 0) {
+        fprintf(stderr, "Errore nella ricezione della risposta del server: %s\n", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    if (response.status == FT_STATUS_NOT_FOUND) {
+        printf("CLIENT: '%s' non esiste sul server, invio dell'intero file\n", destination_path);
+        close(file_fd);
+        return request_write(client_sock, from_path, destination_path);
+    }
+    if (response.status != FT_STATUS_OK) {
+        fprintf(stderr, "Errore dal server: %s\n", ft_status_message(response.status));
+        close(file_fd);
+        return -1;
+    }
+
+    uint64_t length = response.payload_len;
+    if (length < FT_INFO_SIZE || length > FT_INFO_SIZE + SIGNATURE_MAX_SIZE || (buffer = (unsigned char *)malloc(length)) == NULL ||
+        recv_all(client_sock, buffer, length) < 0 || delta_signature_decode(buffer + FT_INFO_SIZE, length - FT_INFO_SIZE, &sig) < 0) {
+        fprintf(stderr, "Errore nella ricezione della firma del file '%s'\n", destination_path);
+        free(buffer);
+        close(file_fd);
+        return -1;
+    }
+    free(buffer);
+
+    int computed = delta_compute(file_fd, &sig, &delta);
+    delta_signature_free(&sig);
+    if (computed < 0) {
+        fprintf(stderr, "Errore durante il calcolo delle differenze: %s\n", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    uint64_t size = delta_encoded_size(&delta);
+    printf("CLIENT: %llu byte nuovi su %llu, delta di %llu byte\n", (unsigned long long)delta.literal_bytes, (unsigned long long)delta.size, (unsigned long long)size);
+
+    if (ft_send_request(client_sock, 'w', FT_FLAG_DELTA, destination_path, size) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        goto out;
+    }
+    printf("CLIENT: Richiesta di aggiornamento di '%s' inviata al server\n", destination_path);
+
+    // attende il via libera (FT_STATUS_CONTINUE) o l'errore, ad esempio spazio insufficiente
+    if (recv_response(client_sock, &response) < 0 || response.status != FT_STATUS_CONTINUE) {
+        goto out;
+    }
+
+    int sent = delta_send(client_sock, file_fd, &delta);
+    if (sent < 0) {
+        fprintf(stderr, "Errore durante l' invio del delta al server: %s\n", strerror(errno));
+    }
+
+    // anche se l'invio è fallito il server potrebbe aver inviato il motivo (es. file cambiato dopo la firma)
+    if (recv_response(client_sock, &response) < 0 || sent < 0) {
+        goto out;
+    }
+    printf("CLIENT: Il server ha aggiornato il file\n");
+    result = 0;
+
+out:
+    delta_free(&delta);
+    close(file_fd);
+    return result;
+}
+
+
+
+/**
+ * Aggiorna un file locale ricevendo solo le differenze. Il client invia la firma della propria copia
+ * insieme alla richiesta di lettura ('r' con FT_FLAG_DELTA) e il server risponde con il delta, che viene
+ * applicato in un file temporaneo accanto alla copia locale e la sostituisce atomicamente. Se il file
+ * locale non esiste viene ricevuto per intero.
+ *
+ * @param client_sock - Il socket connesso al server.
+ * @param remote_path - Il percorso remoto del file da leggere.
+ * @param destination_path - Il percorso del file locale da aggiornare.
+ * @return 0 se il file è stato aggiornato, -1 in caso di errore.
+ */
+int request_delta_read(int client_sock, const char *remote_path, const char *destination_path)
+{
+    struct stat statbuf;
+    ft_header_t response;
+    delta_signature_t sig;
+    size_t len;
+
+    if (stat(destination_path, &statbuf) < 0 && errno == ENOENT) {
+        printf("CLIENT: '%s' non esiste in locale, ricezione dell'intero file\n", destination_path);
+        return request_read(client_sock, remote_path, destination_path);
+    }
+
+    int file_fd = open(destination_path, O_RDONLY);
+    if (file_fd < 0) {
+        fprintf(stderr, "Errore durante l' apertura del file: %s\n", strerror(errno));
+        return -1;
+    }
+    int built = delta_signature_build(file_fd, &sig);
+    close(file_fd);
+    if (built < 0) {
+        fprintf(stderr, "Errore durante il calcolo della firma di '%s': %s\n", destination_path, strerror(errno));
+        return -1;
+    }
+    unsigned char *encoded = delta_signature_encode(&sig, &len);
+    delta_signature_free(&sig);
+    if (encoded == NULL) {
+        fprintf(stderr, "Errore nel allocazione della memoria: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // la firma segue subito la richiesta, senza attendere il via libera
+    if (ft_send_request(client_sock, 'r', FT_FLAG_DELTA, remote_path, len) < 0 || send_all(client_sock, encoded, len, 0) < 0) {
+        fprintf(stderr, "Errore durante l' invio della richiesta al server: %s\n", strerror(errno));
+        free(encoded);
+        return -1;
+    }
+    free(encoded);
+    printf("CLIENT: Richiesta delle differenze di '%s' inviata al server (firma di %zu byte)\n", remote_path, len);
+
+    if (recv_response(client_sock, &response) < 0) {
+        return -1;
+    }
+    printf("CLIENT: Il server invia un delta di %llu byte\n", (unsigned long long)response.payload_len);
+
+    if (delta_patch(destination_path, client_sock, response.payload_len) < 0) {
+        fprintf(stderr, "Errore durante l'applicazione del delta a '%s': %s\n", destination_path, strerror(errno));
+        return -1;
+    }
+    printf("CLIENT: File aggiornato -> %s\n", destination_path);
+    return 0;
+}
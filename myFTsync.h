@@ -0,0 +1,11 @@
+#ifndef MY_FT_SYNC_H
+#define MY_FT_SYNC_H
+
+#include "myFTclient.h"
+#include "myFTdelta.h"          // firma e delta dei file
+
+
+int request_delta_write(int client_sock, const char *from_path, const char *destination_path);
+int request_delta_read(int client_sock, const char *remote_path, const char *destination_path);
+
+#endif // MY_FT_SYNC_H
@@ -0,0 +1,1334 @@
+// TRASFERIMENTO DATI
+
+#define _GNU_SOURCE         // necessaria per le estensioni Linux (sendfile, splice, fallocate)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>        // per la chiave dei pool di buffer di ogni thread
+#include <sys/socket.h>
+#include <fcntl.h>          // per splice(), fallocate() e F_SETPIPE_SZ
+#include <sys/sendfile.h>   // per sendfile()
+#include "myFTtransfer.h"
+#include "myFTchecksum.h"   // CRC32C dei dati trasferiti
+#include "myFTuring.h"      // percorso dati con io_uring
+
+
+
+// stato della preallocazione dello spazio su disco durante una ricezione
+typedef struct
+{
+    long long length;           // dimensione annunciata del file (-1 se non nota)
+    unsigned long long max_bytes;   // byte disponibili sul dispositivo (limite alla ricezione)
+    off_t base;                 // posizione nel file del primo byte ricevuto (scritture di un intervallo)
+    off_t allocated;            // byte già preallocati
+    off_t step;                 // prossimo passo di preallocazione speculativa
+} prealloc_t;
+
+// buffer liberi di un thread, riusati dai trasferimenti successivi dello stesso thread
+typedef struct
+{
+    void *free[TRANSFER_POOL_BUFFERS];
+    int count;
+} buffer_pool_t;
+
+// anello di buffer tra il thread che legge (o riceve) e quello che invia (o scrive) nella modalità pipeline
+typedef struct
+{
+    char *buffers[TRANSFER_PIPELINE_DEPTH];
+    size_t lens[TRANSFER_PIPELINE_DEPTH];   // byte validi in ogni buffer pieno
+    int head;                   // primo buffer pieno
+    int count;                  // buffer pieni
+    int done;                   // 1 quando il produttore ha finito
+    int error;                  // errno del primo errore del produttore o del consumatore (0 se nessuno)
+    int aborted;                // 1 se il consumatore ha smesso di prendere buffer
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    int fd;                     // file letto (invio) o scritto (ricezione) dal thread ausiliario
+    long long length;           // totale di byte da raggiungere (-1 fino alla fine del file)
+    unsigned long long start;   // byte già trasferiti all'avvio
+    uint32_t crc;               // CRC32C aggiornato dal thread ausiliario
+    uint32_t *want_crc;         // NULL se il CRC non serve
+    unsigned long long syscalls;    // chiamate di sistema del thread ausiliario
+} transfer_ring_t;
+
+static size_t chunk_size = TRANSFER_CHUNK_DEFAULT;     // byte letti o ricevuti a ogni passo del percorso bufferizzato
+static int chunk_size_set = 0;                          // 1 se la dimensione è stata scelta con -b
+static pthread_key_t pool_key;                          // pool di buffer del thread corrente
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static transfer_pace_t pace_hook = NULL;                 // limiti di banda sui dati inviati (NULL se nessuno)
+
+static size_t next_chunk(long long length, unsigned long long received, size_t chunk);
+
+
+
+/**
+ * Converte il nome di una modalità di trasferimento nel valore corrispondente.
+ *
+ * @param str Il nome della modalità ("buffered", "zerocopy", "pipeline" o, se compilato con liburing, "uring").
+ * @param mode Puntatore dove memorizzare la modalità.
+ * @return 1 se il nome è valido, 0 altrimenti.
+ */
+int parse_transfer_mode(const char *str, transfer_mode_t *mode)
+{
+    if (strcmp(str, "buffered") == 0) {
+        *mode = TRANSFER_BUFFERED;
+    } else if (strcmp(str, "zerocopy") == 0) {
+        *mode = TRANSFER_ZEROCOPY;
+    } else if (strcmp(str, "pipeline") == 0) {
+        *mode = TRANSFER_PIPELINE;
+#ifdef HAVE_LIBURING
+    } else if (strcmp(str, "uring") == 0) {
+        *mode = TRANSFER_URING;
+#endif
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+
+
+/**
+ * Restituisce il nome leggibile di una modalità di trasferimento.
+ *
+ * @param mode La modalità.
+ * @return Il nome della modalità.
+ */
+const char* transfer_mode_name(transfer_mode_t mode)
+{
+    switch (mode)
+    {
+        case TRANSFER_ZEROCOPY:
+            return "zerocopy";
+        case TRANSFER_URING:
+            return "uring";
+        case TRANSFER_PIPELINE:
+            return "pipeline";
+        default:
+            return "buffered";
+    }
+}
+
+
+
+/**
+ * Restituisce il nome del percorso effettivamente seguito dai dati di un trasferimento, che può
+ * differire dalla modalità richiesta quando si ripiega sul percorso bufferizzato.
+ *
+ * @param stats Le statistiche del trasferimento.
+ * @return "io_uring", "pipeline", "zerocopy" o "buffered".
+ */
+const char* transfer_path_name(const transfer_stats_t *stats)
+{
+    if (stats->uring) {
+        return "io_uring";
+    }
+    if (stats->pipelined) {
+        return "pipeline";
+    }
+    return stats->zerocopy ? "zerocopy" : "buffered";
+}
+
+
+
+/**
+ * Imposta la dimensione dei blocchi del percorso bufferizzato (opzione -b). Va chiamata all'avvio, prima
+ * che i thread comincino a trasferire dati: i buffer già nei pool hanno la dimensione precedente.
+ *
+ * @param size La dimensione in byte, da TRANSFER_CHUNK_MIN a TRANSFER_CHUNK_MAX.
+ * @return 0 in caso di successo, -1 se la dimensione non è valida.
+ */
+int transfer_set_chunk_size(size_t size)
+{
+    if (size < TRANSFER_CHUNK_MIN || size > TRANSFER_CHUNK_MAX) {
+        return -1;
+    }
+    chunk_size = size;
+    chunk_size_set = 1;
+    return 0;
+}
+
+
+
+/**
+ * Restituisce la dimensione dei blocchi del percorso bufferizzato, cioè dei buffer del pool.
+ */
+size_t transfer_chunk_size(void)
+{
+    return chunk_size;
+}
+
+
+
+/**
+ * Restituisce i byte da chiedere al massimo a una chiamata a sendfile: SENDFILE_CHUNK, oppure un blocco
+ * di -b byte se è impostata una funzione con transfer_set_pace.
+ */
+size_t transfer_sendfile_chunk(void)
+{
+    return pace_hook ? chunk_size : SENDFILE_CHUNK;
+}
+
+
+
+/**
+ * Libera i buffer rimasti nel pool di un thread che termina.
+ */
+static void pool_destroy(void *arg)
+{
+    buffer_pool_t *pool = (buffer_pool_t *)arg;
+
+    for (int i = 0; i < pool->count; i++) {
+        free(pool->free[i]);
+    }
+    free(pool);
+}
+
+
+
+static void pool_key_create(void)
+{
+    pthread_key_create(&pool_key, pool_destroy);
+}
+
+
+
+/**
+ * Restituisce un buffer di transfer_chunk_size() byte allineato alla pagina, riusando se possibile uno
+ * di quelli liberati dal thread corrente: un worker o un ciclo a eventi non alloca memoria per ogni
+ * connessione, e un blocco allineato non attraversa più pagine del necessario.
+ *
+ * @return Il buffer (da restituire con transfer_buffer_release), NULL se la memoria non basta.
+ */
+void* transfer_buffer_acquire(void)
+{
+    pthread_once(&pool_once, pool_key_create);
+
+    buffer_pool_t *pool = (buffer_pool_t *)pthread_getspecific(pool_key);
+    if (pool != NULL && pool->count > 0) {
+        return pool->free[--pool->count];
+    }
+
+    void *buffer = NULL;
+    long page = sysconf(_SC_PAGESIZE);
+    int err = posix_memalign(&buffer, page > 0 ? (size_t)page : 4096, chunk_size);
+    if (err != 0) {
+        errno = err;
+        return NULL;
+    }
+    return buffer;
+}
+
+
+
+/**
+ * Restituisce un buffer al pool del thread corrente; oltre TRANSFER_POOL_BUFFERS buffer liberi viene liberato.
+ *
+ * @param buffer Il buffer ottenuto con transfer_buffer_acquire (NULL è ignorato).
+ */
+void transfer_buffer_release(void *buffer)
+{
+    int saved_errno = errno;        // chi rilascia il buffer dopo un errore deve poterlo ancora riportare
+
+    if (buffer == NULL) {
+        return;
+    }
+    pthread_once(&pool_once, pool_key_create);
+
+    buffer_pool_t *pool = (buffer_pool_t *)pthread_getspecific(pool_key);
+    if (pool == NULL) {
+        pool = (buffer_pool_t *)calloc(1, sizeof(buffer_pool_t));
+        if (pool == NULL || pthread_setspecific(pool_key, pool) != 0) {
+            free(pool);
+            free(buffer);
+            errno = saved_errno;
+            return;
+        }
+    }
+    if (pool->count < TRANSFER_POOL_BUFFERS) {
+        pool->free[pool->count++] = buffer;
+    } else {
+        free(buffer);
+    }
+    errno = saved_errno;
+}
+
+
+
+/**
+ * Con una dimensione dei blocchi scelta con -b porta i buffer di invio e ricezione della socket ad
+ * almeno un blocco, così una send o una recv sposta un blocco intero. Senza -b i buffer restano
+ * quelli del kernel: fissarli disattiva il loro adattamento automatico, che su reti veloci li porta
+ * oltre la dimensione di default dei blocchi. Va chiamata prima di connect o listen, perché la finestra
+ * TCP annunciata dipende dal buffer di ricezione.
+ *
+ * @param sock La socket.
+ */
+void transfer_tune_socket(int sock)
+{
+    int size = (int)chunk_size;
+
+    if (!chunk_size_set) {
+        return;
+    }
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0) {
+        fprintf(stderr, "Errore durante l'impostazione dei buffer della socket: %s\n", strerror(errno));
+    }
+}
+
+
+
+/**
+ * Imposta la funzione chiamata dopo ogni blocco di dati inviato (il server con i limiti di banda).
+ * Con una funzione impostata sendfile invia un blocco di -b byte alla volta invece di SENDFILE_CHUNK,
+ * così l'attesa si distribuisce sul trasferimento.
+ *
+ * @param pace La funzione (NULL per nessuna).
+ */
+void transfer_set_pace(transfer_pace_t pace)
+{
+    pace_hook = pace;
+}
+
+
+
+/**
+ * Segnala i byte di un file appena inviati alla funzione impostata con transfer_set_pace.
+ *
+ * @param bytes I byte inviati.
+ */
+void transfer_paced(size_t bytes)
+{
+    if (pace_hook != NULL && bytes > 0) {
+        pace_hook(bytes);
+    }
+}
+
+
+
+/**
+ * Invia tutti i byte di un buffer sulla socket, ripetendo send finché non sono stati trasmessi tutti.
+ *
+ * @param sock La socket su cui inviare.
+ * @param buffer I dati da inviare.
+ * @param len Il numero di byte da inviare.
+ * @param flags Flag aggiuntivi per send (es. MSG_MORE), MSG_NOSIGNAL è sempre impostato.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int send_all(int sock, const void *buffer, size_t len, int flags)
+{
+    const char *data = (const char *)buffer;
+    size_t total_sent = 0;
+
+    while (total_sent < len)
+    {
+        ssize_t bytes_sent = send(sock, data + total_sent, len - total_sent, MSG_NOSIGNAL | flags);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total_sent += bytes_sent;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Invia più buffer sulla socket con una sola sendmsg (come writev), ripetendola sui byte rimasti se la
+ * socket ne accetta solo una parte.
+ *
+ * @param sock La socket su cui inviare.
+ * @param iov I buffer da inviare (modificati durante l'invio).
+ * @param count Il numero di buffer.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int send_all_iov(int sock, struct iovec *iov, int count)
+{
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    while (msg.msg_iovlen > 0)
+    {
+        ssize_t bytes_sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        // salta i buffer inviati per intero e avanza in quello inviato in parte
+        while (msg.msg_iovlen > 0 && (size_t)bytes_sent >= msg.msg_iov->iov_len) {
+            bytes_sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + bytes_sent;
+            msg.msg_iov->iov_len -= bytes_sent;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve esattamente len byte dalla socket, ripetendo recv finché non sono arrivati tutti.
+ *
+ * @param sock La socket da cui ricevere.
+ * @param buffer Il buffer di destinazione.
+ * @param len Il numero di byte da ricevere.
+ * @return 0 in caso di successo, -1 in caso di errore o se la connessione si chiude prima (errno = ECONNRESET).
+ */
+int recv_all(int sock, void *buffer, size_t len)
+{
+    char *data = (char *)buffer;
+    size_t total_received = 0;
+
+    while (total_received < len)
+    {
+        ssize_t bytes_received = recv(sock, data + total_received, len - total_received, 0);
+        if (bytes_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (bytes_received == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        total_received += bytes_received;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Scarta i prossimi length byte della socket (o tutto fino alla chiusura se length è -1). Con MSG_TRUNC
+ * il kernel libera i dati di una socket TCP senza copiarli nel buffer.
+ *
+ * @param sock La socket da cui scartare i dati.
+ * @param length Il numero di byte da scartare (-1 fino alla chiusura della connessione).
+ * @return 0 in caso di successo, -1 in caso di errore o se la connessione si chiude prima (errno = ECONNRESET).
+ */
+int recv_discard(int sock, long long length)
+{
+    char buffer[1024];                  // con MSG_TRUNC non viene scritto
+    unsigned long long discarded = 0;
+
+    while (length < 0 || discarded < (unsigned long long)length)
+    {
+        ssize_t n = recv(sock, buffer, next_chunk(length, discarded, SPLICE_PIPE_SIZE), MSG_TRUNC);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            if (length < 0) {
+                return 0;
+            }
+            errno = ECONNRESET;
+            return -1;
+        }
+        discarded += n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Invia il file a partire dalla posizione corrente leggendo in un buffer in user space (read + send).
+ *
+ * @param fd File descriptor del file da inviare.
+ * @param sock Socket su cui inviare i dati.
+ * @param length Totale di byte da raggiungere (-1 per inviare fino alla fine del file).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già inviati).
+ * @param crc CRC32C dei byte già inviati, aggiornato con quelli nuovi (NULL se non serve).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int send_file_buffered(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    char *buffer = (char *)transfer_buffer_acquire();
+    ssize_t bytes_read = 0;
+
+    if (buffer == NULL) {
+        return -1;
+    }
+    while (length < 0 || stats->bytes < (unsigned long long)length)
+    {
+        bytes_read = read(fd, buffer, next_chunk(length, stats->bytes, chunk_size));
+        stats->syscalls++;
+
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            break;
+        }
+        if (crc != NULL) {
+            *crc = crc32c(*crc, buffer, bytes_read);
+        }
+
+        // ciclo che garantisce che tutti i dati siano inviati, anche se send invia solo una parte
+        ssize_t total_sent = 0;
+        while (total_sent < bytes_read)
+        {
+            ssize_t bytes_sent = send(sock, buffer + total_sent, bytes_read - total_sent, MSG_NOSIGNAL);
+            stats->syscalls++;
+
+            if (bytes_sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                transfer_buffer_release(buffer);
+                return -1;
+            }
+            total_sent += bytes_sent;
+        }
+        stats->bytes += bytes_read;
+        transfer_paced(bytes_read);
+    }
+
+    transfer_buffer_release(buffer);
+    return bytes_read < 0 ? -1 : 0;
+}
+
+
+
+/**
+ * Invia il file a partire dalla posizione corrente con sendfile, senza copiare i dati in user space.
+ * Gestisce gli invii parziali ripetendo la chiamata finché non si raggiunge la fine del file. Se il kernel
+ * o il tipo di file non supportano sendfile (EINVAL, ENOSYS, EOPNOTSUPP) si prosegue con il percorso
+ * bufferizzato dal punto in cui si era arrivati: sendfile con offset NULL aggiorna la posizione del file.
+ * Il processo non vede i dati: il CRC si calcola rileggendo dal page cache il tratto appena inviato.
+ *
+ * @param fd File descriptor del file da inviare.
+ * @param sock Socket su cui inviare i dati.
+ * @param length Totale di byte da raggiungere (-1 per inviare fino alla fine del file).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già inviati).
+ * @param crc CRC32C dei byte già inviati, aggiornato con quelli nuovi (NULL se non serve).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int send_file_zerocopy(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    off_t position = (crc != NULL) ? lseek(fd, 0, SEEK_CUR) : 0;
+
+    while (length < 0 || stats->bytes < (unsigned long long)length)
+    {
+        ssize_t bytes_sent = sendfile(sock, fd, NULL, next_chunk(length, stats->bytes, transfer_sendfile_chunk()));
+        stats->syscalls++;
+
+        if (bytes_sent > 0) {
+            if (crc != NULL && file_crc32c_update(fd, position, bytes_sent, crc) < 0) {
+                return -1;
+            }
+            position += bytes_sent;
+            stats->bytes += bytes_sent;
+            stats->zerocopy = 1;
+            transfer_paced(bytes_sent);
+            continue;
+        }
+        if (bytes_sent == 0) {
+            return 0;   // fine del file
+        }
+
+        if (errno == EINTR || errno == EAGAIN) {
+            continue;
+        }
+        if (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+            return send_file_buffered(fd, sock, length, stats, crc);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Prepara l'anello della modalità pipeline con TRANSFER_PIPELINE_DEPTH buffer del pool del thread chiamante.
+ *
+ * @return 0 in caso di successo, -1 se manca memoria (errno impostato).
+ */
+static int ring_init(transfer_ring_t *rg, int fd, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    memset(rg, 0, sizeof(*rg));
+    rg->fd = fd;
+    rg->length = length;
+    rg->start = stats->bytes;
+    rg->want_crc = crc;
+    rg->crc = (crc != NULL) ? *crc : 0;
+    pthread_mutex_init(&rg->mutex, NULL);
+    pthread_cond_init(&rg->cond, NULL);
+
+    for (int i = 0; i < TRANSFER_PIPELINE_DEPTH; i++) {
+        if ((rg->buffers[i] = (char *)transfer_buffer_acquire()) == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+static void ring_destroy(transfer_ring_t *rg)
+{
+    for (int i = 0; i < TRANSFER_PIPELINE_DEPTH; i++) {
+        transfer_buffer_release(rg->buffers[i]);
+    }
+    pthread_mutex_destroy(&rg->mutex);
+    pthread_cond_destroy(&rg->cond);
+}
+
+
+
+/**
+ * Attende un buffer libero in fondo all'anello.
+ *
+ * @return Il buffer da riempire, NULL se il consumatore ha smesso.
+ */
+static char* ring_reserve(transfer_ring_t *rg)
+{
+    pthread_mutex_lock(&rg->mutex);
+    while (rg->count == TRANSFER_PIPELINE_DEPTH && !rg->aborted) {
+        pthread_cond_wait(&rg->cond, &rg->mutex);
+    }
+    char *buffer = rg->aborted ? NULL : rg->buffers[(rg->head + rg->count) % TRANSFER_PIPELINE_DEPTH];
+    pthread_mutex_unlock(&rg->mutex);
+    return buffer;
+}
+
+
+
+/**
+ * Rende disponibile al consumatore il buffer riempito con len byte.
+ */
+static void ring_publish(transfer_ring_t *rg, size_t len)
+{
+    pthread_mutex_lock(&rg->mutex);
+    rg->lens[(rg->head + rg->count) % TRANSFER_PIPELINE_DEPTH] = len;
+    rg->count++;
+    pthread_cond_broadcast(&rg->cond);
+    pthread_mutex_unlock(&rg->mutex);
+}
+
+
+
+/**
+ * Segnala la fine del lavoro del produttore (err = 0) oppure il suo errore.
+ */
+static void ring_finish(transfer_ring_t *rg, int err)
+{
+    pthread_mutex_lock(&rg->mutex);
+    rg->done = 1;
+    if (err != 0 && rg->error == 0) {
+        rg->error = err;
+    }
+    pthread_cond_broadcast(&rg->cond);
+    pthread_mutex_unlock(&rg->mutex);
+}
+
+
+
+/**
+ * Attende il primo buffer pieno dell'anello.
+ *
+ * @param rg L'anello.
+ * @param len Dove memorizzare i byte validi del buffer.
+ * @return Il buffer, NULL se il produttore ha finito e l'anello è vuoto.
+ */
+static char* ring_take(transfer_ring_t *rg, size_t *len)
+{
+    pthread_mutex_lock(&rg->mutex);
+    while (rg->count == 0 && !rg->done) {
+        pthread_cond_wait(&rg->cond, &rg->mutex);
+    }
+    char *buffer = NULL;
+    if (rg->count > 0) {
+        buffer = rg->buffers[rg->head];
+        *len = rg->lens[rg->head];
+    }
+    pthread_mutex_unlock(&rg->mutex);
+    return buffer;
+}
+
+
+
+/**
+ * Libera il primo buffer dell'anello, già consumato.
+ */
+static void ring_release(transfer_ring_t *rg)
+{
+    pthread_mutex_lock(&rg->mutex);
+    rg->head = (rg->head + 1) % TRANSFER_PIPELINE_DEPTH;
+    rg->count--;
+    pthread_cond_broadcast(&rg->cond);
+    pthread_mutex_unlock(&rg->mutex);
+}
+
+
+
+/**
+ * Il consumatore smette di prendere buffer (errore): il produttore non resta bloccato sull'anello pieno.
+ */
+static void ring_abort(transfer_ring_t *rg, int err)
+{
+    pthread_mutex_lock(&rg->mutex);
+    rg->aborted = 1;
+    if (rg->error == 0) {
+        rg->error = err;
+    }
+    pthread_cond_broadcast(&rg->cond);
+    pthread_mutex_unlock(&rg->mutex);
+}
+
+
+
+/**
+ * Thread di lettura della modalità pipeline: riempie i buffer dell'anello leggendo il file, e prima di ogni
+ * lettura chiede al kernel (POSIX_FADV_WILLNEED) il blocco che servirà dopo quelli già in coda, così il
+ * disco lavora mentre la socket si svuota.
+ */
+static void* pipeline_reader(void *arg)
+{
+    transfer_ring_t *rg = (transfer_ring_t *)arg;
+    unsigned long long produced = rg->start;
+    off_t position = lseek(rg->fd, 0, SEEK_CUR);
+    int err = 0;
+
+    while (rg->length < 0 || produced < (unsigned long long)rg->length)
+    {
+        char *buffer = ring_reserve(rg);
+        if (buffer == NULL) {
+            break;
+        }
+        if (position >= 0) {
+            posix_fadvise(rg->fd, position + (off_t)chunk_size * TRANSFER_PIPELINE_DEPTH, chunk_size, POSIX_FADV_WILLNEED);
+            rg->syscalls++;
+        }
+
+        ssize_t bytes_read = read(rg->fd, buffer, next_chunk(rg->length, produced, chunk_size));
+        rg->syscalls++;
+
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read < 0) {
+            err = errno;
+            break;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        if (rg->want_crc != NULL) {
+            rg->crc = crc32c(rg->crc, buffer, bytes_read);
+        }
+        produced += bytes_read;
+        position += bytes_read;
+        ring_publish(rg, bytes_read);
+    }
+
+    ring_finish(rg, err);
+    return NULL;
+}
+
+
+
+/**
+ * Invia il file a partire dalla posizione corrente sovrapponendo disco e rete: un thread legge il file
+ * nei buffer di un anello mentre il thread chiamante invia quelli già pieni, invece di alternare read e
+ * send. Con un solo blocco da inviare non c'è niente da sovrapporre e si usa il percorso bufferizzato.
+ *
+ * @param fd File descriptor del file da inviare.
+ * @param sock Socket su cui inviare i dati.
+ * @param length Totale di byte da raggiungere (-1 per inviare fino alla fine del file).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già inviati).
+ * @param crc CRC32C dei byte già inviati, aggiornato con quelli nuovi (NULL se non serve).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int send_file_pipeline(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    transfer_ring_t rg;
+    pthread_t thread;
+
+    if (length >= 0 && (unsigned long long)length <= stats->bytes + chunk_size) {
+        return send_file_buffered(fd, sock, length, stats, crc);
+    }
+    if (ring_init(&rg, fd, length, stats, crc) < 0 || pthread_create(&thread, NULL, pipeline_reader, &rg) != 0) {
+        ring_destroy(&rg);
+        return send_file_buffered(fd, sock, length, stats, crc);
+    }
+
+    char *buffer;
+    size_t len;
+    while ((buffer = ring_take(&rg, &len)) != NULL)
+    {
+        if (send_all(sock, buffer, len, 0) < 0) {
+            ring_abort(&rg, errno);
+            break;
+        }
+        stats->syscalls++;
+        stats->bytes += len;
+        stats->pipelined = 1;
+        ring_release(&rg);
+        transfer_paced(len);
+    }
+
+    pthread_join(thread, NULL);
+    stats->syscalls += rg.syscalls;
+    if (crc != NULL) {
+        *crc = rg.crc;
+    }
+    int err = rg.error;
+    ring_destroy(&rg);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Invia il contenuto di un file (dalla posizione corrente fino alla fine, oppure length byte) sulla socket
+ * usando la modalità richiesta.
+ *
+ * @param fd File descriptor del file da inviare.
+ * @param sock Socket su cui inviare i dati.
+ * @param length Byte da inviare (-1 per inviare fino alla fine del file).
+ * @param mode Modalità di trasferimento.
+ * @param stats Statistiche del trasferimento (azzerate all'inizio).
+ * @param crc Puntatore dove memorizzare il CRC32C dei byte inviati (NULL se non serve).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato, EIO se il file finisce prima di length byte).
+ */
+int send_file(int fd, int sock, long long length, transfer_mode_t mode, transfer_stats_t *stats, uint32_t *crc)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (crc != NULL) {
+        *crc = 0;
+    }
+
+    // lettura sequenziale: il kernel raddoppia la finestra di lettura anticipata del file
+    if (length < 0 || (unsigned long long)length > chunk_size) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    int result;
+    if (mode == TRANSFER_ZEROCOPY) {
+        result = send_file_zerocopy(fd, sock, length, stats, crc);
+    } else if (mode == TRANSFER_URING) {
+        result = send_file_uring(fd, sock, length, stats, crc);
+    } else if (mode == TRANSFER_PIPELINE) {
+        result = send_file_pipeline(fd, sock, length, stats, crc);
+    } else {
+        result = send_file_buffered(fd, sock, length, stats, crc);
+    }
+
+    // il file si è accorciato dopo che la sua dimensione era stata annunciata
+    if (result == 0 && length >= 0 && stats->bytes < (unsigned long long)length) {
+        errno = EIO;
+        result = -1;
+    }
+    return result;
+}
+
+
+
+/**
+ * Prealloca lo spazio su disco per il file in ricezione, così il filesystem può disporre i dati in extent
+ * contigui invece di allocarli a pezzi a ogni write. Se la dimensione è annunciata viene allocata tutta in una
+ * volta; altrimenti si prealloca in modo speculativo (FALLOC_FL_KEEP_SIZE) con passi crescenti davanti ai
+ * dati ricevuti, e l'eccesso viene restituito da prealloc_finish. I filesystem senza fallocate sono ignorati.
+ *
+ * @param fd File descriptor del file in scrittura.
+ * @param pa Stato della preallocazione.
+ * @param received Byte ricevuti finora.
+ * @return 0 in caso di successo, -1 se lo spazio sul dispositivo non è sufficiente (errno = ENOSPC).
+ */
+static int prealloc_ahead(int fd, prealloc_t *pa, off_t received)
+{
+    if (pa->step == 0 || received < pa->allocated) {
+        return 0;
+    }
+
+    off_t target;
+    int flags = 0;
+    if (pa->length >= 0) {
+        target = pa->length;
+    } else {
+        target = received + pa->step;
+        flags = FALLOC_FL_KEEP_SIZE;
+        if (pa->step < PREALLOC_MAX) {
+            pa->step *= 2;
+        }
+    }
+
+    if (target > pa->allocated && fallocate(fd, flags, pa->base + pa->allocated, target - pa->allocated) == 0) {
+        pa->allocated = target;
+        return 0;
+    }
+    if (target > pa->allocated && errno == ENOSPC && (pa->length >= 0 || (unsigned long long)received >= pa->max_bytes)) {
+        return -1;
+    }
+
+    // fallocate non supportato (o spazio insufficiente per un passo speculativo): si prosegue senza preallocare
+    if (pa->length >= 0 || errno != ENOSPC) {
+        pa->step = 0;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Restituisce al filesystem lo spazio preallocato in modo speculativo oltre la fine dei dati ricevuti.
+ *
+ * @param fd File descriptor del file in scrittura.
+ * @param pa Stato della preallocazione.
+ * @param received Byte ricevuti in totale.
+ */
+static void prealloc_finish(int fd, prealloc_t *pa, off_t received)
+{
+    // ftruncate alla dimensione attuale libera i blocchi allocati con FALLOC_FL_KEEP_SIZE oltre la fine del file
+    if (pa->length < 0 && pa->allocated > received) {
+        if (ftruncate(fd, pa->base + received) < 0) {
+            fprintf(stderr, "Errore durante il rilascio dello spazio preallocato: %s\n", strerror(errno));
+        }
+    }
+}
+
+
+
+/**
+ * Calcola quanti byte richiedere alla prossima ricezione, senza superare la dimensione annunciata.
+ *
+ * @param length Dimensione annunciata (-1 se non nota).
+ * @param received Byte ricevuti finora.
+ * @param chunk Dimensione massima del blocco.
+ * @return Il numero di byte da richiedere.
+ */
+static size_t next_chunk(long long length, unsigned long long received, size_t chunk)
+{
+    if (length >= 0 && (unsigned long long)length - received < chunk) {
+        return (size_t)((unsigned long long)length - received);
+    }
+    return chunk;
+}
+
+
+
+/**
+ * Scrive tutti i byte di un buffer nel file, ripetendo write in caso di scritture parziali.
+ *
+ * @param fd File descriptor del file.
+ * @param buffer I dati da scrivere.
+ * @param len Il numero di byte da scrivere.
+ * @param stats Statistiche del trasferimento da aggiornare.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+static int write_all(int fd, const char *buffer, size_t len, transfer_stats_t *stats)
+{
+    size_t written = 0;
+
+    while (written < len)
+    {
+        ssize_t n = write(fd, buffer + written, len - written);
+        stats->syscalls++;
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve i dati dalla socket passando per un buffer in user space (recv + write).
+ *
+ * @param sock Socket da cui ricevere.
+ * @param fd File descriptor del file in scrittura.
+ * @param length Totale di byte da raggiungere (-1 per ricevere fino alla chiusura della connessione).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già ricevuti).
+ * @param crc CRC32C dei byte già ricevuti, aggiornato con quelli nuovi (NULL se non serve).
+ * @return 0 se si è raggiunto length o la connessione è stata chiusa, -1 in caso di errore (errno impostato).
+ */
+int recv_file_buffered(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    char *buffer = (char *)transfer_buffer_acquire();
+    int result = 0;
+
+    if (buffer == NULL) {
+        return -1;
+    }
+    while (length < 0 || stats->bytes < (unsigned long long)length)
+    {
+        ssize_t bytes_received = recv(sock, buffer, next_chunk(length, stats->bytes, chunk_size), 0);
+        stats->syscalls++;
+
+        if (bytes_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        if (bytes_received == 0) {
+            break;
+        }
+
+        if (write_all(fd, buffer, bytes_received, stats) < 0) {
+            result = -1;
+            break;
+        }
+        if (crc != NULL) {
+            *crc = crc32c(*crc, buffer, bytes_received);
+        }
+        stats->bytes += bytes_received;
+    }
+
+    transfer_buffer_release(buffer);
+    return result;
+}
+
+
+
+/**
+ * Svuota nel file i byte rimasti nella pipe, passando per un buffer (usata quando splice verso il file non è
+ * supportato dopo che i dati sono già stati spostati dalla socket alla pipe).
+ *
+ * @param pipe_fd Estremo di lettura della pipe.
+ * @param fd File descriptor del file.
+ * @param pending Byte presenti nella pipe.
+ * @param stats Statistiche del trasferimento da aggiornare.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+static int drain_pipe_buffered(int pipe_fd, int fd, size_t pending, transfer_stats_t *stats)
+{
+    char *buffer = (char *)transfer_buffer_acquire();
+    int result = 0;
+
+    if (buffer == NULL) {
+        return -1;
+    }
+    while (pending > 0)
+    {
+        ssize_t n = read(pipe_fd, buffer, pending < chunk_size ? pending : chunk_size);
+        stats->syscalls++;
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        if (write_all(fd, buffer, n, stats) < 0) {
+            result = -1;
+            break;
+        }
+        pending -= n;
+    }
+
+    transfer_buffer_release(buffer);
+    return result;
+}
+
+
+
+/**
+ * Riceve i dati dalla socket con splice (socket -> pipe -> file), senza copiarli in user space.
+ * Se splice non è supportato dalla socket o dal filesystem si prosegue con il percorso bufferizzato.
+ * Il CRC si calcola rileggendo dal page cache il tratto appena scritto nel file.
+ *
+ * @param sock Socket da cui ricevere.
+ * @param fd File descriptor del file in scrittura.
+ * @param length Totale di byte da raggiungere (-1 per ricevere fino alla chiusura della connessione).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già ricevuti).
+ * @param crc CRC32C dei byte già ricevuti, aggiornato con quelli nuovi rileggendoli dal file, che deve essere
+ *            aperto anche in lettura (NULL se non serve).
+ * @return 0 se si è raggiunto length o la connessione è stata chiusa, -1 in caso di errore (errno impostato).
+ */
+int recv_file_zerocopy(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    int pipe_fds[2];
+
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+        return recv_file_buffered(sock, fd, length, stats, crc);
+    }
+    off_t position = (crc != NULL) ? lseek(fd, 0, SEEK_CUR) : 0;
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);    // best effort: una pipe più grande riduce le chiamate
+
+    int result = 0;
+    int fallback = 0;
+
+    while (length < 0 || stats->bytes < (unsigned long long)length)
+    {
+        // socket -> pipe
+        ssize_t in_pipe = splice(sock, NULL, pipe_fds[1], NULL, next_chunk(length, stats->bytes, SPLICE_PIPE_SIZE), SPLICE_F_MOVE | SPLICE_F_MORE);
+        stats->syscalls++;
+
+        if (in_pipe < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+                fallback = 1;
+            } else {
+                result = -1;
+            }
+            break;
+        }
+        if (in_pipe == 0) {
+            break;
+        }
+
+        // pipe -> file
+        size_t pending = in_pipe;
+        while (pending > 0)
+        {
+            ssize_t out = splice(pipe_fds[0], NULL, fd, NULL, pending, SPLICE_F_MOVE | SPLICE_F_MORE);
+            stats->syscalls++;
+
+            if (out < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+                    // il filesystem non accetta splice: i byte già nella pipe vanno scritti a mano
+                    fallback = 1;
+                    if (drain_pipe_buffered(pipe_fds[0], fd, pending, stats) < 0) {
+                        result = -1;
+                    }
+                } else {
+                    result = -1;
+                }
+                break;
+            }
+            pending -= out;
+        }
+        if (result < 0) {
+            break;
+        }
+        if (crc != NULL && file_crc32c_update(fd, position, in_pipe, crc) < 0) {
+            result = -1;
+            break;
+        }
+        position += in_pipe;
+
+        stats->bytes += in_pipe;
+        stats->zerocopy = 1;
+        if (fallback) {
+            break;
+        }
+    }
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    if (result < 0) {
+        return -1;
+    }
+    if (fallback) {
+        return recv_file_buffered(sock, fd, length, stats, crc);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Thread di scrittura della modalità pipeline: scrive nel file i buffer ricevuti. Dopo un errore
+ * registra l'errno nell'anello e continua a liberare i buffer senza scriverli.
+ */
+static void* pipeline_writer(void *arg)
+{
+    transfer_ring_t *rg = (transfer_ring_t *)arg;
+    transfer_stats_t local = { 0 };
+    int err = 0;
+    char *buffer;
+    size_t len;
+
+    while ((buffer = ring_take(rg, &len)) != NULL)
+    {
+        if (err == 0 && write_all(rg->fd, buffer, len, &local) < 0) {
+            err = errno;
+            ring_abort(rg, err);
+        }
+        if (err == 0 && rg->want_crc != NULL) {
+            rg->crc = crc32c(rg->crc, buffer, len);
+        }
+        ring_release(rg);
+    }
+    rg->syscalls = local.syscalls;
+    return NULL;
+}
+
+
+
+/**
+ * Riceve i dati dalla socket sovrapponendo rete e disco: il thread chiamante riceve nei buffer di un
+ * anello (blocchi interi con MSG_WAITALL, senza mai chiedere oltre length) mentre un altro thread li
+ * scrive nel file. Se la scrittura fallisce la ricezione si interrompe con il suo errore, come nel percorso
+ * bufferizzato.
+ *
+ * @param sock Socket da cui ricevere.
+ * @param fd File descriptor del file in scrittura.
+ * @param length Totale di byte da raggiungere (-1 per ricevere fino alla chiusura della connessione).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già ricevuti).
+ * @param crc CRC32C dei byte già ricevuti, aggiornato con quelli nuovi (NULL se non serve).
+ * @return 0 se si è raggiunto length o la connessione è stata chiusa, -1 in caso di errore (errno impostato).
+ */
+int recv_file_pipeline(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    transfer_ring_t rg;
+    pthread_t thread;
+    int err = 0;
+
+    if (length >= 0 && (unsigned long long)length <= stats->bytes + chunk_size) {
+        return recv_file_buffered(sock, fd, length, stats, crc);
+    }
+    if (ring_init(&rg, fd, length, stats, crc) < 0 || pthread_create(&thread, NULL, pipeline_writer, &rg) != 0) {
+        ring_destroy(&rg);
+        return recv_file_buffered(sock, fd, length, stats, crc);
+    }
+
+    while (length < 0 || stats->bytes < (unsigned long long)length)
+    {
+        char *buffer = ring_reserve(&rg);
+        if (buffer == NULL) {
+            break;      // errore di scrittura
+        }
+
+        ssize_t bytes_received = recv(sock, buffer, next_chunk(length, stats->bytes, chunk_size), MSG_WAITALL);
+        stats->syscalls++;
+
+        if (bytes_received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_received < 0) {
+            err = errno;
+            break;
+        }
+        if (bytes_received == 0) {
+            break;
+        }
+        stats->bytes += bytes_received;
+        stats->pipelined = 1;
+        ring_publish(&rg, bytes_received);
+    }
+
+    ring_finish(&rg, err);
+    pthread_join(thread, NULL);
+    stats->syscalls += rg.syscalls;
+    if (crc != NULL) {
+        *crc = rg.crc;
+    }
+    err = rg.error;
+    ring_destroy(&rg);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve il contenuto di un file dalla socket e lo scrive nel file indicato, preallocando lo spazio su disco.
+ *
+ * @param sock Socket da cui ricevere.
+ * @param fd File descriptor del file in scrittura, posizionato dove scrivere il primo byte ricevuto.
+ * @param length Dimensione annunciata del file (-1 per ricevere fino alla chiusura della connessione).
+ * @param max_bytes Byte disponibili sul dispositivo: superarli è un errore ENOSPC.
+ * @param mode Modalità di trasferimento.
+ * @param stats Statistiche del trasferimento (azzerate all'inizio).
+ * @param crc Puntatore dove memorizzare il CRC32C dei byte ricevuti (NULL se non serve).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int recv_file(int sock, int fd, long long length, unsigned long long max_bytes, transfer_mode_t mode, transfer_stats_t *stats, uint32_t *crc)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (crc != NULL) {
+        *crc = 0;
+    }
+
+    if (length >= 0 && (unsigned long long)length > max_bytes) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    // i dati si scrivono dalla posizione corrente del file (diversa da 0 nelle scritture di un intervallo)
+    off_t base = lseek(fd, 0, SEEK_CUR);
+    prealloc_t pa = { length, max_bytes, base > 0 ? base : 0, 0, PREALLOC_MIN };
+    if (prealloc_ahead(fd, &pa, 0) < 0) {
+        return -1;
+    }
+
+    int result = 0;
+    while (result == 0)
+    {
+        // con dimensione ignota si riceve a tratti, per estendere la preallocazione speculativa tra un tratto e l'altro
+        long long target = length;
+        if (length < 0 && pa.step > 0) {
+            target = pa.allocated;
+        }
+
+        unsigned long long before = stats->bytes;
+        if (mode == TRANSFER_ZEROCOPY) {
+            result = recv_file_zerocopy(sock, fd, target, stats, crc);
+        } else if (mode == TRANSFER_URING) {
+            result = recv_file_uring(sock, fd, target, stats, crc);
+        } else if (mode == TRANSFER_PIPELINE) {
+            result = recv_file_pipeline(sock, fd, target, stats, crc);
+        } else {
+            result = recv_file_buffered(sock, fd, target, stats, crc);
+        }
+
+        if (stats->bytes > max_bytes) {
+            errno = ENOSPC;
+            result = -1;
+        }
+
+        // fine dei dati: raggiunta la dimensione annunciata o connessione chiusa dal mittente (tratto incompleto)
+        if (result < 0 || target == length || stats->bytes < (unsigned long long)target || stats->bytes == before) {
+            break;
+        }
+        if (prealloc_ahead(fd, &pa, stats->bytes) < 0) {
+            result = -1;
+        }
+    }
+
+    prealloc_finish(fd, &pa, stats->bytes);
+
+    // connessione chiusa prima di aver ricevuto tutti i byte annunciati
+    if (result == 0 && length >= 0 && stats->bytes < (unsigned long long)length) {
+        errno = ECONNRESET;
+        result = -1;
+    }
+    return result;
+}
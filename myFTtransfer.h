@@ -0,0 +1,68 @@
+#ifndef MY_FT_TRANSFER_H
+#define MY_FT_TRANSFER_H
+
+#include <stdint.h>         // per uint32_t
+#include <sys/types.h>      // per ssize_t e off_t
+#include <sys/uio.h>        // per struct iovec
+
+#define TRANSFER_CHUNK_MIN (4 << 10)        // dimensione minima dei blocchi del percorso bufferizzato
+#define TRANSFER_CHUNK_MAX (16 << 20)       // dimensione massima dei blocchi del percorso bufferizzato
+#define TRANSFER_CHUNK_DEFAULT (256 << 10)  // dimensione dei blocchi se non indicata con -b
+#define TRANSFER_POOL_BUFFERS 4             // buffer liberi conservati al massimo dal pool di ogni thread
+#define TRANSFER_PIPELINE_DEPTH 4           // buffer in volo tra i due thread della modalità pipeline
+#define SENDFILE_CHUNK (1 << 30)            // byte massimi richiesti a una singola chiamata a sendfile
+#define SPLICE_PIPE_SIZE (1 << 20)          // capacità richiesta per la pipe usata da splice
+#define PREALLOC_MIN (1 << 20)              // primo passo di preallocazione quando la dimensione non è nota
+#define PREALLOC_MAX (64 << 20)             // passo massimo di preallocazione quando la dimensione non è nota
+
+
+// Modalità con cui i dati del file attraversano il processo
+typedef enum
+{
+    TRANSFER_BUFFERED = 0,      // read()/send() attraverso un buffer in user space
+    TRANSFER_ZEROCOPY = 1,      // sendfile()/splice(): i dati restano nel kernel, con ripiego sul percorso bufferizzato
+    TRANSFER_URING = 2,         // catene di richieste io_uring su buffer registrati (con HAVE_LIBURING, vedi myFTuring.h)
+    TRANSFER_PIPELINE = 3       // come buffered, con un thread che legge (o scrive) il file mentre l'altro invia (o riceve)
+} transfer_mode_t;
+
+
+// Chiamata dopo ogni blocco inviato da send_file (e dagli altri percorsi di invio dei dati dei file) con i byte
+// appena inviati: può sospendere il thread per rispettare un limite di banda (vedi myFTshape.h)
+typedef void (*transfer_pace_t)(size_t bytes);
+
+
+// Statistiche di un singolo trasferimento
+typedef struct
+{
+    unsigned long long bytes;       // byte trasferiti
+    unsigned long long syscalls;    // chiamate di sistema eseguite nel percorso dati
+    int zerocopy;                   // 1 se almeno una parte dei dati è passata per il percorso zero-copy
+    int uring;                      // 1 se almeno una parte dei dati è passata per io_uring
+    int pipelined;                  // 1 se disco e rete hanno lavorato in parallelo (modalità pipeline)
+} transfer_stats_t;
+
+int parse_transfer_mode(const char *str, transfer_mode_t *mode);
+const char* transfer_mode_name(transfer_mode_t mode);
+const char* transfer_path_name(const transfer_stats_t *stats);
+int transfer_set_chunk_size(size_t size);
+size_t transfer_chunk_size(void);
+size_t transfer_sendfile_chunk(void);
+void* transfer_buffer_acquire(void);
+void transfer_buffer_release(void *buffer);
+void transfer_tune_socket(int sock);
+void transfer_set_pace(transfer_pace_t pace);
+void transfer_paced(size_t bytes);
+int send_all(int sock, const void *buffer, size_t len, int flags);
+int send_all_iov(int sock, struct iovec *iov, int count);
+int recv_all(int sock, void *buffer, size_t len);
+int recv_discard(int sock, long long length);
+int send_file_buffered(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc);
+int send_file_zerocopy(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc);
+int send_file_pipeline(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc);
+int send_file(int fd, int sock, long long length, transfer_mode_t mode, transfer_stats_t *stats, uint32_t *crc);
+int recv_file_buffered(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc);
+int recv_file_zerocopy(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc);
+int recv_file_pipeline(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc);
+int recv_file(int sock, int fd, long long length, unsigned long long max_bytes, transfer_mode_t mode, transfer_stats_t *stats, uint32_t *crc);
+
+#endif // MY_FT_TRANSFER_H
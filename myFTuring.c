@@ -0,0 +1,580 @@
+// TRASFERIMENTO DATI CON IO_URING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>        // per la chiave delle code di ogni thread
+#include <sys/stat.h>       // per fstat()
+#include "myFTuring.h"
+#include "myFTchecksum.h"   // CRC32C dei dati trasferiti
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+
+// coda io_uring di un thread con i suoi buffer registrati
+typedef struct
+{
+    struct io_uring ring;
+    char *buffers[URING_SLOTS];     // buffer registrati (indice = slot)
+    size_t size;                    // dimensione di ogni buffer
+} uring_ctx_t;
+
+// esito dei due passi di uno slot in una catena
+typedef struct
+{
+    size_t len;                     // byte richiesti
+    int first;                      // esito della lettura (invio) o della ricezione (scrittura)
+    int second;                     // esito dell'invio o della scrittura
+} uring_slot_t;
+
+static struct io_uring shared_ring;                 // coda del thread che accetta le connessioni (e del thread SQPOLL)
+static int shared_ready = 0;                        // 1 se shared_ring è stata creata da uring_init
+static unsigned sqpoll_idle = 0;                    // millisecondi di inattività del thread SQPOLL (0 = disattivato)
+static int accept_armed = 0;                        // 1 se la richiesta di accept multishot è attiva
+static pthread_key_t ring_key;                      // coda del thread corrente
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static char ring_unavailable;                       // segnaposto per i thread in cui la coda non si può creare
+
+
+
+/**
+ * Chiude la coda di un thread che termina e libera i suoi buffer.
+ */
+static void ring_destroy(void *arg)
+{
+    uring_ctx_t *ctx = (uring_ctx_t *)arg;
+
+    if (arg == &ring_unavailable) {
+        return;
+    }
+    io_uring_queue_exit(&ctx->ring);
+    for (int i = 0; i < URING_SLOTS; i++) {
+        free(ctx->buffers[i]);
+    }
+    free(ctx);
+}
+
+
+
+static void ring_key_create(void)
+{
+    pthread_key_create(&ring_key, ring_destroy);
+}
+
+
+
+/**
+ * Crea una coda con i parametri comuni: con SQPOLL le code dei thread si agganciano a quella condivisa
+ * (IORING_SETUP_ATTACH_WQ), così un solo thread del kernel serve tutte le code.
+ *
+ * @param ring La coda da inizializzare.
+ * @param attach 1 per agganciarsi alla coda condivisa.
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+static int ring_setup(struct io_uring *ring, int attach)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    if (sqpoll_idle > 0) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = sqpoll_idle;
+        if (attach) {
+            params.flags |= IORING_SETUP_ATTACH_WQ;
+            params.wq_fd = shared_ring.ring_fd;
+        }
+    }
+
+    int ret = io_uring_queue_init_params(URING_ENTRIES, ring, &params);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Restituisce la coda del thread corrente, creandola al primo trasferimento: registra URING_SLOTS buffer
+ * allineati alla pagina e una tabella di file vuota, aggiornata a ogni trasferimento da ring_bind.
+ *
+ * @return La coda, NULL se io_uring non è utilizzabile in questo thread.
+ */
+static uring_ctx_t* ring_get(void)
+{
+    pthread_once(&ring_once, ring_key_create);
+
+    void *current = pthread_getspecific(ring_key);
+    if (current == &ring_unavailable) {
+        return NULL;
+    }
+    if (current != NULL) {
+        return (uring_ctx_t *)current;
+    }
+
+    uring_ctx_t *ctx = (uring_ctx_t *)calloc(1, sizeof(uring_ctx_t));
+    if (ctx == NULL || ring_setup(&ctx->ring, shared_ready) < 0) {
+        fprintf(stderr, "Errore durante la creazione della coda io_uring: %s\n", strerror(errno));
+        free(ctx);
+        pthread_setspecific(ring_key, &ring_unavailable);
+        return NULL;
+    }
+
+    struct iovec iov[URING_SLOTS];
+    long page = sysconf(_SC_PAGESIZE);
+    int files[2] = { -1, -1 };
+    int ret = 0;
+
+    ctx->size = transfer_chunk_size();
+    for (int i = 0; i < URING_SLOTS && ret == 0; i++) {
+        ret = -posix_memalign((void **)&ctx->buffers[i], page > 0 ? (size_t)page : 4096, ctx->size);
+        iov[i].iov_base = ctx->buffers[i];
+        iov[i].iov_len = ctx->size;
+    }
+    if (ret == 0) {
+        ret = io_uring_register_buffers(&ctx->ring, iov, URING_SLOTS);
+    }
+    if (ret == 0) {
+        ret = io_uring_register_files(&ctx->ring, files, 2);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Errore durante la registrazione dei buffer io_uring: %s\n", strerror(-ret));
+        ring_destroy(ctx);
+        pthread_setspecific(ring_key, &ring_unavailable);
+        return NULL;
+    }
+
+    pthread_setspecific(ring_key, ctx);
+    return ctx;
+}
+
+
+
+/**
+ * Scarta la coda del thread corrente dopo un errore di sottomissione, quando possono esserci richieste
+ * rimaste a metà: il trasferimento successivo ne crea una nuova.
+ */
+static void ring_discard(uring_ctx_t *ctx)
+{
+    ring_destroy(ctx);
+    pthread_setspecific(ring_key, NULL);
+}
+
+
+
+/**
+ * Registra il file e la socket del trasferimento negli indici URING_FILE e URING_SOCK (fd = -1 libera
+ * gli indici: un file registrato resta aperto finché la tabella lo contiene).
+ *
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+static int ring_bind(uring_ctx_t *ctx, int fd, int sock)
+{
+    int files[2] = { fd, sock };
+
+    return io_uring_register_files_update(&ctx->ring, URING_FILE, files, 2) == 2 ? 0 : -1;
+}
+
+
+
+/**
+ * Sottomette la catena preparata e attende i completamenti di tutti i suoi passi, due per slot. Lo slot
+ * è nei bit alti di user_data, il passo nel bit basso.
+ *
+ * @param ctx La coda.
+ * @param slots Gli slot della catena, dove memorizzare gli esiti.
+ * @param count Numero di slot.
+ * @param stats Statistiche del trasferimento da aggiornare.
+ * @return 0 in caso di successo, -1 se la sottomissione fallisce (errno impostato, coda scartata).
+ */
+static int ring_run(uring_ctx_t *ctx, uring_slot_t *slots, int count, transfer_stats_t *stats)
+{
+    int ret = io_uring_submit_and_wait(&ctx->ring, 2 * count);
+    stats->syscalls++;
+
+    if (ret < 0) {
+        ring_discard(ctx);
+        errno = -ret;
+        return -1;
+    }
+
+    for (int i = 0; i < 2 * count; i++)
+    {
+        struct io_uring_cqe *cqe;
+
+        ret = io_uring_wait_cqe(&ctx->ring, &cqe);
+        if (ret < 0) {
+            ring_discard(ctx);
+            errno = -ret;
+            return -1;
+        }
+        unsigned long long data = io_uring_cqe_get_data64(cqe);
+        if (data & 1) {
+            slots[data >> 1].second = cqe->res;
+        } else {
+            slots[data >> 1].first = cqe->res;
+        }
+        io_uring_cqe_seen(&ctx->ring, cqe);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Completa un passo già preparato della catena: lo marca con il suo slot e il suo passo (le funzioni
+ * io_uring_prep_* azzerano user_data) e lo collega al successivo, sui file registrati.
+ */
+static void ring_step(struct io_uring_sqe *sqe, int slot, int second)
+{
+    io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE | IOSQE_IO_LINK);
+    io_uring_sqe_set_data64(sqe, ((unsigned long long)slot << 1) | (second ? 1 : 0));
+}
+
+
+
+/**
+ * Scrive con pwrite tutti i byte di un buffer a partire dalla posizione indicata.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+static int pwrite_all(int fd, const char *buffer, size_t len, off_t offset, transfer_stats_t *stats)
+{
+    size_t written = 0;
+
+    while (written < len)
+    {
+        ssize_t n = pwrite(fd, buffer + written, len - written, offset + written);
+        stats->syscalls++;
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Crea la coda condivisa: serve il ciclo di accept del server e, con SQPOLL, possiede il thread del kernel
+ * a cui si agganciano le code dei thread. Va chiamata all'avvio, prima di creare altri thread; senza di
+ * essa (nel client) ogni thread usa una coda propria senza SQPOLL.
+ *
+ * @param sqpoll_idle_ms Millisecondi di inattività dopo cui il thread SQPOLL si ferma (0 = niente SQPOLL).
+ * @return 0 in caso di successo, -1 se io_uring non è disponibile (errno impostato).
+ */
+int uring_init(unsigned sqpoll_idle_ms)
+{
+    sqpoll_idle = sqpoll_idle_ms;
+    if (ring_setup(&shared_ring, 0) < 0) {
+        sqpoll_idle = 0;
+        return -1;
+    }
+    shared_ready = 1;
+    return 0;
+}
+
+
+
+/**
+ * Accetta una connessione dalla richiesta di accept multishot della coda condivisa, armandola alla prima
+ * chiamata e di nuovo quando il kernel la termina (es. dopo un errore). Va chiamata da un solo thread.
+ * Senza coda condivisa, o se il kernel non supporta l'accept multishot, usa accept().
+ *
+ * @param listen_fd Socket in ascolto.
+ * @param addr Dove memorizzare l'indirizzo del client.
+ * @param addrlen Dimensione di addr, aggiornata con quella dell'indirizzo.
+ * @return La socket della connessione, -1 in caso di errore (errno impostato).
+ */
+int uring_accept(int listen_fd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    static int multishot = 1;       // 0 se il kernel ha rifiutato l'accept multishot
+
+    if (!shared_ready || !multishot) {
+        return accept(listen_fd, addr, addrlen);
+    }
+
+    if (!accept_armed) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&shared_ring);
+        io_uring_prep_multishot_accept(sqe, listen_fd, NULL, NULL, 0);
+        io_uring_sqe_set_data64(sqe, 0);
+        int ret = io_uring_submit(&shared_ring);
+        if (ret < 0) {
+            errno = -ret;
+            return -1;
+        }
+        accept_armed = 1;
+    }
+
+    struct io_uring_cqe *cqe;
+    int ret = io_uring_wait_cqe(&shared_ring, &cqe);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    int res = cqe->res;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        accept_armed = 0;
+    }
+    io_uring_cqe_seen(&shared_ring, cqe);
+
+    if (res == -EINVAL) {
+        multishot = 0;
+        return accept(listen_fd, addr, addrlen);
+    }
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+
+    // la richiesta multishot non riporta l'indirizzo: lo si chiede alla socket accettata
+    if (getpeername(res, addr, addrlen) < 0) {
+        memset(addr, 0, *addrlen);
+    }
+    return res;
+}
+
+
+
+/**
+ * Invia il file a partire dalla posizione corrente con catene di coppie read_fixed->send sui buffer e sui
+ * file registrati: fino a URING_SLOTS blocchi per sottomissione, con una sola chiamata di sistema. Senza
+ * length si inviano i byte che il file ha ora (fstat), poi il percorso bufferizzato invia quelli aggiunti
+ * nel frattempo. Un passo incompleto annulla il resto della catena: si riparte con il percorso bufferizzato
+ * dall'ultimo byte inviato, così un file accorciato, un invio parziale o un errore sono gestiti come lì.
+ *
+ * @param fd File descriptor del file da inviare.
+ * @param sock Socket su cui inviare i dati.
+ * @param length Totale di byte da raggiungere (-1 per inviare fino alla fine del file).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già inviati).
+ * @param crc CRC32C dei byte già inviati, aggiornato con quelli nuovi (NULL se non serve).
+ * @return 0 in caso di successo, -1 in caso di errore (errno impostato).
+ */
+int send_file_uring(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    uring_ctx_t *ctx = ring_get();
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    unsigned long long start = stats->bytes;
+    unsigned long long end = (unsigned long long)length;
+    struct stat st;
+
+    if (length < 0) {
+        if (position < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            return send_file_buffered(fd, sock, length, stats, crc);
+        }
+        end = start + (st.st_size > position ? (unsigned long long)(st.st_size - position) : 0);
+    }
+    if (ctx == NULL || position < 0 || end <= start || ring_bind(ctx, fd, sock) < 0) {
+        return send_file_buffered(fd, sock, length, stats, crc);
+    }
+
+    int err = 0, incomplete = 0;
+    while (!err && !incomplete && stats->bytes < end)
+    {
+        uring_slot_t slots[URING_SLOTS];
+        struct io_uring_sqe *sqe = NULL;
+        unsigned long long queued = stats->bytes;
+        int count = 0;
+
+        for (; count < URING_SLOTS && queued < end; count++)
+        {
+            size_t len = end - queued < ctx->size ? (size_t)(end - queued) : ctx->size;
+            off_t offset = position + (off_t)(queued - start);
+
+            slots[count].len = len;
+            sqe = io_uring_get_sqe(&ctx->ring);
+            io_uring_prep_read_fixed(sqe, URING_FILE, ctx->buffers[count], len, offset, count);
+            ring_step(sqe, count, 0);
+            sqe = io_uring_get_sqe(&ctx->ring);
+            io_uring_prep_send(sqe, URING_SOCK, ctx->buffers[count], len, MSG_WAITALL | MSG_NOSIGNAL);
+            ring_step(sqe, count, 1);
+            queued += len;
+        }
+        io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);     // l'ultimo passo chiude la catena
+
+        if (ring_run(ctx, slots, count, stats) < 0) {
+            return -1;
+        }
+
+        // i passi si sono eseguiti in ordine: si contano i byte inviati fino al primo passo incompleto
+        for (int i = 0; i < count; i++)
+        {
+            if (slots[i].first < 0 && slots[i].first != -ECANCELED) {
+                err = -slots[i].first;
+                break;
+            }
+            if (slots[i].second > 0) {
+                if (crc != NULL) {
+                    *crc = crc32c(*crc, ctx->buffers[i], slots[i].second);
+                }
+                stats->bytes += slots[i].second;
+                stats->uring = 1;
+                transfer_paced(slots[i].second);
+            }
+            if (slots[i].second != (int)slots[i].len) {
+                if (slots[i].second < 0 && slots[i].second != -ECANCELED) {
+                    err = -slots[i].second;
+                }
+                incomplete = 1;
+                break;
+            }
+        }
+    }
+
+    ring_bind(ctx, -1, -1);
+    lseek(fd, position + (off_t)(stats->bytes - start), SEEK_SET);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    if (incomplete || length < 0) {
+        return send_file_buffered(fd, sock, length, stats, crc);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Riceve i dati dalla socket con catene di coppie recv->write_fixed: ogni ricezione attende il blocco intero
+ * (MSG_WAITALL) e la scrittura collegata lo salva nel file alla sua posizione. Se la connessione si chiude o
+ * una ricezione restituisce meno byte del previsto, la scrittura collegata viene annullata: i byte ricevuti
+ * si scrivono con pwrite e si prosegue con il percorso bufferizzato, che termina alla chiusura della connessione.
+ *
+ * @param sock Socket da cui ricevere.
+ * @param fd File descriptor del file in scrittura.
+ * @param length Totale di byte da raggiungere (-1 per ricevere fino alla chiusura della connessione).
+ * @param stats Statistiche del trasferimento (stats->bytes contiene i byte già ricevuti).
+ * @param crc CRC32C dei byte già ricevuti, aggiornato con quelli nuovi (NULL se non serve).
+ * @return 0 se si è raggiunto length o la connessione è stata chiusa, -1 in caso di errore (errno impostato).
+ */
+int recv_file_uring(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    uring_ctx_t *ctx = ring_get();
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    unsigned long long start = stats->bytes;
+
+    if (ctx == NULL || position < 0 || ring_bind(ctx, fd, sock) < 0) {
+        return recv_file_buffered(sock, fd, length, stats, crc);
+    }
+
+    int err = 0, incomplete = 0;
+    while (!err && !incomplete && (length < 0 || stats->bytes < (unsigned long long)length))
+    {
+        uring_slot_t slots[URING_SLOTS];
+        struct io_uring_sqe *sqe = NULL;
+        unsigned long long queued = stats->bytes;
+        int count = 0;
+
+        for (; count < URING_SLOTS && (length < 0 || queued < (unsigned long long)length); count++)
+        {
+            size_t len = ctx->size;
+            off_t offset = position + (off_t)(queued - start);
+
+            if (length >= 0 && (unsigned long long)length - queued < len) {
+                len = (size_t)((unsigned long long)length - queued);
+            }
+            slots[count].len = len;
+            sqe = io_uring_get_sqe(&ctx->ring);
+            io_uring_prep_recv(sqe, URING_SOCK, ctx->buffers[count], len, MSG_WAITALL);
+            ring_step(sqe, count, 0);
+            sqe = io_uring_get_sqe(&ctx->ring);
+            io_uring_prep_write_fixed(sqe, URING_FILE, ctx->buffers[count], len, offset, count);
+            ring_step(sqe, count, 1);
+            queued += len;
+        }
+        io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);     // l'ultimo passo chiude la catena
+
+        if (ring_run(ctx, slots, count, stats) < 0) {
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            int received = slots[i].first;
+            int written = slots[i].second;
+
+            if (received < 0) {
+                if (received != -ECANCELED) {
+                    err = -received;
+                }
+                incomplete = 1;
+                break;
+            }
+
+            // scrittura annullata (ricezione incompleta), parziale o fallita: il resto si scrive qui
+            if (written != received) {
+                size_t done = written > 0 ? (size_t)written : 0;
+                off_t offset = position + (off_t)(stats->bytes - start);
+                if (pwrite_all(fd, ctx->buffers[i] + done, received - done, offset + done, stats) < 0) {
+                    err = errno;
+                    break;
+                }
+            }
+            if (crc != NULL) {
+                *crc = crc32c(*crc, ctx->buffers[i], received);
+            }
+            stats->bytes += received;
+            stats->uring = 1;
+
+            if (received != (int)slots[i].len) {
+                incomplete = 1;
+                break;
+            }
+        }
+    }
+
+    ring_bind(ctx, -1, -1);
+    lseek(fd, position + (off_t)(stats->bytes - start), SEEK_SET);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    if (incomplete) {
+        return recv_file_buffered(sock, fd, length, stats, crc);
+    }
+    return 0;
+}
+
+#else
+
+// senza liburing la modalità uring non si può scegliere: queste funzioni ripiegano sulle chiamate classiche
+
+int uring_init(unsigned sqpoll_idle_ms)
+{
+    (void)sqpoll_idle_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+
+
+int uring_accept(int listen_fd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    return accept(listen_fd, addr, addrlen);
+}
+
+
+
+int send_file_uring(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    return send_file_buffered(fd, sock, length, stats, crc);
+}
+
+
+
+int recv_file_uring(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc)
+{
+    return recv_file_buffered(sock, fd, length, stats, crc);
+}
+
+#endif // HAVE_LIBURING
@@ -0,0 +1,29 @@
+#ifndef MY_FT_URING_H
+#define MY_FT_URING_H
+
+#include <sys/socket.h>     // per struct sockaddr e socklen_t
+#include "myFTtransfer.h"
+
+// Percorso dati asincrono con io_uring (-t uring), disponibile solo se compilato con -DHAVE_LIBURING -luring.
+// Ogni thread ha una propria coda con URING_SLOTS buffer registrati da transfer_chunk_size() byte e una
+// tabella di due file registrati (il file e la socket del trasferimento in corso). Un invio accoda in una
+// sola chiamata una catena di coppie lettura->invio collegate con IOSQE_IO_LINK, una ricezione una catena
+// di coppie ricezione->scrittura: i passi di una catena partono uno dopo l'altro, quindi i dati restano in
+// ordine sulla socket e nel file. Se un passo termina prima del previsto (fine del file, connessione chiusa,
+// errore) il resto della catena viene annullato dal kernel e il trasferimento prosegue dal punto raggiunto
+// con il percorso bufferizzato; lo stesso se la coda non si può creare.
+// Il thread che accetta le connessioni usa una richiesta di accept multishot: una sola sottomissione
+// produce un completamento per ogni connessione. Con SQPOLL (opzione -K del server) un thread del kernel,
+// condiviso da tutte le code, preleva le richieste senza chiamate di sistema finché resta attivo.
+
+#define URING_SLOTS 4                   // buffer registrati di ogni coda: coppie lettura->invio in una catena
+#define URING_ENTRIES (2 * URING_SLOTS) // richieste della coda di sottomissione
+#define URING_FILE 0                    // indice del file nella tabella dei file registrati
+#define URING_SOCK 1                    // indice della socket nella tabella dei file registrati
+
+int uring_init(unsigned sqpoll_idle_ms);
+int uring_accept(int listen_fd, struct sockaddr *addr, socklen_t *addrlen);
+int send_file_uring(int fd, int sock, long long length, transfer_stats_t *stats, uint32_t *crc);
+int recv_file_uring(int sock, int fd, long long length, transfer_stats_t *stats, uint32_t *crc);
+
+#endif // MY_FT_URING_H